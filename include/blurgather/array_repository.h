@@ -2,6 +2,7 @@
 #define BLURGATHER_PASSWORD_ARRAY_REPOSITORY_H
 
 #include <stdlib.h>
+#include <stdint.h>
 #include "context.h"
 #include "password.h"
 #include "repository.h"
@@ -22,6 +23,8 @@ struct bg_password_array_repository {
   size_t number_passwords;
   bg_password_array password_array;
   size_t allocated_length;
+
+  uint64_t generation;
 };
 
 bg_repository_t *bg_password_array_repository_new();
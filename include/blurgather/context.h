@@ -11,6 +11,20 @@ extern "C" {
 #define BGCTX_ACQUIRE_ALLOCATOR 0x2
 #define BGCTX_ACQUIRE_REPOSITORY 0x4
 #define BGCTX_ACQUIRE_PERSISTER 0x8
+#define BGCTX_ACQUIRE_EXECUTOR 0x10
+
+/* once sealed, a context can be shared between threads: lookups, iteration,
+   search and crypting share a reader lock, mutations, load, persist and
+   lock take it alone. lookups and iteration over repositories supporting
+   snapshots go through one instead, holding no lock writers wait on.
+   initialization and finalization are not guarded. callbacks run under
+   reader lock, or over such a snapshot, they may read through context but
+   not change it. passwords found in repository stay valid until next mutation,
+   threads not in control of every mutation copy them with bgctx_copy_passwords.
+   a transaction is context wide, whichever thread opened it.
+   persist writes a snapshot of repositories supporting one while readers and
+   writers go on, load, persist, commit, lock, unlock and refresh persist one
+   at a time */
 
 /* manual initialization */
 int bgctx_init(bg_context **ctx);
@@ -18,6 +32,8 @@ int bgctx_init(bg_context **ctx);
 int bgctx_register_repository(bg_context *ctx, bg_repository_t *repository);
 int bgctx_register_persister(bg_context *ctx, bg_persister_t *persister);
 int bgctx_register_cryptor(bg_context *ctx, bg_cryptor_t *cryptor);
+/* optional, for bulk operations to run in parallel */
+int bgctx_register_executor(bg_context *ctx, bg_executor *executor);
 int bgctx_config(bg_context *ctx, int flags);
 int bgctx_seal(bg_context *ctx);
 int bgctx_sealed(bg_context *ctx);
@@ -29,6 +45,9 @@ int bgctx_finalize(bg_context *ctx);
 bg_secret_key_t *bgctx_access_key(bg_context *ctx);
 bg_repository_t *bgctx_repository(bg_context *ctx);
 bg_cryptor_t *bgctx_cryptor(bg_context *ctx);
+bg_persister_t *bgctx_persister(bg_context *ctx);
+/* NULL when none registered */
+bg_executor *bgctx_executor(bg_context *ctx);
 
 /* runtime password library lock/unlock */
 int bgctx_unlock(bg_context *ctx, bg_secret_key_t *secret_key);
@@ -37,14 +56,73 @@ int bgctx_locked(bg_context *ctx);
 
 /* runtime password library manipulation shortcuts */
 int bgctx_find_password(bg_context *ctx, const bg_string *name, bg_password **password);
+/* resolves names in one pass over repository, decrypting names only and stopping once
+   all are found. passwords[i] is as contained in repository, NULL when names[i] is missing.
+   returns 1 when any is */
+int bgctx_find_passwords(bg_context *ctx, const bg_string * const *names, size_t count, bg_password **passwords);
+/* same as bgctx_find_passwords, copies[i] being a copy owned by caller, taken
+   before any other thread can change repository */
+int bgctx_copy_passwords(bg_context *ctx, const bg_string * const *names, size_t count, bg_password **copies);
+int bgctx_fetch_password(bg_context *ctx, const bg_string *name, bg_password **password);
 int bgctx_each_password(bg_context *ctx, int (* callback)(bg_password *password, void *), void *out);
+/* same as bgctx_each_password, callback getting a decrypted copy freed once it
+   returns. returns -2 when locked */
+int bgctx_each_decrypted_password(bg_context *ctx, int (* callback)(bg_password *password, void *), void *out);
 int bgctx_load(bg_context *ctx);
+/* when persister tells another process persisted since last load or persist,
+   its changes are merged in before persisting, see bg_persister_refresh */
 int bgctx_persist(bg_context *ctx);
+/* applies changes other processes persisted since last load or persist, for
+   long-lived contexts. local changes stay over them. returns 1 when repository
+   changed, 0 when not, -3 within a transaction and persister errors otherwise */
+int bgctx_refresh(bg_context *ctx);
+/* persists on a thread of its own, never on context executor, and returns at
+   once. requests made before a write starts share it, callback (may be NULL)
+   then gets its result from that thread. returns -1 when unsealed and -4 on
+   allocation failure, in which case callback is not called */
+int bgctx_persist_async(bg_context *ctx, void (* callback)(bg_context *ctx, int err, void *arg), void *arg);
+/* returns once no asynchronous persist is left, not to be called from their
+   callbacks. finalize waits for them too */
+void bgctx_persist_wait(bg_context *ctx);
+
+/* whether repository changed since last load or persist, persisting is a no-op
+   otherwise. always dirty before first one, or when repository keeps no generation */
+int bgctx_dirty(bg_context *ctx);
 int bgctx_add_password(bg_context *ctx, bg_password *password);
+/* adds every password or none, caller keeps them on error */
+int bgctx_add_passwords(bg_context *ctx, bg_password **passwords, size_t count);
 int bgctx_remove_password(bg_context *ctx, bg_string *name);
 int bgctx_encrypt_password(bg_context *ctx, bg_password *password);
 int bgctx_decrypt_password(bg_context *ctx, bg_password *password);
 
+/* replaces password stored under name (as stored) by given one,
+   returns 1 when there is no such password */
+int bgctx_update_password(bg_context *ctx, const bg_string *name, bg_password *password);
+
+/* transactions: between begin and commit, mutations only touch the repository
+   and persist is deferred to commit, which persists once. rollback undoes
+   them instead, from last to first; restored passwords may come back in a
+   different repository order. no nesting, loading is refused while one is
+   open, and these return -3 when called out of place */
+int bgctx_begin(bg_context *ctx);
+int bgctx_commit(bg_context *ctx);
+int bgctx_rollback(bg_context *ctx);
+int bgctx_in_transaction(bg_context *ctx);
+
+/* plain text name search, index is built on first search after unlock.
+   callback is called once per matching name, in repository order */
+int bgctx_search(bg_context *ctx, const bg_string *pattern, int (* callback)(const bg_string *name, void *), void *out);
+int bgctx_search_prefix(bg_context *ctx, const bg_string *prefix, int (* callback)(const bg_string *name, void *), void *out);
+
+/* at most k names closest to pattern, see bg_name_index_fuzzy */
+int bgctx_fuzzy_search(bg_context *ctx, const bg_string *pattern, size_t k, size_t max_distance,
+                       int (* callback)(const bg_string *name, size_t distance, void *), void *out);
+
+/* names of passwords tagged with every one of tags (at least one), in
+   repository order. uses the same index as search, intersecting posting lists */
+int bgctx_list_tagged(bg_context *ctx, const bg_string * const *tags, size_t count,
+                      int (* callback)(const bg_string *name, void *), void *out);
+
 /* data memorization association facility */
 int bgctx_register_memory(bg_context *ctx, bg_string *key, void *mem,  void (*mem_free)(void *));
 void *bgctx_get_memory(bg_context *ctx, bg_string *key);
@@ -8,6 +8,10 @@
 extern "C" {
 #endif
 
+/* cryptor identifiers, as persisted in file headers */
+#define BG_CRYPTOR_UNKNOWN 0
+#define BG_CRYPTOR_MCRYPT_RIJNDAEL256_CFB 1
+
 struct bg_cryptor_t {
   int (* const encrypt)(void *memory,
                         size_t memlen,
@@ -24,6 +28,8 @@ struct bg_cryptor_t {
   int (* const generate_iv)(bg_iv_t **output);
 
   size_t (* const encrypted_length)(size_t input_memlen);
+
+  const unsigned int id;
 };
 
 /* abstract encryption */
@@ -51,6 +57,9 @@ int bg_cryptor_generate_iv(const bg_cryptor_t *cryptor,
    will take when encrypted */
 size_t bg_cryptor_encrypted_length(const bg_cryptor_t *cryptor, size_t input_memlen);
 
+/* algorithm identifier, BG_CRYPTOR_UNKNOWN if none */
+unsigned int bg_cryptor_id(const bg_cryptor_t *cryptor);
+
 #ifdef __cplusplus
 }
 #endif
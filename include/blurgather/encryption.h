@@ -11,6 +11,10 @@ extern "C" {
 int bg_encrypt_string(bg_string **str, const bg_cryptor_t *cryptor, const bg_secret_key_t *key);
 int bg_decrypt_string(bg_string **str, const bg_cryptor_t *cryptor, const bg_secret_key_t *key);
 
+/* same as above, leaving the input string untouched */
+int bg_encrypt_string_to(const bg_string *str, bg_string **output, const bg_cryptor_t *cryptor, const bg_secret_key_t *key);
+int bg_decrypt_string_to(const bg_string *str, bg_string **output, const bg_cryptor_t *cryptor, const bg_secret_key_t *key);
+
 #ifdef __cplusplus
 }
 #endif
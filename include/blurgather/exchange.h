@@ -0,0 +1,36 @@
+#ifndef BLURGATHER_EXCHANGE_H
+#define BLURGATHER_EXCHANGE_H
+
+#include "types.h"
+#include "stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* plain text exchange formats.
+   csv: header row naming columns among name, description, value, tags and
+   metadata, others are ignored. tags are ';' separated, metadata is ';'
+   separated key=value pairs, '\\' escaping ';', '=' and '\\' within both.
+   json: array of {"name", "description", "value", "tags": [...], "metadata": {...}} */
+#define BG_EXCHANGE_CSV  1
+#define BG_EXCHANGE_JSON 2
+
+/* reads every password from input, crypts them over context executor or, when
+   threads is non zero or context has none, over a pool started for this call
+   (one worker per online processor when 0), adds them all then persists once.
+   within an open transaction, persisting is left to its commit, otherwise
+   nothing is added unless all passwords are. returns -2 when locked, -4 on
+   allocation failure, -5 on malformed input and -6 for unknown formats */
+int bgctx_import(bg_context *ctx, bg_stream *input, int format, size_t threads, size_t *imported);
+
+/* writes passwords decrypted one at a time, in repository order, then flushes
+   output. returns -2 when locked, -6 for unknown formats and -7 when writing
+   or flushing failed */
+int bgctx_export(bg_context *ctx, bg_stream *output, int format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef BLURGATHER_EXECUTOR_H
+#define BLURGATHER_EXECUTOR_H
+
+#include <stdlib.h>
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* pool of worker threads, each owning a deque of tasks that idle workers steal
+   from. threads are started on first use and live until bg_executor_free.
+   threads waiting on tasks run queued ones meanwhile, so tasks may use the
+   executor themselves */
+
+/* one worker per online processor when threads is 0, NULL on allocation failure */
+bg_executor *bg_executor_new(size_t threads);
+/* runs queued tasks first */
+void bg_executor_free(bg_executor *executor);
+size_t bg_executor_threads(bg_executor *executor);
+
+/* runs task over [0, count) split in ranges of at most grain indexes, in any
+   order and on any thread including caller. once a task fails, ranges not yet
+   started are skipped and its error is returned. executor may be NULL, which
+   runs whole range on caller */
+int bg_executor_for(bg_executor *executor, size_t count, size_t grain,
+                    int (* task)(size_t begin, size_t end, void *data), void *data);
+
+/* queues task, -1 on allocation failure */
+int bg_executor_submit(bg_executor *executor, void (* task)(void *data), void *data);
+/* returns once no submitted task is left */
+void bg_executor_wait(bg_executor *executor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
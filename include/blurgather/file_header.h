@@ -0,0 +1,67 @@
+#ifndef BLURGATHER_FILE_HEADER_H
+#define BLURGATHER_FILE_HEADER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BG_FILE_HEADER_MAGIC "BLUR"
+#define BG_FILE_HEADER_MAGIC_LENGTH 4
+#define BG_FILE_HEADER_LENGTH 88
+/* 1: payload is a single msgpack array
+   2: index section is a directory of independently encrypted payload records
+   3: directory entries hold a keyed hash of record content
+   4: name and content hashes are keyed by SipHash-2-4 of secret key under two
+      domain labels, each giving half the key, instead of cryptor output */
+#define BG_FILE_FORMAT_VERSION 4
+
+/* header flags */
+#define BG_FILE_ENCRYPTED 0x1
+
+/* key derivation functions */
+#define BG_KDF_NONE 0
+#define BG_KDF_SALT_LENGTH 16
+
+struct bg_file_header;
+typedef struct bg_file_header bg_file_header;
+
+/* plain text, little endian, fixed length file header:
+   [header][optional index section][payload] */
+struct bg_file_header {
+  uint16_t version;
+  uint16_t header_length;
+  uint32_t flags;
+
+  uint32_t cryptor_id;
+  uint32_t kdf_id;
+  uint32_t kdf_iterations;
+  unsigned char kdf_salt[BG_KDF_SALT_LENGTH];
+
+  uint64_t record_count;
+
+  uint64_t index_offset;
+  uint64_t index_length;
+  uint64_t payload_offset;
+  uint64_t payload_length;
+
+  /* bumped by every persist, 0 for files written before it was kept */
+  uint64_t generation;
+};
+
+void bg_file_header_init(bg_file_header *header);
+
+/* buffer must be at least BG_FILE_HEADER_LENGTH bytes long */
+void bg_file_header_encode(const bg_file_header *header, unsigned char *buffer);
+
+/* returns -1 when buffer has no header (legacy file), -2 when truncated,
+   -3 when version is unsupported and -5 when sections are out of bounds */
+int bg_file_header_decode(bg_file_header *header, const unsigned char *buffer, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
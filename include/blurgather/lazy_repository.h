@@ -0,0 +1,30 @@
+#ifndef BLURGATHER_LAZY_REPOSITORY_H
+#define BLURGATHER_LAZY_REPOSITORY_H
+
+#include <stdlib.h>
+#include "password.h"
+#include "repository.h"
+#include "record_source.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* repository keeping persisted records as they are until get or foreach
+   touches them. passwords added directly are kept as with array repository */
+bg_repository_t *bg_lazy_repository_new(void);
+
+/* maximum number of materialized persisted records, least recently used ones
+   are dropped past it. 0 (default) means no limit.
+   passwords obtained from get and foreach, from any thread, stay valid until
+   repository next changes, those dropped meanwhile are only freed then */
+int bg_lazy_repository_limit(bg_repository_t *self, size_t max_materialized);
+
+/* number of records currently materialized */
+size_t bg_lazy_repository_materialized(bg_repository_t *self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BLURGATHER_LAZY_REPOSITORY_H */
@@ -15,6 +15,8 @@ void bg_map_free(bg_map *map);
 
 int bg_map_register_data(bg_map *map, bg_string *key, void *value, void (*free_callback)(void *));
 void *bg_map_get_data(const bg_map *map, bg_string *key);
+/* same as bg_map_get_data, leaving key to caller */
+void *bg_map_find_data(const bg_map *map, const bg_string *key);
 int bg_map_foreach(bg_map *map, int (*callback)(const bg_string*, void*, void*), void *output);
 
 size_t bg_map_length(const bg_map *map);
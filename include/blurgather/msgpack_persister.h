@@ -5,13 +5,19 @@
 #include "string.h"
 #include "secret_key.h"
 #include "cryptor.h"
+#include "file_header.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* i/o engines persisted files are read and written with */
+#define BG_MSGPACK_IO_STDIO 0
+#define BG_MSGPACK_IO_URING 1
+
 struct bg_msgpack_persister;
 typedef struct bg_msgpack_persister bg_msgpack_persister;
+struct bg_record_entry;
 
 struct bg_msgpack_persister {
   bg_persister_t persister;
@@ -20,6 +26,15 @@ struct bg_msgpack_persister {
 
   bg_cryptor_t *cryptor;
   bg_secret_key_t *secret_key;
+  bg_executor *executor;
+  int io_engine;
+  int decode_all;
+
+  /* persisted file as of last load or persist, changes are told against it */
+  int tracking;
+  uint64_t generation;
+  struct bg_record_entry *known;
+  size_t known_count;
 };
 
 bg_msgpack_persister *bg_msgpack_persister_new(bg_string *filename, bg_cryptor_t *cryptor);
@@ -30,6 +45,32 @@ int bg_msgpack_persister_register_key(bg_persister_t *self, bg_secret_key_t *sec
 
 int bg_msgpack_persister_unregister_key(bg_persister_t *self);
 
+/* loading into repositories not taking records as they are decodes records
+   over executor, then adds them all at once. NULL decodes on caller */
+int bg_msgpack_persister_register_executor(bg_persister_t *self, bg_executor *executor);
+
+/* loading decodes records over executor even into repositories that would
+   take them as they are, for callers going through all of them anyway */
+int bg_msgpack_persister_decode_all(bg_persister_t *self, int decode_all);
+
+/* io_uring queues reads ahead of decoding and writes behind encryption, then
+   syncs and renames file in one submission. falls back to stdio when not built
+   in or not supported by kernel: returns engine selected */
+int bg_msgpack_persister_select_io(bg_persister_t *self, int engine);
+
+/* persisting writes a temporary file next to the persisted one, then renames it
+   over: returns -4 when it cannot be created and -10 when writing it failed.
+   it holds an exclusive advisory lock on persisted file, or on its directory
+   before there is one, loading and refreshing a shared one. no lock file is
+   created, locks last as long as the call. persisting returns -12 when the lock
+   cannot be taken, loading and refreshing go on without it. persisting returns -11 when another process
+   persisted since last load or persist, unless that was of a file written
+   before format 4, see bg_persister_refresh */
+
+/* reads persisted file header only, no key needed.
+   returns -4 when there is no file and -1 for files without header */
+int bg_msgpack_persister_header(bg_persister_t *self, bg_file_header *header);
+
 #ifdef __cplusplus
 }
 #endif
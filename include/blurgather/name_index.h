@@ -0,0 +1,49 @@
+#ifndef BLURGATHER_NAME_INDEX_H
+#define BLURGATHER_NAME_INDEX_H
+
+#include <stdlib.h>
+#include "string.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* search flags */
+#define BG_SEARCH_PREFIX 0x1
+
+/* sorted suffix array over plain text names. names are matched up to
+   their first null character */
+struct bg_name_index;
+typedef struct bg_name_index bg_name_index;
+
+bg_name_index *bg_name_index_new(void);
+
+/* wipes names before freeing */
+void bg_name_index_free(bg_name_index *index);
+
+/* name is copied, index must be built again before searching */
+int bg_name_index_reserve(bg_name_index *index, size_t count);
+int bg_name_index_add(bg_name_index *index, const bg_string *name);
+int bg_name_index_build(bg_name_index *index);
+
+size_t bg_name_index_count(const bg_name_index *index);
+
+/* name added id-th, NULL when out of range */
+const bg_string *bg_name_index_name(const bg_name_index *index, size_t id);
+
+/* calls callback once per name containing pattern (starting with it with
+   BG_SEARCH_PREFIX), in insertion order. stops on non zero callback return value */
+int bg_name_index_search(const bg_name_index *index, const bg_string *pattern, int flags,
+                         int (* callback)(const bg_string *name, void *), void *out);
+
+/* calls callback for at most k names closest to pattern by edit distance,
+   ignoring ascii case, and no further than max_distance. closest first,
+   insertion order among equally distant ones. no build needed */
+int bg_name_index_fuzzy(const bg_name_index *index, const bg_string *pattern, size_t k, size_t max_distance,
+                        int (* callback)(const bg_string *name, size_t distance, void *), void *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
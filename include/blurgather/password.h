@@ -17,6 +17,10 @@ bg_password *bg_password_new(void);
 
 /* deserialize */
 int bg_password_fill_raw(bg_password *password, const void *crypted_value, size_t crypted_value_size);
+int bg_password_fill_raw_name(bg_password *password, const void *crypted_name, size_t crypted_name_size);
+int bg_password_fill_raw_description(bg_password *password, const void *crypted_description, size_t crypted_description_size);
+int bg_password_fill_raw_tags(bg_password *password, const void *crypted_tags, size_t crypted_tags_size);
+int bg_password_fill_raw_metadata(bg_password *password, const void *crypted_metadata, size_t crypted_metadata_size);
 
 /* destroy and free */
 void bg_password_destroy(bg_password *password);
@@ -38,6 +42,22 @@ const bg_string *bg_password_value(const bg_password *password);
 size_t bg_password_value_length(const bg_password *password);
 int bg_password_update_value(bg_password *password, bg_string *value);
 
+/* tags, null separated. manipulation requires a decrypted password,
+   tags must be non empty and hold no null character */
+const bg_string *bg_password_tags(const bg_password *password);
+int bg_password_add_tag(bg_password *password, const bg_string *tag);
+int bg_password_has_tag(const bg_password *password, const bg_string *tag);
+int bg_password_foreach_tag(const bg_password *password, int (* callback)(const char *tag, size_t length, void *), void *out);
+
+/* key/value metadata, null separated keys and values. same requirements as tags.
+   get returns 1 when key is not set, value is a new string otherwise */
+const bg_string *bg_password_metadata(const bg_password *password);
+int bg_password_set_metadata(bg_password *password, const bg_string *key, const bg_string *value);
+int bg_password_get_metadata(const bg_password *password, const bg_string *key, bg_string **value);
+int bg_password_foreach_metadata(const bg_password *password,
+                                 int (* callback)(const char *key, size_t key_length, const char *value, size_t value_length, void *),
+                                 void *out);
+
 /* crypted flag */
 int bg_password_crypted(bg_password *password);
 
@@ -1,7 +1,9 @@
 #ifndef BLURGATHER_PERSISTER_H
 #define BLURGATHER_PERSISTER_H
 
+#include <stdlib.h>
 #include "types.h"
+#include "string.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,6 +13,11 @@ struct bg_persister_vtable {
   void (* const destroy)(bg_persister_t *self);
   int (* const load)(bg_persister_t *self, bg_repository_t *repo);
   int (* const persist)(bg_persister_t *self, bg_repository_t *repo);
+
+  /* optional */
+  int (* const count)(bg_persister_t *self, size_t *count);
+  int (* const fetch)(bg_persister_t *self, const bg_string *name, bg_password **password);
+  int (* const refresh)(bg_persister_t *self, bg_repository_t *repo);
 };
 
 struct bg_persister_t {
@@ -22,6 +29,22 @@ void bg_persister_destroy(bg_persister_t *self);
 int bg_persister_load(bg_persister_t *self, bg_repository_t *repo);
 int bg_persister_persist(bg_persister_t *self, bg_repository_t *repo);
 
+/* number of persisted passwords, without loading them.
+   returns -1 if not supported by implementation or persisted format */
+int bg_persister_count(bg_persister_t *self, size_t *count);
+
+/* reads a single persisted password by name, without loading others.
+   output password is crypted and owned by caller. returns 1 when not found,
+   -1 if not supported by implementation and -9 if not by persisted format */
+int bg_persister_fetch(bg_persister_t *self, const bg_string *name, bg_password **password);
+
+/* persisters supporting it refuse to persist over changes persisted by others
+   since last load or persist, returning -11. refresh applies those changes to
+   repo, keeping repo ones over them: records repo changed or removed stay as
+   they are. returns 1 when repo changed, 0 when nothing was persisted since,
+   -1 if not supported by implementation and -9 if not by persisted format */
+int bg_persister_refresh(bg_persister_t *self, bg_repository_t *repo);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,35 @@
+#ifndef BLURGATHER_RECORD_SOURCE_H
+#define BLURGATHER_RECORD_SOURCE_H
+
+#include <stdlib.h>
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* persisted records, as kept by lazy repositories until accessed */
+struct bg_record_source_vtable {
+  void (* const destroy)(bg_record_source *self);
+
+  /* decodes record into a new password, leaving record untouched */
+  int (* const materialize)(bg_record_source *self, const unsigned char *record, size_t length, bg_password **password);
+};
+
+struct bg_record_source {
+  const struct bg_record_source_vtable *vtable;
+  const void *object;
+  size_t references;
+};
+
+/* reference counting: source is destroyed and freed once last reference is released */
+bg_record_source *bg_record_source_retain(bg_record_source *self);
+void bg_record_source_release(bg_record_source *self);
+
+int bg_record_source_materialize(bg_record_source *self, const unsigned char *record, size_t length, bg_password **password);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,12 +1,15 @@
 #ifndef BLURGATHER_PASSWORD_REPOSITORY_H
 #define BLURGATHER_PASSWORD_REPOSITORY_H
 
+#include <stdint.h>
 #include "password.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* get, count, foreach and generation may run concurrently with each other,
+   other operations need exclusive access */
 struct bg_repository_vtable {
   void (* const destroy)(bg_repository_t *self);
 
@@ -16,6 +19,13 @@ struct bg_repository_vtable {
 
   size_t (* const count)(bg_repository_t *self);
   int (* const foreach)(bg_repository_t *self, int (* callback)(bg_password *, void *), void *output);
+
+  /* optional */
+  int (* const reserve)(bg_repository_t *self, size_t count);
+  int (* const add_record)(bg_repository_t *self, bg_record_source *source, const unsigned char *record, size_t length);
+  uint64_t (* const generation)(bg_repository_t *self);
+  int (* const add_all)(bg_repository_t *self, bg_password **passwords, size_t count);
+  bg_repository_t *(* const snapshot)(bg_repository_t *self);
 };
 
 struct bg_repository_t {
@@ -24,6 +34,8 @@ struct bg_repository_t {
 };
 
 void bg_repository_destroy(bg_repository_t *self);
+/* destroys then frees implementation object */
+void bg_repository_free(bg_repository_t *self);
 
 int bg_repository_add(bg_repository_t *self, bg_password *password);
 int bg_repository_get(bg_repository_t *self, const bg_string *name, bg_password **password);
@@ -33,6 +45,29 @@ size_t bg_repository_count(bg_repository_t *self);
 
 int bg_repository_foreach(bg_repository_t *self, int (* callback)(bg_password *, void *), void *output);
 
+/* capacity hint, no-op if not supported by implementation */
+int bg_repository_reserve(bg_repository_t *self, size_t count);
+
+/* whether persisted records can be added as they are, see below */
+int bg_repository_accepts_records(bg_repository_t *self);
+
+/* adds a persisted record, to be materialized from source on first access.
+   record must live as long as source. returns -1 if not supported by implementation */
+int bg_repository_add_record(bg_repository_t *self, bg_record_source *source, const unsigned char *record, size_t length);
+
+/* adds every password or none, returning same errors as add. implementations
+   may check duplicates once for all, falls back to add otherwise */
+int bg_repository_add_all(bg_repository_t *self, bg_password **passwords, size_t count);
+
+/* modification generation, changes on every add and remove.
+   returns -1 if not supported by implementation */
+int bg_repository_generation(bg_repository_t *self, uint64_t *generation);
+
+/* read-only repository pinning current content, unaffected by later changes
+   and safe to read while they happen. freed with bg_repository_free.
+   returns NULL if not supported by implementation */
+bg_repository_t *bg_repository_snapshot(bg_repository_t *self);
+
 #ifdef __cplusplus
 }
 #endif
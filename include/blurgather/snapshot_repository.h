@@ -0,0 +1,25 @@
+#ifndef BLURGATHER_SNAPSHOT_REPOSITORY_H
+#define BLURGATHER_SNAPSHOT_REPOSITORY_H
+
+#include <stdlib.h>
+#include "password.h"
+#include "repository.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* copy-on-write repository: readers pin an immutable version while writers
+   publish a new one, so foreach over a pinned version never blocks mutations
+   nor the other way around. contexts look passwords up, iterate and persist
+   through pinned versions without holding their lock, search still takes it.
+   pinning only waits on another pin or publish.
+   versions nobody pinned are changed in place.
+   bg_repository_snapshot returns a pinned version as a read-only repository */
+bg_repository_t *bg_snapshot_repository_new(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BLURGATHER_SNAPSHOT_REPOSITORY_H */
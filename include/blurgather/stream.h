@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,10 +16,22 @@ typedef int bg_stream_mode;
 #define BGSM_READ   1
 #define BGSM_WRITE  2
 #define BGSM_APPEND 4
+/* descriptor and mapped streams: writing creates file, failing when it
+   exists, symbolic link included */
+#define BGSM_EXCL   8
 
 typedef int bg_stream_object;
 #define BGSO_FILE  1
 #define BGSO_MEM   2
+/* buffered file descriptor: read only, write truncates unless appending,
+   read and write opens without truncating. NULL when file cannot be opened */
+#define BGSO_FD    4
+/* memory mapped file, same modes as BGSO_FD. reads copy straight from the
+   mapping, writes grow file geometrically, down to its length on close */
+#define BGSO_MMAP  8
+/* memory stream over caller's buffer, opened with data and its length.
+   read and written in place, copied away once writes go past its end */
+#define BGSO_BUFFER 16
 
 bg_stream *bg_stream_open_(bg_stream_object oflag, bg_stream_mode mflags, ...);
 #define bg_stream_open(...) bg_stream_open_(__VA_ARGS__, NULL)
@@ -27,8 +40,23 @@ void bg_stream_close(bg_stream *stream);
 void bg_stream_rewind(bg_stream *stream);
 void bg_stream_forward(bg_stream *stream);
 size_t bg_stream_write(bg_stream *stream, const void *data, size_t size);
+/* writes segments in order, in one system call for descriptor streams.
+   returns bytes written */
+size_t bg_stream_writev(bg_stream *stream, const struct iovec *segments, int count);
 size_t bg_stream_read(bg_stream *stream, void *data, size_t size);
 size_t bg_stream_length(bg_stream *stream);
+/* hands buffered writes over to file, -1 when they failed. closing flushes too
+   but cannot tell. no-op for memory streams */
+int bg_stream_flush(bg_stream *stream);
+
+/* whole stream content without copy, valid until next write or close.
+   returns -1 when stream is not held in memory */
+int bg_stream_map(bg_stream *stream, const void **data, size_t *length);
+/* makes room for size bytes, -1 when stream cannot grow */
+int bg_stream_reserve(bg_stream *stream, size_t size);
+/* hands malloc'ed content over to caller, stream is left empty.
+   NULL when stream does not own its memory */
+void *bg_stream_detach(bg_stream *stream, size_t *length);
 
 #ifdef __cplusplus
 }
@@ -16,6 +16,10 @@ bg_string *bg_string_from_char_array(const char *array, size_t length);
 bg_string *bg_string_from_str(const char *array);
 bg_string *bg_string_copy(const bg_string*);
 
+/* construction within caller owned storage (must be aligned as a size_t) */
+size_t bg_string_storage_size(size_t length);
+bg_string *bg_string_in_place(void *storage, const char *array, size_t length);
+
 #define bg_string_free free
 #define bg_string_clean_free(str) bg_string_clean(str); bg_string_free(str)
 
@@ -35,6 +39,7 @@ bg_string *bg_string_from_decimal(long decimal);
 int bg_string_split_after(const bg_string *str, size_t index, bg_string **left, bg_string **right);
 
 int bg_string_compare(const bg_string *str1, const bg_string *str2);
+size_t bg_string_hash(const bg_string *str);
 
 #define bg_string_replace(old, new) bg_string_free(old); old = new
 #define bg_string_clean_replace(old, new) bg_string_clean_free(old); old = new
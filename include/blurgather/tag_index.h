@@ -0,0 +1,41 @@
+#ifndef BLURGATHER_TAG_INDEX_H
+#define BLURGATHER_TAG_INDEX_H
+
+#include <stdlib.h>
+#include "string.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* inverted index from plain text tags to posting lists, that is sorted
+   ids of tagged records, as numbered by the caller */
+struct bg_tag_index;
+typedef struct bg_tag_index bg_tag_index;
+
+bg_tag_index *bg_tag_index_new(void);
+
+/* wipes tags before freeing */
+void bg_tag_index_free(bg_tag_index *index);
+
+/* tag is copied. ids must be added in increasing order, a repeated
+   id is ignored and a smaller one returns -2 */
+int bg_tag_index_add(bg_tag_index *index, const char *tag, size_t length, size_t id);
+
+/* distinct tags */
+size_t bg_tag_index_count(const bg_tag_index *index);
+
+/* ids tagged with tag */
+size_t bg_tag_index_postings(const bg_tag_index *index, const bg_string *tag);
+
+/* calls callback once per id tagged with every one of tags, in increasing
+   order. shortest posting list is walked, others are galloped through.
+   stops on non zero callback return value */
+int bg_tag_index_intersect(const bg_tag_index *index, const bg_string * const *tags, size_t count,
+                           int (* callback)(size_t id, void *), void *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
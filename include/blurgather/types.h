@@ -23,6 +23,12 @@ typedef struct bg_cryptor_t bg_cryptor_t;
 struct bg_password;
 typedef struct bg_password bg_password;
 
+struct bg_record_source;
+typedef struct bg_record_source bg_record_source;
+
+struct bg_executor;
+typedef struct bg_executor bg_executor;
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,14 +6,20 @@ static int bg_password_array_repository_get(bg_repository_t *self, const bg_stri
 static int bg_password_array_repository_remove(bg_repository_t *self, const bg_string *name);
 static size_t bg_password_array_repository_count(bg_repository_t *self);
 static int bg_password_array_repository_foreach(bg_repository_t *self, int (* callback)(bg_password *, void *), void *output);
+static int bg_password_array_repository_reserve(bg_repository_t *self, size_t count);
+static uint64_t bg_password_array_repository_generation(bg_repository_t *self);
+static int bg_password_array_repository_add_all(bg_repository_t *self, bg_password **passwords, size_t count);
 
 static struct bg_repository_vtable bg_password_array_repository_vtable = {
-  .destroy = &bg_password_array_repository_destroy,
-  .add     = &bg_password_array_repository_add,
-  .get     = &bg_password_array_repository_get,
-  .remove  = &bg_password_array_repository_remove,
-  .count   = &bg_password_array_repository_count,
-  .foreach = &bg_password_array_repository_foreach,
+  .destroy    = &bg_password_array_repository_destroy,
+  .add        = &bg_password_array_repository_add,
+  .get        = &bg_password_array_repository_get,
+  .remove     = &bg_password_array_repository_remove,
+  .count      = &bg_password_array_repository_count,
+  .foreach    = &bg_password_array_repository_foreach,
+  .reserve    = &bg_password_array_repository_reserve,
+  .generation = &bg_password_array_repository_generation,
+  .add_all    = &bg_password_array_repository_add_all,
 };
 
 
@@ -26,6 +32,7 @@ bg_repository_t *bg_password_array_repository_new() {
   self->number_passwords = 0;
   self->password_array = malloc(sizeof(void*)*25);
   self->allocated_length = 25;
+  self->generation = 0;
 
   return &self->repository;
 }
@@ -73,6 +80,7 @@ static int add_new_password(bg_password_array_repository* self, bg_password* pas
 
   self->password_array[self->number_passwords] = password;
   self->number_passwords++;
+  self->generation++;
   return 0;
 }
 
@@ -111,6 +119,7 @@ int bg_password_array_repository_remove(bg_repository_t * _self, const bg_string
     }
 
     self->number_passwords--;
+    self->generation++;
     bg_password_free(pwd);
 
     return 0;
@@ -154,3 +163,78 @@ int bg_password_array_repository_foreach(bg_repository_t *_self, int (* callback
 
   return 0;
 }
+
+int bg_password_array_repository_reserve(bg_repository_t *_self, size_t count) {
+  bg_password_array_repository *self = (bg_password_array_repository *)_self->object;
+
+  if(count + 1 <= self->allocated_length) {
+    return 0;
+  }
+
+  bg_password_array password_array = realloc(self->password_array, (count + 1)*sizeof(void*));
+  if(!password_array) {
+    return -1;
+  }
+
+  self->password_array = password_array;
+  self->allocated_length = count + 1;
+  return 0;
+}
+
+uint64_t bg_password_array_repository_generation(bg_repository_t *_self) {
+  bg_password_array_repository* self = (bg_password_array_repository*) _self->object;
+  return self->generation;
+}
+
+/* total order, unlike bg_string_compare which only tells equality apart */
+static int compare_passwords_ordered(const void* _pass1, const void* _pass2) {
+  const bg_string *name1 = bg_password_name(*(bg_password**) _pass1), *name2 = bg_password_name(*(bg_password**) _pass2);
+  if(bg_string_length(name1) != bg_string_length(name2)) {
+    return bg_string_length(name1) < bg_string_length(name2) ? -1 : 1;
+  }
+  return memcmp(bg_string_data(name1), bg_string_data(name2), bg_string_length(name1));
+}
+
+/* duplicates among stored and added names are found sorting them all once */
+int bg_password_array_repository_add_all(bg_repository_t *_self, bg_password **passwords, size_t count) {
+  bg_password_array_repository* self = (bg_password_array_repository*) _self->object;
+  size_t total = self->number_passwords + count, i;
+  int err = 0;
+
+  if(!count) {
+    return 0;
+  }
+  for(i = 0; i < count; ++i) {
+    if(bg_string_empty(bg_password_name(passwords[i]))) {
+      return -2;
+    }
+  }
+
+  bg_password **sorted = malloc(total * sizeof(bg_password *));
+  if(!sorted) {
+    return -3;
+  }
+  memcpy(sorted, self->password_array, self->number_passwords * sizeof(bg_password *));
+  memcpy(sorted + self->number_passwords, passwords, count * sizeof(bg_password *));
+  qsort(sorted, total, sizeof(bg_password *), &compare_passwords_ordered);
+
+  for(i = 1; i < total; ++i) {
+    if(compare_passwords_ordered(&sorted[i - 1], &sorted[i]) == 0) {
+      err = -1;
+      break;
+    }
+  }
+  free(sorted);
+  if(err) {
+    return err;
+  }
+
+  if(bg_password_array_repository_reserve(_self, total)) {
+    return -3;
+  }
+  memcpy(self->password_array + self->number_passwords, passwords, count * sizeof(bg_password *));
+  self->number_passwords = total;
+  self->generation++;
+
+  return 0;
+}
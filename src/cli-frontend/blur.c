@@ -1,7 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <blurgather/mcrypt_cryptor.h>
-#include <blurgather/array_repository.h>
+#include <blurgather/lazy_repository.h>
 #include <blurgather/msgpack_persister.h>
 #include "blur.h"
 #include "clipboard.h"
@@ -49,40 +49,22 @@ int main(int argc, char **argv) {
   bg_persister_t *persister = bg_msgpack_persister_persister(bg_msgpack_persister_new(
                                                                bg_string_copy(bgctx_get_memory(ctx, bg_string_from_str("persistence_filepath"))),
                                                                cryptor));
+  /* stdio when not available */
+  bg_msgpack_persister_select_io(persister, BG_MSGPACK_IO_URING);
   if((err = blur_setup_context(ctx,
                                persister,
-                               bg_password_array_repository_new(),
+                               bg_lazy_repository_new(),
                                cryptor))) {
     fprintf(stderr, "context could not be instantiated!\n");
     return err;
   }
 
-  if(bgctx_locked(ctx)) {
-    if((err = bgctx_unlock(ctx, blur_ask_secret_key(ctx)))) {
-      fprintf(stderr, "could not unlock context!\n");
+  if(command_needs_unlock(argc, argv)) {
+    if((err = blur_open_context(ctx))) {
       return end(ctx, err);
     }
   }
 
-  if(bg_msgpack_persister_register_key(persister, bgctx_access_key(ctx))) {
-    fprintf(stderr, "could not register secret key to persister!\n");
-    return end(ctx, err);
-  }
-
-  if((err = bgctx_load(ctx))) {
-    if(err == -4) {
-      fprintf(stderr, "could not load repository (err %d), creating empty one.\n", err);
-
-      if((err = bgctx_persist(ctx))) {
-        fprintf(stderr, "could not persist repository!\n");
-        return err;
-      }
-    } else {
-      fprintf(stderr, "loading repository failed (err %d)!\n", err);
-      return err;
-    }
-  }
-
   if((err = run_command(ctx, argc, argv))) {
     fprintf(stderr, "running command failed! (err: %d)\n", err);
     return end(ctx, err);
@@ -20,6 +20,9 @@ bg_string *blur_getfield(const char *showing, int hide_input);
 
 bg_secret_key_t *blur_ask_secret_key(bg_context *ctx);
 
+int blur_unlock_context(bg_context *ctx);
+int blur_open_context(bg_context *ctx);
+
 size_t find_string_index(int argc, const char **argv, const char *str);
 
 
@@ -29,6 +32,7 @@ int run_options(bg_context *ctx, int argc, char **argv);
 
 typedef int (* const blur_cmd)(bg_context *ctx, int argc, char **argv);
 int run_command(bg_context *ctx, int argc, char **argv);
+int command_needs_unlock(int argc, char **argv);
 
 
 #ifdef __cplusplus
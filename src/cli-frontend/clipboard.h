@@ -4,5 +4,6 @@
 void send_to_clipboard(const char *password);
 void clear_clipboard();
 void send_to_stdout(const char *password);
+void send_line_to_stdout(const char *password);
 
 #endif
@@ -13,6 +13,11 @@ int blur_cmd_get(bg_context *ctx, int argc, char **argv);
 int blur_cmd_list(bg_context *ctx, int argc, char **argv);
 int blur_cmd_info(bg_context *ctx, int argc, char **argv);
 int blur_cmd_remove(bg_context *ctx, int argc, char **argv);
+int blur_cmd_search(bg_context *ctx, int argc, char **argv);
+int blur_cmd_import(bg_context *ctx, int argc, char **argv);
+int blur_cmd_export(bg_context *ctx, int argc, char **argv);
+int blur_cmd_shell(bg_context *ctx, int argc, char **argv);
+int blur_cmd_batch(bg_context *ctx, int argc, char **argv);
 
 /* options */
 int blur_unlock_from_stdin(bg_context *ctx, int argc, char **argv);
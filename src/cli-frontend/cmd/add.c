@@ -29,6 +29,35 @@ bg_string *get_or_ask_field(const char *field, int argc, char **argv, int hide_i
 }
 
 
+/* every --tag TAG and --meta KEY=VALUE */
+static int add_tags_and_metadata(bg_password *password, int argc, char **argv) {
+  int err = 0;
+  int i;
+
+  for(i = 0; i + 1 < argc && !err; ++i) {
+    if(strcmp(argv[i], "--tag") == 0) {
+      bg_string *tag = bg_string_from_str(argv[++i]);
+      err = bg_password_add_tag(password, tag);
+      bg_string_free(tag);
+    } else if(strcmp(argv[i], "--meta") == 0) {
+      const char *pair = argv[++i];
+      const char *equal = strchr(pair, '=');
+      if(!equal) {
+        return -1;
+      }
+
+      bg_string *key = bg_string_from_char_array(pair, equal - pair);
+      bg_string *value = bg_string_from_str(equal + 1);
+      err = bg_password_set_metadata(password, key, value);
+      bg_string_free(key);
+      bg_string_clean_free(value);
+    }
+  }
+
+  return err;
+}
+
+
 int blur_cmd_add(bg_context* ctx, int argc, char **argv) {
   int return_value = 0;
 
@@ -57,6 +86,12 @@ int blur_cmd_add(bg_context* ctx, int argc, char **argv) {
   bg_password_update_description(password, desc);
   bg_password_update_value(password, value1);
 
+  if((return_value = add_tags_and_metadata(password, argc, argv))) {
+    fprintf(stderr, "bad tag or metadata!\n");
+    bg_password_free(password);
+    return return_value;
+  }
+
   if((return_value = bgctx_encrypt_password(ctx, password))) {
     fprintf(stderr, "password encryption failed!\n");
     bg_password_free(password);
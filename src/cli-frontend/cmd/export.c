@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <blurgather/context.h>
+#include <blurgather/exchange.h>
+#include "../blur.h"
+
+/* blur export [--json] FILE, csv by default. output holds plain text
+   values, an existing file is never overwritten */
+int blur_cmd_export(bg_context *ctx, int argc, char **argv) {
+  int err = 0;
+  int format = find_string_index(argc, (const char **)argv, "--json") < argc ? BG_EXCHANGE_JSON : BG_EXCHANGE_CSV;
+
+  const char *filepath = argv[argc - 1];
+  if(strcmp(filepath, "export") == 0 || filepath[0] == '-') {
+    ERROR_AND_RETURN(-1, "export needs a file to write!\n");
+  }
+  bg_stream *output = bg_stream_open(BGSO_FD, BGSM_WRITE | BGSM_EXCL, filepath);
+  if(!output && errno == EEXIST) {
+    ERROR_AND_RETURN(-1, "%s already exists!\n", filepath);
+  }
+  if(!output) {
+    ERROR_AND_RETURN(-1, "cannot open %s!\n", filepath);
+  }
+
+  if((err = bgctx_export(ctx, output, format))) {
+    fprintf(stderr, "export failed!\n");
+  }
+
+  bg_stream_close(output);
+  if(err) {
+    unlink(filepath);
+  }
+  return err;
+}
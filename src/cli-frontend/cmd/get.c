@@ -5,13 +5,88 @@
 #include "../clipboard.h"
 
 
+/* reads only requested records when persisted format allows it, loads whole
+   repository otherwise and resolves every name in one pass. copies are owned by caller,
+   missing is the first name not found */
+static int get_passwords(bg_context *ctx, bg_string **names, size_t count,
+                         bg_password **copies, size_t *missing, int *loaded) {
+  int err = 0;
+  size_t i;
+
+  for(i = 0; i < count; ++i) {
+    copies[i] = NULL;
+  }
+
+  for(i = 0; !*loaded && i < count; ++i) {
+    if((err = bgctx_fetch_password(ctx, names[i], &copies[i])) < 0) {
+      break;
+    }
+    if(err) {
+      *missing = i;
+      return err;
+    }
+  }
+  if(!*loaded && i == count) {
+    return 0;
+  }
+
+  while(i) {
+    bg_password_free(copies[--i]);
+    copies[i] = NULL;
+  }
+
+  if(!*loaded) {
+    if((err = blur_open_context(ctx))) {
+      return err;
+    }
+    *loaded = 1;
+  }
+
+  if((err = bgctx_copy_passwords(ctx, (const bg_string * const *)names, count, copies)) < 0) {
+    return err;
+  }
+  for(i = 0; i < count; ++i) {
+    if(!copies[i]) {
+      *missing = i;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#define NB_SUGGESTIONS 5
+
+static int print_suggestion(const bg_string *name, size_t distance, void *nb_printed) {
+  if((*(size_t *)nb_printed)++ == 0) {
+    fprintf(stderr, "did you mean:\n");
+  }
+  fprintf(stderr, "  %s\n", bg_string_data(name));
+  return 0;
+}
+
+/* closest names, about a third of the name may be mistyped */
+static void suggest_names(bg_context *ctx, const bg_string *name, int *loaded) {
+  size_t nb_printed = 0;
+  size_t max_distance = bg_string_length(name) / 3 + 1;
+
+  if(!*loaded) {
+    if(blur_open_context(ctx)) {
+      return;
+    }
+    *loaded = 1;
+  }
+
+  bgctx_fuzzy_search(ctx, name, NB_SUGGESTIONS, max_distance, &print_suggestion, &nb_printed);
+}
+
 int blur_cmd_get(bg_context* ctx, int argc, char **argv) {
   int err = 0;
-  bg_string *name = NULL;
-  bg_password *password, *password_copy;
   void (*send_)(const char*) = NULL;
   void (*clear_)(void);
-  size_t n_passwords_to_get = 1;
+  size_t count = 1, missing = 0, i;
+  /* a shell already loaded everything, and reads its commands from stdin */
+  int *interactive_shell = bgctx_get_memory(ctx, bg_string_from_str("shell"));
+  int loaded = interactive_shell != NULL;
 
   send_ = bgctx_get_memory(ctx, bg_string_from_str("clipboard"));
   clear_ = bgctx_get_memory(ctx, bg_string_from_str("clear_clipboard"));
@@ -25,44 +100,47 @@ int blur_cmd_get(bg_context* ctx, int argc, char **argv) {
   }
 
   size_t get_idx = find_string_index(argc, (const char **)argv, "get");
-  size_t arg_idx = get_idx + 1;
 
-  if(get_idx == ((size_t)argc) - 1) {
-    name = blur_getfield("name", 0);
-  } else if(get_idx < ((size_t)argc) - 1) {
-    n_passwords_to_get = ((size_t)argc) - 1 - get_idx;
-    name = bg_string_from_str(argv[arg_idx]);
-  } else {
+  if(get_idx < ((size_t)argc) - 1) {
+    count = ((size_t)argc) - 1 - get_idx;
+  } else if(get_idx != ((size_t)argc) - 1) {
     fprintf(stderr, "bad usage!\n");
     return -1;
   }
 
-  while(arg_idx < (size_t)argc) {
-    if((err = bgctx_find_password(ctx, name, &password))) {
-      fprintf(stderr, "could not find password!\n");
-      bg_string_free(name);
-      return err;
-    }
+  bg_string *names[count];
+  bg_password *copies[count];
+  memset(copies, 0, sizeof(copies));
 
-    password_copy = bg_password_copy(password);
-    if((err = bgctx_decrypt_password(ctx, password_copy))) {
-      fprintf(stderr, "could not decrypt password!\n");
-      bg_password_free(password_copy);
-      bg_string_free(name);
-      return err;
+  if(get_idx == ((size_t)argc) - 1) {
+    names[0] = blur_getfield("name", 0);
+  } else {
+    for(i = 0; i < count; ++i) {
+      names[i] = bg_string_from_str(argv[get_idx + 1 + i]);
     }
+  }
 
-    send_(bg_string_data(bg_password_value(password_copy)));
-    if(arg_idx < (size_t)argc) {
-      getchar();
+  if((err = blur_unlock_context(ctx))) {
+    goto end;
+  }
+
+  if((err = get_passwords(ctx, names, count, copies, &missing, &loaded))) {
+    fprintf(stderr, "could not find password!\n");
+    if(err == 1) {
+      suggest_names(ctx, names[missing], &loaded);
     }
+    goto end;
+  }
 
-    bg_password_free(password_copy);
-    bg_string_free(name);
+  for(i = 0; i < count; ++i) {
+    if((err = bgctx_decrypt_password(ctx, copies[i]))) {
+      fprintf(stderr, "could not decrypt password!\n");
+      goto end;
+    }
 
-    ++arg_idx;
-    if(arg_idx < (size_t)argc) {
-      name = bg_string_from_str(argv[arg_idx]);
+    send_(bg_string_data(bg_password_value(copies[i])));
+    if(!interactive_shell || *interactive_shell) {
+      getchar();
     }
   }
 
@@ -70,5 +148,12 @@ int blur_cmd_get(bg_context* ctx, int argc, char **argv) {
     clear_();
   }
 
+end:
+  for(i = 0; i < count; ++i) {
+    bg_string_free(names[i]);
+    if(copies[i]) {
+      bg_password_free(copies[i]);
+    }
+  }
   return err;
 }
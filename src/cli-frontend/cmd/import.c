@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <blurgather/context.h>
+#include <blurgather/exchange.h>
+#include "../blur.h"
+
+/* blur import [--json] [--threads N] FILE, csv by default */
+int blur_cmd_import(bg_context *ctx, int argc, char **argv) {
+  int err = 0;
+  int format = find_string_index(argc, (const char **)argv, "--json") < argc ? BG_EXCHANGE_JSON : BG_EXCHANGE_CSV;
+  size_t threads = 0, imported = 0;
+
+  size_t idx = find_string_index(argc, (const char **)argv, "--threads");
+  if(idx + 1 < argc) {
+    threads = strtoul(argv[idx + 1], NULL, 10);
+  }
+
+  const char *filepath = argv[argc - 1];
+  if(strcmp(filepath, "import") == 0 || filepath[0] == '-') {
+    ERROR_AND_RETURN(-1, "import needs a file to read!\n");
+  }
+  if(access(filepath, R_OK)) {
+    ERROR_AND_RETURN(-1, "cannot read %s!\n", filepath);
+  }
+
+  bg_stream *input = bg_stream_open(BGSO_FD, BGSM_READ, filepath);
+  if(!input) {
+    ERROR_AND_RETURN(-1, "cannot open %s!\n", filepath);
+  }
+
+  if((err = bgctx_import(ctx, input, format, threads, &imported))) {
+    fprintf(stderr, err == -5 ? "malformed input, nothing imported!\n" : "import failed, nothing imported!\n");
+  } else {
+    printf("%zu passwords imported\n", imported);
+  }
+
+  bg_stream_close(input);
+  return err;
+}
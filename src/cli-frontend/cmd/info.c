@@ -2,12 +2,26 @@
 #include <blurgather/context.h>
 #include <blurgather/password.h>
 #include <blurgather/repository.h>
+#include <blurgather/persister.h>
 #include "../blur.h"
 #include "../clipboard.h"
 
 
 int blur_cmd_info(bg_context* ctx, int argc, char **argv) {
-  printf("number of passwords: %zu\n", bg_repository_count(bgctx_repository(ctx)));
+  int err = 0;
+  size_t count = 0;
+
+  /* answer from persisted file header when possible */
+  if((err = bg_persister_count(bgctx_persister(ctx), &count)) == -4) {
+    count = 0;
+  } else if(err) {
+    if((err = blur_open_context(ctx))) {
+      return err;
+    }
+    count = bg_repository_count(bgctx_repository(ctx));
+  }
+
+  printf("number of passwords: %zu\n", count);
 
   return 0;
 }
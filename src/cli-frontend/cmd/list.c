@@ -17,6 +17,34 @@ static int print_password_name(bg_password *pwd, bg_context *ctx) {
   return 0;
 }
 
+static int print_name(const bg_string *name, void *out) {
+  printf("%s\n", bg_string_data(name));
+  return 0;
+}
+
+/* blur list [--tag TAG]... lists passwords tagged with every given tag */
 int blur_cmd_list(bg_context *ctx, int argc, char **argv) {
-  return bgctx_each_password(ctx, (int(*)(bg_password *, void *))&print_password_name, ctx);
+  bg_string *tags[argc];
+  size_t count = 0;
+  int err = 0;
+
+  int i;
+  for(i = 0; i + 1 < argc; ++i) {
+    if(strcmp(argv[i], "--tag") == 0) {
+      tags[count++] = bg_string_from_str(argv[++i]);
+    }
+  }
+
+  if(!count) {
+    return bgctx_each_password(ctx, (int(*)(bg_password *, void *))&print_password_name, ctx);
+  }
+
+  if((err = bgctx_list_tagged(ctx, (const bg_string * const *)tags, count, &print_name, NULL))) {
+    fprintf(stderr, "tag lookup failed!\n");
+  }
+
+  while(count) {
+    bg_string_free(tags[--count]);
+  }
+  return err;
 }
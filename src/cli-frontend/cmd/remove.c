@@ -3,19 +3,46 @@
 #include <blurgather/password.h>
 #include "../blur.h"
 
+/* repository knows passwords by their crypted name */
+static int remove_password(bg_context *ctx, const bg_string *name) {
+  int err = 0;
+  bg_password *found = NULL;
+
+  if((err = bgctx_find_password(ctx, name, &found))) {
+    return err;
+  }
+
+  bg_string *stored_name = bg_string_copy(bg_password_name(found));
+  err = bgctx_remove_password(ctx, stored_name);
+  bg_string_free(stored_name);
+
+  return err;
+}
+
+/* blur remove [NAME] [--yes] */
 int blur_cmd_remove(bg_context* ctx, int argc, char **argv) {
   int err = 0;
-  bg_string *name = blur_getfield("name", 0);
+  int confirmed = find_string_index(argc, (const char **)argv, "--yes") < (size_t)argc;
+
+  size_t arg_idx = find_string_index(argc, (const char **)argv, "remove") + 1;
+  bg_string *name = NULL;
+  if(arg_idx < (size_t)argc && argv[arg_idx][0] != '-') {
+    name = bg_string_from_str(argv[arg_idx]);
+  } else {
+    name = blur_getfield("name", 0);
+  }
 
   bg_string *valid_yes = bg_string_from_str("yes");
   bg_string *valid_no = bg_string_from_str("no");
 
   while(1) {
-    bg_string *confirmation = blur_getfield("are you sure?", 0);
+    bg_string *confirmation = confirmed ? bg_string_copy(valid_yes) : blur_getfield("are you sure?", 0);
 
     if(bg_string_compare(valid_yes, confirmation) == 0) {
-      if((err = bgctx_remove_password(ctx, name))) {
+      if((err = remove_password(ctx, name))) {
         fprintf(stderr, "removing password failed!\n");
+      } else if((err = bgctx_persist(ctx))) {
+        fprintf(stderr, "persistence failed!\n");
       }
       bg_string_free(confirmation);
       break;
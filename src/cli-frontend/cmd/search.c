@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <blurgather/context.h>
+#include "../blur.h"
+
+
+static int print_name(const bg_string *name, void *out) {
+  printf("%s\n", bg_string_data(name));
+  return 0;
+}
+
+int blur_cmd_search(bg_context *ctx, int argc, char **argv) {
+  int err = 0;
+  bg_string *pattern = NULL;
+  int prefix = find_string_index(argc, (const char **)argv, "--prefix") < (size_t)argc;
+
+  size_t search_idx = find_string_index(argc, (const char **)argv, "search");
+  size_t arg_idx = search_idx + 1;
+
+  if(arg_idx < (size_t)argc && argv[arg_idx][0] == '-') {
+    ++arg_idx;
+  }
+
+  if(arg_idx < (size_t)argc) {
+    pattern = bg_string_from_str(argv[arg_idx]);
+  } else {
+    pattern = blur_getfield("pattern", 0);
+  }
+
+  if(prefix) {
+    err = bgctx_search_prefix(ctx, pattern, &print_name, NULL);
+  } else {
+    err = bgctx_search(ctx, pattern, &print_name, NULL);
+  }
+
+  if(err) {
+    fprintf(stderr, "search failed!\n");
+  }
+
+  bg_string_free(pattern);
+  return err;
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <blurgather/context.h>
+#include "../blur.h"
+#include "../clipboard.h"
+
+#define MAX_LINE 4096
+#define MAX_ARGS 64
+
+/* read by commands through "shell" memory, whether stdin is typed in */
+static int interactive_shell = 1;
+static int batch_shell = 0;
+
+/* splits line in place on blanks, double quotes group words and
+   backslash escapes next character. returns -1 on bad quoting */
+static int split_line(char *line, char **argv, int max_args) {
+  char *read = line, *write = line;
+  int argc = 0;
+
+  while(1) {
+    while(*read == ' ' || *read == '\t' || *read == '\n' || *read == '\r') {
+      ++read;
+    }
+    if(!*read) {
+      return argc;
+    }
+    if(argc == max_args) {
+      return -1;
+    }
+
+    argv[argc++] = write;
+    int quoted = 0;
+    while(*read && (quoted || !strchr(" \t\n\r", *read))) {
+      if(*read == '"') {
+        quoted = !quoted;
+        ++read;
+      } else if(*read == '\\' && read[1]) {
+        *write++ = read[1];
+        read += 2;
+      } else {
+        *write++ = *read++;
+      }
+    }
+    if(quoted) {
+      return -1;
+    }
+
+    int end = !*read;
+    *write++ = 0;
+    if(end) {
+      return argc;
+    }
+    ++read;
+  }
+}
+
+/* rest of an overlong line */
+static void skip_line(char *buffer, size_t size) {
+  while(!strchr(buffer, '\n') && fgets(buffer, size, stdin)) {
+  }
+}
+
+static int restart_transaction(bg_context *ctx, int (* finish)(bg_context *)) {
+  int err = 0;
+  if((err = finish(ctx))) {
+    return err;
+  }
+  return bgctx_begin(ctx);
+}
+
+static int run_line(bg_context *ctx, int argc, char **argv, int *done) {
+  if(strcmp(argv[1], "exit") == 0 || strcmp(argv[1], "quit") == 0) {
+    *done = 1;
+    return 0;
+  }
+  if(strcmp(argv[1], "commit") == 0) {
+    return restart_transaction(ctx, &bgctx_commit);
+  }
+  if(strcmp(argv[1], "rollback") == 0) {
+    return restart_transaction(ctx, &bgctx_rollback);
+  }
+  if(strcmp(argv[1], "shell") == 0 || strcmp(argv[1], "batch") == 0) {
+    ERROR_AND_RETURN(-1, "already in a shell!\n");
+  }
+
+  return run_command(ctx, argc, argv);
+}
+
+/* one command per line, within a transaction committed on exit or commit.
+   batches stop and roll back at first failing line */
+static int shell(bg_context *ctx, int interactive) {
+  char line[MAX_LINE];
+  char *argv[MAX_ARGS + 1] = {"blur"};
+  size_t line_number = 0;
+  int err = 0, done = 0;
+
+  bgctx_register_memory(ctx, bg_string_from_str("shell"), interactive ? &interactive_shell : &batch_shell, NULL);
+  /* values must stay apart from one get to another */
+  if(bgctx_get_memory(ctx, bg_string_from_str("clipboard")) == (void *)&send_to_stdout) {
+    bgctx_register_memory(ctx, bg_string_from_str("clipboard"), &send_line_to_stdout, NULL);
+  }
+
+  if((err = bgctx_begin(ctx))) {
+    ERROR_AND_RETURN(err, "could not start transaction!\n");
+  }
+
+  while(!done) {
+    if(interactive) {
+      printf("blur> ");
+      fflush(stdout);
+    }
+    if(!fgets(line, sizeof(line), stdin)) {
+      break;
+    }
+    ++line_number;
+
+    int argc = 0;
+    if(!strchr(line, '\n') && !feof(stdin)) {
+      fprintf(stderr, "line too long!\n");
+      err = -1;
+      skip_line(line, sizeof(line));
+    } else if((argc = split_line(line, argv + 1, MAX_ARGS)) < 0) {
+      fprintf(stderr, "bad quoting or too many arguments!\n");
+      err = -1;
+    } else if(argc > 0) {
+      err = run_line(ctx, argc + 1, argv, &done);
+    }
+    memset(line, 0, sizeof(line));
+
+    if(err && !interactive) {
+      fprintf(stderr, "line %zu failed (err: %d), rolling back!\n", line_number, err);
+      bgctx_rollback(ctx);
+      return err;
+    }
+    if(err) {
+      fprintf(stderr, "command failed! (err: %d)\n", err);
+      err = 0;
+    }
+  }
+
+  if(interactive && !done) {
+    printf("\n");
+  }
+  if((err = bgctx_commit(ctx))) {
+    fprintf(stderr, "persistence failed!\n");
+  }
+  return err;
+}
+
+/* blur shell, prompts for commands */
+int blur_cmd_shell(bg_context *ctx, int argc, char **argv) {
+  return shell(ctx, isatty(STDIN_FILENO));
+}
+
+/* blur batch < FILE, same as shell without prompting */
+int blur_cmd_batch(bg_context *ctx, int argc, char **argv) {
+  return shell(ctx, 0);
+}
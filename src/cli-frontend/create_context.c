@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <blurgather/context.h>
+#include <blurgather/executor.h>
 #include "blur.h"
 
 
@@ -16,7 +17,11 @@ int blur_setup_context(bg_context *ctx,
   if((err = bgctx_register_cryptor(ctx, cryptor))) {
     ERROR_AND_RETURN(-4, "could not register cryptor: %d\n", err);
   }
-  if((err = bgctx_config(ctx, BGCTX_ACQUIRE_PERSISTER | BGCTX_ACQUIRE_REPOSITORY))) {
+  /* workers only start once a command needs them */
+  if((err = bgctx_register_executor(ctx, bg_executor_new(0)))) {
+    ERROR_AND_RETURN(-7, "could not register executor: %d\n", err);
+  }
+  if((err = bgctx_config(ctx, BGCTX_ACQUIRE_PERSISTER | BGCTX_ACQUIRE_REPOSITORY | BGCTX_ACQUIRE_EXECUTOR))) {
     ERROR_AND_RETURN(-5, "could not configurate context: %d\n", err);
   }
   if((err = bgctx_seal(ctx))) {
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <blurgather/context.h>
+#include <blurgather/msgpack_persister.h>
+#include "blur.h"
+
+
+int blur_unlock_context(bg_context *ctx) {
+  int err = 0;
+
+  if(bgctx_locked(ctx)) {
+    if((err = bgctx_unlock(ctx, blur_ask_secret_key(ctx)))) {
+      ERROR_AND_RETURN(err, "could not unlock context!\n");
+    }
+  }
+
+  if((err = bg_msgpack_persister_register_key(bgctx_persister(ctx), bgctx_access_key(ctx)))) {
+    ERROR_AND_RETURN(err, "could not register secret key to persister!\n");
+  }
+  bg_msgpack_persister_register_executor(bgctx_persister(ctx), bgctx_executor(ctx));
+
+  return err;
+}
+
+int blur_open_context(bg_context *ctx) {
+  int err = 0;
+
+  if((err = blur_unlock_context(ctx))) {
+    return err;
+  }
+  /* commands loading repository go through all of it, at least to persist:
+     records are decoded in parallel while file is read rather than one by one */
+  bg_msgpack_persister_decode_all(bgctx_persister(ctx), 1);
+
+  if((err = bgctx_load(ctx))) {
+    if(err == -4) {
+      /* written on first change */
+      fprintf(stderr, "could not load repository (err %d), starting with an empty one.\n", err);
+      err = 0;
+    } else {
+      ERROR_AND_RETURN(err, "loading repository failed (err %d)!\n", err);
+    }
+  }
+
+  return err;
+}
@@ -1,42 +1,64 @@
 #include <stdio.h>
+#include <string.h>
 #include "blur.h"
 #include "cmd.h"
 
-static const char *cmd_strs[] = {
-  "get",
-  "info",
-  "list",
-  "add",
-  "remove",
+/* commands not needing unlock open the context by themselves, only when needed */
+struct blur_command {
+  const char *name;
+  blur_cmd run;
+  int needs_unlock;
 };
 
-static blur_cmd cmd_fcts[] = {
-  blur_cmd_get,
-  blur_cmd_info,
-  blur_cmd_list,
-  blur_cmd_add,
-  blur_cmd_remove,
+static const struct blur_command commands[] = {
+  { "get",    blur_cmd_get,    0 },
+  { "info",   blur_cmd_info,   0 },
+  { "list",   blur_cmd_list,   1 },
+  { "add",    blur_cmd_add,    1 },
+  { "remove", blur_cmd_remove, 1 },
+  { "search", blur_cmd_search, 1 },
+  { "import", blur_cmd_import, 1 },
+  { "export", blur_cmd_export, 1 },
+  { "shell",  blur_cmd_shell,  1 },
+  { "batch",  blur_cmd_batch,  1 },
 };
 
-#define NB_CMDS sizeof(cmd_fcts)/sizeof(blur_cmd)
+#define NB_CMDS sizeof(commands)/sizeof(struct blur_command)
 
 static int command_not_found(bg_context *ctx, int argc, char **argv) {
   fprintf(stderr, "bad usage: command not found!\n");
   return 1;
 }
 
+/* first argument naming a command */
+static const struct blur_command *find_command(int argc, char **argv) {
+  size_t idx;
+  int i;
+
+  for(i = 1; i < argc; ++i) {
+    for(idx = 0; idx < NB_CMDS; ++idx) {
+      if(strcmp(commands[idx].name, argv[i]) == 0) {
+        return &commands[idx];
+      }
+    }
+  }
+
+  return NULL;
+}
+
+int command_needs_unlock(int argc, char **argv) {
+  const struct blur_command *command = find_command(argc, argv);
+
+  return command ? command->needs_unlock : 1;
+}
+
 int run_command(bg_context *ctx, int argc, char **argv) {
   if(argc < 2) { return command_not_found(ctx, argc, argv); }
 
-  size_t idx = NB_CMDS;
-  int i = 1;
-  while(idx >= NB_CMDS && i < argc) {
-    idx = find_string_index(NB_CMDS, cmd_strs, argv[i]);
-    ++i;
-  }
+  const struct blur_command *command = find_command(argc, argv);
 
-  if(idx < NB_CMDS) {
-    return cmd_fcts[idx](ctx, argc, argv);
+  if(command) {
+    return command->run(ctx, argc, argv);
   } else {
     return command_not_found(ctx, argc, argv);
   }
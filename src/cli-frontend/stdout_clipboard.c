@@ -4,3 +4,8 @@ void send_to_stdout(const char* password) {
   printf("%s", password);
   fflush(stdout);
 }
+
+void send_line_to_stdout(const char* password) {
+  printf("%s\n", password);
+  fflush(stdout);
+}
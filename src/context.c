@@ -1,32 +1,119 @@
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "blurgather/context.h"
 #include "blurgather/mcrypt_cryptor.h"
 #include "blurgather/password.h"
 #include "blurgather/repository.h"
 #include "blurgather/persister.h"
 #include "blurgather/map.h"
+#include "blurgather/name_index.h"
+#include "blurgather/tag_index.h"
+#include "blurgather/encryption.h"
+#include "blurgather/executor.h"
+#include "field_list.h"
 
 
 #define BGCTX_SEALED 0x1
+/* persists attempted over changes persisted by other processes */
+#define PERSIST_TRIES 3
 
+/* what rollback does to undo one mutation */
+enum undo_action {
+  UNDO_REMOVE, /* name of an added password, as stored */
+  UNDO_ADD     /* copy of a removed password */
+};
+
+struct undo_entry {
+  enum undo_action action;
+  bg_string *name;
+  bg_password *password;
+};
+
+struct undo_log {
+  struct undo_entry *entries;
+  size_t count;
+  size_t allocated;
+};
+
+
+/* asynchronous persist request */
+struct persist_waiter {
+  void (* callback)(bg_context *ctx, int err, void *arg);
+  void *arg;
+  struct persist_waiter *next;
+};
 
 struct bg_context {
   bg_repository_t *repository;
   bg_cryptor_t *cryptor;
   bg_persister_t *persister;
+  bg_executor *executor;
   bg_secret_key_t *secret_key;
   bg_map *map;
+  bg_name_index *search_index;
+  bg_tag_index *tag_index;
+  struct undo_log *undo; /* open transaction, if any */
+
+  /* modifications through context, and as of last load or persist */
+  uint64_t generation;
+  uint64_t persisted_generation;
+  uint64_t persisted_repository_generation;
+  int persisted;
+
+  /* readers share rwlock, mutations and lock hold it alone.
+     indexes are built lazily by readers, one at a time */
+  pthread_rwlock_t rwlock;
+  pthread_mutex_t index_lock;
+  /* persister users one at a time, taken before rwlock */
+  pthread_mutex_t persist_lock;
+
+  /* requests waiting for next background write, one writer at most */
+  pthread_mutex_t async_lock;
+  pthread_cond_t async_done;
+  struct persist_waiter *waiters;
+  int persisting;
+
   int flags;
 };
 
 #define RETURN_IF_UNSEALED(ctx) if(!bgctx_sealed(ctx)) {return -1;}
 #define RETURN_IF_LOCKED(ctx) if(!(ctx)->secret_key) {return -2;}
 
+#define WITH_LOCK(acquire, ctx, call) do {   \
+    pthread_rwlock_##acquire(&(ctx)->rwlock); \
+    int ret_ = (call);                        \
+    pthread_rwlock_unlock(&(ctx)->rwlock);    \
+    return ret_;                              \
+  } while(0)
+#define SHARED(ctx, call) WITH_LOCK(rdlock, ctx, call)
+#define EXCLUSIVE(ctx, call) WITH_LOCK(wrlock, ctx, call)
+#define READING(ctx, reading, call) do {  \
+    struct reading reading;               \
+    begin_reading((ctx), &reading);       \
+    int ret_ = (call);                    \
+    end_reading(&reading);                \
+    return ret_;                          \
+  } while(0)
+#define PERSISTING(ctx, call) do {             \
+    pthread_mutex_lock(&(ctx)->persist_lock);  \
+    pthread_rwlock_wrlock(&(ctx)->rwlock);     \
+    int ret_ = (call);                         \
+    pthread_rwlock_unlock(&(ctx)->rwlock);     \
+    pthread_mutex_unlock(&(ctx)->persist_lock); \
+    return ret_;                               \
+  } while(0)
+
 int bgctx_init(bg_context **ctx) {
   *ctx = malloc(sizeof(bg_context));
   memset(*ctx, 0, sizeof(bg_context));
   (*ctx)->map = bg_map_new();
+  pthread_rwlock_init(&(*ctx)->rwlock, NULL);
+  pthread_mutex_init(&(*ctx)->index_lock, NULL);
+  pthread_mutex_init(&(*ctx)->persist_lock, NULL);
+  pthread_mutex_init(&(*ctx)->async_lock, NULL);
+  pthread_cond_init(&(*ctx)->async_done, NULL);
   return 0;
 }
 
@@ -84,8 +171,24 @@ int bgctx_register_cryptor(bg_context *ctx, bg_cryptor_t *cryptor) {
   return 0;
 }
 
+int bgctx_register_executor(bg_context *ctx, bg_executor *executor) {
+  int error_code = 0;
+  if((error_code = check_ctx(ctx))) { return error_code; }
+
+  ctx->executor = executor;
+  return 0;
+}
+
+static void undo_log_free(struct undo_log *log);
+static int lock_context(bg_context *ctx);
+
 int bgctx_finalize(bg_context *ctx) {
-  bgctx_lock(ctx);
+  bgctx_persist_wait(ctx);
+  if(ctx->undo) {
+    undo_log_free(ctx->undo);
+    ctx->undo = NULL;
+  }
+  lock_context(ctx);
 
   if(ctx->repository && (ctx->flags & BGCTX_ACQUIRE_REPOSITORY)) {
     bg_repository_destroy(ctx->repository);
@@ -97,19 +200,45 @@ int bgctx_finalize(bg_context *ctx) {
     free((void*)ctx->persister->object);
     ctx->repository = NULL;
   }
+  if(ctx->executor && (ctx->flags & BGCTX_ACQUIRE_EXECUTOR)) {
+    bg_executor_free(ctx->executor);
+    ctx->executor = NULL;
+  }
   bg_map_free(ctx->map);
+  pthread_rwlock_destroy(&ctx->rwlock);
+  pthread_mutex_destroy(&ctx->index_lock);
+  pthread_mutex_destroy(&ctx->persist_lock);
+  pthread_mutex_destroy(&ctx->async_lock);
+  pthread_cond_destroy(&ctx->async_done);
 
   free(ctx);
 
   return 0;
 }
 
-int bgctx_unlock(bg_context *ctx, bg_secret_key_t *secret_key) {
+static int unlock_context(bg_context *ctx, bg_secret_key_t *secret_key) {
   ctx->secret_key = secret_key;
   return 0;
 }
 
-int bgctx_lock(bg_context *ctx) {
+int bgctx_unlock(bg_context *ctx, bg_secret_key_t *secret_key) {
+  PERSISTING(ctx, unlock_context(ctx, secret_key));
+}
+
+/* plain text names and tags must not outlive unlocked state nor repository changes */
+static void drop_indexes(bg_context *ctx) {
+  if(ctx->search_index) {
+    bg_name_index_free(ctx->search_index);
+    ctx->search_index = NULL;
+  }
+  if(ctx->tag_index) {
+    bg_tag_index_free(ctx->tag_index);
+    ctx->tag_index = NULL;
+  }
+}
+
+static int lock_context(bg_context *ctx) {
+  drop_indexes(ctx);
   if(ctx->secret_key) {
     bg_secret_key_free(ctx->secret_key);
     ctx->secret_key = NULL;
@@ -117,10 +246,18 @@ int bgctx_lock(bg_context *ctx) {
   return 0;
 }
 
-int bgctx_locked(bg_context *ctx) {
+int bgctx_lock(bg_context *ctx) {
+  PERSISTING(ctx, lock_context(ctx));
+}
+
+static int context_locked(bg_context *ctx) {
   return ctx->secret_key == NULL;
 }
 
+int bgctx_locked(bg_context *ctx) {
+  SHARED(ctx, context_locked(ctx));
+}
+
 bg_secret_key_t *bgctx_access_key(bg_context *ctx) {
   return ctx->secret_key;
 }
@@ -133,93 +270,883 @@ bg_cryptor_t *bgctx_cryptor(bg_context *ctx) {
   return ctx->cryptor;
 }
 
-struct find_data {
+bg_persister_t *bgctx_persister(bg_context *ctx) {
+  return ctx->persister;
+}
+
+bg_executor *bgctx_executor(bg_context *ctx) {
+  return ctx->executor;
+}
+
+/* lookups and iteration go through a snapshot when repository takes one,
+   holding no lock writers wait on. key is copied so that locking context
+   meanwhile does not free it. reader lock is held throughout otherwise */
+struct reading {
   bg_context *ctx;
-  const bg_string *name;
-  bg_password *output;
+  bg_repository_t *repository;
+  bg_secret_key_t *secret_key;
+  bg_repository_t *snapshot;
+};
+
+static void begin_reading(bg_context *ctx, struct reading *reading) {
+  pthread_rwlock_rdlock(&ctx->rwlock);
+  reading->ctx = ctx;
+  reading->repository = ctx->repository;
+  reading->secret_key = ctx->secret_key;
+  reading->snapshot = bgctx_sealed(ctx) ? bg_repository_snapshot(ctx->repository) : NULL;
+
+  if(reading->snapshot && ctx->secret_key &&
+     !(reading->secret_key = bg_secret_key_new(bg_secret_key_data(ctx->secret_key),
+                                               bg_secret_key_length(ctx->secret_key)))) {
+    bg_repository_free(reading->snapshot);
+    reading->snapshot = NULL;
+    reading->secret_key = ctx->secret_key;
+  }
+  if(reading->snapshot) {
+    reading->repository = reading->snapshot;
+    pthread_rwlock_unlock(&ctx->rwlock);
+  }
+}
+
+static void end_reading(struct reading *reading) {
+  if(!reading->snapshot) {
+    pthread_rwlock_unlock(&reading->ctx->rwlock);
+    return;
+  }
+  if(reading->secret_key) {
+    bg_secret_key_free(reading->secret_key);
+  }
+  bg_repository_free(reading->snapshot);
+}
+
+/* requested names map to their first index + 1 */
+struct find_data {
+  bg_cryptor_t *cryptor;
+  bg_secret_key_t *secret_key;
+  bg_map *wanted;
+  bg_password **output;
+  size_t missing;
 };
 
-static int password_find(bg_password *pwd, void *data) {
-  bg_password *copy = bg_password_copy(pwd);
+static int password_find(bg_password *pwd, void *_data) {
+  struct find_data *data = _data;
+  const bg_string *name = bg_password_name(pwd);
+  bg_string *decrypted = NULL;
+  int err = 0;
+
+  if(bg_password_crypted(pwd)) { /* name only */
+    if((err = bg_decrypt_string_to(name, &decrypted, data->cryptor, data->secret_key))) {
+      return err;
+    }
+    name = decrypted;
+  }
 
+  size_t found = (size_t)(uintptr_t)bg_map_find_data(data->wanted, name);
+  if(found && !data->output[found - 1]) {
+    data->output[found - 1] = pwd; /* original version contained in repository */
+    --data->missing;
+  }
+
+  if(decrypted) {
+    bg_string_clean_free(decrypted);
+  }
+  return data->missing == 0; /* stops traversal */
+}
+
+static int find_passwords(struct reading *reading, const bg_string * const *names, size_t count, bg_password **passwords) {
   int err = 0;
-  if((err = bg_password_decrypt(copy, ((struct find_data*)data)->ctx->cryptor, ((struct find_data*)data)->ctx->secret_key))) { /* only decrypt copy */
-    bg_password_free(copy);
-    return err;
+  size_t i;
+
+  RETURN_IF_UNSEALED(reading->ctx);
+  RETURN_IF_LOCKED(reading);
+
+  struct find_data data = {
+    .cryptor = reading->ctx->cryptor,
+    .secret_key = reading->secret_key,
+    .wanted = bg_map_new(),
+    .output = passwords,
+    .missing = 0
+  };
+  if(!data.wanted) {
+    return -4;
   }
 
-  if(bg_string_compare(((struct find_data*)data)->name, bg_password_name(copy)) == 0) {
-    ((struct find_data*)data)->output = pwd; /* original version contained in repository */
-    bg_password_free(copy);
-    return 1;
+  for(i = 0; i < count; ++i) {
+    passwords[i] = NULL;
+    if(bg_map_find_data(data.wanted, names[i])) {
+      continue; /* asked twice */
+    }
+    if((err = bg_map_register_data(data.wanted, bg_string_copy(names[i]), (void *)(uintptr_t)(i + 1), NULL))) {
+      err = -4;
+      goto end;
+    }
+    ++data.missing;
   }
 
-  bg_password_free(copy);
+  if(data.missing && (err = bg_repository_foreach(reading->repository, &password_find, &data)) != 1 && err) {
+    goto end;
+  }
+
+  for(i = 0; i < count; ++i) {
+    passwords[i] = passwords[(size_t)(uintptr_t)bg_map_find_data(data.wanted, names[i]) - 1];
+  }
+  err = data.missing != 0;
+
+end:
+  bg_map_free(data.wanted);
+  return err;
+}
+
+int bgctx_find_passwords(bg_context *ctx, const bg_string * const *names, size_t count, bg_password **passwords) {
+  READING(ctx, reading, find_passwords(&reading, names, count, passwords));
+}
+
+static int find_password(struct reading *reading, const bg_string *name, bg_password **password) {
+  bg_password *found = NULL;
+  int err = 0;
+
+  if((err = find_passwords(reading, &name, 1, &found))) {
+    return err;
+  }
+  *password = found;
   return 0;
 }
 
 int bgctx_find_password(bg_context *ctx, const bg_string *name, bg_password **password) {
-  int err;
+  READING(ctx, reading, find_password(&reading, name, password));
+}
 
+/* copied while still pinned or locked, a mutation may free found ones right after */
+static int copy_passwords(struct reading *reading, const bg_string * const *names, size_t count, bg_password **copies) {
+  int err = 0;
+  size_t i;
+
+  if((err = find_passwords(reading, names, count, copies)) < 0) {
+    return err;
+  }
+  for(i = 0; i < count; ++i) {
+    if(copies[i]) {
+      copies[i] = bg_password_copy(copies[i]);
+    }
+  }
+  return err;
+}
+
+int bgctx_copy_passwords(bg_context *ctx, const bg_string * const *names, size_t count, bg_password **copies) {
+  READING(ctx, reading, copy_passwords(&reading, names, count, copies));
+}
+
+/* straight from persisted storage, without loading repository: output is owned by caller */
+static int fetch_password(bg_context *ctx, const bg_string *name, bg_password **password) {
   RETURN_IF_UNSEALED(ctx);
   RETURN_IF_LOCKED(ctx);
+  return bg_persister_fetch(ctx->persister, name, password);
+}
 
-  struct find_data data = {
-    .ctx = ctx,
-    .name = name,
-    .output = NULL
-  };
+int bgctx_fetch_password(bg_context *ctx, const bg_string *name, bg_password **password) {
+  SHARED(ctx, fetch_password(ctx, name, password));
+}
 
-  if((err = bg_repository_foreach(ctx->repository, &password_find, &data)) == 1) {
-    *password = data.output;
-    return 0;
-  } else {
+static int each_password(struct reading *reading, int (* callback)(bg_password *password, void *), void *out) {
+  RETURN_IF_UNSEALED(reading->ctx);
+  return bg_repository_foreach(reading->repository, callback, out);
+}
+
+int bgctx_each_password(bg_context *ctx, int (* callback)(bg_password *password, void *), void *out) {
+  READING(ctx, reading, each_password(&reading, callback, out));
+}
+
+struct decrypting_each {
+  struct reading *reading;
+  int (* callback)(bg_password *password, void *);
+  void *out;
+};
+
+/* decrypts with reading key, taking no lock again */
+static int decrypt_each(bg_password *password, void *_each) {
+  struct decrypting_each *each = _each;
+  int err = 0;
+
+  bg_password *plain = bg_password_copy(password);
+  if(!plain) {
+    return -4;
+  }
+
+  if(!bg_password_crypted(plain) ||
+     !(err = bg_password_decrypt(plain, each->reading->ctx->cryptor, each->reading->secret_key))) {
+    err = each->callback(plain, each->out);
+  }
+
+  bg_password_free(plain);
+  return err;
+}
+
+static int each_decrypted_password(struct reading *reading, int (* callback)(bg_password *password, void *), void *out) {
+  struct decrypting_each each = { reading, callback, out };
+
+  RETURN_IF_UNSEALED(reading->ctx);
+  RETURN_IF_LOCKED(reading);
+  return bg_repository_foreach(reading->repository, &decrypt_each, &each);
+}
+
+int bgctx_each_decrypted_password(bg_context *ctx, int (* callback)(bg_password *password, void *), void *out) {
+  READING(ctx, reading, each_decrypted_password(&reading, callback, out));
+}
+
+/* as of context generation, repository being persisted one or a snapshot of it.
+   repository generation is only trusted when implementation keeps one */
+static void mark_persisted(bg_context *ctx, uint64_t generation, bg_repository_t *persisted) {
+  ctx->persisted_generation = generation;
+  ctx->persisted = bg_repository_generation(persisted, &ctx->persisted_repository_generation) == 0;
+}
+
+static int dirty(bg_context *ctx) {
+  uint64_t generation;
+
+  if(!ctx->persisted || ctx->generation != ctx->persisted_generation) {
     return 1;
   }
+  if(bg_repository_generation(ctx->repository, &generation)) {
+    return 1;
+  }
+  return generation != ctx->persisted_repository_generation;
 }
 
-int bgctx_each_password(bg_context *ctx, int (* callback)(bg_password *password, void *), void *out) {
+int bgctx_dirty(bg_context *ctx) {
+  SHARED(ctx, dirty(ctx));
+}
+
+static int load(bg_context *ctx) {
+  int err = 0;
+
   RETURN_IF_UNSEALED(ctx);
-  return bg_repository_foreach(ctx->repository, callback, out);
+  if(ctx->undo) {
+    return -3;
+  }
+  drop_indexes(ctx);
+
+  if(!(err = bg_persister_load(ctx->persister, ctx->repository))) {
+    mark_persisted(ctx, ctx->generation, ctx->repository);
+  }
+  return err;
 }
 
 int bgctx_load(bg_context *ctx) {
+  PERSISTING(ctx, load(ctx));
+}
+
+/* applies what other processes persisted since last load or persist. context
+   still matches persisted file afterwards when it did before */
+static int refresh(bg_context *ctx) {
+  int err = 0, clean = !dirty(ctx);
+
+  if((err = bg_persister_refresh(ctx->persister, ctx->repository)) == 1) {
+    drop_indexes(ctx);
+    ctx->generation++;
+    if(clean) {
+      mark_persisted(ctx, ctx->generation, ctx->repository);
+    }
+  }
+  return err;
+}
+
+static int refresh_loaded(bg_context *ctx) {
+  RETURN_IF_UNSEALED(ctx);
+  if(ctx->undo) {
+    return -3;
+  }
+  return refresh(ctx);
+}
+
+int bgctx_refresh(bg_context *ctx) {
+  PERSISTING(ctx, refresh_loaded(ctx));
+}
+
+/* others persisting in between are merged first, a few times at most */
+static int persist_if_dirty(bg_context *ctx) {
+  int err = 0, tries = 0;
+
+  if(!dirty(ctx)) {
+    return 0;
+  }
+  while((err = bg_persister_persist(ctx->persister, ctx->repository)) == -11 && ++tries < PERSIST_TRIES) {
+    if((err = refresh(ctx)) < 0) {
+      return err;
+    }
+  }
+  if(!err) {
+    mark_persisted(ctx, ctx->generation, ctx->repository);
+  }
+  return err;
+}
+
+/* deferred to commit within a transaction */
+static int persist(bg_context *ctx) {
   RETURN_IF_UNSEALED(ctx);
-  return bg_persister_load(ctx->persister, ctx->repository);
+  if(ctx->undo) {
+    return 0;
+  }
+  return persist_if_dirty(ctx);
 }
 
+/* under reader lock, 1 when something is to persist. snapshot stays NULL
+   when repository cannot take one */
+static int pin_snapshot(bg_context *ctx, bg_repository_t **snapshot, uint64_t *generation) {
+  RETURN_IF_UNSEALED(ctx);
+  if(ctx->undo || !dirty(ctx)) {
+    return 0;
+  }
+  *snapshot = bg_repository_snapshot(ctx->repository);
+  *generation = ctx->generation;
+  return 1;
+}
+
+/* slow writes hold no lock readers or writers wait on, unless
+   repository takes no snapshot */
 int bgctx_persist(bg_context *ctx) {
+  bg_repository_t *snapshot = NULL;
+  uint64_t generation = 0;
+  int err = 0;
+
+  pthread_mutex_lock(&ctx->persist_lock);
+
+  pthread_rwlock_rdlock(&ctx->rwlock);
+  err = pin_snapshot(ctx, &snapshot, &generation);
+  pthread_rwlock_unlock(&ctx->rwlock);
+
+  if(err == 1 && snapshot) {
+    if(!(err = bg_persister_persist(ctx->persister, snapshot))) {
+      pthread_rwlock_wrlock(&ctx->rwlock);
+      mark_persisted(ctx, generation, snapshot);
+      pthread_rwlock_unlock(&ctx->rwlock);
+    }
+    bg_repository_free(snapshot);
+    /* changes persisted by others are merged under writer lock */
+    err = err == -11 ? 1 : err;
+  }
+  if(err == 1) {
+    pthread_rwlock_wrlock(&ctx->rwlock);
+    err = persist(ctx);
+    pthread_rwlock_unlock(&ctx->rwlock);
+  }
+
+  pthread_mutex_unlock(&ctx->persist_lock);
+  return err;
+}
+
+/* back in request order */
+static struct persist_waiter *reverse_waiters(struct persist_waiter *waiters) {
+  struct persist_waiter *reversed = NULL;
+  while(waiters) {
+    struct persist_waiter *next = waiters->next;
+    waiters->next = reversed;
+    reversed = waiters;
+    waiters = next;
+  }
+  return reversed;
+}
+
+/* writes until no request is left, each write answering requests made before it */
+static void persist_in_background(void *_ctx) {
+  bg_context *ctx = _ctx;
+
+  while(1) {
+    pthread_mutex_lock(&ctx->async_lock);
+    struct persist_waiter *waiters = ctx->waiters;
+    ctx->waiters = NULL;
+    if(!waiters) {
+      ctx->persisting = 0;
+      pthread_cond_broadcast(&ctx->async_done);
+      pthread_mutex_unlock(&ctx->async_lock);
+      return;
+    }
+    pthread_mutex_unlock(&ctx->async_lock);
+
+    int err = bgctx_persist(ctx);
+    waiters = reverse_waiters(waiters);
+    while(waiters) {
+      struct persist_waiter *next = waiters->next;
+      if(waiters->callback) {
+        waiters->callback(ctx, err, waiters->arg);
+      }
+      free(waiters);
+      waiters = next;
+    }
+  }
+}
+
+static void *persist_thread(void *ctx) {
+  persist_in_background(ctx);
+  return NULL;
+}
+
+/* detached thread, caller when it cannot start. never on context executor:
+   a thread persisting or loading helps it while waiting on its own tasks,
+   and would then wait on persist_lock it already holds */
+static void start_background_persist(bg_context *ctx) {
+  pthread_attr_t attributes;
+  pthread_t thread;
+  int err = 0;
+
+  pthread_attr_init(&attributes);
+  pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+  err = pthread_create(&thread, &attributes, &persist_thread, ctx);
+  pthread_attr_destroy(&attributes);
+
+  if(err) {
+    persist_in_background(ctx);
+  }
+}
+
+int bgctx_persist_async(bg_context *ctx, void (* callback)(bg_context *ctx, int err, void *arg), void *arg) {
+  RETURN_IF_UNSEALED(ctx);
+
+  struct persist_waiter *waiter = malloc(sizeof(struct persist_waiter));
+  if(!waiter) {
+    return -4;
+  }
+  waiter->callback = callback;
+  waiter->arg = arg;
+
+  pthread_mutex_lock(&ctx->async_lock);
+  waiter->next = ctx->waiters;
+  ctx->waiters = waiter;
+  int start = !ctx->persisting;
+  ctx->persisting = 1;
+  pthread_mutex_unlock(&ctx->async_lock);
+
+  if(start) {
+    start_background_persist(ctx);
+  }
+  return 0;
+}
+
+void bgctx_persist_wait(bg_context *ctx) {
+  pthread_mutex_lock(&ctx->async_lock);
+  while(ctx->persisting) {
+    pthread_cond_wait(&ctx->async_done, &ctx->async_lock);
+  }
+  pthread_mutex_unlock(&ctx->async_lock);
+}
+
+static int undo_log_push(struct undo_log *log, enum undo_action action, bg_string *name, bg_password *password) {
+  if(log->count == log->allocated) {
+    size_t allocated = log->allocated ? log->allocated * 2 : 8;
+    struct undo_entry *entries = realloc(log->entries, allocated * sizeof(struct undo_entry));
+    if(!entries) {
+      return -1;
+    }
+    log->entries = entries;
+    log->allocated = allocated;
+  }
+
+  struct undo_entry *entry = &log->entries[log->count++];
+  entry->action = action;
+  entry->name = name;
+  entry->password = password;
+  return 0;
+}
+
+/* forgets last entry, which mutation did not happen */
+static void undo_log_drop_last(struct undo_log *log) {
+  struct undo_entry *entry = &log->entries[--log->count];
+  if(entry->name) {
+    bg_string_free(entry->name);
+  }
+  if(entry->password) {
+    bg_password_free(entry->password);
+  }
+}
+
+static void undo_log_free(struct undo_log *log) {
+  while(log->count) {
+    undo_log_drop_last(log);
+  }
+  free(log->entries);
+  free(log);
+}
+
+static int add_password(bg_context *ctx, bg_password *password) {
+  int err = 0;
+
   RETURN_IF_UNSEALED(ctx);
-  return bg_persister_persist(ctx->persister, ctx->repository);
+  drop_indexes(ctx);
+
+  if(ctx->undo &&
+     (err = undo_log_push(ctx->undo, UNDO_REMOVE, bg_string_copy(bg_password_name(password)), NULL))) {
+    return err;
+  }
+
+  if((err = bg_repository_add(ctx->repository, password))) {
+    if(ctx->undo) {
+      undo_log_drop_last(ctx->undo);
+    }
+    return err;
+  }
+
+  ctx->generation++;
+  return 0;
 }
 
 int bgctx_add_password(bg_context *ctx, bg_password *password) {
+  EXCLUSIVE(ctx, add_password(ctx, password));
+}
+
+static int add_passwords(bg_context *ctx, bg_password **passwords, size_t count) {
+  int err = 0;
+  size_t i, logged = 0;
+
   RETURN_IF_UNSEALED(ctx);
-  return bg_repository_add(ctx->repository, password);
+  drop_indexes(ctx);
+
+  for(i = 0; ctx->undo && i < count; ++i, ++logged) {
+    if((err = undo_log_push(ctx->undo, UNDO_REMOVE, bg_string_copy(bg_password_name(passwords[i])), NULL))) {
+      goto end;
+    }
+  }
+
+  if((err = bg_repository_add_all(ctx->repository, passwords, count))) {
+    goto end;
+  }
+
+  ctx->generation++;
+  return 0;
+
+end:
+  while(logged--) {
+    undo_log_drop_last(ctx->undo);
+  }
+  return err;
 }
 
-int bgctx_encrypt_password(bg_context *ctx, bg_password *password) {
+int bgctx_add_passwords(bg_context *ctx, bg_password **passwords, size_t count) {
+  EXCLUSIVE(ctx, add_passwords(ctx, passwords, count));
+}
+
+static int encrypt_password(bg_context *ctx, bg_password *password) {
   RETURN_IF_UNSEALED(ctx);
   RETURN_IF_LOCKED(ctx);
   return bg_password_crypt(password, ctx->cryptor, ctx->secret_key);
 }
 
-int bgctx_decrypt_password(bg_context *ctx, bg_password *password) {
+int bgctx_encrypt_password(bg_context *ctx, bg_password *password) {
+  SHARED(ctx, encrypt_password(ctx, password));
+}
+
+static int decrypt_password(bg_context *ctx, bg_password *password) {
   RETURN_IF_UNSEALED(ctx);
   RETURN_IF_LOCKED(ctx);
   return bg_password_decrypt(password, ctx->cryptor, ctx->secret_key);
 }
 
+int bgctx_decrypt_password(bg_context *ctx, bg_password *password) {
+  SHARED(ctx, decrypt_password(ctx, password));
+}
+
+static int remove_password(bg_context *ctx, bg_string *name) {
+  int err = 0;
+  bg_password *removed = NULL;
+
+  RETURN_IF_UNSEALED(ctx);
+  RETURN_IF_LOCKED(ctx);
+  drop_indexes(ctx);
+
+  if(ctx->undo && bg_repository_get(ctx->repository, name, &removed) == 0 && removed &&
+     (err = undo_log_push(ctx->undo, UNDO_ADD, NULL, bg_password_copy(removed)))) {
+    return err;
+  }
+
+  if((err = bg_repository_remove(ctx->repository, name))) {
+    if(removed) {
+      undo_log_drop_last(ctx->undo);
+    }
+    return err;
+  }
+
+  ctx->generation++;
+  return 0;
+}
+
 int bgctx_remove_password(bg_context *ctx, bg_string *name) {
+  EXCLUSIVE(ctx, remove_password(ctx, name));
+}
+
+static int update_password(bg_context *ctx, const bg_string *name, bg_password *password) {
+  int err = 0;
+  bg_password *previous = NULL;
+
   RETURN_IF_UNSEALED(ctx);
   RETURN_IF_LOCKED(ctx);
-  return bg_repository_remove(ctx->repository, name);
+
+  if(bg_repository_get(ctx->repository, name, &previous) || !previous) {
+    return 1;
+  }
+  previous = bg_password_copy(previous);
+
+  if((err = remove_password(ctx, (bg_string *)name))) {
+    bg_password_free(previous);
+    return err;
+  }
+
+  if((err = add_password(ctx, password))) {
+    /* put previous one back, it no longer needs to be undone */
+    if(ctx->undo) {
+      undo_log_drop_last(ctx->undo);
+    }
+    if(bg_repository_add(ctx->repository, previous)) {
+      bg_password_free(previous);
+    }
+    return err;
+  }
+
+  bg_password_free(previous);
+  return 0;
 }
 
-int bgctx_register_memory(bg_context *ctx, bg_string *key, void *mem, void (*mem_free)(void *)) {
+int bgctx_update_password(bg_context *ctx, const bg_string *name, bg_password *password) {
+  EXCLUSIVE(ctx, update_password(ctx, name, password));
+}
+
+static int begin(bg_context *ctx) {
+  RETURN_IF_UNSEALED(ctx);
+  if(ctx->undo) {
+    return -3;
+  }
+
+  ctx->undo = malloc(sizeof(struct undo_log));
+  if(!ctx->undo) {
+    return -4;
+  }
+  memset(ctx->undo, 0, sizeof(struct undo_log));
+
+  return 0;
+}
+
+int bgctx_begin(bg_context *ctx) {
+  EXCLUSIVE(ctx, begin(ctx));
+}
+
+static int in_transaction(bg_context *ctx) {
+  return ctx->undo != NULL;
+}
+
+int bgctx_in_transaction(bg_context *ctx) {
+  SHARED(ctx, in_transaction(ctx));
+}
+
+static int commit(bg_context *ctx) {
+  int err = 0;
+
+  RETURN_IF_UNSEALED(ctx);
+  if(!ctx->undo) {
+    return -3;
+  }
+
+  if((err = persist_if_dirty(ctx))) {
+    return err;
+  }
+
+  undo_log_free(ctx->undo);
+  ctx->undo = NULL;
+  return 0;
+}
+
+int bgctx_commit(bg_context *ctx) {
+  PERSISTING(ctx, commit(ctx));
+}
+
+/* undoes mutations from last to first */
+static int rollback(bg_context *ctx) {
+  int err = 0;
+
+  RETURN_IF_UNSEALED(ctx);
+  if(!ctx->undo) {
+    return -3;
+  }
+  drop_indexes(ctx);
+
+  struct undo_log *log = ctx->undo;
+  ctx->undo = NULL;
+  ctx->generation++;
+
+  while(log->count) {
+    struct undo_entry *entry = &log->entries[log->count - 1];
+    int undo_err = 0;
+
+    if(entry->action == UNDO_REMOVE) {
+      undo_err = bg_repository_remove(ctx->repository, entry->name);
+    } else if(!(undo_err = bg_repository_add(ctx->repository, entry->password))) {
+      entry->password = NULL; /* now owned by repository */
+    }
+
+    if(undo_err && !err) {
+      err = undo_err;
+    }
+    undo_log_drop_last(log);
+  }
+
+  undo_log_free(log);
+  return err;
+}
+
+int bgctx_rollback(bg_context *ctx) {
+  EXCLUSIVE(ctx, rollback(ctx));
+}
+
+/* records are numbered by their place in the name index */
+static int index_password_tag(const char *tag, size_t length, void *_ctx) {
+  bg_context *ctx = _ctx;
+  return bg_tag_index_add(ctx->tag_index, tag, length, bg_name_index_count(ctx->search_index));
+}
+
+static int index_password_tags(bg_context *ctx, bg_password *password) {
+  bg_string *tags = NULL;
+  int err = 0;
+
+  if(!bg_password_crypted(password)) {
+    return bg_password_foreach_tag(password, &index_password_tag, ctx);
+  }
+  if(bg_string_length(bg_password_tags(password)) == 0) {
+    return 0; /* persisted before tags existed */
+  }
+
+  if((err = bg_decrypt_string_to(bg_password_tags(password), &tags, ctx->cryptor, ctx->secret_key))) {
+    return err;
+  }
+  err = bg_field_list_foreach(tags, &index_password_tag, ctx);
+  bg_string_clean_free(tags);
+
+  return err;
+}
+
+static int index_password(bg_password *password, void *_ctx) {
+  bg_context *ctx = _ctx;
+  bg_string *name = NULL;
+  int err = 0;
+
+  if((err = index_password_tags(ctx, password))) {
+    return err;
+  }
+
+  if(!bg_password_crypted(password)) {
+    return bg_name_index_add(ctx->search_index, bg_password_name(password));
+  }
+
+  if((err = bg_decrypt_string_to(bg_password_name(password), &name, ctx->cryptor, ctx->secret_key))) {
+    return err;
+  }
+  err = bg_name_index_add(ctx->search_index, name);
+  bg_string_clean_free(name);
+
+  return err;
+}
+
+/* built once from decrypted names and tags only, then kept until lock or repository change */
+static int build_indexes(bg_context *ctx) {
+  int err = 0;
+
+  pthread_mutex_lock(&ctx->index_lock);
+  if(ctx->search_index) {
+    goto end;
+  }
+
+  ctx->search_index = bg_name_index_new();
+  ctx->tag_index = bg_tag_index_new();
+  bg_name_index_reserve(ctx->search_index, bg_repository_count(ctx->repository));
+
+  if((err = bg_repository_foreach(ctx->repository, &index_password, ctx)) ||
+     (err = bg_name_index_build(ctx->search_index))) {
+    drop_indexes(ctx);
+  }
+
+end:
+  pthread_mutex_unlock(&ctx->index_lock);
+  return err;
+}
+
+static int search(bg_context *ctx, const bg_string *pattern, int flags,
+                  int (* callback)(const bg_string *name, void *), void *out) {
+  int err = 0;
+
+  RETURN_IF_UNSEALED(ctx);
+  RETURN_IF_LOCKED(ctx);
+
+  if((err = build_indexes(ctx))) {
+    return err;
+  }
+
+  return bg_name_index_search(ctx->search_index, pattern, flags, callback, out);
+}
+
+int bgctx_search(bg_context *ctx, const bg_string *pattern, int (* callback)(const bg_string *name, void *), void *out) {
+  SHARED(ctx, search(ctx, pattern, 0, callback, out));
+}
+
+int bgctx_search_prefix(bg_context *ctx, const bg_string *prefix, int (* callback)(const bg_string *name, void *), void *out) {
+  SHARED(ctx, search(ctx, prefix, BG_SEARCH_PREFIX, callback, out));
+}
+
+static int fuzzy_search(bg_context *ctx, const bg_string *pattern, size_t k, size_t max_distance,
+                       int (* callback)(const bg_string *name, size_t distance, void *), void *out) {
+  int err = 0;
+
+  RETURN_IF_UNSEALED(ctx);
+  RETURN_IF_LOCKED(ctx);
+
+  if((err = build_indexes(ctx))) {
+    return err;
+  }
+
+  return bg_name_index_fuzzy(ctx->search_index, pattern, k, max_distance, callback, out);
+}
+
+int bgctx_fuzzy_search(bg_context *ctx, const bg_string *pattern, size_t k, size_t max_distance,
+                       int (* callback)(const bg_string *name, size_t distance, void *), void *out) {
+  SHARED(ctx, fuzzy_search(ctx, pattern, k, max_distance, callback, out));
+}
+
+struct tagged_names {
+  bg_context *ctx;
+  int (* callback)(const bg_string *name, void *);
+  void *out;
+};
+
+static int call_with_name(size_t id, void *_tagged) {
+  struct tagged_names *tagged = _tagged;
+  return tagged->callback(bg_name_index_name(tagged->ctx->search_index, id), tagged->out);
+}
+
+static int list_tagged(bg_context *ctx, const bg_string * const *tags, size_t count,
+                      int (* callback)(const bg_string *name, void *), void *out) {
+  int err = 0;
+  struct tagged_names tagged = { .ctx = ctx, .callback = callback, .out = out };
+
+  RETURN_IF_UNSEALED(ctx);
+  RETURN_IF_LOCKED(ctx);
+
+  if((err = build_indexes(ctx))) {
+    return err;
+  }
+
+  return bg_tag_index_intersect(ctx->tag_index, tags, count, &call_with_name, &tagged);
+}
+
+int bgctx_list_tagged(bg_context *ctx, const bg_string * const *tags, size_t count,
+                      int (* callback)(const bg_string *name, void *), void *out) {
+  SHARED(ctx, list_tagged(ctx, tags, count, callback, out));
+}
+
+static int register_memory(bg_context *ctx, bg_string *key, void *mem, void (*mem_free)(void *)) {
   return bg_map_register_data(ctx->map, key, mem, mem_free);
 }
 
+int bgctx_register_memory(bg_context *ctx, bg_string *key, void *mem, void (*mem_free)(void *)) {
+  EXCLUSIVE(ctx, register_memory(ctx, key, mem, mem_free));
+}
+
 void *bgctx_get_memory(bg_context *ctx, bg_string *key) {
-  return bg_map_get_data(ctx->map, key);
+  pthread_rwlock_rdlock(&ctx->rwlock);
+  void *mem = bg_map_get_data(ctx->map, key);
+  pthread_rwlock_unlock(&ctx->rwlock);
+  return mem;
 }
@@ -19,3 +19,7 @@ int bg_cryptor_generate_iv(const bg_cryptor_t *cryptor, bg_iv_t **output) {
 size_t bg_cryptor_encrypted_length(const bg_cryptor_t *cryptor, size_t input_memlen) {
   return cryptor->encrypted_length(input_memlen);
 }
+
+unsigned int bg_cryptor_id(const bg_cryptor_t *cryptor) {
+  return cryptor->id;
+}
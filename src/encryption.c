@@ -1,9 +1,10 @@
 #include <string.h>
 #include <blurgather/string.h>
 #include <blurgather/cryptor.h>
+#include <blurgather/encryption.h>
 
 
-int bg_encrypt_string(bg_string **str, const bg_cryptor_t *cryptor, const bg_secret_key_t *key) {
+int bg_encrypt_string_to(const bg_string *str, bg_string **output, const bg_cryptor_t *cryptor, const bg_secret_key_t *key) {
   int err = 0;
   if(!cryptor) { return -1; }
   if(!key) { return -3; }
@@ -13,43 +14,42 @@ int bg_encrypt_string(bg_string **str, const bg_cryptor_t *cryptor, const bg_sec
     return err;
   }
 
-  size_t needed_length = bg_cryptor_encrypted_length(cryptor, bg_string_length(*str));
-  bg_string *buffer = bg_string_filled_with_length(0, needed_length);
-  memcpy((void*)bg_string_data(buffer), bg_string_data(*str), bg_string_length(*str));
+  size_t iv_length = bg_iv_length(iv);
+  size_t needed_length = bg_cryptor_encrypted_length(cryptor, bg_string_length(str));
+  bg_string *buffer = bg_string_filled_with_length(0, iv_length + needed_length);
+  memcpy((void*)bg_string_data(buffer), bg_iv_data(iv), iv_length);
+  memcpy((void*)bg_string_data(buffer) + iv_length, bg_string_data(str), bg_string_length(str));
 
   if((err = bg_cryptor_encrypt(cryptor,
-                               (void *)bg_string_data(buffer),
-                               bg_string_length(buffer),
+                               (void *)bg_string_data(buffer) + iv_length,
+                               needed_length,
                                key,
                                iv))) {
     bg_string_clean_free(buffer);
+    bg_iv_free(iv);
     return err;
   }
 
-  bg_string_clean_free(*str);
-  *str = bg_string_plus(bg_string_from_char_array(bg_iv_data(iv), bg_iv_length(iv)), buffer);
+  *output = buffer;
 
   bg_iv_free(iv);
   return 0;
 }
 
-int bg_decrypt_string(bg_string **str, const bg_cryptor_t *cryptor, const bg_secret_key_t *key) {
+int bg_decrypt_string_to(const bg_string *str, bg_string **output, const bg_cryptor_t *cryptor, const bg_secret_key_t *key) {
   int err = 0;
   if(!cryptor) { return -1; }
   if(!key) { return -3; }
 
-  bg_iv_t *iv;
-  bg_string *cr_str;
-  {
-    bg_string *lhs, *rhs;
-    if((err = bg_string_split_after(*str, bg_cryptor_iv_length(cryptor), &lhs, &rhs))) {
-      return err;
-    }
-    iv = bg_iv_new(bg_string_data(lhs), bg_string_length(lhs));
-    bg_string_free(lhs);
-    cr_str = rhs;
+  size_t iv_length = bg_cryptor_iv_length(cryptor);
+  if(iv_length > bg_string_length(str)) {
+    return -1;
   }
 
+  bg_iv_t *iv = bg_iv_new(bg_string_data(str), iv_length);
+  bg_string *cr_str = bg_string_from_char_array(bg_string_data(str) + iv_length,
+                                                bg_string_length(str) - iv_length);
+
   if((err = bg_cryptor_decrypt(cryptor,
                                (void *)bg_string_data(cr_str),
                                bg_string_length(cr_str),
@@ -61,9 +61,34 @@ int bg_decrypt_string(bg_string **str, const bg_cryptor_t *cryptor, const bg_sec
   }
   bg_string_strip_nuls(&cr_str);
 
-  bg_string_clean_free(*str);
-  *str = cr_str;
+  *output = cr_str;
 
   bg_iv_free(iv);
   return 0;
 }
+
+int bg_encrypt_string(bg_string **str, const bg_cryptor_t *cryptor, const bg_secret_key_t *key) {
+  int err = 0;
+  bg_string *output;
+
+  if((err = bg_encrypt_string_to(*str, &output, cryptor, key))) {
+    return err;
+  }
+
+  bg_string_clean_free(*str);
+  *str = output;
+  return 0;
+}
+
+int bg_decrypt_string(bg_string **str, const bg_cryptor_t *cryptor, const bg_secret_key_t *key) {
+  int err = 0;
+  bg_string *output;
+
+  if((err = bg_decrypt_string_to(*str, &output, cryptor, key))) {
+    return err;
+  }
+
+  bg_string_clean_free(*str);
+  *str = output;
+  return 0;
+}
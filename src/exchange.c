@@ -0,0 +1,236 @@
+#include <string.h>
+#include <blurgather/exchange.h>
+#include <blurgather/context.h>
+#include <blurgather/executor.h>
+#include "exchange_format.h"
+
+#define READ_CHUNK 65536
+#define CRYPT_CHUNK 64
+
+static const struct bg_exchange_format *exchange_format(int format) {
+  switch(format) {
+  case BG_EXCHANGE_CSV:
+    return &bg_exchange_csv_format;
+  case BG_EXCHANGE_JSON:
+    return &bg_exchange_json_format;
+  default:
+    return NULL;
+  }
+}
+
+int bg_exchange_write(bg_stream *output, const char *data, size_t length) {
+  if(length && bg_stream_write(output, data, length) != length) {
+    return BG_EXCHANGE_WRITE_FAILED;
+  }
+  return 0;
+}
+
+int bg_exchange_set_field(bg_password *password, int (* update)(bg_password *, bg_string *), bg_string *str) {
+  if(bg_string_empty(str)) {
+    bg_string_clean_free(str);
+    return 0;
+  }
+  return update(password, str);
+}
+
+/* plain text input, grown buffers are wiped before being released */
+static int read_all(bg_stream *input, char **data, size_t *length) {
+  size_t allocated = READ_CHUNK, read = 0, chunk;
+  char *buffer = malloc(allocated);
+  if(!buffer) {
+    return -4;
+  }
+
+  while((chunk = bg_stream_read(input, buffer + read, allocated - read)) > 0) {
+    read += chunk;
+    if(read < allocated) {
+      continue;
+    }
+
+    char *grown = malloc(allocated * 2);
+    if(!grown) {
+      memset(buffer, 0, read);
+      free(buffer);
+      return -4;
+    }
+    memcpy(grown, buffer, read);
+    memset(buffer, 0, read);
+    free(buffer);
+    buffer = grown;
+    allocated *= 2;
+  }
+
+  *data = buffer;
+  *length = read;
+  return 0;
+}
+
+struct batch {
+  bg_password **passwords;
+  size_t count;
+  size_t allocated;
+};
+
+static int batch_add(bg_password *password, void *_batch) {
+  struct batch *batch = _batch;
+
+  if(batch->count == batch->allocated) {
+    size_t allocated = batch->allocated ? batch->allocated * 2 : 256;
+    bg_password **passwords = realloc(batch->passwords, allocated * sizeof(bg_password *));
+    if(!passwords) {
+      bg_password_free(password);
+      return -4;
+    }
+    batch->passwords = passwords;
+    batch->allocated = allocated;
+  }
+
+  batch->passwords[batch->count++] = password;
+  return 0;
+}
+
+static void batch_free(struct batch *batch) {
+  size_t i;
+  for(i = 0; i < batch->count; ++i) {
+    bg_password_free(batch->passwords[i]);
+  }
+  free(batch->passwords);
+}
+
+struct crypt_job {
+  bg_context *ctx;
+  struct batch *batch;
+};
+
+static int crypt_range(size_t begin, size_t end, void *_job) {
+  struct crypt_job *job = _job;
+  size_t i;
+
+  for(i = begin; i < end; ++i) {
+    int err = 0;
+    if((err = bgctx_encrypt_password(job->ctx, job->batch->passwords[i]))) {
+      return err;
+    }
+  }
+  return 0;
+}
+
+/* context executor unless a thread count is asked for */
+static int crypt_batch(bg_context *ctx, struct batch *batch, size_t threads) {
+  struct crypt_job job = { ctx, batch };
+  bg_executor *executor = threads ? NULL : bgctx_executor(ctx);
+  int err = 0;
+
+  if(executor) {
+    return bg_executor_for(executor, batch->count, CRYPT_CHUNK, &crypt_range, &job);
+  }
+  if(threads == 1 || batch->count <= CRYPT_CHUNK) {
+    return crypt_range(0, batch->count, &job);
+  }
+
+  if(!(executor = bg_executor_new(threads))) {
+    return -4;
+  }
+  err = bg_executor_for(executor, batch->count, CRYPT_CHUNK, &crypt_range, &job);
+  bg_executor_free(executor);
+
+  return err;
+}
+
+static int add_batch(bg_context *ctx, struct batch *batch) {
+  int err = 0, own_transaction = !bgctx_in_transaction(ctx);
+
+  if(own_transaction && (err = bgctx_begin(ctx))) {
+    return err;
+  }
+
+  if((err = bgctx_add_passwords(ctx, batch->passwords, batch->count))) {
+    if(own_transaction) {
+      bgctx_rollback(ctx);
+    }
+    return err;
+  }
+  /* repository took them */
+  batch->count = 0;
+
+  if(own_transaction && (err = bgctx_commit(ctx))) {
+    return err;
+  }
+  return 0;
+}
+
+int bgctx_import(bg_context *ctx, bg_stream *input, int format, size_t threads, size_t *imported) {
+  const struct bg_exchange_format *exchange = exchange_format(format);
+  struct batch batch = { NULL, 0, 0 };
+  char *data = NULL;
+  size_t length = 0, count;
+  int err = 0;
+
+  if(!exchange) {
+    return -6;
+  }
+  if(bgctx_locked(ctx)) {
+    return -2;
+  }
+
+  if((err = read_all(input, &data, &length))) {
+    return err;
+  }
+  err = exchange->parse(data, length, &batch_add, &batch);
+  memset(data, 0, length);
+  free(data);
+  if(err) {
+    goto end;
+  }
+
+  if((err = crypt_batch(ctx, &batch, threads))) {
+    goto end;
+  }
+
+  count = batch.count;
+  if((err = add_batch(ctx, &batch))) {
+    goto end;
+  }
+  if(imported) {
+    *imported = count;
+  }
+
+end:
+  batch_free(&batch);
+  return err;
+}
+
+struct export_state {
+  bg_stream *output;
+  const struct bg_exchange_format *exchange;
+  size_t index;
+};
+
+static int export_password(bg_password *plain, void *_state) {
+  struct export_state *state = _state;
+  int err = 0;
+
+  if(!(err = state->exchange->write(state->output, plain, state->index))) {
+    ++state->index;
+  }
+  return err;
+}
+
+int bgctx_export(bg_context *ctx, bg_stream *output, int format) {
+  struct export_state state = { output, exchange_format(format), 0 };
+  int err = 0;
+
+  if(!state.exchange) {
+    return -6;
+  }
+  if(bgctx_locked(ctx)) {
+    return -2;
+  }
+
+  if((err = state.exchange->begin(output)) ||
+     (err = bgctx_each_decrypted_password(ctx, &export_password, &state)) ||
+     (err = state.exchange->end(output))) {
+    return err;
+  }
+  return bg_stream_flush(output) ? BG_EXCHANGE_WRITE_FAILED : 0;
+}
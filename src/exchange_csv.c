@@ -0,0 +1,379 @@
+#include <string.h>
+#include "exchange_format.h"
+
+/* rfc 4180 fields, rows ending with either \n or \r\n. within tags and
+   metadata lists, '\\' escapes a following ';', '=' or '\\' */
+
+enum csv_column {
+  CSV_IGNORED,
+  CSV_NAME,
+  CSV_DESCRIPTION,
+  CSV_VALUE,
+  CSV_TAGS,
+  CSV_METADATA
+};
+
+static const char *csv_columns[] = { NULL, "name", "description", "value", "tags", "metadata" };
+#define CSV_COLUMNS (sizeof(csv_columns) / sizeof(const char *))
+
+struct csv_cursor {
+  const char *data;
+  const char *end;
+};
+
+/* reads one field, unquoting it. last is set once row is over */
+static int csv_field(struct csv_cursor *cursor, bg_string **field, int *last) {
+  const char *p = cursor->data;
+  bg_string *out = NULL;
+
+  if(p < cursor->end && *p == '"') {
+    out = bg_string_new();
+    ++p;
+    while(1) {
+      const char *quote = memchr(p, '"', cursor->end - p);
+      if(!quote) {
+        bg_string_clean_free(out);
+        return BG_EXCHANGE_MALFORMED;
+      }
+      bg_string_cat_char_array(&out, p, quote - p);
+      p = quote + 1;
+
+      if(p < cursor->end && *p == '"') { /* escaped quote */
+        bg_string_cat_char_array(&out, "\"", 1);
+        ++p;
+      } else {
+        break;
+      }
+    }
+  } else {
+    const char *start = p;
+    while(p < cursor->end && *p != ',' && *p != '\n' && *p != '\r') {
+      ++p;
+    }
+    out = bg_string_from_char_array(start, p - start);
+  }
+
+  if(p == cursor->end) {
+    *last = 1;
+  } else if(*p == ',') {
+    *last = 0;
+    ++p;
+  } else if(*p == '\n' || *p == '\r') {
+    *last = 1;
+    p += (*p == '\r' && p + 1 < cursor->end && p[1] == '\n') ? 2 : 1;
+  } else { /* text after closing quote */
+    bg_string_clean_free(out);
+    return BG_EXCHANGE_MALFORMED;
+  }
+
+  cursor->data = p;
+  *field = out;
+  return 0;
+}
+
+static enum csv_column csv_column(const bg_string *name) {
+  size_t i;
+  for(i = 1; i < CSV_COLUMNS; ++i) {
+    if(strcmp(bg_string_data(name), csv_columns[i]) == 0) {
+      return (enum csv_column)i;
+    }
+  }
+  return CSV_IGNORED;
+}
+
+static int csv_header(struct csv_cursor *cursor, enum csv_column **columns, size_t *count) {
+  int err = 0;
+  int last = 0;
+  size_t allocated = 0;
+  *columns = NULL;
+  *count = 0;
+
+  while(!last) {
+    bg_string *name = NULL;
+    if((err = csv_field(cursor, &name, &last))) {
+      return err;
+    }
+
+    if(*count == allocated) {
+      allocated = allocated ? allocated * 2 : 8;
+      enum csv_column *grown = realloc(*columns, allocated * sizeof(enum csv_column));
+      if(!grown) {
+        bg_string_free(name);
+        return -4;
+      }
+      *columns = grown;
+    }
+    (*columns)[(*count)++] = csv_column(name);
+    bg_string_free(name);
+  }
+
+  return 0;
+}
+
+/* first separator not escaped between data and end, NULL when none */
+static const char *csv_unescaped(const char *data, const char *end, char separator) {
+  for(; data < end; ++data) {
+    if(*data == '\\') {
+      if(++data == end) {
+        break;
+      }
+    } else if(*data == separator) {
+      return data;
+    }
+  }
+  return NULL;
+}
+
+static bg_string *csv_unescape(const char *data, size_t length) {
+  const char *end = data + length;
+  bg_string *out = bg_string_new();
+
+  while(data < end) {
+    const char *escape = memchr(data, '\\', end - data);
+    const char *chunk_end = escape ? escape : end;
+    bg_string_cat_char_array(&out, data, chunk_end - data);
+    if(!escape) {
+      break;
+    }
+    data = escape + 1;
+    if(data < end) {
+      bg_string_cat_char_array(&out, data++, 1);
+    }
+  }
+
+  return out;
+}
+
+/* splits on unescaped ';', calling add on non empty parts */
+static int csv_split(const bg_string *list, bg_password *password, int (* add)(bg_password *, const char *, size_t)) {
+  const char *item = bg_string_data(list);
+  const char *end = item + bg_string_length(list);
+  int err = 0;
+
+  while(item < end) {
+    const char *separator = csv_unescaped(item, end, ';');
+    size_t length = (separator ? separator : end) - item;
+
+    if(length && (err = add(password, item, length))) {
+      return err;
+    }
+    item += length + 1;
+  }
+
+  return 0;
+}
+
+static int csv_add_tag(bg_password *password, const char *item, size_t length) {
+  bg_string *tag = csv_unescape(item, length);
+  int err = bg_password_add_tag(password, tag);
+  bg_string_clean_free(tag);
+  return err ? BG_EXCHANGE_MALFORMED : 0;
+}
+
+static int csv_add_metadata(bg_password *password, const char *item, size_t length) {
+  const char *equal = csv_unescaped(item, item + length, '=');
+  if(!equal) {
+    return BG_EXCHANGE_MALFORMED;
+  }
+
+  bg_string *key = csv_unescape(item, equal - item);
+  bg_string *value = csv_unescape(equal + 1, length - (equal - item) - 1);
+  int err = bg_password_set_metadata(password, key, value);
+  bg_string_clean_free(key);
+  bg_string_clean_free(value);
+
+  return err ? BG_EXCHANGE_MALFORMED : 0;
+}
+
+/* takes field */
+static int csv_apply(bg_password *password, enum csv_column column, bg_string *field) {
+  int err = 0;
+
+  switch(column) {
+  case CSV_NAME:
+    return bg_exchange_set_field(password, &bg_password_update_name, field);
+  case CSV_DESCRIPTION:
+    return bg_exchange_set_field(password, &bg_password_update_description, field);
+  case CSV_VALUE:
+    return bg_exchange_set_field(password, &bg_password_update_value, field);
+  case CSV_TAGS:
+    err = csv_split(field, password, &csv_add_tag);
+    break;
+  case CSV_METADATA:
+    err = csv_split(field, password, &csv_add_metadata);
+    break;
+  case CSV_IGNORED:
+    break;
+  }
+
+  bg_string_clean_free(field);
+  return err;
+}
+
+static int csv_row(struct csv_cursor *cursor, const enum csv_column *columns, size_t count, bg_password **output) {
+  int err = 0;
+  int last = 0;
+  size_t i;
+  bg_password *password = bg_password_new();
+
+  for(i = 0; !last; ++i) {
+    bg_string *field = NULL;
+    if((err = csv_field(cursor, &field, &last)) ||
+       (err = csv_apply(password, i < count ? columns[i] : CSV_IGNORED, field))) {
+      bg_password_free(password);
+      return err;
+    }
+  }
+
+  if(i == 1 && bg_string_empty(bg_password_name(password))) { /* blank line */
+    bg_password_free(password);
+    *output = NULL;
+    return 0;
+  }
+  if(bg_string_empty(bg_password_name(password))) {
+    bg_password_free(password);
+    return BG_EXCHANGE_MALFORMED;
+  }
+
+  *output = password;
+  return 0;
+}
+
+static int csv_parse(const char *data, size_t length, int (* add)(bg_password *password, void *), void *out) {
+  struct csv_cursor cursor = { .data = data, .end = data + length };
+  enum csv_column *columns = NULL;
+  size_t count = 0;
+  int err = 0;
+
+  if((err = csv_header(&cursor, &columns, &count))) {
+    free(columns);
+    return err;
+  }
+
+  while(cursor.data < cursor.end) {
+    bg_password *password = NULL;
+    if((err = csv_row(&cursor, columns, count, &password))) {
+      break;
+    }
+    if(password && (err = add(password, out))) {
+      break;
+    }
+  }
+
+  free(columns);
+  return err;
+}
+
+
+/* writer */
+
+static int csv_write_field(bg_stream *output, const char *data, size_t length, int last) {
+  int err = 0;
+  size_t i;
+
+  for(i = 0; i < length; ++i) {
+    if(data[i] == ',' || data[i] == '"' || data[i] == '\n' || data[i] == '\r') {
+      break;
+    }
+  }
+
+  /* plain field and separator in one go */
+  if(i == length) {
+    struct iovec segments[2] = { { (void *)data, length }, { (void *)(last ? "\n" : ","), 1 } };
+    return bg_stream_writev(output, segments, 2) == length + 1 ? 0 : BG_EXCHANGE_WRITE_FAILED;
+  }
+
+  if(!(err = bg_exchange_write(output, "\"", 1))) {
+    const char *end = data + length;
+    while(!err && data < end) {
+      const char *quote = memchr(data, '"', end - data);
+      size_t chunk = (quote ? quote + 1 : end) - data;
+      if(!(err = bg_exchange_write(output, data, chunk)) && quote) {
+        err = bg_exchange_write(output, "\"", 1); /* doubled */
+      }
+      data += chunk;
+    }
+    if(!err) {
+      err = bg_exchange_write(output, "\"", 1);
+    }
+  }
+
+  if(!err) {
+    err = bg_exchange_write(output, last ? "\n" : ",", 1);
+  }
+  return err;
+}
+
+/* appends data escaping list separators */
+static void csv_join_escaped(bg_string **joined, const char *data, size_t length) {
+  const char *end = data + length;
+  const char *plain = data;
+
+  for(; data < end; ++data) {
+    if(*data == ';' || *data == '=' || *data == '\\') {
+      bg_string_cat_char_array(joined, plain, data - plain);
+      bg_string_cat_char_array(joined, "\\", 1);
+      plain = data;
+    }
+  }
+  bg_string_cat_char_array(joined, plain, end - plain);
+}
+
+static int csv_join_tag(const char *tag, size_t length, void *_joined) {
+  bg_string **joined = _joined;
+  if(bg_string_length(*joined)) {
+    bg_string_cat_char_array(joined, ";", 1);
+  }
+  csv_join_escaped(joined, tag, length);
+  return 0;
+}
+
+static int csv_join_metadata(const char *key, size_t key_length, const char *value, size_t value_length, void *_joined) {
+  bg_string **joined = _joined;
+  if(bg_string_length(*joined)) {
+    bg_string_cat_char_array(joined, ";", 1);
+  }
+  csv_join_escaped(joined, key, key_length);
+  bg_string_cat_char_array(joined, "=", 1);
+  csv_join_escaped(joined, value, value_length);
+  return 0;
+}
+
+static int csv_write_string(bg_stream *output, const bg_string *str, int last) {
+  return csv_write_field(output, bg_string_data(str), bg_string_length(str), last);
+}
+
+static int csv_begin(bg_stream *output) {
+  return bg_exchange_write_str(output, "name,description,value,tags,metadata\n");
+}
+
+static int csv_write(bg_stream *output, const bg_password *password, size_t index) {
+  int err = 0;
+  bg_string *tags = bg_string_new();
+  bg_string *metadata = bg_string_new();
+
+  bg_password_foreach_tag(password, &csv_join_tag, &tags);
+  bg_password_foreach_metadata(password, &csv_join_metadata, &metadata);
+
+  if(!(err = csv_write_string(output, bg_password_name(password), 0)) &&
+     !(err = csv_write_string(output, bg_password_description(password), 0)) &&
+     !(err = csv_write_string(output, bg_password_value(password), 0)) &&
+     !(err = csv_write_string(output, tags, 0))) {
+    err = csv_write_string(output, metadata, 1);
+  }
+
+  bg_string_clean_free(tags);
+  bg_string_clean_free(metadata);
+  return err;
+}
+
+static int csv_end(bg_stream *output) {
+  return 0;
+}
+
+const struct bg_exchange_format bg_exchange_csv_format = {
+  .parse = &csv_parse,
+  .begin = &csv_begin,
+  .write = &csv_write,
+  .end   = &csv_end,
+};
@@ -0,0 +1,31 @@
+#ifndef _BLURGATHER_EXCHANGE_FORMAT_H_
+#define _BLURGATHER_EXCHANGE_FORMAT_H_
+
+#include <blurgather/password.h>
+#include <blurgather/stream.h>
+
+/* errors */
+#define BG_EXCHANGE_MALFORMED -5
+#define BG_EXCHANGE_WRITE_FAILED -7
+
+/* parse hands plain text passwords over to add, which takes them.
+   writers are given plain text passwords, index being their place in output */
+struct bg_exchange_format {
+  int (* parse)(const char *data, size_t length, int (* add)(bg_password *password, void *), void *out);
+
+  int (* begin)(bg_stream *output);
+  int (* write)(bg_stream *output, const bg_password *password, size_t index);
+  int (* end)(bg_stream *output);
+};
+
+extern const struct bg_exchange_format bg_exchange_csv_format;
+extern const struct bg_exchange_format bg_exchange_json_format;
+
+/* shared by formats */
+int bg_exchange_write(bg_stream *output, const char *data, size_t length);
+#define bg_exchange_write_str(output, str) bg_exchange_write(output, str, strlen(str))
+
+/* takes str, empty ones are dropped */
+int bg_exchange_set_field(bg_password *password, int (* update)(bg_password *, bg_string *), bg_string *str);
+
+#endif
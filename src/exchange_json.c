@@ -0,0 +1,481 @@
+#include <string.h>
+#include <stdio.h>
+#include "exchange_format.h"
+
+/* just enough json for an array of password objects: unknown members are
+   skipped whatever their value, strings are expected to be utf-8 */
+
+#define JSON_MAX_DEPTH 64
+
+struct json_cursor {
+  const char *p;
+  const char *end;
+};
+
+static void json_skip_spaces(struct json_cursor *cursor) {
+  while(cursor->p < cursor->end &&
+        (*cursor->p == ' ' || *cursor->p == '\t' || *cursor->p == '\n' || *cursor->p == '\r')) {
+    ++cursor->p;
+  }
+}
+
+/* consumes c, after spaces */
+static int json_expect(struct json_cursor *cursor, char c) {
+  json_skip_spaces(cursor);
+  if(cursor->p == cursor->end || *cursor->p != c) {
+    return BG_EXCHANGE_MALFORMED;
+  }
+  ++cursor->p;
+  return 0;
+}
+
+/* consumes c if it is next, after spaces */
+static int json_accept(struct json_cursor *cursor, char c) {
+  json_skip_spaces(cursor);
+  if(cursor->p < cursor->end && *cursor->p == c) {
+    ++cursor->p;
+    return 1;
+  }
+  return 0;
+}
+
+static int json_hex4(struct json_cursor *cursor, unsigned int *code) {
+  int i;
+  *code = 0;
+
+  if(cursor->end - cursor->p < 4) {
+    return BG_EXCHANGE_MALFORMED;
+  }
+  for(i = 0; i < 4; ++i) {
+    char c = *cursor->p++;
+    *code <<= 4;
+    if(c >= '0' && c <= '9') { *code |= c - '0'; }
+    else if(c >= 'a' && c <= 'f') { *code |= c - 'a' + 10; }
+    else if(c >= 'A' && c <= 'F') { *code |= c - 'A' + 10; }
+    else { return BG_EXCHANGE_MALFORMED; }
+  }
+  return 0;
+}
+
+static void json_cat_utf8(bg_string **str, unsigned int code) {
+  char utf8[4];
+  size_t length;
+
+  if(code < 0x80) {
+    utf8[0] = code;
+    length = 1;
+  } else if(code < 0x800) {
+    utf8[0] = 0xc0 | (code >> 6);
+    utf8[1] = 0x80 | (code & 0x3f);
+    length = 2;
+  } else if(code < 0x10000) {
+    utf8[0] = 0xe0 | (code >> 12);
+    utf8[1] = 0x80 | ((code >> 6) & 0x3f);
+    utf8[2] = 0x80 | (code & 0x3f);
+    length = 3;
+  } else {
+    utf8[0] = 0xf0 | (code >> 18);
+    utf8[1] = 0x80 | ((code >> 12) & 0x3f);
+    utf8[2] = 0x80 | ((code >> 6) & 0x3f);
+    utf8[3] = 0x80 | (code & 0x3f);
+    length = 4;
+  }
+
+  bg_string_cat_char_array(str, utf8, length);
+}
+
+static int json_escape(struct json_cursor *cursor, bg_string **str) {
+  unsigned int code, low;
+  int err = 0;
+
+  if(cursor->p == cursor->end) {
+    return BG_EXCHANGE_MALFORMED;
+  }
+
+  switch(*cursor->p++) {
+  case '"':  bg_string_cat_char_array(str, "\"", 1); return 0;
+  case '\\': bg_string_cat_char_array(str, "\\", 1); return 0;
+  case '/':  bg_string_cat_char_array(str, "/", 1); return 0;
+  case 'b':  bg_string_cat_char_array(str, "\b", 1); return 0;
+  case 'f':  bg_string_cat_char_array(str, "\f", 1); return 0;
+  case 'n':  bg_string_cat_char_array(str, "\n", 1); return 0;
+  case 'r':  bg_string_cat_char_array(str, "\r", 1); return 0;
+  case 't':  bg_string_cat_char_array(str, "\t", 1); return 0;
+  case 'u':
+    if((err = json_hex4(cursor, &code))) {
+      return err;
+    }
+    if(code >= 0xd800 && code < 0xdc00) { /* surrogate pair */
+      if(cursor->end - cursor->p < 2 || cursor->p[0] != '\\' || cursor->p[1] != 'u') {
+        return BG_EXCHANGE_MALFORMED;
+      }
+      cursor->p += 2;
+      if((err = json_hex4(cursor, &low)) || low < 0xdc00 || low >= 0xe000) {
+        return BG_EXCHANGE_MALFORMED;
+      }
+      code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+    }
+    json_cat_utf8(str, code);
+    return 0;
+  }
+
+  return BG_EXCHANGE_MALFORMED;
+}
+
+static int json_string(struct json_cursor *cursor, bg_string **output) {
+  int err = 0;
+
+  if((err = json_expect(cursor, '"'))) {
+    return err;
+  }
+
+  bg_string *str = bg_string_new();
+  while(1) {
+    const char *start = cursor->p;
+    while(cursor->p < cursor->end && *cursor->p != '"' && *cursor->p != '\\' &&
+          (unsigned char)*cursor->p >= 0x20) {
+      ++cursor->p;
+    }
+    bg_string_cat_char_array(&str, start, cursor->p - start);
+
+    if(cursor->p == cursor->end || (unsigned char)*cursor->p < 0x20) {
+      err = BG_EXCHANGE_MALFORMED;
+      break;
+    }
+    if(*cursor->p++ == '"') {
+      break;
+    }
+    if((err = json_escape(cursor, &str))) {
+      break;
+    }
+  }
+
+  if(err) {
+    bg_string_clean_free(str);
+    return err;
+  }
+
+  *output = str;
+  return 0;
+}
+
+static int json_skip_value(struct json_cursor *cursor, int depth);
+
+static int json_skip_members(struct json_cursor *cursor, char close, int depth) {
+  int err = 0;
+
+  if(json_accept(cursor, close)) {
+    return 0;
+  }
+
+  do {
+    if(close == '}') {
+      bg_string *key = NULL;
+      if((err = json_string(cursor, &key))) {
+        return err;
+      }
+      bg_string_free(key);
+      if((err = json_expect(cursor, ':'))) {
+        return err;
+      }
+    }
+    if((err = json_skip_value(cursor, depth + 1))) {
+      return err;
+    }
+  } while(json_accept(cursor, ','));
+
+  return json_expect(cursor, close);
+}
+
+static int json_skip_value(struct json_cursor *cursor, int depth) {
+  bg_string *str = NULL;
+  int err = 0;
+
+  if(depth > JSON_MAX_DEPTH) {
+    return BG_EXCHANGE_MALFORMED;
+  }
+
+  json_skip_spaces(cursor);
+  if(cursor->p == cursor->end) {
+    return BG_EXCHANGE_MALFORMED;
+  }
+
+  switch(*cursor->p) {
+  case '"':
+    if(!(err = json_string(cursor, &str))) {
+      bg_string_clean_free(str);
+    }
+    return err;
+  case '{':
+    ++cursor->p;
+    return json_skip_members(cursor, '}', depth);
+  case '[':
+    ++cursor->p;
+    return json_skip_members(cursor, ']', depth);
+  }
+
+  /* numbers and literals */
+  const char *start = cursor->p;
+  while(cursor->p < cursor->end && *cursor->p && strchr("+-.0123456789eEtrufalsn", *cursor->p)) {
+    ++cursor->p;
+  }
+  return cursor->p == start ? BG_EXCHANGE_MALFORMED : 0;
+}
+
+static int json_tags(struct json_cursor *cursor, bg_password *password) {
+  int err = 0;
+
+  if((err = json_expect(cursor, '['))) {
+    return err;
+  }
+  if(json_accept(cursor, ']')) {
+    return 0;
+  }
+
+  do {
+    bg_string *tag = NULL;
+    if((err = json_string(cursor, &tag))) {
+      return err;
+    }
+    err = bg_password_add_tag(password, tag);
+    bg_string_clean_free(tag);
+    if(err) {
+      return BG_EXCHANGE_MALFORMED;
+    }
+  } while(json_accept(cursor, ','));
+
+  return json_expect(cursor, ']');
+}
+
+static int json_metadata(struct json_cursor *cursor, bg_password *password) {
+  int err = 0;
+
+  if((err = json_expect(cursor, '{'))) {
+    return err;
+  }
+  if(json_accept(cursor, '}')) {
+    return 0;
+  }
+
+  do {
+    bg_string *key = NULL;
+    bg_string *value = NULL;
+    if((err = json_string(cursor, &key))) {
+      return err;
+    }
+    if((err = json_expect(cursor, ':')) || (err = json_string(cursor, &value))) {
+      bg_string_clean_free(key);
+      return err;
+    }
+    err = bg_password_set_metadata(password, key, value);
+    bg_string_clean_free(key);
+    bg_string_clean_free(value);
+    if(err) {
+      return BG_EXCHANGE_MALFORMED;
+    }
+  } while(json_accept(cursor, ','));
+
+  return json_expect(cursor, '}');
+}
+
+static int json_member(struct json_cursor *cursor, const bg_string *key, bg_password *password) {
+  int (* update)(bg_password *, bg_string *) = NULL;
+  bg_string *str = NULL;
+  int err = 0;
+
+  if(strcmp(bg_string_data(key), "name") == 0) {
+    update = &bg_password_update_name;
+  } else if(strcmp(bg_string_data(key), "description") == 0) {
+    update = &bg_password_update_description;
+  } else if(strcmp(bg_string_data(key), "value") == 0) {
+    update = &bg_password_update_value;
+  } else if(strcmp(bg_string_data(key), "tags") == 0) {
+    return json_tags(cursor, password);
+  } else if(strcmp(bg_string_data(key), "metadata") == 0) {
+    return json_metadata(cursor, password);
+  } else {
+    return json_skip_value(cursor, 2);
+  }
+
+  if((err = json_string(cursor, &str))) {
+    return err;
+  }
+  return bg_exchange_set_field(password, update, str);
+}
+
+static int json_record(struct json_cursor *cursor, bg_password **output) {
+  int err = 0;
+  bg_password *password = bg_password_new();
+
+  if((err = json_expect(cursor, '{'))) {
+    bg_password_free(password);
+    return err;
+  }
+
+  if(!json_accept(cursor, '}')) {
+    do {
+      bg_string *key = NULL;
+      if((err = json_string(cursor, &key))) {
+        break;
+      }
+      if(!(err = json_expect(cursor, ':'))) {
+        err = json_member(cursor, key, password);
+      }
+      bg_string_free(key);
+    } while(!err && json_accept(cursor, ','));
+
+    if(!err) {
+      err = json_expect(cursor, '}');
+    }
+  }
+
+  if(!err && bg_string_empty(bg_password_name(password))) {
+    err = BG_EXCHANGE_MALFORMED;
+  }
+  if(err) {
+    bg_password_free(password);
+    return err;
+  }
+
+  *output = password;
+  return 0;
+}
+
+static int json_parse(const char *data, size_t length, int (* add)(bg_password *password, void *), void *out) {
+  struct json_cursor cursor = { .p = data, .end = data + length };
+  int err = 0;
+
+  if((err = json_expect(&cursor, '['))) {
+    return err;
+  }
+
+  if(!json_accept(&cursor, ']')) {
+    do {
+      bg_password *password = NULL;
+      if((err = json_record(&cursor, &password)) || (err = add(password, out))) {
+        return err;
+      }
+    } while(json_accept(&cursor, ','));
+
+    if((err = json_expect(&cursor, ']'))) {
+      return err;
+    }
+  }
+
+  json_skip_spaces(&cursor);
+  return cursor.p == cursor.end ? 0 : BG_EXCHANGE_MALFORMED;
+}
+
+
+/* writer */
+
+static int json_write_string(bg_stream *output, const char *data, size_t length) {
+  int err = 0;
+  const char *end = data + length;
+
+  if((err = bg_exchange_write(output, "\"", 1))) {
+    return err;
+  }
+
+  while(!err && data < end) {
+    const char *start = data;
+    while(data < end && *data != '"' && *data != '\\' && (unsigned char)*data >= 0x20) {
+      ++data;
+    }
+    if((err = bg_exchange_write(output, start, data - start)) || data == end) {
+      break;
+    }
+
+    char escaped[7];
+    switch(*data) {
+    case '"':  strcpy(escaped, "\\\""); break;
+    case '\\': strcpy(escaped, "\\\\"); break;
+    case '\n': strcpy(escaped, "\\n"); break;
+    case '\r': strcpy(escaped, "\\r"); break;
+    case '\t': strcpy(escaped, "\\t"); break;
+    default:   snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*data); break;
+    }
+    err = bg_exchange_write_str(output, escaped);
+    ++data;
+  }
+
+  if(!err) {
+    err = bg_exchange_write(output, "\"", 1);
+  }
+  return err;
+}
+
+static int json_write_member(bg_stream *output, const char *key, const bg_string *value) {
+  int err = 0;
+
+  if(!(err = bg_exchange_write_str(output, ", \"")) &&
+     !(err = bg_exchange_write_str(output, key)) &&
+     !(err = bg_exchange_write_str(output, "\": "))) {
+    err = json_write_string(output, bg_string_data(value), bg_string_length(value));
+  }
+  return err;
+}
+
+struct json_list {
+  bg_stream *output;
+  size_t count;
+};
+
+static int json_write_tag(const char *tag, size_t length, void *_list) {
+  struct json_list *list = _list;
+  int err = 0;
+
+  if(list->count++ && (err = bg_exchange_write_str(list->output, ", "))) {
+    return err;
+  }
+  return json_write_string(list->output, tag, length);
+}
+
+static int json_write_metadata(const char *key, size_t key_length, const char *value, size_t value_length, void *_list) {
+  struct json_list *list = _list;
+  int err = 0;
+
+  if(list->count++ && (err = bg_exchange_write_str(list->output, ", "))) {
+    return err;
+  }
+  if(!(err = json_write_string(list->output, key, key_length)) &&
+     !(err = bg_exchange_write_str(list->output, ": "))) {
+    err = json_write_string(list->output, value, value_length);
+  }
+  return err;
+}
+
+static int json_begin(bg_stream *output) {
+  return bg_exchange_write_str(output, "[");
+}
+
+static int json_write(bg_stream *output, const bg_password *password, size_t index) {
+  struct json_list tags = { .output = output, .count = 0 };
+  struct json_list metadata = { .output = output, .count = 0 };
+  const bg_string *name = bg_password_name(password);
+  int err = 0;
+
+  if(!(err = bg_exchange_write_str(output, index ? ",\n  {\"name\": " : "\n  {\"name\": ")) &&
+     !(err = json_write_string(output, bg_string_data(name), bg_string_length(name))) &&
+     !(err = json_write_member(output, "description", bg_password_description(password))) &&
+     !(err = json_write_member(output, "value", bg_password_value(password))) &&
+     !(err = bg_exchange_write_str(output, ", \"tags\": [")) &&
+     !(err = bg_password_foreach_tag(password, &json_write_tag, &tags)) &&
+     !(err = bg_exchange_write_str(output, "], \"metadata\": {")) &&
+     !(err = bg_password_foreach_metadata(password, &json_write_metadata, &metadata))) {
+    err = bg_exchange_write_str(output, "}}");
+  }
+
+  return err;
+}
+
+static int json_end(bg_stream *output) {
+  return bg_exchange_write_str(output, "\n]\n");
+}
+
+const struct bg_exchange_format bg_exchange_json_format = {
+  .parse = &json_parse,
+  .begin = &json_begin,
+  .write = &json_write,
+  .end   = &json_end,
+};
@@ -0,0 +1,333 @@
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <blurgather/executor.h>
+
+/* tasks waited on together */
+struct group {
+  int (* range)(size_t begin, size_t end, void *data); /* NULL for submitted tasks */
+  void *data;
+  size_t grain;
+  size_t pending;
+  int error;
+};
+
+struct task {
+  struct group *group;
+  void (* function)(void *data); /* submitted task, range of group otherwise */
+  void *data;
+  size_t begin;
+  size_t end;
+};
+
+/* owner pushes and pops at back, thieves take from front */
+struct deque {
+  pthread_mutex_t lock;
+  struct task *tasks;
+  size_t head;
+  size_t count;
+  size_t allocated;
+};
+
+struct worker {
+  bg_executor *executor;
+  size_t index;
+  pthread_t thread;
+};
+
+struct bg_executor {
+  size_t threads;
+  struct worker *workers;
+  size_t started;
+
+  /* one per worker, last one for other threads */
+  struct deque *deques;
+  size_t queued;
+  struct group submitted;
+
+  /* idle threads sleep on wake, which is signaled on push and group completion */
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int stopping;
+};
+
+
+static int deque_push(struct deque *deque, const struct task *task) {
+  int err = 0;
+
+  pthread_mutex_lock(&deque->lock);
+  if(deque->count == deque->allocated) {
+    size_t allocated = deque->allocated ? deque->allocated * 2 : 64;
+    struct task *tasks = malloc(allocated * sizeof(struct task));
+    if(!tasks) {
+      err = -1;
+      goto end;
+    }
+    size_t i;
+    for(i = 0; i < deque->count; ++i) {
+      tasks[i] = deque->tasks[(deque->head + i) % deque->allocated];
+    }
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->head = 0;
+    deque->allocated = allocated;
+  }
+
+  deque->tasks[(deque->head + deque->count++) % deque->allocated] = *task;
+
+end:
+  pthread_mutex_unlock(&deque->lock);
+  return err;
+}
+
+static int deque_take(struct deque *deque, int back, struct task *task) {
+  int taken = 0;
+
+  pthread_mutex_lock(&deque->lock);
+  if(deque->count) {
+    if(back) {
+      *task = deque->tasks[(deque->head + deque->count - 1) % deque->allocated];
+    } else {
+      *task = deque->tasks[deque->head];
+      deque->head = (deque->head + 1) % deque->allocated;
+    }
+    --deque->count;
+    taken = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+
+  return taken;
+}
+
+static void notify(bg_executor *self, int all) {
+  pthread_mutex_lock(&self->lock);
+  if(all) {
+    pthread_cond_broadcast(&self->wake);
+  } else {
+    pthread_cond_signal(&self->wake);
+  }
+  pthread_mutex_unlock(&self->lock);
+}
+
+static int push(bg_executor *self, size_t own, const struct task *task) {
+  __atomic_add_fetch(&task->group->pending, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&self->queued, 1, __ATOMIC_RELEASE);
+
+  if(deque_push(&self->deques[own], task)) {
+    __atomic_sub_fetch(&self->queued, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&task->group->pending, 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+
+  notify(self, 0);
+  return 0;
+}
+
+/* own deque first, then others in turn */
+static int take(bg_executor *self, size_t own, struct task *task) {
+  size_t i;
+
+  if(!__atomic_load_n(&self->queued, __ATOMIC_ACQUIRE)) {
+    return 0;
+  }
+  for(i = 0; i <= self->threads; ++i) {
+    if(deque_take(&self->deques[(own + i) % (self->threads + 1)], i == 0, task)) {
+      __atomic_sub_fetch(&self->queued, 1, __ATOMIC_RELAXED);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void fail(struct group *group, int err) {
+  int none = 0;
+  __atomic_compare_exchange_n(&group->error, &none, err, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/* ranges larger than grain leave their upper half to thieves */
+static void run(bg_executor *self, size_t own, struct task *task) {
+  struct group *group = task->group;
+
+  if(task->function) {
+    task->function(task->data);
+  } else {
+    while(task->end - task->begin > group->grain && !__atomic_load_n(&group->error, __ATOMIC_RELAXED)) {
+      struct task half = *task;
+      half.begin = task->begin + (task->end - task->begin) / 2;
+      if(push(self, own, &half)) {
+        break;
+      }
+      task->end = half.begin;
+    }
+
+    int err = 0;
+    if(!__atomic_load_n(&group->error, __ATOMIC_RELAXED) &&
+       (err = group->range(task->begin, task->end, group->data))) {
+      fail(group, err);
+    }
+  }
+
+  if(__atomic_sub_fetch(&group->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+    notify(self, 1);
+  }
+}
+
+/* runs queued tasks, whichever group they belong to, until group is done */
+static void help(bg_executor *self, size_t own, struct group *group) {
+  struct task task;
+
+  while(__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE)) {
+    if(take(self, own, &task)) {
+      run(self, own, &task);
+      continue;
+    }
+
+    pthread_mutex_lock(&self->lock);
+    while(__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) && !__atomic_load_n(&self->queued, __ATOMIC_ACQUIRE)) {
+      pthread_cond_wait(&self->wake, &self->lock);
+    }
+    pthread_mutex_unlock(&self->lock);
+  }
+}
+
+static void *work(void *_worker) {
+  struct worker *worker = _worker;
+  bg_executor *self = worker->executor;
+  struct task task;
+
+  while(1) {
+    if(take(self, worker->index, &task)) {
+      run(self, worker->index, &task);
+      continue;
+    }
+
+    pthread_mutex_lock(&self->lock);
+    while(!self->stopping && !__atomic_load_n(&self->queued, __ATOMIC_ACQUIRE)) {
+      pthread_cond_wait(&self->wake, &self->lock);
+    }
+    int done = self->stopping && !__atomic_load_n(&self->queued, __ATOMIC_ACQUIRE);
+    pthread_mutex_unlock(&self->lock);
+
+    if(done) {
+      return NULL;
+    }
+  }
+}
+
+/* workers which could not start leave their share to others */
+static void start(bg_executor *self) {
+  size_t i;
+
+  pthread_mutex_lock(&self->lock);
+  if(!self->started && !self->stopping) {
+    for(i = 0; i < self->threads; ++i) {
+      struct worker *worker = &self->workers[self->started];
+      worker->executor = self;
+      worker->index = i;
+      if(pthread_create(&worker->thread, NULL, &work, worker) == 0) {
+        ++self->started;
+      }
+    }
+  }
+  pthread_mutex_unlock(&self->lock);
+}
+
+
+bg_executor *bg_executor_new(size_t threads) {
+  bg_executor *self = NULL;
+  size_t i;
+
+  if(!threads) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? (size_t) online : 1;
+  }
+
+  if(!(self = malloc(sizeof(bg_executor)))) {
+    return NULL;
+  }
+  memset(self, 0, sizeof(bg_executor));
+  self->threads = threads;
+
+  if(!(self->workers = malloc(threads * sizeof(struct worker))) ||
+     !(self->deques = malloc((threads + 1) * sizeof(struct deque)))) {
+    free(self->workers);
+    free(self);
+    return NULL;
+  }
+  memset(self->deques, 0, (threads + 1) * sizeof(struct deque));
+  for(i = 0; i <= threads; ++i) {
+    pthread_mutex_init(&self->deques[i].lock, NULL);
+  }
+
+  pthread_mutex_init(&self->lock, NULL);
+  pthread_cond_init(&self->wake, NULL);
+
+  return self;
+}
+
+void bg_executor_free(bg_executor *self) {
+  size_t i;
+
+  if(!self) {
+    return;
+  }
+
+  pthread_mutex_lock(&self->lock);
+  self->stopping = 1;
+  pthread_cond_broadcast(&self->wake);
+  pthread_mutex_unlock(&self->lock);
+
+  for(i = 0; i < self->started; ++i) {
+    pthread_join(self->workers[i].thread, NULL);
+  }
+  /* none could start */
+  help(self, self->threads, &self->submitted);
+
+  for(i = 0; i <= self->threads; ++i) {
+    pthread_mutex_destroy(&self->deques[i].lock);
+    free(self->deques[i].tasks);
+  }
+  pthread_mutex_destroy(&self->lock);
+  pthread_cond_destroy(&self->wake);
+
+  free(self->deques);
+  free(self->workers);
+  free(self);
+}
+
+size_t bg_executor_threads(bg_executor *self) {
+  return self->threads;
+}
+
+int bg_executor_for(bg_executor *self, size_t count, size_t grain,
+                    int (* task)(size_t begin, size_t end, void *data), void *data) {
+  if(!count) {
+    return 0;
+  }
+  if(!grain) {
+    grain = 1;
+  }
+  if(!self || count <= grain) {
+    return task(0, count, data);
+  }
+
+  struct group group = { task, data, grain, 1, 0 };
+  struct task whole = { &group, NULL, NULL, 0, count };
+
+  start(self);
+  run(self, self->threads, &whole);
+  help(self, self->threads, &group);
+
+  return group.error;
+}
+
+int bg_executor_submit(bg_executor *self, void (* function)(void *data), void *data) {
+  struct task task = { &self->submitted, function, data, 0, 0 };
+
+  start(self);
+  return push(self, self->threads, &task);
+}
+
+void bg_executor_wait(bg_executor *self) {
+  help(self, self->threads, &self->submitted);
+}
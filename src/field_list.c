@@ -0,0 +1,42 @@
+#include <string.h>
+#include "field_list.h"
+
+int bg_field_list_valid_item(const char *item, size_t length) {
+  return length > 0 && memchr(item, 0, length) == NULL;
+}
+
+int bg_field_list_foreach(const bg_string *list, int (* callback)(const char *item, size_t length, void *), void *out) {
+  const char *item = bg_string_data(list);
+  const char *end = item + bg_string_length(list);
+  int err = 0;
+
+  while(item < end) {
+    const char *separator = memchr(item, 0, end - item);
+    size_t length = (separator ? separator : end) - item;
+
+    if(length && (err = callback(item, length, out))) {
+      return err;
+    }
+
+    item += length + 1;
+  }
+
+  return 0;
+}
+
+int bg_field_list_append(bg_string **list, const char *item, size_t length) {
+  size_t old_length = bg_string_length(*list);
+  size_t separator = old_length ? 1 : 0;
+  bg_string *appended = bg_string_filled_with_length(0, old_length + separator + length);
+  if(!appended) {
+    return -1;
+  }
+
+  char *data = (char *)bg_string_data(appended);
+  memcpy(data, bg_string_data(*list), old_length);
+  memcpy(data + old_length + separator, item, length);
+
+  bg_string_clean_free(*list);
+  *list = appended;
+  return 0;
+}
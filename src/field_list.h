@@ -0,0 +1,19 @@
+#ifndef _BLURGATHER_FIELD_LIST_H_
+#define _BLURGATHER_FIELD_LIST_H_
+
+#include <blurgather/string.h>
+
+/* plain text lists packed in a single password field: non empty items
+   separated by null characters. no trailing separator, since decryption
+   strips trailing nuls. metadata alternates keys and values */
+
+/* non zero when item can be listed */
+int bg_field_list_valid_item(const char *item, size_t length);
+
+/* stops on non zero callback return value, which is returned */
+int bg_field_list_foreach(const bg_string *list, int (* callback)(const char *item, size_t length, void *), void *out);
+
+/* list is replaced by a new string, old one is wiped */
+int bg_field_list_append(bg_string **list, const char *item, size_t length);
+
+#endif
@@ -0,0 +1,98 @@
+#include <string.h>
+#include <blurgather/file_header.h>
+
+#define MAGIC_OFFSET          0
+#define VERSION_OFFSET        4
+#define HEADER_LENGTH_OFFSET  6
+#define FLAGS_OFFSET          8
+#define CRYPTOR_ID_OFFSET     12
+#define KDF_ID_OFFSET         16
+#define KDF_ITERATIONS_OFFSET 20
+#define KDF_SALT_OFFSET       24
+#define RECORD_COUNT_OFFSET   40
+#define INDEX_OFFSET_OFFSET   48
+#define INDEX_LENGTH_OFFSET   56
+#define PAYLOAD_OFFSET_OFFSET 64
+#define PAYLOAD_LENGTH_OFFSET 72
+#define GENERATION_OFFSET     80
+
+static void put_le(unsigned char *buffer, uint64_t value, size_t length) {
+  size_t i;
+  for(i = 0; i < length; ++i) {
+    buffer[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+static uint64_t get_le(const unsigned char *buffer, size_t length) {
+  uint64_t value = 0;
+  size_t i;
+  for(i = length; i > 0; --i) {
+    value = (value << 8) | buffer[i - 1];
+  }
+  return value;
+}
+
+void bg_file_header_init(bg_file_header *header) {
+  memset(header, 0, sizeof(bg_file_header));
+  header->version = BG_FILE_FORMAT_VERSION;
+  header->header_length = BG_FILE_HEADER_LENGTH;
+  header->kdf_id = BG_KDF_NONE;
+  header->payload_offset = BG_FILE_HEADER_LENGTH;
+}
+
+void bg_file_header_encode(const bg_file_header *header, unsigned char *buffer) {
+  memcpy(buffer + MAGIC_OFFSET, BG_FILE_HEADER_MAGIC, BG_FILE_HEADER_MAGIC_LENGTH);
+  put_le(buffer + VERSION_OFFSET, header->version, 2);
+  put_le(buffer + HEADER_LENGTH_OFFSET, header->header_length, 2);
+  put_le(buffer + FLAGS_OFFSET, header->flags, 4);
+  put_le(buffer + CRYPTOR_ID_OFFSET, header->cryptor_id, 4);
+  put_le(buffer + KDF_ID_OFFSET, header->kdf_id, 4);
+  put_le(buffer + KDF_ITERATIONS_OFFSET, header->kdf_iterations, 4);
+  memcpy(buffer + KDF_SALT_OFFSET, header->kdf_salt, BG_KDF_SALT_LENGTH);
+  put_le(buffer + RECORD_COUNT_OFFSET, header->record_count, 8);
+  put_le(buffer + INDEX_OFFSET_OFFSET, header->index_offset, 8);
+  put_le(buffer + INDEX_LENGTH_OFFSET, header->index_length, 8);
+  put_le(buffer + PAYLOAD_OFFSET_OFFSET, header->payload_offset, 8);
+  put_le(buffer + PAYLOAD_LENGTH_OFFSET, header->payload_length, 8);
+  put_le(buffer + GENERATION_OFFSET, header->generation, 8);
+}
+
+static int section_in_bounds(uint64_t offset, uint64_t length, uint64_t header_length) {
+  return offset >= header_length && offset + length >= offset;
+}
+
+int bg_file_header_decode(bg_file_header *header, const unsigned char *buffer, size_t length) {
+  if(length < BG_FILE_HEADER_MAGIC_LENGTH ||
+     memcmp(buffer + MAGIC_OFFSET, BG_FILE_HEADER_MAGIC, BG_FILE_HEADER_MAGIC_LENGTH)) {
+    return -1;
+  }
+  if(length < BG_FILE_HEADER_LENGTH) {
+    return -2;
+  }
+
+  header->version = get_le(buffer + VERSION_OFFSET, 2);
+  header->header_length = get_le(buffer + HEADER_LENGTH_OFFSET, 2);
+  if(header->version == 0 || header->version > BG_FILE_FORMAT_VERSION ||
+     header->header_length < BG_FILE_HEADER_LENGTH) {
+    return -3;
+  }
+
+  header->flags = get_le(buffer + FLAGS_OFFSET, 4);
+  header->cryptor_id = get_le(buffer + CRYPTOR_ID_OFFSET, 4);
+  header->kdf_id = get_le(buffer + KDF_ID_OFFSET, 4);
+  header->kdf_iterations = get_le(buffer + KDF_ITERATIONS_OFFSET, 4);
+  memcpy(header->kdf_salt, buffer + KDF_SALT_OFFSET, BG_KDF_SALT_LENGTH);
+  header->record_count = get_le(buffer + RECORD_COUNT_OFFSET, 8);
+  header->index_offset = get_le(buffer + INDEX_OFFSET_OFFSET, 8);
+  header->index_length = get_le(buffer + INDEX_LENGTH_OFFSET, 8);
+  header->payload_offset = get_le(buffer + PAYLOAD_OFFSET_OFFSET, 8);
+  header->payload_length = get_le(buffer + PAYLOAD_LENGTH_OFFSET, 8);
+  header->generation = get_le(buffer + GENERATION_OFFSET, 8);
+
+  if((header->index_length && !section_in_bounds(header->index_offset, header->index_length, header->header_length)) ||
+     !section_in_bounds(header->payload_offset, header->payload_length, header->header_length)) {
+    return -5;
+  }
+
+  return 0;
+}
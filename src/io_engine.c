@@ -0,0 +1,674 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <blurgather/msgpack_persister.h>
+#include "io_engine.h"
+
+#ifdef BG_HAVE_IO_URING
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#define READ_CHUNK (1 << 20)
+#define QUEUE_DEPTH 8
+
+#ifdef BG_HAVE_IO_URING
+
+/* submission and completion queues shared with kernel, one thread at a time */
+struct ring {
+  int fd;
+  unsigned entries;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_map, *cq_map;
+  size_t sq_map_size, cq_map_size, sqes_size;
+  unsigned queued;    /* pushed, not yet submitted */
+  unsigned in_flight; /* submitted, not yet reaped */
+};
+
+static int ring_init(struct ring *ring, unsigned entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  memset(ring, 0, sizeof(struct ring));
+
+  if((ring->fd = syscall(SYS_io_uring_setup, entries, &params)) < 0) {
+    return -1;
+  }
+  ring->entries = params.sq_entries;
+
+  ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if(params.features & IORING_FEAT_SINGLE_MMAP) {
+    if(ring->cq_map_size > ring->sq_map_size) {
+      ring->sq_map_size = ring->cq_map_size;
+    }
+    ring->cq_map_size = 0;
+  }
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  ring->cq_map = ring->cq_map_size ?
+    mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING) :
+    ring->sq_map;
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+  if(ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+    if(ring->sq_map != MAP_FAILED) munmap(ring->sq_map, ring->sq_map_size);
+    if(ring->cq_map_size && ring->cq_map != MAP_FAILED) munmap(ring->cq_map, ring->cq_map_size);
+    if(ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+    close(ring->fd);
+    ring->fd = -1;
+    return -1;
+  }
+
+  unsigned char *sq = ring->sq_map, *cq = ring->cq_map;
+  ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+  ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  return 0;
+}
+
+static void ring_free(struct ring *ring) {
+  munmap(ring->sqes, ring->sqes_size);
+  if(ring->cq_map_size) {
+    munmap(ring->cq_map, ring->cq_map_size);
+  }
+  munmap(ring->sq_map, ring->sq_map_size);
+  close(ring->fd);
+}
+
+static int ring_full(struct ring *ring) {
+  return ring->queued + ring->in_flight >= ring->entries;
+}
+
+static void ring_push(struct ring *ring, const struct io_uring_sqe *sqe) {
+  unsigned tail = *ring->sq_tail;
+  unsigned index = tail & *ring->sq_mask;
+
+  ring->sqes[index] = *sqe;
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++ring->queued;
+}
+
+/* submits pushed entries, waiting for a completion if asked to */
+static int ring_enter(struct ring *ring, int wait) {
+  int submitted;
+
+  do {
+    submitted = syscall(SYS_io_uring_enter, ring->fd, ring->queued, wait ? 1 : 0,
+                        wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+  } while(submitted < 0 && errno == EINTR);
+
+  if(submitted < 0) {
+    return -1;
+  }
+  ring->queued -= submitted;
+  ring->in_flight += submitted;
+  return 0;
+}
+
+static int ring_reap(struct ring *ring, struct io_uring_cqe *cqe) {
+  unsigned head = *ring->cq_head;
+
+  if(head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    return 0;
+  }
+  *cqe = ring->cqes[head & *ring->cq_mask];
+  __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+  --ring->in_flight;
+  return 1;
+}
+
+static int ring_wait(struct ring *ring, struct io_uring_cqe *cqe) {
+  while(!ring_reap(ring, cqe)) {
+    if(ring_enter(ring, 1)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int uring_supported;
+
+#define PROBED_OPS 256
+
+static int op_supported(const struct io_uring_probe *probe, unsigned op) {
+  return op < probe->ops_len && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+}
+
+/* kernels take rings from 5.1 on but reads and writes only from 5.6, which
+   also brought probing: without it, io_uring is not used at all. renameat
+   falls back to rename, see commit */
+static void probe_uring(void) {
+  struct ring ring;
+  struct io_uring_probe *probe = calloc(1, sizeof(struct io_uring_probe) + PROBED_OPS * sizeof(struct io_uring_probe_op));
+
+  if(!probe || ring_init(&ring, 2)) {
+    free(probe);
+    return;
+  }
+  if(syscall(SYS_io_uring_register, ring.fd, IORING_REGISTER_PROBE, probe, PROBED_OPS) == 0) {
+    uring_supported = op_supported(probe, IORING_OP_READ) &&
+                      op_supported(probe, IORING_OP_WRITE) &&
+                      op_supported(probe, IORING_OP_FSYNC);
+  }
+  ring_free(&ring);
+  free(probe);
+}
+
+/* write not fully done yet */
+struct pending_write {
+  unsigned char *data;
+  size_t length;
+  size_t done;
+  uint64_t offset;
+};
+
+#endif /* BG_HAVE_IO_URING */
+
+struct bg_io_file {
+  int engine;
+  int writing;
+  int failed;
+  char *path; /* written file, removed unless committed */
+
+  /* stdio */
+  FILE *stream;
+
+  /* read file, ready bytes are those read from start on */
+  unsigned char *data;
+  size_t length;
+  size_t ready;
+
+#ifdef BG_HAVE_IO_URING
+  int fd;
+  struct ring ring;
+  size_t queued; /* bytes reads were queued up to */
+  size_t *progress; /* bytes read per chunk */
+#endif
+};
+
+int bg_io_engine_available(int engine) {
+#ifdef BG_HAVE_IO_URING
+  static pthread_once_t probed = PTHREAD_ONCE_INIT;
+  if(engine == BG_MSGPACK_IO_URING) {
+    pthread_once(&probed, &probe_uring);
+    return uring_supported;
+  }
+#else
+  if(engine == BG_MSGPACK_IO_URING) {
+    return 0;
+  }
+#endif
+  return engine == BG_MSGPACK_IO_STDIO;
+}
+
+static bg_io_file *file_new(int engine, int writing) {
+  bg_io_file *file = malloc(sizeof(bg_io_file));
+  if(!file) {
+    return NULL;
+  }
+  memset(file, 0, sizeof(bg_io_file));
+  file->engine = bg_io_engine_available(engine) ? engine : BG_MSGPACK_IO_STDIO;
+  file->writing = writing;
+#ifdef BG_HAVE_IO_URING
+  file->fd = -1;
+  /* kernel may refuse more rings than the one probed */
+  if(file->engine == BG_MSGPACK_IO_URING && ring_init(&file->ring, QUEUE_DEPTH)) {
+    file->engine = BG_MSGPACK_IO_STDIO;
+  }
+#endif
+  return file;
+}
+
+unsigned char *bg_io_data(bg_io_file *file) {
+  return file->data;
+}
+
+size_t bg_io_length(bg_io_file *file) {
+  return file->length;
+}
+
+/* whole file at once */
+static int stdio_read(bg_io_file *file, const char *path) {
+  FILE *stream = fopen(path, "rb");
+  if(!stream) {
+    return -4;
+  }
+
+  fseek(stream, 0, SEEK_END);
+  file->length = ftell(stream);
+  fseek(stream, 0, SEEK_SET);
+
+  if(!(file->data = malloc(file->length + 1))) {
+    fclose(stream);
+    return -3;
+  }
+  /* short reads show when waited on */
+  file->ready = fread(file->data, 1, file->length, stream);
+  fclose(stream);
+  return 0;
+}
+
+#ifdef BG_HAVE_IO_URING
+
+static size_t chunk_length(bg_io_file *file, size_t chunk) {
+  size_t begin = chunk * READ_CHUNK;
+  return file->length - begin < READ_CHUNK ? file->length - begin : READ_CHUNK;
+}
+
+static void push_read(bg_io_file *file, size_t chunk) {
+  struct io_uring_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+
+  sqe.opcode = IORING_OP_READ;
+  sqe.fd = file->fd;
+  sqe.off = chunk * READ_CHUNK + file->progress[chunk];
+  sqe.addr = (uint64_t)(uintptr_t)(file->data + sqe.off);
+  sqe.len = chunk_length(file, chunk) - file->progress[chunk];
+  sqe.user_data = chunk;
+
+  ring_push(&file->ring, &sqe);
+}
+
+/* keeps queue full of chunks ahead of caller */
+static int queue_reads(bg_io_file *file) {
+  while(file->queued < file->length && !ring_full(&file->ring)) {
+    push_read(file, file->queued / READ_CHUNK);
+    file->queued += chunk_length(file, file->queued / READ_CHUNK);
+  }
+  return file->ring.queued ? ring_enter(&file->ring, 0) : 0;
+}
+
+static int uring_read(bg_io_file *file, const char *path) {
+  struct stat status;
+
+  if((file->fd = open(path, O_RDONLY)) < 0) {
+    return -4;
+  }
+  if(fstat(file->fd, &status)) {
+    return -4;
+  }
+  file->length = status.st_size;
+
+  if(!(file->data = malloc(file->length + 1)) ||
+     !(file->progress = calloc(file->length / READ_CHUNK + 2, sizeof(size_t)))) {
+    return -3;
+  }
+
+  if(queue_reads(file)) {
+    file->failed = 1;
+  }
+  return 0;
+}
+
+static void read_completed(bg_io_file *file, const struct io_uring_cqe *cqe) {
+  size_t chunk = cqe->user_data;
+
+  if(cqe->res <= 0) {
+    file->failed = 1;
+    return;
+  }
+  file->progress[chunk] += cqe->res;
+
+  if(file->progress[chunk] < chunk_length(file, chunk)) {
+    push_read(file, chunk);
+  }
+  while(file->ready < file->length &&
+        file->progress[file->ready / READ_CHUNK] == chunk_length(file, file->ready / READ_CHUNK)) {
+    file->ready += chunk_length(file, file->ready / READ_CHUNK);
+  }
+}
+
+static void write_completed(bg_io_file *file, const struct io_uring_cqe *cqe);
+
+static int reap_one(bg_io_file *file) {
+  struct io_uring_cqe cqe;
+
+  if(ring_wait(&file->ring, &cqe)) {
+    file->failed = 1;
+    return -1;
+  }
+  if(file->writing) {
+    write_completed(file, &cqe);
+  } else {
+    read_completed(file, &cqe);
+  }
+  return 0;
+}
+
+#endif /* BG_HAVE_IO_URING */
+
+int bg_io_read_open(int engine, const char *path, bg_io_file **file) {
+  int err = 0;
+
+  if(!(*file = file_new(engine, 0))) {
+    return -3;
+  }
+
+#ifdef BG_HAVE_IO_URING
+  if((*file)->engine == BG_MSGPACK_IO_URING) {
+    err = uring_read(*file, path);
+  } else
+#endif
+  {
+    err = stdio_read(*file, path);
+  }
+
+  if(err) {
+    bg_io_close(*file);
+    *file = NULL;
+  }
+  return err;
+}
+
+int bg_io_read_wait(bg_io_file *file, size_t length) {
+  if(length > file->length) {
+    return -2;
+  }
+
+#ifdef BG_HAVE_IO_URING
+  if(file->engine == BG_MSGPACK_IO_URING) {
+    while(file->ready < length && !file->failed) {
+      if(reap_one(file) == 0 && queue_reads(file)) {
+        file->failed = 1;
+      }
+    }
+  }
+#endif
+
+  return file->ready < length ? -2 : 0;
+}
+
+/* readable by owner only until commit. writers hold persisted file lock:
+   one already there was left by an interrupted write */
+static int create_exclusive(const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if(fd < 0 && errno == EEXIST && unlink(path) == 0) {
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  }
+  return fd;
+}
+
+/* replacing file keeps mode and owner of replaced one. only root gives files
+   away, others still keep group when they belong to it */
+static int match_replaced(int fd, const char *path) {
+  struct stat status;
+
+  if(stat(path, &status)) {
+    return errno == ENOENT ? 0 : -1;
+  }
+  if(fchmod(fd, status.st_mode & 07777)) {
+    return -1;
+  }
+  if(fchown(fd, status.st_uid, status.st_gid) && fchown(fd, -1, status.st_gid)) {
+    /* keeps ours */
+  }
+  return 0;
+}
+
+int bg_io_write_open(int engine, const char *path, bg_io_file **file) {
+  int opened = 0, fd = -1;
+
+  if(!(*file = file_new(engine, 1))) {
+    return -3;
+  }
+
+  if((fd = create_exclusive(path)) >= 0) {
+#ifdef BG_HAVE_IO_URING
+    if((*file)->engine == BG_MSGPACK_IO_URING) {
+      (*file)->fd = fd;
+    } else
+#endif
+    if(!((*file)->stream = fdopen(fd, "wb"))) {
+      close(fd);
+      remove(path);
+      fd = -1;
+    }
+  }
+  opened = fd >= 0;
+
+  /* nothing to remove when not created */
+  if(!opened || !((*file)->path = strdup(path))) {
+    if(opened) {
+      remove(path);
+    }
+    bg_io_close(*file);
+    *file = NULL;
+    return opened ? -3 : -4;
+  }
+  return 0;
+}
+
+#ifdef BG_HAVE_IO_URING
+
+static void push_write(bg_io_file *file, struct pending_write *pending) {
+  struct io_uring_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+
+  sqe.opcode = IORING_OP_WRITE;
+  sqe.fd = file->fd;
+  sqe.off = pending->offset + pending->done;
+  sqe.addr = (uint64_t)(uintptr_t)(pending->data + pending->done);
+  sqe.len = pending->length - pending->done;
+  sqe.user_data = (uint64_t)(uintptr_t)pending;
+
+  ring_push(&file->ring, &sqe);
+}
+
+static void write_completed(bg_io_file *file, const struct io_uring_cqe *cqe) {
+  struct pending_write *pending = (struct pending_write *)(uintptr_t)cqe->user_data;
+
+  if(!pending) {
+    /* sync and rename, see commit */
+    return;
+  }
+
+  if(cqe->res > 0) {
+    pending->done += cqe->res;
+  }
+  if(cqe->res > 0 && pending->done < pending->length) {
+    push_write(file, pending);
+    if(ring_enter(&file->ring, 0)) {
+      file->failed = 1;
+    }
+    return;
+  }
+
+  file->failed = file->failed || cqe->res <= 0;
+  free(pending->data);
+  free(pending);
+}
+
+static int uring_write(bg_io_file *file, uint64_t offset, void *data, size_t length) {
+  struct pending_write *pending = NULL;
+
+  while(ring_full(&file->ring)) {
+    if(reap_one(file)) {
+      break;
+    }
+  }
+  if(file->failed || !(pending = malloc(sizeof(struct pending_write)))) {
+    file->failed = 1;
+    free(data);
+    return -10;
+  }
+
+  pending->data = data;
+  pending->length = length;
+  pending->done = 0;
+  pending->offset = offset;
+
+  push_write(file, pending);
+  if(ring_enter(&file->ring, 0)) {
+    file->failed = 1;
+    return -10;
+  }
+  return 0;
+}
+
+/* sync and rename are linked: rename only happens once file is synced */
+static int uring_commit(bg_io_file *file, const char *path) {
+  struct io_uring_sqe sync, rename_to;
+  struct io_uring_cqe cqe;
+  int renamed = -1, synced = -1;
+
+  while(file->ring.in_flight && reap_one(file) == 0) {
+  }
+  if(file->failed || match_replaced(file->fd, path)) {
+    return -10;
+  }
+
+  memset(&sync, 0, sizeof(sync));
+  sync.opcode = IORING_OP_FSYNC;
+  sync.fd = file->fd;
+  sync.flags = IOSQE_IO_LINK;
+  sync.user_data = 0;
+
+  memset(&rename_to, 0, sizeof(rename_to));
+  rename_to.opcode = IORING_OP_RENAMEAT;
+  rename_to.fd = AT_FDCWD;
+  rename_to.addr = (uint64_t)(uintptr_t)file->path;
+  rename_to.len = AT_FDCWD;
+  rename_to.addr2 = (uint64_t)(uintptr_t)path;
+  rename_to.user_data = 1;
+
+  ring_push(&file->ring, &sync);
+  ring_push(&file->ring, &rename_to);
+  if(ring_enter(&file->ring, 0)) {
+    return -10;
+  }
+
+  while(file->ring.in_flight) {
+    if(ring_wait(&file->ring, &cqe)) {
+      return -10;
+    }
+    if(cqe.user_data == 0) {
+      synced = cqe.res;
+    } else {
+      renamed = cqe.res;
+    }
+  }
+  if(synced) {
+    return -10;
+  }
+  /* kernels without renameat support in io_uring */
+  if(renamed == -EINVAL && rename(file->path, path)) {
+    return -10;
+  } else if(renamed && renamed != -EINVAL) {
+    return -10;
+  }
+
+  close(file->fd);
+  file->fd = -1;
+  return 0;
+}
+
+#endif /* BG_HAVE_IO_URING */
+
+int bg_io_write(bg_io_file *file, uint64_t offset, void *data, size_t length) {
+  if(!length) {
+    free(data);
+    return 0;
+  }
+
+#ifdef BG_HAVE_IO_URING
+  if(file->engine == BG_MSGPACK_IO_URING) {
+    return uring_write(file, offset, data, length);
+  }
+#endif
+
+  if(!file->failed && (fseek(file->stream, offset, SEEK_SET) || fwrite(data, 1, length, file->stream) != length)) {
+    file->failed = 1;
+  }
+  free(data);
+  return file->failed ? -10 : 0;
+}
+
+int bg_io_write_commit(bg_io_file *file, const char *path) {
+  int err = 0;
+
+#ifdef BG_HAVE_IO_URING
+  if(file->engine == BG_MSGPACK_IO_URING) {
+    err = uring_commit(file, path);
+  } else
+#endif
+  {
+    int failed = file->failed || fflush(file->stream) || match_replaced(fileno(file->stream), path) ||
+                 fsync(fileno(file->stream));
+    failed = fclose(file->stream) || failed;
+    file->stream = NULL;
+    err = failed || rename(file->path, path) ? -10 : 0;
+  }
+
+  if(!err) {
+    free(file->path);
+    file->path = NULL;
+  }
+  return err;
+}
+
+#ifdef BG_HAVE_IO_URING
+/* user data above 1 is a write, see commit */
+static void drop_pending_write(bg_io_file *file, uint64_t user_data) {
+  if(file->writing && user_data > 1) {
+    struct pending_write *pending = (struct pending_write *)(uintptr_t)user_data;
+    free(pending->data);
+    free(pending);
+  }
+}
+#endif
+
+void bg_io_close(bg_io_file *file) {
+  if(!file) {
+    return;
+  }
+
+#ifdef BG_HAVE_IO_URING
+  if(file->engine == BG_MSGPACK_IO_URING) {
+    /* kernel may still be writing to or reading from our buffers */
+    while(file->ring.in_flight) {
+      struct io_uring_cqe cqe;
+      if(ring_wait(&file->ring, &cqe)) {
+        break;
+      }
+      drop_pending_write(file, cqe.user_data);
+    }
+    /* last entries pushed, left unsubmitted when entering ring failed */
+    unsigned tail = *file->ring.sq_tail, i;
+    for(i = 0; i < file->ring.queued; ++i) {
+      unsigned index = file->ring.sq_array[(tail - 1 - i) & *file->ring.sq_mask];
+      drop_pending_write(file, file->ring.sqes[index].user_data);
+    }
+    ring_free(&file->ring);
+    if(file->fd >= 0) {
+      close(file->fd);
+    }
+    free(file->progress);
+  }
+#endif
+
+  if(file->stream) {
+    fclose(file->stream);
+  }
+  if(file->path) {
+    remove(file->path);
+    free(file->path);
+  }
+  free(file->data);
+  free(file);
+}
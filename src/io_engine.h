@@ -0,0 +1,34 @@
+#ifndef _BLURGATHER_IO_ENGINE_H_
+#define _BLURGATHER_IO_ENGINE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* persisted files read and written in large chunks, either through stdio or
+   io_uring, which queues reads ahead and writes behind caller */
+struct bg_io_file;
+typedef struct bg_io_file bg_io_file;
+
+/* io_uring needs both build and kernel support */
+int bg_io_engine_available(int engine);
+
+/* starts reading whole file, -4 when it cannot be opened and -3 on allocation failure */
+int bg_io_read_open(int engine, const char *path, bg_io_file **file);
+/* buffer chunks are read into, valid until close */
+unsigned char *bg_io_data(bg_io_file *file);
+size_t bg_io_length(bg_io_file *file);
+/* returns once first length bytes are read, -2 when they could not be */
+int bg_io_read_wait(bg_io_file *file, size_t length);
+
+/* creates file readable by owner only, -4 when it cannot be */
+int bg_io_write_open(int engine, const char *path, bg_io_file **file);
+/* takes malloc'ed data, freed once written. failures show at commit */
+int bg_io_write(bg_io_file *file, uint64_t offset, void *data, size_t length);
+/* gives file mode and owner of path when it exists, syncs it then renames
+   it to path. -10 when anything failed */
+int bg_io_write_commit(bg_io_file *file, const char *path);
+
+/* written files not committed are removed */
+void bg_io_close(bg_io_file *file);
+
+#endif
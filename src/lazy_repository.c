@@ -0,0 +1,490 @@
+#include <string.h>
+#include <pthread.h>
+#include <blurgather/lazy_repository.h>
+
+static void bg_lazy_repository_destroy(bg_repository_t *self);
+static int bg_lazy_repository_add(bg_repository_t *self, bg_password *password);
+static int bg_lazy_repository_get(bg_repository_t *self, const bg_string *name, bg_password **password);
+static int bg_lazy_repository_remove(bg_repository_t *self, const bg_string *name);
+static size_t bg_lazy_repository_count(bg_repository_t *self);
+static int bg_lazy_repository_foreach(bg_repository_t *self, int (* callback)(bg_password *, void *), void *output);
+static int bg_lazy_repository_reserve(bg_repository_t *self, size_t count);
+static int bg_lazy_repository_add_record(bg_repository_t *self, bg_record_source *source, const unsigned char *record, size_t length);
+static uint64_t bg_lazy_repository_generation(bg_repository_t *self);
+static int bg_lazy_repository_add_all(bg_repository_t *self, bg_password **passwords, size_t count);
+
+static struct bg_repository_vtable bg_lazy_repository_vtable = {
+  .destroy    = &bg_lazy_repository_destroy,
+  .add        = &bg_lazy_repository_add,
+  .get        = &bg_lazy_repository_get,
+  .remove     = &bg_lazy_repository_remove,
+  .count      = &bg_lazy_repository_count,
+  .foreach    = &bg_lazy_repository_foreach,
+  .reserve    = &bg_lazy_repository_reserve,
+  .add_record = &bg_lazy_repository_add_record,
+  .generation = &bg_lazy_repository_generation,
+  .add_all    = &bg_lazy_repository_add_all,
+};
+
+/* source is NULL for passwords added directly, those are never dropped */
+struct lazy_entry {
+  bg_record_source *source;
+  const unsigned char *record;
+  size_t length;
+
+  bg_password *password;
+  int referenced;
+};
+
+struct bg_lazy_repository {
+  bg_repository_t repository;
+
+  struct lazy_entry *entries;
+  size_t count;
+  size_t capacity;
+
+  size_t materialized;
+  size_t max_materialized;
+  size_t clock_hand;
+
+  /* evicted while readers may still hold them, freed on next exclusive access */
+  bg_password **retired;
+  size_t retired_count;
+  size_t retired_capacity;
+
+  uint64_t generation;
+
+  /* concurrent readers materialize records, guarding materialized state */
+  pthread_mutex_t lock;
+};
+typedef struct bg_lazy_repository bg_lazy_repository;
+
+
+bg_repository_t *bg_lazy_repository_new(void) {
+  bg_lazy_repository *self = malloc(sizeof(bg_lazy_repository));
+  memset(self, 0, sizeof(bg_lazy_repository));
+
+  self->repository.object = (void *) self;
+  self->repository.vtable = &bg_lazy_repository_vtable;
+  pthread_mutex_init(&self->lock, NULL);
+
+  return &self->repository;
+}
+
+int bg_lazy_repository_limit(bg_repository_t *_self, size_t max_materialized) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+  self->max_materialized = max_materialized;
+  return 0;
+}
+
+size_t bg_lazy_repository_materialized(bg_repository_t *_self) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+
+  pthread_mutex_lock(&self->lock);
+  size_t materialized = self->materialized;
+  pthread_mutex_unlock(&self->lock);
+
+  return materialized;
+}
+
+/* only from operations having exclusive access */
+static void free_retired(bg_lazy_repository *self) {
+  size_t i;
+  for(i = 0; i < self->retired_count; ++i) {
+    bg_password_free(self->retired[i]);
+  }
+  self->retired_count = 0;
+}
+
+void bg_lazy_repository_destroy(bg_repository_t *_self) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+
+  free_retired(self);
+  free(self->retired);
+
+  size_t i;
+  for(i = 0; i < self->count; ++i) {
+    if(self->entries[i].password) {
+      bg_password_free(self->entries[i].password);
+    }
+    if(self->entries[i].source) {
+      bg_record_source_release(self->entries[i].source);
+    }
+  }
+
+  free(self->entries);
+  pthread_mutex_destroy(&self->lock);
+}
+
+int bg_lazy_repository_reserve(bg_repository_t *_self, size_t count) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+
+  if(count <= self->capacity) {
+    return 0;
+  }
+
+  struct lazy_entry *entries = realloc(self->entries, count * sizeof(struct lazy_entry));
+  if(!entries) {
+    return -3;
+  }
+  self->entries = entries;
+  self->capacity = count;
+
+  return 0;
+}
+
+static struct lazy_entry *new_entry(bg_lazy_repository *self) {
+  if(self->count == self->capacity &&
+     bg_lazy_repository_reserve(&self->repository, self->capacity ? self->capacity * 2 : 16)) {
+    return NULL;
+  }
+
+  struct lazy_entry *entry = &self->entries[self->count++];
+  memset(entry, 0, sizeof(struct lazy_entry));
+  return entry;
+}
+
+static int retire(bg_lazy_repository *self, bg_password *password) {
+  if(self->retired_count == self->retired_capacity) {
+    size_t capacity = self->retired_capacity ? self->retired_capacity * 2 : 16;
+    bg_password **retired = realloc(self->retired, capacity * sizeof(bg_password *));
+    if(!retired) {
+      return -3;
+    }
+    self->retired = retired;
+    self->retired_capacity = capacity;
+  }
+
+  self->retired[self->retired_count++] = password;
+  return 0;
+}
+
+/* second chance sweep over materialized persisted records. evicted password is
+   retired rather than freed, other readers may have got it from get or foreach */
+static void evict_one(bg_lazy_repository *self, const struct lazy_entry *keep) {
+  size_t visited;
+  for(visited = 0; visited < 2 * self->count; ++visited) {
+    struct lazy_entry *entry = &self->entries[self->clock_hand];
+    self->clock_hand = (self->clock_hand + 1) % self->count;
+
+    if(!entry->source || !entry->password || entry == keep) {
+      continue;
+    }
+    if(entry->referenced) {
+      entry->referenced = 0;
+      continue;
+    }
+
+    if(retire(self, entry->password)) {
+      return; /* kept over limit */
+    }
+    entry->password = NULL;
+    --self->materialized;
+    return;
+  }
+}
+
+static void keep_materialized(bg_lazy_repository *self, struct lazy_entry *entry, bg_password *password) {
+  entry->password = password;
+  ++self->materialized;
+
+  if(self->max_materialized && self->materialized > self->max_materialized) {
+    evict_one(self, entry);
+  }
+}
+
+static bg_password *materialized_password(bg_lazy_repository *self, struct lazy_entry *entry) {
+  pthread_mutex_lock(&self->lock);
+  bg_password *password = entry->password;
+  pthread_mutex_unlock(&self->lock);
+  return password;
+}
+
+/* password is dropped when another reader materialized entry meanwhile */
+static bg_password *keep_first_materialized(bg_lazy_repository *self, struct lazy_entry *entry, bg_password *password) {
+  pthread_mutex_lock(&self->lock);
+  if(!entry->password && password) {
+    keep_materialized(self, entry, password);
+  } else if(password) {
+    bg_password_free(password);
+  }
+  entry->referenced = 1;
+  password = entry->password;
+  pthread_mutex_unlock(&self->lock);
+
+  return password;
+}
+
+/* records are decrypted outside lock, readers only wait on each other to keep them */
+static int materialize(bg_lazy_repository *self, struct lazy_entry *entry, bg_password **password) {
+  int err = 0;
+
+  do {
+    bg_password *materialized = NULL;
+    if(!materialized_password(self, entry) &&
+       (err = bg_record_source_materialize(entry->source, entry->record, entry->length, &materialized))) {
+      return err;
+    }
+    *password = keep_first_materialized(self, entry, materialized);
+  } while(!*password); /* evicted in between */
+
+  return 0;
+}
+
+/* looks records up without keeping those not matching materialized.
+   found is matching password as read under lock, retired ones included */
+static struct lazy_entry *find_entry(bg_lazy_repository *self, const bg_string *name, bg_password **found, int *error) {
+  size_t i;
+  *error = 0;
+
+  for(i = 0; i < self->count; ++i) {
+    struct lazy_entry *entry = &self->entries[i];
+    bg_password *password = materialized_password(self, entry), *temporary = NULL;
+
+    if(!password) {
+      if((*error = bg_record_source_materialize(entry->source, entry->record, entry->length, &temporary))) {
+        return NULL;
+      }
+      password = temporary;
+    }
+
+    if(bg_string_compare(bg_password_name(password), name) == 0) {
+      bg_password *kept = keep_first_materialized(self, entry, temporary);
+      *found = kept ? kept : password; /* evicted meanwhile */
+      return entry;
+    }
+
+    if(temporary) {
+      bg_password_free(temporary);
+    }
+  }
+
+  return NULL;
+}
+
+int bg_lazy_repository_add(bg_repository_t *_self, bg_password *password) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+  bg_password *found = NULL;
+  int err = 0;
+
+  free_retired(self);
+  if(bg_string_empty(bg_password_name(password))) {
+    return -2;
+  }
+  if(find_entry(self, bg_password_name(password), &found, &err) || err) {
+    return -1;
+  }
+
+  struct lazy_entry *entry = new_entry(self);
+  if(!entry) {
+    return -3;
+  }
+  entry->password = password;
+  self->generation++;
+
+  return 0;
+}
+
+/* position counts stored entries first, then added passwords.
+   temporary is set when a record had to be materialized for its name */
+static int name_at(bg_lazy_repository *self, bg_password **passwords, size_t position,
+                   bg_password **temporary, const bg_string **name) {
+  int err = 0;
+  *temporary = NULL;
+
+  if(position >= self->count) {
+    *name = bg_password_name(passwords[position - self->count]);
+    return 0;
+  }
+
+  struct lazy_entry *entry = &self->entries[position];
+  if(entry->password) {
+    *name = bg_password_name(entry->password);
+    return 0;
+  }
+  if((err = bg_record_source_materialize(entry->source, entry->record, entry->length, temporary))) {
+    return err;
+  }
+  *name = bg_password_name(*temporary);
+  return 0;
+}
+
+static int same_name(bg_lazy_repository *self, bg_password **passwords, size_t lhs, size_t rhs, int *same) {
+  bg_password *lhs_temporary = NULL, *rhs_temporary = NULL;
+  const bg_string *lhs_name, *rhs_name;
+  int err = 0;
+
+  if(!(err = name_at(self, passwords, lhs, &lhs_temporary, &lhs_name)) &&
+     !(err = name_at(self, passwords, rhs, &rhs_temporary, &rhs_name))) {
+    *same = bg_string_compare(lhs_name, rhs_name) == 0;
+  }
+
+  if(lhs_temporary) bg_password_free(lhs_temporary);
+  if(rhs_temporary) bg_password_free(rhs_temporary);
+  return err;
+}
+
+struct name_hash {
+  size_t hash;
+  size_t position;
+};
+
+static int compare_name_hashes(const void *_lhs, const void *_rhs) {
+  const struct name_hash *lhs = _lhs, *rhs = _rhs;
+  if(lhs->hash != rhs->hash) {
+    return lhs->hash < rhs->hash ? -1 : 1;
+  }
+  return lhs->position < rhs->position ? -1 : lhs->position > rhs->position;
+}
+
+/* one hashing pass over stored names instead of a lookup per added password,
+   names are only compared again when hashes collide */
+static int find_duplicate(bg_lazy_repository *self, bg_password **passwords, size_t count) {
+  size_t total = self->count + count, i, j;
+  int err = 0, same = 0;
+
+  struct name_hash *hashes = malloc(total * sizeof(struct name_hash));
+  if(!hashes) {
+    return -3;
+  }
+
+  for(i = 0; i < total; ++i) {
+    bg_password *temporary = NULL;
+    const bg_string *name;
+    if((err = name_at(self, passwords, i, &temporary, &name))) {
+      goto end;
+    }
+    hashes[i].hash = bg_string_hash(name);
+    hashes[i].position = i;
+    if(temporary) bg_password_free(temporary);
+  }
+
+  qsort(hashes, total, sizeof(struct name_hash), &compare_name_hashes);
+
+  for(i = 0; i < total && !same; ++i) {
+    for(j = i + 1; j < total && hashes[j].hash == hashes[i].hash && !same; ++j) {
+      if((err = same_name(self, passwords, hashes[i].position, hashes[j].position, &same))) {
+        goto end;
+      }
+    }
+  }
+  err = same ? -1 : 0;
+
+end:
+  free(hashes);
+  return err;
+}
+
+int bg_lazy_repository_add_all(bg_repository_t *_self, bg_password **passwords, size_t count) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+  int err = 0;
+  size_t i;
+
+  free_retired(self);
+  if(!count) {
+    return 0;
+  }
+  for(i = 0; i < count; ++i) {
+    if(bg_string_empty(bg_password_name(passwords[i]))) {
+      return -2;
+    }
+  }
+  if((err = find_duplicate(self, passwords, count))) {
+    return err == -3 ? -3 : -1;
+  }
+  if(bg_lazy_repository_reserve(_self, self->count + count)) {
+    return -3;
+  }
+
+  for(i = 0; i < count; ++i) {
+    new_entry(self)->password = passwords[i];
+  }
+  self->generation++;
+
+  return 0;
+}
+
+int bg_lazy_repository_add_record(bg_repository_t *_self, bg_record_source *source, const unsigned char *record, size_t length) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+
+  free_retired(self);
+  struct lazy_entry *entry = new_entry(self);
+  if(!entry) {
+    return -3;
+  }
+  entry->source = bg_record_source_retain(source);
+  entry->record = record;
+  entry->length = length;
+  self->generation++;
+
+  return 0;
+}
+
+int bg_lazy_repository_get(bg_repository_t *_self, const bg_string *name, bg_password **password) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+  bg_password *found = NULL;
+  int err = 0;
+
+  struct lazy_entry *entry = find_entry(self, name, &found, &err);
+  if(err) {
+    return err;
+  }
+
+  *password = found;
+  return entry == NULL;
+}
+
+int bg_lazy_repository_remove(bg_repository_t *_self, const bg_string *name) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+  bg_password *found = NULL;
+  int err = 0;
+
+  free_retired(self);
+  struct lazy_entry *entry = find_entry(self, name, &found, &err);
+  if(!entry) {
+    return err ? err : -1;
+  }
+
+  bg_password_free(entry->password);
+  if(entry->source) {
+    bg_record_source_release(entry->source);
+    --self->materialized;
+  }
+
+  /* keep persisted order */
+  memmove(entry, entry + 1, (self->entries + self->count - entry - 1) * sizeof(struct lazy_entry));
+  --self->count;
+  self->clock_hand = 0;
+  self->generation++;
+
+  return 0;
+}
+
+uint64_t bg_lazy_repository_generation(bg_repository_t *_self) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+  return self->generation;
+}
+
+size_t bg_lazy_repository_count(bg_repository_t *_self) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+  return self->count;
+}
+
+int bg_lazy_repository_foreach(bg_repository_t *_self, int (* callback)(bg_password *, void *), void *output) {
+  bg_lazy_repository *self = (bg_lazy_repository *)_self->object;
+
+  size_t i;
+  for(i = 0; i < self->count; ++i) {
+    int err = 0;
+    bg_password *password = NULL;
+
+    if((err = materialize(self, &self->entries[i], &password))) {
+      return err;
+    }
+    if((err = callback(password, output))) {
+      return err;
+    }
+  }
+
+  return 0;
+}
@@ -1,82 +1,150 @@
+#include <string.h>
 #include <blurgather/map.h>
 
 typedef void (*map_free_callback)(void *);
 
+/* entries are kept in insertion order, the open addressing table only
+   refers to them by index, which keeps bg_map_foreach deterministic */
+struct bg_map_entry {
+  size_t hash;
+  bg_string *key;
+  void *data;
+  map_free_callback free;
+};
+
+struct bg_map_slot {
+  size_t hash;
+  size_t entry; /* entry index + 1, 0 when slot is empty */
+};
+
 struct bg_map {
   size_t data_pair_count;
-  bg_string **data_keys;
-  void **data;
-  map_free_callback *frees;
+  size_t allocated_entries;
+  struct bg_map_entry *entries;
+
+  size_t slots_mask; /* slots count - 1, slots count being a power of 2 */
+  struct bg_map_slot *slots;
 };
 
+#define BG_MAP_INITIAL_SLOTS 8
+
 bg_map *bg_map_new() {
   bg_map *map = malloc(sizeof(bg_map));
   map->data_pair_count = 0;
-  map->data_keys = NULL;
-  map->data = NULL;
-  map->frees = NULL;
+  map->allocated_entries = 0;
+  map->entries = NULL;
+  map->slots_mask = 0;
+  map->slots = NULL;
   return map;
 }
 
 void bg_map_free(bg_map *map) {
   size_t i;
   for(i = 0; i < map->data_pair_count; ++i) {
-    bg_string_free(map->data_keys[i]);
-    if(map->frees[i]) {
-      map->frees[i](map->data[i]);
+    bg_string_free(map->entries[i].key);
+    if(map->entries[i].free) {
+      map->entries[i].free(map->entries[i].data);
     }
   }
-  free(map->data_keys);
-  free(map->data);
-  free(map->frees);
+  free(map->entries);
+  free(map->slots);
   free(map);
 }
 
-static void get_data_index(bg_map *map, const bg_string *key, size_t *idx) {
+/* returns the slot holding key, or the empty slot where it would be inserted */
+static struct bg_map_slot *find_slot(const bg_map *map, const bg_string *key, size_t hash) {
+  size_t i = hash & map->slots_mask;
+
+  while(map->slots[i].entry) {
+    if(map->slots[i].hash == hash &&
+       bg_string_compare(key, map->entries[map->slots[i].entry - 1].key) == 0) {
+      break;
+    }
+    i = (i + 1) & map->slots_mask;
+  }
+
+  return &map->slots[i];
+}
+
+static int grow(bg_map *map) {
+  if(map->data_pair_count == map->allocated_entries) {
+    size_t allocated = map->allocated_entries ? map->allocated_entries * 2 : BG_MAP_INITIAL_SLOTS / 2;
+    struct bg_map_entry *entries = realloc(map->entries, allocated * sizeof(struct bg_map_entry));
+    if(!entries) { return -1; }
+    map->entries = entries;
+    map->allocated_entries = allocated;
+  }
+
+  /* keep load factor under 1/2 */
+  if(map->slots && (map->data_pair_count + 1) * 2 <= map->slots_mask + 1) {
+    return 0;
+  }
+
+  size_t slots_count = map->slots ? (map->slots_mask + 1) * 2 : BG_MAP_INITIAL_SLOTS;
+  struct bg_map_slot *slots = calloc(slots_count, sizeof(struct bg_map_slot));
+  if(!slots) { return -1; }
+
+  free(map->slots);
+  map->slots = slots;
+  map->slots_mask = slots_count - 1;
+
   size_t i;
   for(i = 0; i < map->data_pair_count; ++i) {
-    if(bg_string_compare(key, map->data_keys[i]) == 0) {
-      *idx = i;
-      return;
-    }
+    struct bg_map_slot *slot = find_slot(map, map->entries[i].key, map->entries[i].hash);
+    slot->hash = map->entries[i].hash;
+    slot->entry = i + 1;
   }
-  *idx = map->data_pair_count;
+
+  return 0;
 }
 
 int bg_map_register_data(bg_map *map, bg_string *key, void *value, void (*free_callback)(void *)) {
-  size_t i;
-  get_data_index(map, key, &i);
+  size_t hash = bg_string_hash(key);
+  struct bg_map_slot *slot = map->slots ? find_slot(map, key, hash) : NULL;
+  struct bg_map_entry *entry;
+
+  if(!slot || !slot->entry) { /* new key */
+    if(grow(map)) {
+      return -1;
+    }
+    slot = find_slot(map, key, hash);
 
-  if(!(i < map->data_pair_count)) { /* new key */
-    map->data_keys = realloc(map->data_keys, (map->data_pair_count + 1) * sizeof(void*));
-    map->data = realloc(map->data, (map->data_pair_count + 1) * sizeof(void*));
-    map->frees = realloc(map->frees, (map->data_pair_count + 1) * sizeof(void*));
+    entry = &map->entries[map->data_pair_count];
+    entry->hash = hash;
+    entry->key = key;
 
-    map->data_keys[i] = key;
     map->data_pair_count++;
+    slot->hash = hash;
+    slot->entry = map->data_pair_count;
   } else { /* key already exists */
+    entry = &map->entries[slot->entry - 1];
     bg_string_free(key);
-    if(map->frees[i]) {
-      map->frees[i](map->data[i]);
+    if(entry->free) {
+      entry->free(entry->data);
     }
   }
 
-  map->data[i] = value;
-  map->frees[i] = free_callback;
+  entry->data = value;
+  entry->free = free_callback;
 
   return 0;
 }
 
-void *bg_map_get_data(const bg_map *map, bg_string *key) {
-  size_t i;
-  get_data_index((bg_map*)map, key, &i);
-  bg_string_free(key);
-
-  if(!(i < map->data_pair_count)) {
-    return NULL;
+void *bg_map_find_data(const bg_map *map, const bg_string *key) {
+  if(map->slots) {
+    struct bg_map_slot *slot = find_slot(map, key, bg_string_hash(key));
+    if(slot->entry) {
+      return map->entries[slot->entry - 1].data;
+    }
   }
 
-  return map->data[i];
+  return NULL;
+}
+
+void *bg_map_get_data(const bg_map *map, bg_string *key) {
+  void *data = bg_map_find_data(map, key);
+  bg_string_free(key);
+  return data;
 }
 
 int bg_map_foreach(bg_map *map, int (*callback)(const bg_string*, void*, void*), void *output) {
@@ -84,7 +152,7 @@ int bg_map_foreach(bg_map *map, int (*callback)(const bg_string*, void*, void*),
   int err;
 
   for(i = 0; i < map->data_pair_count; ++i) {
-    if((err = callback(map->data_keys[i], map->data[i], output))) {
+    if((err = callback(map->entries[i].key, map->entries[i].data, output))) {
       return err;
     }
   }
@@ -88,6 +88,7 @@ const static bg_cryptor_t bg_mcrypt_aes256 = {
   .iv_length = &bg_mcrypt_iv32_iv_length,
   .generate_iv = &bg_mcrypt_iv32_generate_iv,
   .encrypted_length = &bg_mcrypt_cfb_encrypted_length,
+  .id = BG_CRYPTOR_MCRYPT_RIJNDAEL256_CFB,
 };
 
 const bg_cryptor_t *bg_mcrypt_cryptor() {
@@ -1,14 +1,32 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 #include <blurgather/msgpack_persister.h>
+#include <blurgather/repository.h>
+#include <blurgather/encryption.h>
+#include <blurgather/record_source.h>
+#include <blurgather/executor.h>
 #include "msgpack_serialize.h"
+#include "record_directory.h"
+#include "siphash.h"
+#include "io_engine.h"
 
 static void bg_msgpack_persister_destroy(bg_persister_t *_self);
 static int bg_msgpack_persister_load(bg_persister_t * self, bg_repository_t *repo);
 static int bg_msgpack_persister_persist(bg_persister_t * self, bg_repository_t *repo);
+static int bg_msgpack_persister_count(bg_persister_t * self, size_t *count);
+static int bg_msgpack_persister_fetch(bg_persister_t * self, const bg_string *name, bg_password **password);
+static int bg_msgpack_persister_refresh(bg_persister_t * self, bg_repository_t *repo);
 
 static struct bg_persister_vtable bg_msgpack_persister_vtable = {
   .destroy = &bg_msgpack_persister_destroy,
   .load    = &bg_msgpack_persister_load,
   .persist = &bg_msgpack_persister_persist,
+  .count   = &bg_msgpack_persister_count,
+  .fetch   = &bg_msgpack_persister_fetch,
+  .refresh = &bg_msgpack_persister_refresh,
 };
 
 bg_msgpack_persister *bg_msgpack_persister_new(bg_string *filename, bg_cryptor_t *cryptor) {
@@ -21,6 +39,13 @@ bg_msgpack_persister *bg_msgpack_persister_new(bg_string *filename, bg_cryptor_t
 
   self->cryptor = cryptor;
   self->secret_key = NULL;
+  self->executor = NULL;
+  self->io_engine = BG_MSGPACK_IO_STDIO;
+  self->decode_all = 0;
+  self->tracking = 0;
+  self->generation = 0;
+  self->known = NULL;
+  self->known_count = 0;
 
   return self;
 }
@@ -33,6 +58,7 @@ void bg_msgpack_persister_destroy(bg_persister_t *_self) {
   bg_msgpack_persister* self = (bg_msgpack_persister*) _self->object;
 
   bg_string_free(self->persistence_filename);
+  free(self->known);
 }
 
 int bg_msgpack_persister_register_key(bg_persister_t *_self, bg_secret_key_t *secret_key) {
@@ -47,69 +73,1029 @@ int bg_msgpack_persister_unregister_key(bg_persister_t *_self) {
   return 0;
 }
 
+int bg_msgpack_persister_register_executor(bg_persister_t *_self, bg_executor *executor) {
+  bg_msgpack_persister* self = (bg_msgpack_persister*) _self->object;
+  self->executor = executor;
+  return 0;
+}
+
+int bg_msgpack_persister_decode_all(bg_persister_t *_self, int decode_all) {
+  bg_msgpack_persister* self = (bg_msgpack_persister*) _self->object;
+  self->decode_all = decode_all;
+  return 0;
+}
+
+int bg_msgpack_persister_select_io(bg_persister_t *_self, int engine) {
+  bg_msgpack_persister* self = (bg_msgpack_persister*) _self->object;
+  self->io_engine = bg_io_engine_available(engine) ? engine : BG_MSGPACK_IO_STDIO;
+  return self->io_engine;
+}
+
 FILE *fmemopen(void *buf, size_t size, const char *mode);
 
+/* records decoded by each executor task */
+#define DECODE_CHUNK 64
+/* payload bytes decoded at once while following ones are read */
+#define DECODE_BATCH (1 << 20)
+/* encrypted payload buffered before being written */
+#define WRITE_CHUNK (1 << 20)
+
+/* keys record names and contents hashes of files without a secret key */
+static const unsigned char blind_key_seed[BG_SIPHASH_KEY_LENGTH] = "blur blind index";
+/* domain labels each half of secret key derived one is hashed under */
+static const unsigned char blind_key_labels[2][BG_SIPHASH_KEY_LENGTH] = { "blur blind key 0", "blur blind key 1" };
+
+/* format 4 on: SipHash-2-4 of secret key under both labels, independent from
+   cryptor. older formats encrypted seed with a zero iv */
+static int derive_blind_key(bg_msgpack_persister *self, uint16_t version, unsigned char *blind_key) {
+  size_t i, half;
+
+  memcpy(blind_key, blind_key_seed, BG_SIPHASH_KEY_LENGTH);
+  if(!self->secret_key || !self->cryptor) {
+    return 0;
+  }
+
+  if(version >= 4) {
+    for(half = 0; half < 2; ++half) {
+      uint64_t hash = bg_siphash(blind_key_labels[half], bg_secret_key_data(self->secret_key),
+                                 bg_secret_key_length(self->secret_key));
+      for(i = 0; i < 8; ++i) {
+        blind_key[half * 8 + i] = (unsigned char)(hash >> (8 * i));
+      }
+    }
+    return 0;
+  }
+
+  size_t iv_length = bg_cryptor_iv_length(self->cryptor);
+  unsigned char *zeros = calloc(iv_length + 1, 1);
+  if(!zeros) {
+    return -3;
+  }
+  bg_iv_t *iv = bg_iv_new(zeros, iv_length);
+  free(zeros);
+
+  int err = bg_cryptor_encrypt(self->cryptor, blind_key, BG_SIPHASH_KEY_LENGTH, self->secret_key, iv);
+  bg_iv_free(iv);
+  return err;
+}
+
+static int plain_name(bg_msgpack_persister *self, bg_password *password, bg_string **output) {
+  if(bg_password_crypted(password) && self->secret_key && self->cryptor) {
+    return bg_decrypt_string_to(bg_password_name(password), output, self->cryptor, self->secret_key);
+  }
+  *output = bg_string_copy(bg_password_name(password));
+  return 0;
+}
+
+static int open_directory_of(const char *path) {
+  const char *slash = strrchr(path, '/');
+  if(!slash) {
+    return open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  }
+
+  bg_string *directory = bg_string_from_char_array(path, slash == path ? 1 : slash - path);
+  int fd = open(bg_string_data(directory), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  bg_string_free(directory);
+  return fd;
+}
+
+/* advisory lock on persisted file itself, on its directory while there is none
+   yet, so that nothing is created for it. persisting renames another file over
+   it: lock is taken again when path moved to another file meanwhile.
+   -1 when it cannot be taken: readers then go on without it, persisting gives up */
+static int lock_file(bg_msgpack_persister *self, int operation) {
+  const char *path = bg_string_data(self->persistence_filename);
+  struct stat locked, current;
+
+  while(1) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    int on_directory = fd < 0 && errno == ENOENT;
+    if(on_directory) {
+      fd = open_directory_of(path);
+    }
+    if(fd < 0) {
+      return -1;
+    }
+
+    while(flock(fd, operation)) {
+      if(errno != EINTR) {
+        close(fd);
+        return -1;
+      }
+    }
+
+    int moved = on_directory ? stat(path, &current) == 0 :
+                fstat(fd, &locked) || stat(path, &current) ||
+                locked.st_dev != current.st_dev || locked.st_ino != current.st_ino;
+    if(!moved) {
+      return fd;
+    }
+    close(fd);
+  }
+}
+
+/* closing releases lock */
+static void unlock_file(int fd) {
+  if(fd >= 0) {
+    close(fd);
+  }
+}
+
+/* persisted directory as of last load or persist, sorted by blind index. takes entries */
+static void track(bg_msgpack_persister *self, uint64_t generation, struct bg_record_entry *entries, size_t count) {
+  free(self->known);
+  self->tracking = 1;
+  self->generation = generation;
+  self->known = entries;
+  self->known_count = count;
+}
+
+/* files without content hashes cannot be compared against */
+static void untrack(bg_msgpack_persister *self) {
+  free(self->known);
+  self->tracking = 0;
+  self->known = NULL;
+  self->known_count = 0;
+}
+
+/* appends [iv][encrypted data] when a key is registered, data as is otherwise.
+   data is encrypted in place */
+static int append_section(bg_msgpack_persister *self, msgpack_sbuffer *output, void *data, size_t length) {
+  int err = 0;
+
+  if(self->secret_key && self->cryptor) {
+    bg_iv_t *iv = NULL;
+    if((err = bg_cryptor_generate_iv(self->cryptor, &iv))) {
+      return err;
+    }
+    if((err = bg_cryptor_encrypt(self->cryptor, data, length, self->secret_key, iv))) {
+      bg_iv_free(iv);
+      return err;
+    }
+    msgpack_sbuffer_write(output, bg_iv_data(iv), bg_iv_length(iv));
+    bg_iv_free(iv);
+  }
+
+  return length ? msgpack_sbuffer_write(output, data, length) : 0;
+}
+
+struct persist_data {
+  bg_msgpack_persister *self;
+  unsigned char blind_key[BG_SIPHASH_KEY_LENGTH];
+  msgpack_sbuffer record;
+  msgpack_sbuffer payload;
+  struct bg_record_entry *entries;
+  size_t count;
+  size_t capacity;
+  bg_io_file *file;
+  uint64_t payload_offset;
+  uint64_t written; /* payload bytes handed to file */
+};
+
+/* hands encrypted payload over to file, written while next records are encrypted */
+static int flush_payload(struct persist_data *data) {
+  size_t length = data->payload.size;
+  if(!length) {
+    return 0;
+  }
+
+  void *chunk = msgpack_sbuffer_release(&data->payload);
+  int err = bg_io_write(data->file, data->payload_offset + data->written, chunk, length);
+  data->written += length;
+  return err;
+}
+
+static int persist_record(bg_password *password, void *_data) {
+  int err = 0;
+  struct persist_data *data = _data;
+
+  if(data->count == data->capacity) {
+    size_t capacity = data->capacity ? data->capacity * 2 : 16;
+    struct bg_record_entry *entries = realloc(data->entries, capacity * sizeof(struct bg_record_entry));
+    if(!entries) {
+      return -3;
+    }
+    data->entries = entries;
+    data->capacity = capacity;
+  }
+  struct bg_record_entry *entry = &data->entries[data->count];
+
+  bg_string *name = NULL;
+  if((err = plain_name(data->self, password, &name))) {
+    return err;
+  }
+  entry->blind_index = bg_siphash(data->blind_key, bg_string_data(name), bg_string_length(name));
+  bg_string_clean_free(name);
+
+  msgpack_packer pk;
+  msgpack_sbuffer_clear(&data->record);
+  msgpack_packer_init(&pk, &data->record, msgpack_sbuffer_write);
+  if((err = bg_persistence_msgpack_serialize_password(&pk, password))) {
+    return err;
+  }
+  entry->hash = bg_siphash(data->blind_key, data->record.data, data->record.size);
+
+  size_t buffered = data->payload.size;
+  if((err = append_section(data->self, &data->payload, data->record.data, data->record.size))) {
+    return err;
+  }
+  entry->offset = data->written + buffered;
+  entry->length = data->payload.size - buffered;
+
+  ++data->count;
+  return data->payload.size >= WRITE_CHUNK ? flush_payload(data) : 0;
+}
+
+/* index is encrypted as is: its length only depends on record count */
+static size_t index_length(bg_msgpack_persister *self, size_t count) {
+  size_t iv_length = self->secret_key && self->cryptor ? bg_cryptor_iv_length(self->cryptor) : 0;
+  return iv_length + count * BG_RECORD_ENTRY_LENGTH;
+}
+
+static int write_buffer(bg_io_file *file, uint64_t offset, const void *data, size_t length) {
+  if(!length) {
+    return 0;
+  }
+
+  void *copy = malloc(length);
+  if(!copy) {
+    return -3;
+  }
+  memcpy(copy, data, length);
+  return bg_io_write(file, offset, copy, length);
+}
+
+/* [header][iv][encrypted sorted directory][[iv][encrypted record]...]
+   written aside then renamed over persisted file, which is thus either
+   left as it was or fully replaced. payload goes out in chunks as records
+   are encrypted, directory and header once all are */
 int bg_msgpack_persister_persist(bg_persister_t * _self, bg_repository_t *repo) {
   int err = 0;
   bg_msgpack_persister* self = (bg_msgpack_persister*) _self->object;
+  bg_file_header persisted;
+  uint64_t generation = 0;
 
-  msgpack_sbuffer buffer;
-  msgpack_sbuffer_init(&buffer);
-  if((err = bg_persistence_msgpack_serialize_password_array(self, &buffer, repo))) {
-    msgpack_sbuffer_destroy(&buffer);
-    return err;
+  int lock = lock_file(self, LOCK_EX);
+  if(lock < 0) {
+    return -12;
+  }
+  if(bg_msgpack_persister_header(_self, &persisted) == 0) {
+    if(self->tracking && persisted.generation != self->generation) {
+      unlock_file(lock);
+      return -11;
+    }
+    generation = persisted.generation;
   }
 
-  bg_iv_t *iv = NULL;
-  size_t buffer_size = buffer.size;
-  void *memory_buffer = malloc(buffer_size);
+  struct persist_data data;
+  memset(&data, 0, sizeof(struct persist_data));
+  data.self = self;
+  msgpack_sbuffer_init(&data.record);
+  msgpack_sbuffer_init(&data.payload);
+
+  msgpack_sbuffer index;
+  msgpack_sbuffer_init(&index);
+  unsigned char *directory = NULL;
+
+  bg_string *temporary_filename = bg_string_copy(self->persistence_filename);
+  bg_string_cat_char_array(&temporary_filename, ".tmp", 4);
+
+  if((err = derive_blind_key(self, BG_FILE_FORMAT_VERSION, data.blind_key))) {
+    goto end;
+  }
+  if((err = bg_io_write_open(self->io_engine, bg_string_data(temporary_filename), &data.file))) {
+    goto end;
+  }
 
-  if(!memory_buffer) {
-    return -1;
+  data.payload_offset = BG_FILE_HEADER_LENGTH + index_length(self, bg_repository_count(repo));
+  if((err = bg_repository_foreach(repo, &persist_record, &data)) ||
+     (err = flush_payload(&data))) {
+    goto end;
   }
-  memcpy(memory_buffer, buffer.data, buffer.size);
-  msgpack_sbuffer_destroy(&buffer);
 
-  FILE* shadow_file = fopen(bg_string_data(self->persistence_filename), "wb");
+  bg_record_directory_sort(data.entries, data.count);
+  directory = malloc(data.count * BG_RECORD_ENTRY_LENGTH + 1);
+  if(!directory) {
+    err = -3;
+    goto end;
+  }
+  bg_record_directory_encode(data.entries, data.count, directory);
+  if((err = append_section(self, &index, directory, data.count * BG_RECORD_ENTRY_LENGTH))) {
+    goto end;
+  }
 
+  bg_file_header header;
+  bg_file_header_init(&header);
+  header.record_count = data.count;
+  header.index_offset = BG_FILE_HEADER_LENGTH;
+  header.index_length = index.size;
+  header.payload_offset = data.payload_offset;
+  header.payload_length = data.written;
+  header.generation = generation + 1;
   if(self->secret_key && self->cryptor) {
-    bg_cryptor_generate_iv(self->cryptor, &iv);
-    bg_cryptor_encrypt(self->cryptor, memory_buffer, buffer_size, self->secret_key, iv);
-    fwrite(bg_iv_data(iv), 1, bg_iv_length(iv), shadow_file);
+    header.flags |= BG_FILE_ENCRYPTED;
+    header.cryptor_id = bg_cryptor_id(self->cryptor);
+  }
+  /* repository counted otherwise than it iterated: index goes last */
+  if(BG_FILE_HEADER_LENGTH + index.size != data.payload_offset) {
+    header.index_offset = data.payload_offset + data.written;
   }
 
-  fwrite(memory_buffer, 1, buffer_size, shadow_file);
-  fclose(shadow_file);
+  unsigned char header_buffer[BG_FILE_HEADER_LENGTH];
+  bg_file_header_encode(&header, header_buffer);
+
+  if((err = write_buffer(data.file, header.index_offset, index.data, index.size)) ||
+     (err = write_buffer(data.file, 0, header_buffer, BG_FILE_HEADER_LENGTH)) ||
+     (err = bg_io_write_commit(data.file, bg_string_data(self->persistence_filename)))) {
+    goto end;
+  }
+  track(self, header.generation, data.entries, data.count);
+  data.entries = NULL;
+
+end:
+  /* temporary file is removed before another writer can create it again */
+  bg_io_close(data.file);
+  unlock_file(lock);
+  bg_string_free(temporary_filename);
+  memset(data.blind_key, 0, BG_SIPHASH_KEY_LENGTH);
+  free(directory);
+  free(data.entries);
+  msgpack_sbuffer_destroy(&index);
+  msgpack_sbuffer_destroy(&data.payload);
+  msgpack_sbuffer_destroy(&data.record);
+  return err;
+}
+
+static int check_cryptor(bg_msgpack_persister *self, const bg_file_header *header) {
+  if(!(header->flags & BG_FILE_ENCRYPTED)) {
+    return 0;
+  }
+  if(!self->secret_key || !self->cryptor) {
+    return -5;
+  }
+  if(header->cryptor_id != bg_cryptor_id(self->cryptor)) {
+    return -6;
+  }
+  return 0;
+}
+
+static int decrypt_payload(bg_msgpack_persister *self, unsigned char *data, size_t data_length, size_t *data_offset) {
+  if(!self->secret_key || !self->cryptor) {
+    return -5;
+  }
+
+  size_t iv_length = bg_cryptor_iv_length(self->cryptor);
+  if(iv_length > data_length) {
+    return -2;
+  }
+
+  bg_iv_t *iv = bg_iv_new(data, iv_length);
+  bg_cryptor_decrypt(self->cryptor, data + iv_length, data_length - iv_length, self->secret_key, iv);
+  bg_iv_free(iv);
+
+  *data_offset = iv_length;
+  return 0;
+}
+
+/* files written before headers were introduced: [iv][encrypted msgpack array] */
+static int load_legacy(bg_msgpack_persister *self, unsigned char *data, size_t data_length, bg_repository_t *repo) {
+  int err = 0;
+  size_t data_offset = 0;
+
+  if(self->secret_key && self->cryptor) {
+    if((err = decrypt_payload(self, data, data_length, &data_offset))) {
+      return err;
+    }
+  }
+
+  return bg_persistence_msgpack_deserialize_password_array(self, data + data_offset, data_length - data_offset, repo);
+}
+
+/* format 1: [header][iv][encrypted msgpack array] */
+static int load_payload(bg_msgpack_persister *self, const bg_file_header *header,
+                        unsigned char *data, size_t data_length, bg_repository_t *repo) {
+  int err = 0;
+
+  data += header->payload_offset;
+  data_length = header->payload_length;
+
+  size_t data_offset = 0;
+  if(header->flags & BG_FILE_ENCRYPTED) {
+    if((err = decrypt_payload(self, data, data_length, &data_offset))) {
+      return err;
+    }
+  }
+
+  /* a record takes at least one byte: do not trust count further than that */
+  bg_repository_reserve(repo, header->record_count < data_length ? header->record_count : data_length);
+
+  return bg_persistence_msgpack_deserialize_password_array(self, data + data_offset, data_length - data_offset, repo);
+}
+
+/* decrypts index section in place and decodes its directory, sorted by blind index */
+static int read_directory(bg_msgpack_persister *self, const bg_file_header *header,
+                          unsigned char *index, size_t index_length, struct bg_record_entry **entries) {
+  int err = 0;
+  size_t index_offset = 0;
+
+  if(header->flags & BG_FILE_ENCRYPTED) {
+    if((err = decrypt_payload(self, index, index_length, &index_offset))) {
+      return err;
+    }
+  }
+
+  size_t entry_length = header->version < 3 ? BG_RECORD_ENTRY_V2_LENGTH : BG_RECORD_ENTRY_LENGTH;
+  if(header->record_count > (index_length - index_offset) / entry_length ||
+     header->record_count * entry_length != index_length - index_offset) {
+    return -2;
+  }
+
+  *entries = malloc(header->record_count * sizeof(struct bg_record_entry) + 1);
+  if(!*entries) {
+    return -3;
+  }
+  bg_record_directory_decode(*entries, header->record_count, index + index_offset, entry_length);
 
   return 0;
 }
 
+/* decrypts record in place and decodes it into a new password */
+static int read_record(bg_msgpack_persister *self, const bg_file_header *header,
+                       unsigned char *record, size_t record_length, bg_password **password) {
+  int err = 0;
+  size_t record_offset = 0;
+
+  if(header->flags & BG_FILE_ENCRYPTED) {
+    if((err = decrypt_payload(self, record, record_length, &record_offset))) {
+      return err;
+    }
+  }
+
+  *password = bg_password_new();
+  if((err = bg_persistence_msgpack_deserialize_password_record(record + record_offset,
+                                                               record_length - record_offset,
+                                                               *password))) {
+    bg_password_free(*password);
+    *password = NULL;
+  }
+
+  return err;
+}
+
+static int entry_in_payload(const bg_file_header *header, const struct bg_record_entry *entry) {
+  return entry->offset <= header->payload_length &&
+         entry->length <= header->payload_length - entry->offset;
+}
+
+struct msgpack_record_source {
+  bg_record_source source;
+  bg_msgpack_persister *persister;
+  bg_file_header header;
+  unsigned char *payload;
+};
+
+static void record_source_destroy(bg_record_source *_self) {
+  struct msgpack_record_source *self = (struct msgpack_record_source *)_self->object;
+  free(self->payload);
+}
+
+/* decrypts a copy: records stay as persisted in source so they can be materialized again */
+static int record_source_materialize(bg_record_source *_self, const unsigned char *record, size_t length, bg_password **password) {
+  struct msgpack_record_source *self = (struct msgpack_record_source *)_self->object;
+
+  unsigned char *copy = malloc(length + 1);
+  if(!copy) {
+    return -3;
+  }
+  memcpy(copy, record, length);
+
+  int err = read_record(self->persister, &self->header, copy, length, password);
+
+  memset(copy, 0, length);
+  free(copy);
+  return err;
+}
+
+static struct bg_record_source_vtable msgpack_record_source_vtable = {
+  .destroy     = &record_source_destroy,
+  .materialize = &record_source_materialize,
+};
+
+/* hands payload records over to repository, as they are */
+static int add_records(bg_msgpack_persister *self, const bg_file_header *header, const unsigned char *payload,
+                       const struct bg_record_entry *entries, bg_repository_t *repo) {
+  int err = 0;
+
+  struct msgpack_record_source *source = malloc(sizeof(struct msgpack_record_source));
+  if(!source) {
+    return -3;
+  }
+  source->source.vtable = &msgpack_record_source_vtable;
+  source->source.object = source;
+  source->source.references = 1;
+  source->persister = self;
+  source->header = *header;
+  source->payload = malloc(header->payload_length + 1);
+  if(!source->payload) {
+    free(source);
+    return -3;
+  }
+  memcpy(source->payload, payload, header->payload_length);
+
+  size_t i;
+  for(i = 0; i < header->record_count; ++i) {
+    if(!entry_in_payload(header, &entries[i])) {
+      err = -2;
+      break;
+    }
+    if((err = bg_repository_add_record(repo, &source->source, source->payload + entries[i].offset, entries[i].length))) {
+      break;
+    }
+  }
+
+  bg_record_source_release(&source->source);
+  return err;
+}
+
+struct decode_job {
+  bg_msgpack_persister *persister;
+  const bg_file_header *header;
+  unsigned char *payload;
+  const struct bg_record_entry *entries;
+  bg_password **passwords;
+};
+
+static int decode_range(size_t begin, size_t end, void *_job) {
+  struct decode_job *job = _job;
+  size_t i;
+
+  for(i = begin; i < end; ++i) {
+    int err = 0;
+    if((err = read_record(job->persister, job->header, job->payload + job->entries[i].offset,
+                          job->entries[i].length, &job->passwords[i]))) {
+      return err;
+    }
+  }
+  return 0;
+}
+
+/* records sorted by offset and within payload, decrypted in place over
+   executor: they must not overlap. each batch is decoded once read, while
+   following ones are still being read */
+static int decode_records(bg_msgpack_persister *self, const bg_file_header *header, bg_io_file *file,
+                          const struct bg_record_entry *entries, bg_repository_t *repo) {
+  size_t count = header->record_count, i, batch;
+  int err = 0;
+
+  for(i = 1; i < count; ++i) {
+    if(entries[i].offset < entries[i - 1].offset + entries[i - 1].length) {
+      return -2;
+    }
+  }
+
+  bg_password **passwords = calloc(count + 1, sizeof(bg_password *));
+  if(!passwords) {
+    return -3;
+  }
+
+  unsigned char *payload = bg_io_data(file) + header->payload_offset;
+  for(i = 0; i < count && !err; i = batch) {
+    for(batch = i + 1; batch < count && entries[batch].offset + entries[batch].length <= entries[i].offset + DECODE_BATCH; ++batch) {
+    }
+
+    struct decode_job job = { self, header, payload, entries + i, passwords + i };
+    if(!(err = bg_io_read_wait(file, header->payload_offset + entries[batch - 1].offset + entries[batch - 1].length))) {
+      err = bg_executor_for(self->executor, batch - i, DECODE_CHUNK, &decode_range, &job);
+    }
+  }
+  if(!err && !(err = bg_repository_add_all(repo, passwords, count))) {
+    free(passwords);
+    return 0;
+  }
+
+  /* repository kept none, some were not decoded */
+  for(i = 0; i < count; ++i) {
+    if(passwords[i]) {
+      bg_password_free(passwords[i]);
+    }
+  }
+  free(passwords);
+  return err;
+}
+
+/* format 2: records are loaded in persisted order, not directory order */
+static int load_records(bg_msgpack_persister *self, const bg_file_header *header,
+                        bg_io_file *file, bg_repository_t *repo) {
+  int err = 0;
+  struct bg_record_entry *entries = NULL;
+  unsigned char *data = bg_io_data(file);
+
+  if(header->index_offset + header->index_length > bg_io_length(file)) {
+    return -2;
+  }
+  if((err = bg_io_read_wait(file, header->index_offset + header->index_length)) ||
+     (err = read_directory(self, header, data + header->index_offset, header->index_length, &entries))) {
+    return err;
+  }
+
+  bg_record_directory_sort_by_offset(entries, header->record_count);
+  bg_repository_reserve(repo, header->record_count);
+
+  unsigned char *payload = data + header->payload_offset;
+  if(bg_repository_accepts_records(repo) && !self->decode_all) {
+    if(!(err = bg_io_read_wait(file, header->payload_offset + header->payload_length))) {
+      err = add_records(self, header, payload, entries, repo);
+    }
+  } else {
+    size_t i;
+    for(i = 0; i < header->record_count; ++i) {
+      if(!entry_in_payload(header, &entries[i])) {
+        err = -2;
+        break;
+      }
+    }
+    if(!err) {
+      err = decode_records(self, header, file, entries, repo);
+    }
+  }
+
+  /* hashes of older files are keyed otherwise than those persisting computes */
+  if(!err && header->version >= 4) {
+    bg_record_directory_sort(entries, header->record_count);
+    track(self, header->generation, entries, header->record_count);
+    return 0;
+  }
+  free(entries);
+  return err;
+}
+
+/* older formats are decoded once fully read */
+static int load_file(bg_msgpack_persister *self, bg_io_file *file, bg_repository_t *repo) {
+  int err = 0;
+  bg_file_header header;
+  unsigned char *data = bg_io_data(file);
+  size_t data_length = bg_io_length(file);
+
+  if((err = bg_io_read_wait(file, data_length < BG_FILE_HEADER_LENGTH ? data_length : BG_FILE_HEADER_LENGTH))) {
+    return err;
+  }
+  if((err = bg_file_header_decode(&header, data, data_length)) == -1) {
+    return (err = bg_io_read_wait(file, data_length)) ? err : load_legacy(self, data, data_length, repo);
+  } else if(err) {
+    return -7;
+  }
+
+  if(header.payload_offset + header.payload_length > data_length) {
+    return -2;
+  }
+  if((err = check_cryptor(self, &header))) {
+    return err;
+  }
+
+  if(header.version < 2) {
+    return (err = bg_io_read_wait(file, data_length)) ? err : load_payload(self, &header, data, data_length, repo);
+  }
+  return load_records(self, &header, file, repo);
+}
+
 int bg_msgpack_persister_load(bg_persister_t * _self, bg_repository_t *repo) {
+  int err = 0;
+  bg_msgpack_persister* self = (bg_msgpack_persister*) _self->object;
+  bg_io_file *file = NULL;
+
+  /* nothing persisted yet is as good a base as any */
+  int lock = lock_file(self, LOCK_SH);
+  untrack(self);
+  if((err = bg_io_read_open(self->io_engine, bg_string_data(self->persistence_filename), &file))) {
+    if(err == -4) {
+      track(self, 0, NULL, 0);
+    }
+    unlock_file(lock);
+    return err;
+  }
+
+  err = load_file(self, file, repo);
+
+  bg_io_close(file);
+  unlock_file(lock);
+  return err;
+}
+
+static int pread_section(int fd, uint64_t offset, uint64_t length, unsigned char **output) {
+  *output = malloc(length + 1);
+  if(!*output) {
+    return -3;
+  }
+  if(pread(fd, *output, length, offset) != (ssize_t)length) {
+    free(*output);
+    *output = NULL;
+    return -2;
+  }
+  return 0;
+}
+
+static int name_matches(bg_msgpack_persister *self, bg_password *password, const bg_string *name) {
+  bg_string *candidate = NULL;
+  if(plain_name(self, password, &candidate)) {
+    return 0;
+  }
+  int matches = bg_string_compare(candidate, name) == 0;
+  bg_string_clean_free(candidate);
+  return matches;
+}
+
+/* header and directory of files having one, -9 for others */
+static int read_index(bg_msgpack_persister *self, int fd, bg_file_header *header, struct bg_record_entry **entries) {
+  int err = 0;
+  unsigned char header_buffer[BG_FILE_HEADER_LENGTH];
+  unsigned char *index = NULL;
+
+  ssize_t read_length = pread(fd, header_buffer, BG_FILE_HEADER_LENGTH, 0);
+  if((err = bg_file_header_decode(header, header_buffer, read_length < 0 ? 0 : read_length)) == -1 ||
+     (!err && header->version < 2)) {
+    return -9;
+  } else if(err) {
+    return -7;
+  }
+
+  if(!(err = check_cryptor(self, header)) &&
+     !(err = pread_section(fd, header->index_offset, header->index_length, &index))) {
+    err = read_directory(self, header, index, header->index_length, entries);
+  }
+
+  free(index);
+  return err;
+}
+
+/* binary searches directory, then reads and decrypts matching records only */
+int bg_msgpack_persister_fetch(bg_persister_t * _self, const bg_string *name, bg_password **password) {
+  int err = 0;
   bg_msgpack_persister* self = (bg_msgpack_persister*) _self->object;
+  bg_file_header header;
+  struct bg_record_entry *entries = NULL;
+  unsigned char blind_key[BG_SIPHASH_KEY_LENGTH];
+  uint64_t blind_index;
+  size_t i;
+
+  int fd = open(bg_string_data(self->persistence_filename), O_RDONLY);
+  if(fd < 0) return -4;
+
+  if((err = read_index(self, fd, &header, &entries))) {
+    goto end;
+  }
+
+  if((err = derive_blind_key(self, header.version, blind_key))) {
+    goto end;
+  }
+  blind_index = bg_siphash(blind_key, bg_string_data(name), bg_string_length(name));
+  memset(blind_key, 0, BG_SIPHASH_KEY_LENGTH);
+
+  /* same blind index does not imply same name: check each candidate */
+  err = 1;
+  for(i = bg_record_directory_find(entries, header.record_count, blind_index);
+      i < header.record_count && entries[i].blind_index == blind_index; ++i) {
+    unsigned char *record = NULL;
+    bg_password *candidate = NULL;
+
+    if(!entry_in_payload(&header, &entries[i])) {
+      err = -2;
+      break;
+    }
+
+    int read_err = 0;
+    if((read_err = pread_section(fd, header.payload_offset + entries[i].offset, entries[i].length, &record)) ||
+       (read_err = read_record(self, &header, record, entries[i].length, &candidate))) {
+      free(record);
+      err = read_err;
+      break;
+    }
+    free(record);
+
+    if(name_matches(self, candidate, name)) {
+      *password = candidate;
+      err = 0;
+      break;
+    }
+    bg_password_free(candidate);
+  }
+
+end:
+  free(entries);
+  close(fd);
+  return err;
+}
+
+/* repository password as it would be persisted */
+struct local_record {
+  uint64_t blind_index;
+  uint64_t hash;
+  bg_string *name; /* as stored */
+};
+
+struct local_records {
+  bg_msgpack_persister *self;
+  const unsigned char *blind_key;
+  msgpack_sbuffer buffer;
+  struct local_record *records;
+  size_t count;
+  size_t capacity;
+};
+
+static int collect_local_record(bg_password *password, void *_locals) {
+  int err = 0;
+  struct local_records *locals = _locals;
+
+  if(locals->count == locals->capacity) {
+    size_t capacity = locals->capacity ? locals->capacity * 2 : 16;
+    struct local_record *records = realloc(locals->records, capacity * sizeof(struct local_record));
+    if(!records) {
+      return -3;
+    }
+    locals->records = records;
+    locals->capacity = capacity;
+  }
+  struct local_record *record = &locals->records[locals->count];
+
+  bg_string *name = NULL;
+  if((err = plain_name(locals->self, password, &name))) {
+    return err;
+  }
+  record->blind_index = bg_siphash(locals->blind_key, bg_string_data(name), bg_string_length(name));
+  bg_string_clean_free(name);
+
+  msgpack_packer pk;
+  msgpack_sbuffer_clear(&locals->buffer);
+  msgpack_packer_init(&pk, &locals->buffer, msgpack_sbuffer_write);
+  if((err = bg_persistence_msgpack_serialize_password(&pk, password))) {
+    return err;
+  }
+  record->hash = bg_siphash(locals->blind_key, locals->buffer.data, locals->buffer.size);
+
+  if(!(record->name = bg_string_copy(bg_password_name(password)))) {
+    return -3;
+  }
+  ++locals->count;
+  return 0;
+}
+
+static int compare_local_records(const void *lhs, const void *rhs) {
+  const struct local_record *a = lhs, *b = rhs;
+  return a->blind_index < b->blind_index ? -1 : a->blind_index > b->blind_index;
+}
+
+static struct local_record *find_local_record(struct local_records *locals, uint64_t blind_index) {
+  struct local_record key = { blind_index, 0, NULL };
+  return bsearch(&key, locals->records, locals->count, sizeof(struct local_record), &compare_local_records);
+}
+
+static const struct bg_record_entry *find_entry(const struct bg_record_entry *entries, size_t count, uint64_t blind_index) {
+  size_t i = bg_record_directory_find(entries, count, blind_index);
+  return i < count ? &entries[i] : NULL;
+}
+
+/* persisted record replaces local one, or is added when there is none */
+static int apply_record(bg_msgpack_persister *self, int fd, const bg_file_header *header,
+                        const struct bg_record_entry *entry, struct local_record *local, bg_repository_t *repo) {
+  int err = 0;
+  unsigned char *record = NULL;
+  bg_password *password = NULL;
+
+  if(!entry_in_payload(header, entry)) {
+    return -2;
+  }
+  if((err = pread_section(fd, header->payload_offset + entry->offset, entry->length, &record)) ||
+     (err = read_record(self, header, record, entry->length, &password))) {
+    free(record);
+    return err;
+  }
+  free(record);
+
+  if((local && (err = bg_repository_remove(repo, local->name))) ||
+     (err = bg_repository_add(repo, password))) {
+    bg_password_free(password);
+  }
+  return err;
+}
+
+/* compares persisted directory to the one last loaded or persisted: only
+   records whose content hash differs are read, and only applied where repo
+   still has what was last loaded or persisted */
+int bg_msgpack_persister_refresh(bg_persister_t * _self, bg_repository_t *repo) {
+  int err = 0, changed = 0;
+  bg_msgpack_persister* self = (bg_msgpack_persister*) _self->object;
+  bg_file_header header;
+  struct bg_record_entry *entries = NULL;
+  unsigned char blind_key[BG_SIPHASH_KEY_LENGTH];
+  struct local_records locals;
+  size_t i;
+
+  if(!self->tracking) {
+    return -9;
+  }
+
+  memset(&locals, 0, sizeof(struct local_records));
+  locals.self = self;
+  locals.blind_key = blind_key;
+  msgpack_sbuffer_init(&locals.buffer);
+
+  int lock = lock_file(self, LOCK_SH);
+  int fd = open(bg_string_data(self->persistence_filename), O_RDONLY);
+  if(fd < 0) {
+    err = -4;
+    goto end;
+  }
+
+  if((err = read_index(self, fd, &header, &entries))) {
+    goto end;
+  }
+  if(header.generation == self->generation) {
+    goto end;
+  }
+  if(header.version < 4) {
+    err = -9;
+    goto end;
+  }
+  bg_record_directory_sort(entries, header.record_count);
+
+  if((err = derive_blind_key(self, header.version, blind_key)) ||
+     (err = bg_repository_foreach(repo, &collect_local_record, &locals))) {
+    goto end;
+  }
+  if(locals.count > 1) {
+    qsort(locals.records, locals.count, sizeof(struct local_record), &compare_local_records);
+  }
+
+  /* added or changed by others */
+  for(i = 0; i < header.record_count; ++i) {
+    const struct bg_record_entry *base = find_entry(self->known, self->known_count, entries[i].blind_index);
+    struct local_record *local = find_local_record(&locals, entries[i].blind_index);
+
+    if(base && base->hash == entries[i].hash) {
+      continue;
+    }
+    if(base ? !local || local->hash != base->hash : local != NULL) {
+      continue;
+    }
+    if((err = apply_record(self, fd, &header, &entries[i], local, repo))) {
+      goto end;
+    }
+    changed = 1;
+  }
+
+  /* removed by others */
+  for(i = 0; i < self->known_count; ++i) {
+    struct local_record *local = find_local_record(&locals, self->known[i].blind_index);
+
+    if(find_entry(entries, header.record_count, self->known[i].blind_index) ||
+       !local || local->hash != self->known[i].hash) {
+      continue;
+    }
+    if((err = bg_repository_remove(repo, local->name))) {
+      goto end;
+    }
+    changed = 1;
+  }
+
+  track(self, header.generation, entries, header.record_count);
+  entries = NULL;
+  err = changed;
+
+end:
+  for(i = 0; i < locals.count; ++i) {
+    bg_string_free(locals.records[i].name);
+  }
+  free(locals.records);
+  msgpack_sbuffer_destroy(&locals.buffer);
+  memset(blind_key, 0, BG_SIPHASH_KEY_LENGTH);
+  free(entries);
+  if(fd >= 0) {
+    close(fd);
+  }
+  unlock_file(lock);
+  return err;
+}
+
+int bg_msgpack_persister_header(bg_persister_t *_self, bg_file_header *header) {
+  bg_msgpack_persister* self = (bg_msgpack_persister*) _self->object;
+  unsigned char header_buffer[BG_FILE_HEADER_LENGTH];
 
   FILE* shadow_file = fopen(bg_string_data(self->persistence_filename), "rb");
   if(!shadow_file) return -4;
 
-  fseek(shadow_file, 0, SEEK_END);
-  size_t data_length = ftell(shadow_file);
-  fseek(shadow_file, 0, SEEK_SET);
+  size_t read_length = fread(header_buffer, 1, BG_FILE_HEADER_LENGTH, shadow_file);
+  fclose(shadow_file);
 
-  unsigned char* data = malloc(data_length);
-  if(!data) { return -3; }
+  return bg_file_header_decode(header, header_buffer, read_length);
+}
 
-  if(fread(data, sizeof(char), data_length, shadow_file) != data_length) { return -2; }
-  fclose(shadow_file);
+int bg_msgpack_persister_count(bg_persister_t *self, size_t *count) {
+  int err = 0;
+  bg_file_header header;
 
-  size_t data_offset = 0;
-  if(self->secret_key && self->cryptor) {
-    data_offset = bg_cryptor_iv_length(self->cryptor);
-    bg_iv_t *iv = bg_iv_new(data, data_offset);
-    bg_cryptor_decrypt(self->cryptor, data + data_offset, data_length - data_offset, self->secret_key, iv);
-    bg_iv_free(iv);
+  if((err = bg_msgpack_persister_header(self, &header))) {
+    return err;
   }
 
-  int error_value = bg_persistence_msgpack_deserialize_password_array(self, data + data_offset, data_length - data_offset, repo);
-
-  free(data);
-  return error_value;
+  *count = header.record_count;
+  return 0;
 }
@@ -1,123 +1,192 @@
 #include "msgpack_serialize.h"
+#include "password_fields.h"
 #include <blurgather/repository.h>
-#include <blurgather/map.h>
-#include <blurgather/password_to_map.h>
+#include <blurgather/executor.h>
 
-static int get_keyvalue_iterator(const char *field, msgpack_object_kv **keyvalue_iterator_ptr, char **iterator, size_t *size, int error_value) {
-  if(memcmp(field, (*keyvalue_iterator_ptr)->key.via.str.ptr, (*keyvalue_iterator_ptr)->key.via.str.size)) {
-    return error_value;
-  }
-  *iterator = (char*)(*keyvalue_iterator_ptr)->val.via.str.ptr;
-  *size = (*keyvalue_iterator_ptr)->val.via.str.size;
+/* passwords built by each executor task */
+#define DESERIALIZE_CHUNK 64
 
-  return 0;
-}
+#define COUNT_FIELD(field, accessor, filler, type, required) + 1
 
-static int serialize_field(const bg_string *field_key,
-                           const bg_string *field_value,
-                           msgpack_packer *packer) {
-  /* key */
-  msgpack_pack_str(packer, bg_string_length(field_key));
-  msgpack_pack_str_body(packer, bg_string_data(field_key), bg_string_length(field_key));
+#define PACK_FIELD(field, accessor, filler, type, required)             \
+  msgpack_pack_str(packer, BG_PASSWORD_FIELD_KEY_LENGTH(field));        \
+  msgpack_pack_str_body(packer, BG_PASSWORD_FIELD_KEY(field),           \
+                        BG_PASSWORD_FIELD_KEY_LENGTH(field));           \
+  msgpack_pack_##type(packer, bg_string_length(accessor(password)));    \
+  msgpack_pack_##type##_body(packer,                                    \
+                             bg_string_data(accessor(password)),        \
+                             bg_string_length(accessor(password)));
 
-  /* value */
-  msgpack_pack_bin(packer, bg_string_length(field_value));
-  msgpack_pack_bin_body(packer, bg_string_data(field_value), bg_string_length(field_value));
+#define MSGPACK_TYPE_bin MSGPACK_OBJECT_BIN
+#define MSGPACK_TYPE_str MSGPACK_OBJECT_STR
 
-  return 0;
+#define DESCRIBE_FIELD(field, accessor, filler, msgpack_type, required) \
+  { .type = MSGPACK_TYPE_##msgpack_type, .fill = &filler },
+
+static const struct field_descriptor {
+  msgpack_object_type type;
+  int (* fill)(bg_password *password, const void *raw, size_t raw_size);
+} field_descriptors[] = {
+  BG_PASSWORD_FIELDS(DESCRIBE_FIELD)
+};
+
+#define REQUIRE_FIELD(field, accessor, filler, type, required) \
+  | ((unsigned int)(required) << BG_PASSWORD_FIELD_##field)
+
+static const unsigned int required_fields = 0 BG_PASSWORD_FIELDS(REQUIRE_FIELD);
+
+#define MATCH_FIELD(field)                                              \
+  if(memcmp(key->ptr, BG_PASSWORD_FIELD_KEY(field), BG_PASSWORD_FIELD_KEY_LENGTH(field)) == 0) { \
+    return BG_PASSWORD_FIELD_##field;                                   \
+  }                                                                     \
+  break
+
+/* perfect hash over known field names: their key lengths are distinct but
+   for name and tags, told apart by first character. a duplicate case here
+   means a new field needs its own discriminant */
+static int field_index(const msgpack_object_str *key) {
+  switch(key->size) {
+  case BG_PASSWORD_FIELD_KEY_LENGTH(name):
+    if(key->ptr[0] == 't') {
+      MATCH_FIELD(tags);
+    }
+    MATCH_FIELD(name);
+  case BG_PASSWORD_FIELD_KEY_LENGTH(description):
+    MATCH_FIELD(description);
+  case BG_PASSWORD_FIELD_KEY_LENGTH(value):
+    MATCH_FIELD(value);
+  case BG_PASSWORD_FIELD_KEY_LENGTH(metadata):
+    MATCH_FIELD(metadata);
+  }
+  return -1;
 }
 
+/* packs straight from the password, as described by BG_PASSWORD_FIELDS */
 int bg_persistence_msgpack_serialize_password(msgpack_packer *packer, bg_password* password) {
-  bg_map *map = NULL;
-  map = bg_password_to_map(password);
-  if(!map) {return -1;}
-
-  msgpack_pack_map(packer, bg_map_length(map));
+  msgpack_pack_map(packer, 0 BG_PASSWORD_FIELDS(COUNT_FIELD));
 
-  int err;
-  if((err = bg_map_foreach(map,
-                           (int (*)(const bg_string*, void*, void*))&serialize_field,
-                           packer))) {
-    return err;
-  }
+  BG_PASSWORD_FIELDS(PACK_FIELD)
 
-  bg_map_free(map);
   return 0;
 }
 
+/* fields may come in any order, unknown ones are skipped */
 int bg_persistence_msgpack_deserialize_password(msgpack_object* object, bg_password* password) {
-  msgpack_object_kv* keyvalue_iterator = object->via.map.ptr;
   int error_value = 0;
-  char *name_iterator, *description_iterator;
-  char *value_iterator;
-  size_t name_size, description_size, value_size;
-
-  if((error_value = get_keyvalue_iterator("name", &keyvalue_iterator, &name_iterator, &name_size,
-                                          -3))) { return error_value; }
-  ++keyvalue_iterator;
-  if((error_value = get_keyvalue_iterator("description", &keyvalue_iterator, &description_iterator,
-                                          &description_size, -4))) { return error_value; }
-  ++keyvalue_iterator;
-  if((error_value = get_keyvalue_iterator("value", &keyvalue_iterator, (char **)&value_iterator, &value_size,
-                                          -5))) { return error_value; }
-
-  if((error_value = bg_password_fill_raw(password, value_iterator, value_size))) {
-    return error_value;
+  unsigned int seen = 0;
+
+  if(object->type != MSGPACK_OBJECT_MAP) {
+    return -2;
   }
 
-  bg_string *name_buffer = bg_string_from_char_array(name_iterator, name_size);
-  bg_password_update_name(password, name_buffer);
+  uint32_t i;
+  for(i = 0; i < object->via.map.size; ++i) {
+    const msgpack_object_kv *keyvalue = &object->via.map.ptr[i];
+
+    if(keyvalue->key.type != MSGPACK_OBJECT_STR) {
+      return -6;
+    }
+
+    int index = field_index(&keyvalue->key.via.str);
+    if(index < 0) {
+      continue;
+    }
+
+    if(keyvalue->val.type != field_descriptors[index].type) {
+      return -6;
+    }
+    if(seen & (1u << index)) {
+      return -7;
+    }
+    seen |= 1u << index;
+
+    if((error_value = field_descriptors[index].fill(password,
+                                                    keyvalue->val.via.bin.ptr,
+                                                    keyvalue->val.via.bin.size))) {
+      return error_value;
+    }
+  }
 
-  bg_string *desc_buffer = bg_string_from_char_array(description_iterator, description_size);
-  bg_password_update_description(password, desc_buffer);
+  for(i = 0; i < BG_PASSWORD_FIELDS_COUNT; ++i) {
+    if((required_fields & (1u << i)) && !(seen & (1u << i))) {
+      return -3 - (int)i;
+    }
+  }
 
-  return error_value;
+  return 0;
 }
 
-struct serialize_data {
-  msgpack_packer *packer;
-  bg_msgpack_persister *persister;
-};
+/* a single record, as persisted by format 2 */
+int bg_persistence_msgpack_deserialize_password_record(const unsigned char* data, size_t data_length, bg_password *password) {
+  msgpack_zone mempool;
+  msgpack_zone_init(&mempool, 512);
+  msgpack_object deserialized;
+  msgpack_unpack_return unpacked = msgpack_unpack((const char*)data, data_length, NULL, &mempool, &deserialized);
 
-static int serialize_password(bg_password *pwd, void *_serialize_data) {
-  msgpack_packer *pk = ((struct serialize_data *)_serialize_data)->packer;
-  bg_msgpack_persister *self = ((struct serialize_data *)_serialize_data)->persister;
+  int err = 0;
+  if(unpacked != MSGPACK_UNPACK_SUCCESS) {
+    err = -8;
+  } else {
+    err = bg_persistence_msgpack_deserialize_password(&deserialized, password);
+  }
 
-  bg_persistence_msgpack_serialize_password(pk, pwd);
-  return 0;
+  msgpack_zone_destroy(&mempool);
+  return err;
 }
 
-int bg_persistence_msgpack_serialize_password_array(bg_msgpack_persister* self, msgpack_sbuffer* buffer, bg_repository_t *repo) {
-  msgpack_packer pk;
-  msgpack_packer_init(&pk, buffer, msgpack_sbuffer_write);
-
-  struct serialize_data data = {
-    .packer = &pk,
-    .persister = self,
-  };
+struct array_job {
+  msgpack_object *objects;
+  bg_password **passwords;
+};
 
-  msgpack_pack_array(&pk, bg_repository_count(repo));
-  return bg_repository_foreach(repo, &serialize_password, &data);
+static int deserialize_range(size_t begin, size_t end, void *_job) {
+  struct array_job *job = _job;
+  size_t i;
+
+  for(i = begin; i < end; ++i) {
+    int err = 0;
+    if(!(job->passwords[i] = bg_password_new())) {
+      return -3;
+    }
+    if((err = bg_persistence_msgpack_deserialize_password(job->objects + i, job->passwords[i]))) {
+      return err;
+    }
+  }
+  return 0;
 }
 
+/* unpacked in one pass, then passwords are built over persister executor and added all at once */
 int bg_persistence_msgpack_deserialize_password_array(bg_msgpack_persister* self, unsigned char* data, size_t data_length, bg_repository_t *repo) {
   msgpack_zone mempool;
   msgpack_zone_init(&mempool, 2048);
   msgpack_object deserialized;
-  msgpack_unpack((char*)data, data_length, NULL, &mempool, &deserialized);
+  msgpack_unpack_return unpacked = msgpack_unpack((char*)data, data_length, NULL, &mempool, &deserialized);
 
-  int i, err;
-  msgpack_object* ptr = deserialized.via.array.ptr;
-  for(i = 0; i < deserialized.via.array.size; ++i) {
-    bg_password* password = bg_password_new();
+  if((unpacked != MSGPACK_UNPACK_SUCCESS && unpacked != MSGPACK_UNPACK_EXTRA_BYTES) ||
+     deserialized.type != MSGPACK_OBJECT_ARRAY) {
+    msgpack_zone_destroy(&mempool);
+    return -8;
+  }
 
-    err = bg_persistence_msgpack_deserialize_password(ptr + i, password);
-    if(err) { return err; }
+  int err = 0;
+  size_t count = deserialized.via.array.size, i;
+  bg_password **passwords = calloc(count + 1, sizeof(bg_password *));
+  if(!passwords) {
+    msgpack_zone_destroy(&mempool);
+    return -3;
+  }
 
-    err = bg_repository_add(repo, password);
-    if(err) { return err; }
+  struct array_job job = { deserialized.via.array.ptr, passwords };
+  if((err = bg_executor_for(self->executor, count, DESERIALIZE_CHUNK, &deserialize_range, &job)) ||
+     (err = bg_repository_add_all(repo, passwords, count))) {
+    for(i = 0; i < count; ++i) {
+      if(passwords[i]) {
+        bg_password_free(passwords[i]);
+      }
+    }
   }
 
+  free(passwords);
   msgpack_zone_destroy(&mempool);
-  return 0;
+  return err;
 }
@@ -0,0 +1,461 @@
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <blurgather/name_index.h>
+
+struct suffix {
+  const char *text;
+  size_t name;
+  size_t offset;
+};
+
+struct bg_name_index {
+  bg_string **names;
+  size_t *lengths;
+  size_t count;
+  size_t capacity;
+
+  struct suffix *suffixes;
+  size_t suffixes_count;
+  int built;
+};
+
+
+bg_name_index *bg_name_index_new(void) {
+  bg_name_index *index = malloc(sizeof(bg_name_index));
+  memset(index, 0, sizeof(bg_name_index));
+  return index;
+}
+
+void bg_name_index_free(bg_name_index *index) {
+  size_t i;
+  for(i = 0; i < index->count; ++i) {
+    bg_string_clean_free(index->names[i]);
+  }
+  free(index->names);
+  free(index->lengths);
+  free(index->suffixes);
+  free(index);
+}
+
+size_t bg_name_index_count(const bg_name_index *index) {
+  return index->count;
+}
+
+const bg_string *bg_name_index_name(const bg_name_index *index, size_t id) {
+  return id < index->count ? index->names[id] : NULL;
+}
+
+int bg_name_index_reserve(bg_name_index *index, size_t count) {
+  if(count <= index->capacity) {
+    return 0;
+  }
+
+  bg_string **names = realloc(index->names, count * sizeof(bg_string *));
+  if(!names) {
+    return -3;
+  }
+  index->names = names;
+
+  size_t *lengths = realloc(index->lengths, count * sizeof(size_t));
+  if(!lengths) {
+    return -3;
+  }
+  index->lengths = lengths;
+  index->capacity = count;
+
+  return 0;
+}
+
+int bg_name_index_add(bg_name_index *index, const bg_string *name) {
+  int err = 0;
+
+  if(index->count == index->capacity &&
+     (err = bg_name_index_reserve(index, index->capacity ? index->capacity * 2 : 32))) {
+    return err;
+  }
+
+  index->names[index->count] = bg_string_copy(name);
+  index->lengths[index->count] = strlen(bg_string_data(name));
+  ++index->count;
+  index->built = 0;
+  return 0;
+}
+
+static int compare_suffixes(const void *lhs, const void *rhs) {
+  return strcmp(((const struct suffix *)lhs)->text, ((const struct suffix *)rhs)->text);
+}
+
+int bg_name_index_build(bg_name_index *index) {
+  size_t i, total = 0;
+
+  for(i = 0; i < index->count; ++i) {
+    total += index->lengths[i];
+  }
+
+  free(index->suffixes);
+  index->suffixes = malloc((total + 1) * sizeof(struct suffix));
+  if(!index->suffixes) {
+    index->suffixes_count = 0;
+    return -3;
+  }
+
+  index->suffixes_count = 0;
+  for(i = 0; i < index->count; ++i) {
+    const char *name = bg_string_data(index->names[i]);
+    size_t offset, length = index->lengths[i];
+
+    for(offset = 0; offset < length; ++offset) {
+      struct suffix *suffix = &index->suffixes[index->suffixes_count++];
+      suffix->text = name + offset;
+      suffix->name = i;
+      suffix->offset = offset;
+    }
+  }
+
+  if(index->suffixes_count > 1) {
+    qsort(index->suffixes, index->suffixes_count, sizeof(struct suffix), &compare_suffixes);
+  }
+  index->built = 1;
+
+  return 0;
+}
+
+/* first suffix not ordered before pattern, or after it when upper is set */
+static size_t bound(const bg_name_index *index, const char *pattern, size_t length, int upper) {
+  size_t low = 0, high = index->suffixes_count;
+
+  while(low < high) {
+    size_t middle = low + (high - low) / 2;
+    int comparison = strncmp(index->suffixes[middle].text, pattern, length);
+
+    if(comparison < 0 || (upper && comparison == 0)) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  return low;
+}
+
+static int compare_names(const void *lhs, const void *rhs) {
+  size_t a = *(const size_t *)lhs, b = *(const size_t *)rhs;
+  return a < b ? -1 : a > b;
+}
+
+int bg_name_index_search(const bg_name_index *index, const bg_string *pattern, int flags,
+                         int (* callback)(const bg_string *name, void *), void *out) {
+  if(!index->built) {
+    return -1;
+  }
+
+  const char *text = bg_string_data(pattern);
+  size_t length = strlen(text);
+  size_t first = 0, last = index->count;
+  size_t i, found = 0;
+  size_t *matches = NULL;
+
+  /* every name contains empty pattern */
+  if(length) {
+    first = bound(index, text, length, 0);
+    last = bound(index, text, length, 1);
+  }
+  if(first == last) {
+    return 0;
+  }
+
+  matches = malloc((last - first) * sizeof(size_t));
+  if(!matches) {
+    return -3;
+  }
+
+  for(i = first; i < last; ++i) {
+    if(!length) {
+      matches[found++] = i;
+    } else if(!(flags & BG_SEARCH_PREFIX) || index->suffixes[i].offset == 0) {
+      matches[found++] = index->suffixes[i].name;
+    }
+  }
+
+  if(found > 1) {
+    qsort(matches, found, sizeof(size_t), &compare_names);
+  }
+
+  int err = 0;
+  for(i = 0; i < found; ++i) {
+    if(i > 0 && matches[i] == matches[i - 1]) {
+      continue;
+    }
+    if((err = callback(index->names[matches[i]], out))) {
+      break;
+    }
+  }
+
+  free(matches);
+  return err;
+}
+
+/* bit parallel edit distance (Myers, Hyyro), one dp column per word:
+   bit i of peq[c] is set when pattern[i] is c, vertical deltas in pv/mv */
+struct column {
+  uint64_t pv;
+  uint64_t mv;
+  size_t distance;
+};
+
+static void column_step(struct column *column, uint64_t eq, uint64_t high) {
+  uint64_t xv = eq | column->mv;
+  uint64_t xh = (((eq & column->pv) + column->pv) ^ column->pv) | eq;
+  uint64_t ph = column->mv | ~(xh | column->pv);
+  uint64_t mh = column->pv & xh;
+
+  if(ph & high) {
+    ++column->distance;
+  } else if(mh & high) {
+    --column->distance;
+  }
+
+  /* first row is text position: horizontal delta is always +1 there */
+  ph = (ph << 1) | 1;
+  mh <<= 1;
+  column->pv = mh | ~(xv | ph);
+  column->mv = ph & xv;
+}
+
+static size_t finish_distance(struct column *column, const uint64_t *peq, size_t pattern_length,
+                              const char *text, size_t text_length, size_t j, size_t threshold) {
+  uint64_t high = (uint64_t)1 << (pattern_length - 1);
+
+  for(; j < text_length; ++j) {
+    column_step(column, peq[(unsigned char)text[j]], high);
+
+    /* distance drops by at most one per remaining text character */
+    if(column->distance > threshold + (text_length - j - 1)) {
+      return column->distance - (text_length - j - 1);
+    }
+  }
+
+  return column->distance;
+}
+
+static size_t bit_parallel_distance(const uint64_t *peq, size_t pattern_length,
+                                    const char *text, size_t text_length, size_t threshold) {
+  struct column column = { ~(uint64_t)0, 0, pattern_length };
+  return finish_distance(&column, peq, pattern_length, text, text_length, 0, threshold);
+}
+
+#if defined(__SSE2__)
+#define SIMD_NAMES 2
+
+struct simd_columns {
+  __m128i pv;
+  __m128i mv;
+  __m128i distance;
+};
+
+static void simd_step(struct simd_columns *columns, __m128i eq, __m128i high_shift) {
+  const __m128i ones = _mm_set1_epi32(-1);
+  const __m128i one = _mm_set_epi64x(1, 1);
+  __m128i xv = _mm_or_si128(eq, columns->mv);
+  __m128i xh = _mm_or_si128(_mm_xor_si128(_mm_add_epi64(_mm_and_si128(eq, columns->pv), columns->pv), columns->pv), eq);
+  __m128i ph = _mm_or_si128(columns->mv, _mm_andnot_si128(_mm_or_si128(xh, columns->pv), ones));
+  __m128i mh = _mm_and_si128(columns->pv, xh);
+
+  columns->distance = _mm_add_epi64(columns->distance, _mm_and_si128(_mm_srl_epi64(ph, high_shift), one));
+  columns->distance = _mm_sub_epi64(columns->distance, _mm_and_si128(_mm_srl_epi64(mh, high_shift), one));
+
+  ph = _mm_or_si128(_mm_slli_epi64(ph, 1), one);
+  mh = _mm_slli_epi64(mh, 1);
+  columns->pv = _mm_or_si128(mh, _mm_andnot_si128(_mm_or_si128(xv, ph), ones));
+  columns->mv = _mm_and_si128(ph, xv);
+}
+
+static void simd_store(const struct simd_columns *columns, struct column *output) {
+  uint64_t pv[2], mv[2], distance[2];
+  _mm_storeu_si128((__m128i *)pv, columns->pv);
+  _mm_storeu_si128((__m128i *)mv, columns->mv);
+  _mm_storeu_si128((__m128i *)distance, columns->distance);
+
+  output[0].pv = pv[0];
+  output[0].mv = mv[0];
+  output[0].distance = distance[0];
+  output[1].pv = pv[1];
+  output[1].mv = mv[1];
+  output[1].distance = distance[1];
+}
+
+/* same as above for SIMD_NAMES names at once, one per 64 bits lane, while both last */
+static void bit_parallel_distances(const uint64_t *peq, size_t pattern_length,
+                                   const char **texts, const size_t *lengths,
+                                   size_t threshold, size_t *distances) {
+  const __m128i high_shift = _mm_cvtsi32_si128((int)pattern_length - 1);
+  struct simd_columns lanes = { _mm_set1_epi32(-1), _mm_setzero_si128(), _mm_set_epi64x(pattern_length, pattern_length) };
+  struct column columns[SIMD_NAMES];
+  size_t length = lengths[0] < lengths[1] ? lengths[0] : lengths[1];
+  size_t i, j;
+
+  for(j = 0; j < length; ++j) {
+    simd_step(&lanes, _mm_set_epi64x((long long)peq[(unsigned char)texts[1][j]],
+                                     (long long)peq[(unsigned char)texts[0][j]]), high_shift);
+  }
+
+  simd_store(&lanes, columns);
+  for(i = 0; i < SIMD_NAMES; ++i) {
+    distances[i] = finish_distance(&columns[i], peq, pattern_length, texts[i], lengths[i], length, threshold);
+  }
+}
+#endif
+
+/* patterns longer than a word: plain two rows dynamic programming */
+static size_t row_distance(size_t *row, const char *pattern, size_t pattern_length, const char *text, size_t text_length) {
+  size_t i, j;
+
+  for(i = 0; i <= pattern_length; ++i) {
+    row[i] = i;
+  }
+  for(j = 1; j <= text_length; ++j) {
+    size_t diagonal = row[0];
+    row[0] = j;
+    for(i = 1; i <= pattern_length; ++i) {
+      size_t above = row[i];
+      size_t cost = tolower((unsigned char)pattern[i - 1]) != tolower((unsigned char)text[j - 1]);
+      size_t best = diagonal + cost;
+      if(above + 1 < best) best = above + 1;
+      if(row[i - 1] + 1 < best) best = row[i - 1] + 1;
+      row[i] = best;
+      diagonal = above;
+    }
+  }
+
+  return row[pattern_length];
+}
+
+struct candidate {
+  size_t name;
+  size_t distance;
+};
+
+/* keeps best k candidates sorted, closest first */
+static size_t keep_candidate(struct candidate *best, size_t count, size_t k, size_t name, size_t distance) {
+  size_t i = count < k ? count : k - 1;
+
+  if(count == k && best[k - 1].distance <= distance) {
+    return count;
+  }
+  while(i > 0 && best[i - 1].distance > distance) {
+    best[i] = best[i - 1];
+    --i;
+  }
+  best[i].name = name;
+  best[i].distance = distance;
+
+  return count < k ? count + 1 : k;
+}
+
+/* current worst kept distance once k candidates are found */
+static size_t threshold(const struct candidate *best, size_t found, size_t k, size_t max_distance) {
+  return found == k && best[k - 1].distance < max_distance ? best[k - 1].distance : max_distance;
+}
+
+/* first name from start which length allows to be within threshold:
+   length difference is a lower bound of edit distance */
+static size_t next_candidate(const bg_name_index *index, size_t pattern_length, size_t threshold, size_t start) {
+  for(; start < index->count; ++start) {
+    size_t name_length = index->lengths[start];
+    if((name_length > pattern_length ? name_length - pattern_length : pattern_length - name_length) <= threshold) {
+      break;
+    }
+  }
+  return start;
+}
+
+int bg_name_index_fuzzy(const bg_name_index *index, const bg_string *pattern, size_t k, size_t max_distance,
+                        int (* callback)(const bg_string *name, size_t distance, void *), void *out) {
+  const char *pattern_text = bg_string_data(pattern);
+  size_t pattern_length = strlen(pattern_text);
+  uint64_t peq[256];
+  size_t *row = NULL;
+  size_t i, found = 0;
+  int err = 0;
+
+  if(k == 0) {
+    return 0;
+  }
+
+  struct candidate *best = malloc(k * sizeof(struct candidate));
+  if(!best) {
+    return -3;
+  }
+
+  if(pattern_length > 64) {
+    row = malloc((pattern_length + 1) * sizeof(size_t));
+    if(!row) {
+      free(best);
+      return -3;
+    }
+  } else {
+    memset(peq, 0, sizeof(peq));
+    for(i = 0; i < pattern_length; ++i) {
+      peq[(unsigned char)tolower((unsigned char)pattern_text[i])] |= (uint64_t)1 << i;
+      peq[(unsigned char)toupper((unsigned char)pattern_text[i])] |= (uint64_t)1 << i;
+    }
+  }
+
+  i = 0;
+  while((i = next_candidate(index, pattern_length, threshold(best, found, k, max_distance), i)) < index->count) {
+    const char *name = bg_string_data(index->names[i]);
+    size_t name_length = index->lengths[i];
+    size_t distance;
+
+    if(pattern_length == 0) {
+      distance = name_length;
+    } else if(row) {
+      distance = row_distance(row, pattern_text, pattern_length, name, name_length);
+    } else {
+#if defined(__SSE2__)
+      const char *texts[SIMD_NAMES];
+      size_t names[SIMD_NAMES], lengths[SIMD_NAMES], distances[SIMD_NAMES];
+      size_t n, next = i;
+
+      for(n = 0; n < SIMD_NAMES && next < index->count; ++n) {
+        names[n] = next;
+        texts[n] = bg_string_data(index->names[next]);
+        lengths[n] = index->lengths[next];
+        next = next_candidate(index, pattern_length, threshold(best, found, k, max_distance), next + 1);
+      }
+
+      if(n == SIMD_NAMES) {
+        bit_parallel_distances(peq, pattern_length, texts, lengths, threshold(best, found, k, max_distance), distances);
+        for(n = 0; n < SIMD_NAMES; ++n) {
+          if(distances[n] <= max_distance) {
+            found = keep_candidate(best, found, k, names[n], distances[n]);
+          }
+        }
+        i = names[SIMD_NAMES - 1] + 1;
+        continue;
+      }
+#endif
+      distance = bit_parallel_distance(peq, pattern_length, name, name_length,
+                                       threshold(best, found, k, max_distance));
+    }
+
+    if(distance <= max_distance) {
+      found = keep_candidate(best, found, k, i, distance);
+    }
+    ++i;
+  }
+
+  for(i = 0; i < found; ++i) {
+    if((err = callback(index->names[best[i].name], best[i].distance, out))) {
+      break;
+    }
+  }
+
+  free(row);
+  free(best);
+  return err;
+}
@@ -2,16 +2,107 @@
 #include <blurgather/cryptor.h>
 #include <blurgather/repository.h>
 #include <blurgather/encryption.h>
+#include "field_list.h"
 
 
+/* fields storage: short strings live inside the record itself, longer ones
+   spill to the heap. 96 bytes fit a 48 bytes field once prefixed by its iv */
+#define BG_PASSWORD_FIELD_STORAGE 96
+
+struct bg_password_field {
+  bg_string *str;
+  size_t storage[BG_PASSWORD_FIELD_STORAGE / sizeof(size_t)];
+};
+
 struct bg_password {
-  bg_string *name;
-  bg_string *description;
-  bg_string *value;
+  struct bg_password_field name;
+  struct bg_password_field description;
+  struct bg_password_field value;
+  struct bg_password_field tags;
+  struct bg_password_field metadata;
 
   int crypted;
 };
 
+#define FIELD_INLINE(field) ((void *)(field)->str == (void *)(field)->storage)
+
+static void field_init(struct bg_password_field *field) {
+  field->str = bg_string_in_place(field->storage, "", 0);
+}
+
+static void field_release(struct bg_password_field *field) {
+  if(FIELD_INLINE(field)) {
+    bg_string_clean(field->str);
+  } else {
+    bg_string_clean_free(field->str);
+  }
+}
+
+/* copies data, inline when it fits */
+static void field_assign(struct bg_password_field *field, const char *data, size_t length) {
+  field_release(field);
+
+  if(bg_string_storage_size(length) <= sizeof(field->storage)) {
+    field->str = bg_string_in_place(field->storage, data, length);
+  } else {
+    field->str = bg_string_from_char_array(data, length);
+  }
+}
+
+/* takes memory acquisition of str */
+static void field_adopt(struct bg_password_field *field, bg_string *str) {
+  field_release(field);
+  field->str = str;
+}
+
+/* takes memory acquisition of str, moving it inline when it fits */
+static void field_take(struct bg_password_field *field, bg_string *str) {
+  if(bg_string_storage_size(bg_string_length(str)) <= sizeof(field->storage)) {
+    field_assign(field, bg_string_data(str), bg_string_length(str));
+    bg_string_clean_free(str);
+  } else {
+    field_adopt(field, str);
+  }
+}
+
+static void field_copy(struct bg_password_field *field, const struct bg_password_field *copied) {
+  if(bg_string_storage_size(bg_string_length(copied->str)) <= sizeof(field->storage)) {
+    field->str = bg_string_in_place(field->storage, bg_string_data(copied->str), bg_string_length(copied->str));
+  } else {
+    field->str = bg_string_copy(copied->str);
+  }
+}
+
+static int field_encrypt(struct bg_password_field *field, bg_cryptor_t *cryptor, bg_secret_key_t *key) {
+  int err = 0;
+  bg_string *output;
+
+  if((err = bg_encrypt_string_to(field->str, &output, cryptor, key))) {
+    return err;
+  }
+
+  field_take(field, output);
+  return 0;
+}
+
+static int field_decrypt(struct bg_password_field *field, bg_cryptor_t *cryptor, bg_secret_key_t *key) {
+  int err = 0;
+  bg_string *output;
+
+  /* crypted fields hold at least their iv, optional ones missing from older records are empty */
+  if(bg_string_length(field->str) == 0) {
+    return 0;
+  }
+
+  if((err = bg_decrypt_string_to(field->str, &output, cryptor, key))) {
+    return err;
+  }
+
+  field_take(field, output);
+  return 0;
+}
+
+
 size_t bg_password_size() {
   return sizeof(bg_password);
 }
@@ -19,9 +110,11 @@ size_t bg_password_size() {
 bg_password *bg_password_new(void) {
   bg_password *self = malloc(sizeof(bg_password));
 
-  self->name = bg_string_new();
-  self->description = bg_string_new();
-  self->value = bg_string_new();
+  field_init(&self->name);
+  field_init(&self->description);
+  field_init(&self->value);
+  field_init(&self->tags);
+  field_init(&self->metadata);
 
   self->crypted = 0;
 
@@ -31,18 +124,22 @@ bg_password *bg_password_new(void) {
 bg_password *bg_password_copy(const bg_password *password) {
   bg_password *self = malloc(sizeof(bg_password));
 
-  self->name = bg_string_copy(password->name);
-  self->description = bg_string_copy(password->description);
-  self->value = bg_string_copy(password->value);
+  field_copy(&self->name, &password->name);
+  field_copy(&self->description, &password->description);
+  field_copy(&self->value, &password->value);
+  field_copy(&self->tags, &password->tags);
+  field_copy(&self->metadata, &password->metadata);
   self->crypted = password->crypted;
 
   return self;
 }
 
 void bg_password_free(bg_password *self) {
-  bg_string_clean_free(self->name);
-  bg_string_clean_free(self->description);
-  bg_string_clean_free(self->value);
+  field_release(&self->name);
+  field_release(&self->description);
+  field_release(&self->value);
+  field_release(&self->tags);
+  field_release(&self->metadata);
   free(self);
 }
 
@@ -54,15 +151,21 @@ int bg_password_crypt(bg_password *self, bg_cryptor_t *cryptor, bg_secret_key_t
   if(self->crypted) {
     return -1;
   }
-  if((err = bg_encrypt_string(&self->name, cryptor, key))) {
+  if((err = field_encrypt(&self->name, cryptor, key))) {
     return -2;
   }
-  if((err = bg_encrypt_string(&self->description, cryptor, key))) {
+  if((err = field_encrypt(&self->description, cryptor, key))) {
     return -3;
   }
-  if((err = bg_encrypt_string(&self->value, cryptor, key))) {
+  if((err = field_encrypt(&self->value, cryptor, key))) {
     return -4;
   }
+  if((err = field_encrypt(&self->tags, cryptor, key))) {
+    return -5;
+  }
+  if((err = field_encrypt(&self->metadata, cryptor, key))) {
+    return -6;
+  }
   self->crypted = 1;
   return 0;
 }
@@ -72,21 +175,27 @@ int bg_password_decrypt(bg_password *self, bg_cryptor_t *cryptor, bg_secret_key_
   if(!self->crypted) {
     return -1;
   }
-  if((err = bg_decrypt_string(&self->name, cryptor, key))) {
+  if((err = field_decrypt(&self->name, cryptor, key))) {
     return -2;
   }
-  if((err = bg_decrypt_string(&self->description, cryptor, key))) {
+  if((err = field_decrypt(&self->description, cryptor, key))) {
     return -3;
   }
-  if((err = bg_decrypt_string(&self->value, cryptor, key))) {
+  if((err = field_decrypt(&self->value, cryptor, key))) {
     return -4;
   }
+  if((err = field_decrypt(&self->tags, cryptor, key))) {
+    return -5;
+  }
+  if((err = field_decrypt(&self->metadata, cryptor, key))) {
+    return -6;
+  }
   self->crypted = 0;
   return 0;
 }
 
 const bg_string *bg_password_name(const bg_password *password) {
-  return password->name;
+  return password->name.str;
 }
 
 int bg_password_crypted(bg_password *password) {
@@ -94,11 +203,11 @@ int bg_password_crypted(bg_password *password) {
 }
 
 const bg_string *bg_password_description(const bg_password *password) {
-  return password->description;
+  return password->description.str;
 }
 
 const bg_string *bg_password_value(const bg_password *password) {
-  return password->value;
+  return password->value.str;
 }
 
 static int check_str_non_empty(const bg_string *str) {
@@ -109,7 +218,7 @@ int bg_password_update_name(bg_password *password, bg_string *name) {
   int error_code = 0;
   if((error_code = check_str_non_empty(name))) { return error_code; }
 
-  bg_string_clean_replace(password->name, name);
+  field_adopt(&password->name, name);
 
   return 0;
 }
@@ -118,7 +227,7 @@ int bg_password_update_description(bg_password *password, bg_string *description
   int error_code = 0;
   if((error_code = check_str_non_empty(description))) { return error_code; }
 
-  bg_string_clean_replace(password->description, description);
+  field_adopt(&password->description, description);
 
   return 0;
 }
@@ -127,23 +236,224 @@ int bg_password_update_value(bg_password *password, bg_string *value) {
   int error_code = 0;
   if((error_code = check_str_non_empty(value))) { return error_code; }
 
-  bg_string_clean_replace(password->value, value);
+  field_adopt(&password->value, value);
 
   return 0;
 }
 
 size_t bg_password_value_length(const bg_password *password) {
-  return bg_string_length(password->value);
+  return bg_string_length(password->value.str);
 }
 
-int bg_password_fill_raw(bg_password *password, const void *crypted_value, size_t crypted_value_size) {
-  if(bg_string_length(password->value)) {
+static int fill_raw_field(bg_password *password, struct bg_password_field *field, const void *raw, size_t raw_size) {
+  if(bg_string_length(field->str)) {
     return -1;
   }
 
-  bg_string_clean_free(password->value);
-  password->value = bg_string_from_char_array(crypted_value, crypted_value_size);
+  field_assign(field, raw, raw_size);
   password->crypted = 1;
 
   return 0;
 }
+
+int bg_password_fill_raw(bg_password *password, const void *crypted_value, size_t crypted_value_size) {
+  return fill_raw_field(password, &password->value, crypted_value, crypted_value_size);
+}
+
+int bg_password_fill_raw_name(bg_password *password, const void *crypted_name, size_t crypted_name_size) {
+  return fill_raw_field(password, &password->name, crypted_name, crypted_name_size);
+}
+
+int bg_password_fill_raw_description(bg_password *password, const void *crypted_description, size_t crypted_description_size) {
+  return fill_raw_field(password, &password->description, crypted_description, crypted_description_size);
+}
+
+int bg_password_fill_raw_tags(bg_password *password, const void *crypted_tags, size_t crypted_tags_size) {
+  return fill_raw_field(password, &password->tags, crypted_tags, crypted_tags_size);
+}
+
+int bg_password_fill_raw_metadata(bg_password *password, const void *crypted_metadata, size_t crypted_metadata_size) {
+  return fill_raw_field(password, &password->metadata, crypted_metadata, crypted_metadata_size);
+}
+
+static int field_append(struct bg_password_field *field, const char *item, size_t length) {
+  int err = 0;
+  bg_string *list = bg_string_copy(field->str);
+
+  if((err = bg_field_list_append(&list, item, length))) {
+    bg_string_clean_free(list);
+    return err;
+  }
+
+  field_take(field, list);
+  return 0;
+}
+
+
+/* tags */
+
+const bg_string *bg_password_tags(const bg_password *password) {
+  return password->tags.str;
+}
+
+static int match_item(const char *item, size_t length, void *_str) {
+  const bg_string *str = _str;
+  return length == bg_string_length(str) && memcmp(item, bg_string_data(str), length) == 0;
+}
+
+int bg_password_has_tag(const bg_password *password, const bg_string *tag) {
+  if(password->crypted) {
+    return 0;
+  }
+  return bg_field_list_foreach(password->tags.str, &match_item, (void *)tag) == 1;
+}
+
+int bg_password_add_tag(bg_password *password, const bg_string *tag) {
+  if(password->crypted) {
+    return -1;
+  }
+  if(!bg_field_list_valid_item(bg_string_data(tag), bg_string_length(tag))) {
+    return -2;
+  }
+  if(bg_password_has_tag(password, tag)) {
+    return 0;
+  }
+
+  return field_append(&password->tags, bg_string_data(tag), bg_string_length(tag));
+}
+
+int bg_password_foreach_tag(const bg_password *password, int (* callback)(const char *tag, size_t length, void *), void *out) {
+  if(password->crypted) {
+    return -1;
+  }
+  return bg_field_list_foreach(password->tags.str, callback, out);
+}
+
+
+/* metadata, listed as alternating keys and values */
+
+struct metadata_walk {
+  int (* callback)(const char *key, size_t key_length, const char *value, size_t value_length, void *);
+  void *out;
+  const char *key;
+  size_t key_length;
+};
+
+static int walk_metadata(const char *item, size_t length, void *_walk) {
+  struct metadata_walk *walk = _walk;
+
+  if(!walk->key) {
+    walk->key = item;
+    walk->key_length = length;
+    return 0;
+  }
+
+  const char *key = walk->key;
+  walk->key = NULL;
+  return walk->callback(key, walk->key_length, item, length, walk->out);
+}
+
+static int foreach_metadata(const bg_string *metadata,
+                            int (* callback)(const char *key, size_t key_length, const char *value, size_t value_length, void *),
+                            void *out) {
+  struct metadata_walk walk = { .callback = callback, .out = out, .key = NULL, .key_length = 0 };
+  return bg_field_list_foreach(metadata, &walk_metadata, &walk);
+}
+
+const bg_string *bg_password_metadata(const bg_password *password) {
+  return password->metadata.str;
+}
+
+int bg_password_foreach_metadata(const bg_password *password,
+                                 int (* callback)(const char *key, size_t key_length, const char *value, size_t value_length, void *),
+                                 void *out) {
+  if(password->crypted) {
+    return -1;
+  }
+  return foreach_metadata(password->metadata.str, callback, out);
+}
+
+struct metadata_lookup {
+  const bg_string *key;
+  bg_string *value;
+};
+
+static int lookup_metadata(const char *key, size_t key_length, const char *value, size_t value_length, void *_lookup) {
+  struct metadata_lookup *lookup = _lookup;
+
+  if(!match_item(key, key_length, (void *)lookup->key)) {
+    return 0;
+  }
+
+  lookup->value = bg_string_from_char_array(value, value_length);
+  return 1;
+}
+
+int bg_password_get_metadata(const bg_password *password, const bg_string *key, bg_string **value) {
+  struct metadata_lookup lookup = { .key = key, .value = NULL };
+
+  if(password->crypted) {
+    return -1;
+  }
+  if(foreach_metadata(password->metadata.str, &lookup_metadata, &lookup) != 1) {
+    return 1;
+  }
+
+  *value = lookup.value;
+  return 0;
+}
+
+struct metadata_update {
+  const bg_string *key;
+  const bg_string *value;
+  bg_string *list;
+  int replaced;
+};
+
+/* copies pairs to the new list, replacing value of updated key in place */
+static int copy_metadata(const char *key, size_t key_length, const char *value, size_t value_length, void *_update) {
+  struct metadata_update *update = _update;
+  int err = 0;
+
+  if(match_item(key, key_length, (void *)update->key)) {
+    value = bg_string_data(update->value);
+    value_length = bg_string_length(update->value);
+    update->replaced = 1;
+  }
+
+  if((err = bg_field_list_append(&update->list, key, key_length)) ||
+     (err = bg_field_list_append(&update->list, value, value_length))) {
+    return err;
+  }
+
+  return 0;
+}
+
+int bg_password_set_metadata(bg_password *password, const bg_string *key, const bg_string *value) {
+  struct metadata_update update = { .key = key, .value = value, .list = bg_string_new(), .replaced = 0 };
+  int err = 0;
+
+  if(password->crypted) {
+    bg_string_free(update.list);
+    return -1;
+  }
+  if(!bg_field_list_valid_item(bg_string_data(key), bg_string_length(key)) ||
+     !bg_field_list_valid_item(bg_string_data(value), bg_string_length(value))) {
+    bg_string_free(update.list);
+    return -2;
+  }
+
+  if(!(err = foreach_metadata(password->metadata.str, &copy_metadata, &update)) && !update.replaced) {
+    if(!(err = bg_field_list_append(&update.list, bg_string_data(key), bg_string_length(key)))) {
+      err = bg_field_list_append(&update.list, bg_string_data(value), bg_string_length(value));
+    }
+  }
+
+  if(err) {
+    bg_string_clean_free(update.list);
+    return err;
+  }
+
+  field_take(&password->metadata, update.list);
+  return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef _BLURGATHER_PASSWORD_FIELDS_H_
+#define _BLURGATHER_PASSWORD_FIELDS_H_
+
+#include <blurgather/password.h>
+
+/* persisted password fields, in serialization order:
+   X(field, accessor, raw filler, msgpack type, required)
+   records persisted before optional fields existed lack them */
+#define BG_PASSWORD_FIELDS(X)                                                        \
+  X(name,        bg_password_name,        bg_password_fill_raw_name,        bin, 1) \
+  X(description, bg_password_description, bg_password_fill_raw_description, bin, 1) \
+  X(value,       bg_password_value,       bg_password_fill_raw,             bin, 1) \
+  X(tags,        bg_password_tags,        bg_password_fill_raw_tags,        bin, 0) \
+  X(metadata,    bg_password_metadata,    bg_password_fill_raw_metadata,    bin, 0)
+
+#define BG_PASSWORD_FIELD_ENUM(field, accessor, filler, type, required) BG_PASSWORD_FIELD_##field,
+enum bg_password_field_index {
+  BG_PASSWORD_FIELDS(BG_PASSWORD_FIELD_ENUM)
+  BG_PASSWORD_FIELDS_COUNT
+};
+#undef BG_PASSWORD_FIELD_ENUM
+
+#define BG_PASSWORD_FIELD_KEY(field) #field
+#define BG_PASSWORD_FIELD_KEY_LENGTH(field) (sizeof(#field) - 1)
+
+#endif
@@ -2,13 +2,13 @@
 #include <blurgather/password.h>
 #include <blurgather/map.h>
 #include <blurgather/password_to_map.h>
+#include "password_fields.h"
 
 
-#define REGISTER_FIELD(map, field)                                      \
+#define REGISTER_FIELD(field, accessor, filler, type, required)         \
   if((err = bg_map_register_data(map,                                   \
                                  bg_string_from_str(#field),            \
-                                 bg_string_copy(                        \
-                                   bg_password_##field(password)),      \
+                                 bg_string_copy(accessor(password)),    \
                                  bg_string_free))) {                    \
     fprintf(stderr,                                                     \
             "could not register field \"%s\", (err: %d)!\n",            \
@@ -21,9 +21,7 @@ bg_map *bg_password_to_map(const bg_password *password) {
   bg_map *map = bg_map_new();
   int err;
 
-  REGISTER_FIELD(map, name);
-  REGISTER_FIELD(map, description);
-  REGISTER_FIELD(map, value);
+  BG_PASSWORD_FIELDS(REGISTER_FIELD)
 
   return map;
 }
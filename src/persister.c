@@ -12,3 +12,24 @@ int bg_persister_load(bg_persister_t *self, bg_repository_t *repo) {
 int bg_persister_persist(bg_persister_t *self, bg_repository_t *repo) {
   return self->vtable->persist(self, repo);
 }
+
+int bg_persister_count(bg_persister_t *self, size_t *count) {
+  if(!self->vtable->count) {
+    return -1;
+  }
+  return self->vtable->count(self, count);
+}
+
+int bg_persister_fetch(bg_persister_t *self, const bg_string *name, bg_password **password) {
+  if(!self->vtable->fetch) {
+    return -1;
+  }
+  return self->vtable->fetch(self, name, password);
+}
+
+int bg_persister_refresh(bg_persister_t *self, bg_repository_t *repo) {
+  if(!self->vtable->refresh) {
+    return -1;
+  }
+  return self->vtable->refresh(self, repo);
+}
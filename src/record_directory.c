@@ -0,0 +1,79 @@
+#include "record_directory.h"
+
+static void put_le64(unsigned char *buffer, uint64_t value) {
+  int i;
+  for(i = 0; i < 8; ++i) {
+    buffer[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+static uint64_t get_le64(const unsigned char *buffer) {
+  uint64_t value = 0;
+  int i;
+  for(i = 7; i >= 0; --i) {
+    value = (value << 8) | buffer[i];
+  }
+  return value;
+}
+
+static int compare_blind_index(const void *lhs, const void *rhs) {
+  const struct bg_record_entry *a = lhs, *b = rhs;
+  if(a->blind_index != b->blind_index) {
+    return a->blind_index < b->blind_index ? -1 : 1;
+  }
+  return a->offset < b->offset ? -1 : a->offset > b->offset;
+}
+
+static int compare_offset(const void *lhs, const void *rhs) {
+  const struct bg_record_entry *a = lhs, *b = rhs;
+  return a->offset < b->offset ? -1 : a->offset > b->offset;
+}
+
+void bg_record_directory_sort(struct bg_record_entry *entries, size_t count) {
+  if(count < 2) {
+    return;
+  }
+  qsort(entries, count, sizeof(struct bg_record_entry), &compare_blind_index);
+}
+
+void bg_record_directory_sort_by_offset(struct bg_record_entry *entries, size_t count) {
+  if(count < 2) {
+    return;
+  }
+  qsort(entries, count, sizeof(struct bg_record_entry), &compare_offset);
+}
+
+void bg_record_directory_encode(const struct bg_record_entry *entries, size_t count, unsigned char *buffer) {
+  size_t i;
+  for(i = 0; i < count; ++i, buffer += BG_RECORD_ENTRY_LENGTH) {
+    put_le64(buffer, entries[i].blind_index);
+    put_le64(buffer + 8, entries[i].offset);
+    put_le64(buffer + 16, entries[i].length);
+    put_le64(buffer + 24, entries[i].hash);
+  }
+}
+
+void bg_record_directory_decode(struct bg_record_entry *entries, size_t count, const unsigned char *buffer, size_t entry_length) {
+  size_t i;
+  for(i = 0; i < count; ++i, buffer += entry_length) {
+    entries[i].blind_index = get_le64(buffer);
+    entries[i].offset = get_le64(buffer + 8);
+    entries[i].length = get_le64(buffer + 16);
+    entries[i].hash = entry_length >= BG_RECORD_ENTRY_LENGTH ? get_le64(buffer + 24) : 0;
+  }
+}
+
+size_t bg_record_directory_find(const struct bg_record_entry *entries, size_t count, uint64_t blind_index) {
+  size_t low = 0, high = count;
+
+  while(low < high) {
+    size_t middle = low + (high - low) / 2;
+    if(entries[middle].blind_index < blind_index) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  return low < count && entries[low].blind_index == blind_index ? low : count;
+}
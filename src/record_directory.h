@@ -0,0 +1,33 @@
+#ifndef _BLURGATHER_RECORD_DIRECTORY_H_
+#define _BLURGATHER_RECORD_DIRECTORY_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* one persisted record: keyed hash of its name, its place in payload section
+   and keyed hash of its content, 0 in directories written before format 3 */
+struct bg_record_entry {
+  uint64_t blind_index;
+  uint64_t offset;
+  uint64_t length;
+  uint64_t hash;
+};
+
+#define BG_RECORD_ENTRY_LENGTH 32
+#define BG_RECORD_ENTRY_V2_LENGTH 24
+
+/* sorts by blind index, as expected by bg_record_directory_find */
+void bg_record_directory_sort(struct bg_record_entry *entries, size_t count);
+
+/* sorts by offset, that is, in persisted order */
+void bg_record_directory_sort_by_offset(struct bg_record_entry *entries, size_t count);
+
+/* buffer must be at least count * BG_RECORD_ENTRY_LENGTH bytes long */
+void bg_record_directory_encode(const struct bg_record_entry *entries, size_t count, unsigned char *buffer);
+/* entry_length is BG_RECORD_ENTRY_LENGTH, or BG_RECORD_ENTRY_V2_LENGTH for older directories */
+void bg_record_directory_decode(struct bg_record_entry *entries, size_t count, const unsigned char *buffer, size_t entry_length);
+
+/* index of first entry having blind_index, count if none */
+size_t bg_record_directory_find(const struct bg_record_entry *entries, size_t count, uint64_t blind_index);
+
+#endif
@@ -0,0 +1,18 @@
+#include <blurgather/record_source.h>
+
+
+bg_record_source *bg_record_source_retain(bg_record_source *self) {
+  ++self->references;
+  return self;
+}
+
+void bg_record_source_release(bg_record_source *self) {
+  if(--self->references == 0) {
+    self->vtable->destroy(self);
+    free((void*)self->object);
+  }
+}
+
+int bg_record_source_materialize(bg_record_source *self, const unsigned char *record, size_t length, bg_password **password) {
+  return self->vtable->materialize(self, record, length, password);
+}
@@ -28,3 +28,62 @@ size_t bg_repository_count(bg_repository_t *self) {
 int bg_repository_foreach(bg_repository_t *self, int (* callback)(bg_password *, void *), void *output) {
   return self->vtable->foreach(self, callback, output);
 }
+
+int bg_repository_reserve(bg_repository_t *self, size_t count) {
+  if(!self->vtable->reserve) {
+    return 0;
+  }
+  return self->vtable->reserve(self, count);
+}
+
+int bg_repository_accepts_records(bg_repository_t *self) {
+  return self->vtable->add_record != NULL;
+}
+
+int bg_repository_add_record(bg_repository_t *self, bg_record_source *source, const unsigned char *record, size_t length) {
+  if(!self->vtable->add_record) {
+    return -1;
+  }
+  return self->vtable->add_record(self, source, record, length);
+}
+
+int bg_repository_generation(bg_repository_t *self, uint64_t *generation) {
+  if(!self->vtable->generation) {
+    return -1;
+  }
+  *generation = self->vtable->generation(self);
+  return 0;
+}
+
+bg_repository_t *bg_repository_snapshot(bg_repository_t *self) {
+  if(!self->vtable->snapshot) {
+    return NULL;
+  }
+  return self->vtable->snapshot(self);
+}
+
+int bg_repository_add_all(bg_repository_t *self, bg_password **passwords, size_t count) {
+  int err = 0;
+  size_t i;
+
+  if(self->vtable->add_all) {
+    return self->vtable->add_all(self, passwords, count);
+  }
+
+  for(i = 0; i < count; ++i) {
+    if((err = self->vtable->add(self, passwords[i]))) {
+      break;
+    }
+  }
+  if(!err) {
+    return 0;
+  }
+
+  /* taken back out, which must not free them */
+  while(i--) {
+    bg_password *copy = bg_password_copy(passwords[i]);
+    self->vtable->remove(self, bg_password_name(passwords[i]));
+    passwords[i] = copy;
+  }
+  return err;
+}
@@ -0,0 +1,57 @@
+#include "siphash.h"
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                                \
+  v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32);     \
+  v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2;                        \
+  v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0;                        \
+  v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32)
+
+static uint64_t read_le64(const unsigned char *p) {
+  uint64_t value = 0;
+  int i;
+  for(i = 7; i >= 0; --i) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+uint64_t bg_siphash(const unsigned char *key, const void *data, size_t length) {
+  const unsigned char *in = data;
+  uint64_t k0 = read_le64(key);
+  uint64_t k1 = read_le64(key + 8);
+  uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+  uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+  uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+  uint64_t m;
+  size_t i;
+  size_t blocks = length & ~(size_t)7;
+
+  for(i = 0; i < blocks; i += 8) {
+    m = read_le64(in + i);
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+  }
+
+  m = (uint64_t)length << 56;
+  for(i = length & 7; i > 0; --i) {
+    m |= (uint64_t)in[blocks + i - 1] << (8 * (i - 1));
+  }
+
+  v3 ^= m;
+  SIPROUND;
+  SIPROUND;
+  v0 ^= m;
+
+  v2 ^= 0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+
+  return v0 ^ v1 ^ v2 ^ v3;
+}
@@ -0,0 +1,12 @@
+#ifndef _BLURGATHER_SIPHASH_H_
+#define _BLURGATHER_SIPHASH_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define BG_SIPHASH_KEY_LENGTH 16
+
+/* SipHash-2-4, keyed pseudo random function */
+uint64_t bg_siphash(const unsigned char *key, const void *data, size_t length);
+
+#endif
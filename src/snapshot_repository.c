@@ -0,0 +1,443 @@
+#include <string.h>
+#include <pthread.h>
+#include <blurgather/snapshot_repository.h>
+
+static void bg_snapshot_repository_destroy(bg_repository_t *self);
+static int bg_snapshot_repository_add(bg_repository_t *self, bg_password *password);
+static int bg_snapshot_repository_get(bg_repository_t *self, const bg_string *name, bg_password **password);
+static int bg_snapshot_repository_remove(bg_repository_t *self, const bg_string *name);
+static size_t bg_snapshot_repository_count(bg_repository_t *self);
+static int bg_snapshot_repository_foreach(bg_repository_t *self, int (* callback)(bg_password *, void *), void *output);
+static uint64_t bg_snapshot_repository_generation(bg_repository_t *self);
+static int bg_snapshot_repository_add_all(bg_repository_t *self, bg_password **passwords, size_t count);
+static bg_repository_t *bg_snapshot_repository_snapshot(bg_repository_t *self);
+
+static struct bg_repository_vtable bg_snapshot_repository_vtable = {
+  .destroy    = &bg_snapshot_repository_destroy,
+  .add        = &bg_snapshot_repository_add,
+  .get        = &bg_snapshot_repository_get,
+  .remove     = &bg_snapshot_repository_remove,
+  .count      = &bg_snapshot_repository_count,
+  .foreach    = &bg_snapshot_repository_foreach,
+  .generation = &bg_snapshot_repository_generation,
+  .add_all    = &bg_snapshot_repository_add_all,
+  .snapshot   = &bg_snapshot_repository_snapshot,
+};
+
+/* held by every version listing it, freed with last one */
+struct shared_password {
+  bg_password *password;
+  size_t references;
+};
+
+/* immutable once pinned */
+struct version {
+  struct shared_password **passwords;
+  size_t count;
+  size_t capacity;
+  uint64_t generation;
+  size_t references;
+};
+
+struct bg_snapshot_repository {
+  bg_repository_t repository;
+  struct version *current;
+
+  pthread_mutex_t pin_lock;   /* held only to pin, publish or change an unpinned version */
+  pthread_mutex_t write_lock; /* writers one at a time */
+};
+typedef struct bg_snapshot_repository bg_snapshot_repository;
+
+
+static struct version *version_new(size_t capacity) {
+  struct version *version = malloc(sizeof(struct version));
+  if(!version) {
+    return NULL;
+  }
+  memset(version, 0, sizeof(struct version));
+
+  if(capacity && !(version->passwords = malloc(capacity * sizeof(struct shared_password *)))) {
+    free(version);
+    return NULL;
+  }
+  version->capacity = capacity;
+  version->references = 1;
+  return version;
+}
+
+static void shared_password_release(struct shared_password *shared) {
+  if(__atomic_sub_fetch(&shared->references, 1, __ATOMIC_ACQ_REL) == 0) {
+    bg_password_free(shared->password);
+    free(shared);
+  }
+}
+
+static void version_release(struct version *version) {
+  size_t i;
+
+  if(__atomic_sub_fetch(&version->references, 1, __ATOMIC_ACQ_REL)) {
+    return;
+  }
+  for(i = 0; i < version->count; ++i) {
+    shared_password_release(version->passwords[i]);
+  }
+  free(version->passwords);
+  free(version);
+}
+
+/* copy of base sharing its passwords, skipping one at skip if any */
+static struct version *version_derive(const struct version *base, size_t extra, size_t skip) {
+  struct version *version = version_new(base->count + extra);
+  size_t i;
+
+  if(!version) {
+    return NULL;
+  }
+  for(i = 0; i < base->count; ++i) {
+    if(i == skip) {
+      continue;
+    }
+    __atomic_add_fetch(&base->passwords[i]->references, 1, __ATOMIC_RELAXED);
+    version->passwords[version->count++] = base->passwords[i];
+  }
+  version->generation = base->generation;
+  return version;
+}
+
+static int version_find(const struct version *version, const bg_string *name, size_t *index) {
+  size_t i;
+  for(i = 0; i < version->count; ++i) {
+    if(bg_string_compare(bg_password_name(version->passwords[i]->password), name) == 0) {
+      *index = i;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static struct version *pin(bg_snapshot_repository *self) {
+  pthread_mutex_lock(&self->pin_lock);
+  struct version *version = self->current;
+  __atomic_add_fetch(&version->references, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&self->pin_lock);
+  return version;
+}
+
+static void publish(bg_snapshot_repository *self, struct version *version) {
+  pthread_mutex_lock(&self->pin_lock);
+  struct version *previous = self->current;
+  self->current = version;
+  pthread_mutex_unlock(&self->pin_lock);
+
+  version_release(previous);
+}
+
+/* whether current version can be changed in place, pin_lock being held */
+static int unpinned(bg_snapshot_repository *self) {
+  return __atomic_load_n(&self->current->references, __ATOMIC_ACQUIRE) == 1;
+}
+
+
+bg_repository_t *bg_snapshot_repository_new(void) {
+  bg_snapshot_repository *self = malloc(sizeof(bg_snapshot_repository));
+  if(!self) {
+    return NULL;
+  }
+
+  self->repository.object = (void *) self;
+  self->repository.vtable = &bg_snapshot_repository_vtable;
+
+  if(!(self->current = version_new(0))) {
+    free(self);
+    return NULL;
+  }
+  pthread_mutex_init(&self->pin_lock, NULL);
+  pthread_mutex_init(&self->write_lock, NULL);
+
+  return &self->repository;
+}
+
+void bg_snapshot_repository_destroy(bg_repository_t *_self) {
+  bg_snapshot_repository *self = (bg_snapshot_repository *)_self->object;
+
+  version_release(self->current); /* pinned ones live on */
+  pthread_mutex_destroy(&self->pin_lock);
+  pthread_mutex_destroy(&self->write_lock);
+}
+
+/* total order, unlike bg_string_compare which only tells equality apart */
+static int compare_names(const void *_lhs, const void *_rhs) {
+  const bg_string *lhs = bg_password_name(*(bg_password **)_lhs), *rhs = bg_password_name(*(bg_password **)_rhs);
+  if(bg_string_length(lhs) != bg_string_length(rhs)) {
+    return bg_string_length(lhs) < bg_string_length(rhs) ? -1 : 1;
+  }
+  return memcmp(bg_string_data(lhs), bg_string_data(rhs), bg_string_length(lhs));
+}
+
+static int check_names(const struct version *base, bg_password **passwords, size_t count) {
+  size_t total = base->count + count, i;
+  int err = 0;
+
+  for(i = 0; i < count; ++i) {
+    if(bg_string_empty(bg_password_name(passwords[i]))) {
+      return -2;
+    }
+  }
+  if(count == 1) {
+    return version_find(base, bg_password_name(passwords[0]), &i) ? -1 : 0;
+  }
+
+  bg_password **sorted = malloc(total * sizeof(bg_password *));
+  if(!sorted) {
+    return -3;
+  }
+  for(i = 0; i < base->count; ++i) {
+    sorted[i] = base->passwords[i]->password;
+  }
+  memcpy(sorted + base->count, passwords, count * sizeof(bg_password *));
+  qsort(sorted, total, sizeof(bg_password *), &compare_names);
+
+  for(i = 1; i < total && !err; ++i) {
+    err = compare_names(&sorted[i - 1], &sorted[i]) == 0 ? -1 : 0;
+  }
+  free(sorted);
+  return err;
+}
+
+static int append(struct version *version, bg_password **passwords, size_t count) {
+  size_t i;
+
+  if(version->count + count > version->capacity) {
+    size_t capacity = version->capacity * 2 > version->count + count ? version->capacity * 2 : version->count + count;
+    struct shared_password **grown = realloc(version->passwords, capacity * sizeof(struct shared_password *));
+    if(!grown) {
+      return -3;
+    }
+    version->passwords = grown;
+    version->capacity = capacity;
+  }
+
+  for(i = 0; i < count; ++i) {
+    struct shared_password *shared = malloc(sizeof(struct shared_password));
+    if(!shared) {
+      while(i--) {
+        free(version->passwords[--version->count]); /* passwords stay with caller */
+      }
+      return -3;
+    }
+    shared->password = passwords[i];
+    shared->references = 1;
+    version->passwords[version->count++] = shared;
+  }
+
+  version->generation++;
+  return 0;
+}
+
+static int add_passwords(bg_snapshot_repository *self, bg_password **passwords, size_t count) {
+  struct version *next = NULL;
+  int err = 0;
+
+  if(!count) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&self->write_lock);
+  if((err = check_names(self->current, passwords, count))) {
+    goto end;
+  }
+
+  pthread_mutex_lock(&self->pin_lock);
+  if(unpinned(self)) {
+    err = append(self->current, passwords, count);
+    pthread_mutex_unlock(&self->pin_lock);
+    goto end;
+  }
+  pthread_mutex_unlock(&self->pin_lock);
+
+  if(!(next = version_derive(self->current, count, (size_t)-1))) {
+    err = -3;
+    goto end;
+  }
+  if((err = append(next, passwords, count))) {
+    version_release(next);
+    goto end;
+  }
+  publish(self, next);
+
+end:
+  pthread_mutex_unlock(&self->write_lock);
+  return err;
+}
+
+int bg_snapshot_repository_add(bg_repository_t *_self, bg_password *password) {
+  bg_snapshot_repository *self = (bg_snapshot_repository *)_self->object;
+  return add_passwords(self, &password, 1);
+}
+
+int bg_snapshot_repository_add_all(bg_repository_t *_self, bg_password **passwords, size_t count) {
+  bg_snapshot_repository *self = (bg_snapshot_repository *)_self->object;
+  return add_passwords(self, passwords, count);
+}
+
+int bg_snapshot_repository_remove(bg_repository_t *_self, const bg_string *name) {
+  bg_snapshot_repository *self = (bg_snapshot_repository *)_self->object;
+  struct version *current, *next;
+  size_t index;
+  int err = 0;
+
+  pthread_mutex_lock(&self->write_lock);
+  current = self->current;
+  if(!version_find(current, name, &index)) {
+    err = -1;
+    goto end;
+  }
+
+  pthread_mutex_lock(&self->pin_lock);
+  if(unpinned(self)) {
+    struct shared_password *removed = current->passwords[index];
+    memmove(&current->passwords[index], &current->passwords[index + 1],
+            (current->count - index - 1) * sizeof(struct shared_password *));
+    --current->count;
+    current->generation++;
+    pthread_mutex_unlock(&self->pin_lock);
+
+    shared_password_release(removed);
+    goto end;
+  }
+  pthread_mutex_unlock(&self->pin_lock);
+
+  if(!(next = version_derive(current, 0, index))) {
+    err = -3;
+    goto end;
+  }
+  next->generation++;
+  publish(self, next);
+
+end:
+  pthread_mutex_unlock(&self->write_lock);
+  return err;
+}
+
+/* reads of a pinned version, shared with snapshots */
+static int version_get(const struct version *version, const bg_string *name, bg_password **password) {
+  size_t index;
+  *password = version_find(version, name, &index) ? version->passwords[index]->password : NULL;
+  return *password == NULL;
+}
+
+static int version_foreach(const struct version *version, int (* callback)(bg_password *, void *), void *output) {
+  size_t i;
+  for(i = 0; i < version->count; ++i) {
+    int err = 0;
+    if((err = callback(version->passwords[i]->password, output))) {
+      return err;
+    }
+  }
+  return 0;
+}
+
+int bg_snapshot_repository_get(bg_repository_t *_self, const bg_string *name, bg_password **password) {
+  bg_snapshot_repository *self = (bg_snapshot_repository *)_self->object;
+
+  struct version *version = pin(self);
+  int err = version_get(version, name, password);
+  version_release(version);
+
+  return err;
+}
+
+size_t bg_snapshot_repository_count(bg_repository_t *_self) {
+  bg_snapshot_repository *self = (bg_snapshot_repository *)_self->object;
+
+  struct version *version = pin(self);
+  size_t count = version->count;
+  version_release(version);
+
+  return count;
+}
+
+uint64_t bg_snapshot_repository_generation(bg_repository_t *_self) {
+  bg_snapshot_repository *self = (bg_snapshot_repository *)_self->object;
+
+  struct version *version = pin(self);
+  uint64_t generation = version->generation;
+  version_release(version);
+
+  return generation;
+}
+
+int bg_snapshot_repository_foreach(bg_repository_t *_self, int (* callback)(bg_password *, void *), void *output) {
+  bg_snapshot_repository *self = (bg_snapshot_repository *)_self->object;
+
+  struct version *version = pin(self);
+  int err = version_foreach(version, callback, output);
+  version_release(version);
+
+  return err;
+}
+
+
+/* pinned version as a read-only repository */
+struct snapshot {
+  bg_repository_t repository;
+  struct version *version;
+};
+
+static void snapshot_destroy(bg_repository_t *_self) {
+  struct snapshot *self = (struct snapshot *)_self->object;
+  version_release(self->version);
+}
+
+static int snapshot_add(bg_repository_t *self, bg_password *password) {
+  return -1;
+}
+
+static int snapshot_remove(bg_repository_t *self, const bg_string *name) {
+  return -1;
+}
+
+static int snapshot_get(bg_repository_t *_self, const bg_string *name, bg_password **password) {
+  struct snapshot *self = (struct snapshot *)_self->object;
+  return version_get(self->version, name, password);
+}
+
+static size_t snapshot_count(bg_repository_t *_self) {
+  struct snapshot *self = (struct snapshot *)_self->object;
+  return self->version->count;
+}
+
+static int snapshot_foreach(bg_repository_t *_self, int (* callback)(bg_password *, void *), void *output) {
+  struct snapshot *self = (struct snapshot *)_self->object;
+  return version_foreach(self->version, callback, output);
+}
+
+static uint64_t snapshot_generation(bg_repository_t *_self) {
+  struct snapshot *self = (struct snapshot *)_self->object;
+  return self->version->generation;
+}
+
+static struct bg_repository_vtable snapshot_vtable = {
+  .destroy    = &snapshot_destroy,
+  .add        = &snapshot_add,
+  .get        = &snapshot_get,
+  .remove     = &snapshot_remove,
+  .count      = &snapshot_count,
+  .foreach    = &snapshot_foreach,
+  .generation = &snapshot_generation,
+};
+
+bg_repository_t *bg_snapshot_repository_snapshot(bg_repository_t *_self) {
+  bg_snapshot_repository *self = (bg_snapshot_repository *)_self->object;
+
+  struct snapshot *snapshot = malloc(sizeof(struct snapshot));
+  if(!snapshot) {
+    return NULL;
+  }
+
+  snapshot->repository.object = (void *) snapshot;
+  snapshot->repository.vtable = &snapshot_vtable;
+  snapshot->version = pin(self);
+
+  return &snapshot->repository;
+}
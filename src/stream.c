@@ -1,6 +1,13 @@
+#define _GNU_SOURCE
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "blurgather/stream.h"
 
 struct bg_stream_vtable {
@@ -10,6 +17,13 @@ struct bg_stream_vtable {
   size_t (* write)(bg_stream *stream, const void *data, size_t size);
   size_t (* read)(bg_stream *stream, void *data, size_t size);
   size_t (* length)(bg_stream *stream);
+
+  /* optional */
+  size_t (* writev)(bg_stream *stream, const struct iovec *segments, int count);
+  int (* map)(bg_stream *stream, const void **data, size_t *length);
+  int (* reserve)(bg_stream *stream, size_t size);
+  void *(* detach)(bg_stream *stream, size_t *length);
+  int (* flush)(bg_stream *stream);
 };
 
 struct bg_stream {
@@ -33,14 +47,19 @@ typedef struct {
   size_t offset;
   size_t allocated;
   size_t length;
+  int borrowed; /* data belongs to caller until stream outgrows it */
 } bg_mem_stream;
 
+#define MEM_STREAM_MIN_ALLOCATION 1024
+
 static void bg_mem_stream_close(bg_stream *_stream) {
   bg_mem_stream *stream = (bg_mem_stream *)_stream->object;
   
   bg_stream_at_close(_stream);
 
-  free(stream->data);
+  if(!stream->borrowed) {
+    free(stream->data);
+  }
   free(stream);
   free(_stream);
 }
@@ -57,15 +76,40 @@ static void bg_mem_stream_forward(bg_stream *_stream) {
   stream->offset = stream->length;
 }
 
-static void *bg_mem_stream_grow(bg_mem_stream *mem_stream) {
-  return ((mem_stream->data = realloc(mem_stream->data, (mem_stream->allocated += 1024))));
+/* doubles allocation until size fits, a borrowed buffer is copied over */
+static int bg_mem_stream_grow(bg_mem_stream *mem_stream, size_t size) {
+  size_t allocated = mem_stream->allocated > MEM_STREAM_MIN_ALLOCATION ? mem_stream->allocated : MEM_STREAM_MIN_ALLOCATION;
+  unsigned char *data;
+
+  while(allocated < size) {
+    allocated *= 2;
+  }
+
+  if(mem_stream->borrowed) {
+    if(!(data = malloc(allocated))) {
+      return -1;
+    }
+    if(mem_stream->length) {
+      memcpy(data, mem_stream->data, mem_stream->length);
+    }
+    mem_stream->borrowed = 0;
+  } else if(!(data = realloc(mem_stream->data, allocated))) {
+    return -1;
+  }
+
+  mem_stream->data = data;
+  mem_stream->allocated = allocated;
+  return 0;
 }
 
 static size_t bg_mem_stream_write(bg_stream *_stream, const void *data, size_t size) {
   bg_mem_stream *stream = (bg_mem_stream *)_stream->object;
 
-  while(stream->offset + size > stream->allocated) {
-    bg_mem_stream_grow(stream);
+  if(stream->offset + size > stream->allocated && bg_mem_stream_grow(stream, stream->offset + size)) {
+    return 0;
+  }
+  if(!size) {
+    return 0;
   }
 
   memcpy(stream->data + stream->offset, data, size);
@@ -100,13 +144,41 @@ static size_t bg_mem_stream_length(bg_stream *_stream) {
   return stream->length;
 }
 
+static int bg_mem_stream_map(bg_stream *_stream, const void **data, size_t *length) {
+  bg_mem_stream *stream = (bg_mem_stream *)_stream->object;
+
+  *data = stream->data;
+  *length = stream->length;
+  return 0;
+}
+
+static int bg_mem_stream_reserve(bg_stream *_stream, size_t size) {
+  bg_mem_stream *stream = (bg_mem_stream *)_stream->object;
+
+  return size > stream->allocated ? bg_mem_stream_grow(stream, size) : 0;
+}
+
+static void *bg_mem_stream_detach(bg_stream *_stream, size_t *length) {
+  bg_mem_stream *stream = (bg_mem_stream *)_stream->object;
+  void *data = stream->borrowed ? NULL : stream->data;
+
+  *length = data ? stream->length : 0;
+  stream->data = NULL;
+  stream->allocated = stream->length = stream->offset = 0;
+  stream->borrowed = 0;
+  return data;
+}
+
 static struct bg_stream_vtable bg_mem_stream_vtable = {
   .close = &bg_mem_stream_close,
   .rewind = &bg_mem_stream_rewind,
   .forward = &bg_mem_stream_forward,
   .write = &bg_mem_stream_write,
   .read = &bg_mem_stream_read,
-  .length = &bg_mem_stream_length
+  .length = &bg_mem_stream_length,
+  .map = &bg_mem_stream_map,
+  .reserve = &bg_mem_stream_reserve,
+  .detach = &bg_mem_stream_detach
 };
 
 static void bg_stream_open_mem(bg_stream *stream, va_list vl) {
@@ -118,8 +190,20 @@ static void bg_stream_open_mem(bg_stream *stream, va_list vl) {
   object->allocated = 0;
   object->length = 0;
   object->offset = 0;
+  object->borrowed = 0;
+
+  bg_mem_stream_grow(object, MEM_STREAM_MIN_ALLOCATION);
+}
+
+static void bg_stream_open_buffer(bg_stream *stream, va_list vl) {
+  stream->vtable = &bg_mem_stream_vtable;
+  stream->object = malloc(sizeof(bg_mem_stream));
 
-  bg_mem_stream_grow(object);
+  bg_mem_stream *object = stream->object;
+  object->data = va_arg(vl, void *);
+  object->allocated = object->length = va_arg(vl, size_t);
+  object->offset = 0;
+  object->borrowed = 1;
 }
 
 /* file stream implementation */
@@ -181,13 +265,20 @@ static size_t bg_file_stream_length(bg_stream *_stream) {
   return length;
 }
 
+static int bg_file_stream_flush_through(bg_stream *_stream) {
+  bg_file_stream *stream = (bg_file_stream *)_stream->object;
+
+  return fflush(stream->file) ? -1 : 0;
+}
+
 static struct bg_stream_vtable bg_file_stream_vtable = {
   .close = &bg_file_stream_close,
   .rewind = &bg_file_stream_rewind,
   .forward = &bg_file_stream_forward,
   .write = &bg_file_stream_write,
   .read = &bg_file_stream_read,
-  .length = &bg_file_stream_length
+  .length = &bg_file_stream_length,
+  .flush = &bg_file_stream_flush_through
 };
 
 static void bg_stream_open_file(bg_stream *stream, bg_stream_mode mflags, va_list vl) {
@@ -200,6 +291,435 @@ static void bg_stream_open_file(bg_stream *stream, bg_stream_mode mflags, va_lis
   object->file = fopen(object->filename, "ab+");
 }
 
+/* file descriptor implementation, reads and writes go through one buffer */
+#define FD_STREAM_BUFFER_SIZE 65536
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+typedef struct {
+  int fd;
+  unsigned char *buffer;
+  size_t size;
+  size_t begin; /* buffer[begin, end) was read ahead of stream position */
+  size_t end;
+  size_t pending; /* written to buffer, not yet to file */
+} bg_fd_stream;
+
+/* until every segment is written or writing fails, segments are consumed */
+static size_t bg_fd_stream_writev_all(int fd, struct iovec *segments, int count) {
+  size_t written = 0;
+
+  while(count > 0) {
+    if(!segments->iov_len) {
+      ++segments;
+      --count;
+      continue;
+    }
+
+    ssize_t done = writev(fd, segments, count > IOV_MAX ? IOV_MAX : count);
+    if(done < 0 && errno == EINTR) {
+      continue;
+    }
+    if(done <= 0) {
+      break;
+    }
+    written += done;
+
+    while(count > 0 && (size_t)done >= segments->iov_len) {
+      done -= segments->iov_len;
+      ++segments;
+      --count;
+    }
+    if(count > 0) {
+      segments->iov_base = (char *)segments->iov_base + done;
+      segments->iov_len -= done;
+    }
+  }
+
+  return written;
+}
+
+static int bg_fd_stream_flush(bg_fd_stream *stream) {
+  struct iovec pending = { stream->buffer, stream->pending };
+  size_t length = stream->pending;
+
+  stream->pending = 0;
+  return bg_fd_stream_writev_all(stream->fd, &pending, 1) == length ? 0 : -1;
+}
+
+/* file position goes back to stream position */
+static void bg_fd_stream_drop_read_ahead(bg_fd_stream *stream) {
+  if(stream->end > stream->begin) {
+    lseek(stream->fd, -(off_t)(stream->end - stream->begin), SEEK_CUR);
+  }
+  stream->begin = stream->end = 0;
+}
+
+static void bg_fd_stream_close(bg_stream *_stream) {
+  bg_fd_stream *stream = (bg_fd_stream *)_stream->object;
+
+  bg_fd_stream_flush(stream);
+  close(stream->fd);
+
+  bg_stream_at_close(_stream);
+
+  /* may have held plain text */
+  memset(stream->buffer, 0, stream->size);
+  free(stream->buffer);
+  free(stream);
+  free(_stream);
+}
+
+static void bg_fd_stream_seek(bg_stream *_stream, int whence) {
+  bg_fd_stream *stream = (bg_fd_stream *)_stream->object;
+
+  bg_fd_stream_flush(stream);
+  stream->begin = stream->end = 0;
+  lseek(stream->fd, 0, whence);
+}
+
+static void bg_fd_stream_rewind(bg_stream *_stream) {
+  bg_fd_stream_seek(_stream, SEEK_SET);
+}
+
+static void bg_fd_stream_forward(bg_stream *_stream) {
+  bg_fd_stream_seek(_stream, SEEK_END);
+}
+
+/* buffered segments go out along with those overflowing buffer */
+static size_t bg_fd_stream_writev(bg_stream *_stream, const struct iovec *segments, int count) {
+  bg_fd_stream *stream = (bg_fd_stream *)_stream->object;
+  size_t total = 0, pending;
+  int i;
+
+  bg_fd_stream_drop_read_ahead(stream);
+
+  for(i = 0; i < count; ++i) {
+    total += segments[i].iov_len;
+  }
+  if(stream->pending + total <= stream->size) {
+    for(i = 0; i < count; ++i) {
+      memcpy(stream->buffer + stream->pending, segments[i].iov_base, segments[i].iov_len);
+      stream->pending += segments[i].iov_len;
+    }
+    return total;
+  }
+
+  struct iovec *all = malloc((count + 1) * sizeof(struct iovec));
+  if(!all) {
+    return 0;
+  }
+  all[0].iov_base = stream->buffer;
+  all[0].iov_len = pending = stream->pending;
+  memcpy(all + 1, segments, count * sizeof(struct iovec));
+
+  stream->pending = 0;
+  size_t written = bg_fd_stream_writev_all(stream->fd, all, count + 1);
+  free(all);
+
+  return written < pending ? 0 : written - pending;
+}
+
+static size_t bg_fd_stream_write(bg_stream *_stream, const void *data, size_t size) {
+  struct iovec segment = { (void *)data, size };
+  return bg_fd_stream_writev(_stream, &segment, 1);
+}
+
+static size_t bg_fd_stream_read(bg_stream *_stream, void *data, size_t size) {
+  bg_fd_stream *stream = (bg_fd_stream *)_stream->object;
+  size_t done = 0;
+
+  if(bg_fd_stream_flush(stream)) {
+    return 0;
+  }
+
+  while(done < size) {
+    if(stream->begin == stream->end) {
+      /* large reads skip buffer */
+      int direct = size - done >= stream->size;
+      ssize_t chunk = read(stream->fd, direct ? (unsigned char *)data + done : stream->buffer,
+                           direct ? size - done : stream->size);
+      if(chunk < 0 && errno == EINTR) {
+        continue;
+      }
+      if(chunk <= 0) {
+        break;
+      }
+      if(direct) {
+        done += chunk;
+        continue;
+      }
+      stream->begin = 0;
+      stream->end = chunk;
+    }
+
+    size_t chunk = stream->end - stream->begin < size - done ? stream->end - stream->begin : size - done;
+    memcpy((unsigned char *)data + done, stream->buffer + stream->begin, chunk);
+    stream->begin += chunk;
+    done += chunk;
+  }
+
+  return done;
+}
+
+static size_t bg_fd_stream_length(bg_stream *_stream) {
+  bg_fd_stream *stream = (bg_fd_stream *)_stream->object;
+  struct stat status;
+
+  bg_fd_stream_flush(stream);
+  if(fstat(stream->fd, &status)) {
+    return 0;
+  }
+  return status.st_size;
+}
+
+static int bg_fd_stream_flush_through(bg_stream *_stream) {
+  return bg_fd_stream_flush((bg_fd_stream *)_stream->object);
+}
+
+static struct bg_stream_vtable bg_fd_stream_vtable = {
+  .close = &bg_fd_stream_close,
+  .rewind = &bg_fd_stream_rewind,
+  .forward = &bg_fd_stream_forward,
+  .write = &bg_fd_stream_write,
+  .read = &bg_fd_stream_read,
+  .length = &bg_fd_stream_length,
+  .writev = &bg_fd_stream_writev,
+  .flush = &bg_fd_stream_flush_through
+};
+
+static int bg_fd_stream_flags(bg_stream_mode mflags) {
+  if(!(mflags & BGSM_WRITE)) {
+    return O_RDONLY;
+  }
+
+  int flags = (mflags & BGSM_READ ? O_RDWR : O_WRONLY) | O_CREAT;
+  if(mflags & BGSM_EXCL) {
+    flags |= O_EXCL | O_NOFOLLOW;
+  } else if(mflags & BGSM_APPEND) {
+    flags |= O_APPEND;
+  } else if(!(mflags & BGSM_READ)) {
+    flags |= O_TRUNC;
+  }
+  return flags;
+}
+
+static int bg_stream_open_fd(bg_stream *stream, bg_stream_mode mflags, va_list vl) {
+  stream->vtable = &bg_fd_stream_vtable;
+  stream->object = malloc(sizeof(bg_fd_stream));
+  if(!stream->object) {
+    return -1;
+  }
+
+  bg_fd_stream *object = stream->object;
+  object->size = FD_STREAM_BUFFER_SIZE;
+  object->begin = object->end = object->pending = 0;
+  object->buffer = malloc(object->size);
+  object->fd = open(va_arg(vl, const char *), bg_fd_stream_flags(mflags) | O_CLOEXEC, 0600);
+
+  if(!object->buffer || object->fd < 0) {
+    int open_errno = errno; /* kept for caller, EEXIST with BGSM_EXCL */
+    if(object->fd >= 0) {
+      close(object->fd);
+    }
+    free(object->buffer);
+    free(object);
+    errno = open_errno;
+    return -1;
+  }
+  return 0;
+}
+
+/* memory mapped implementation */
+typedef struct {
+  int fd;
+  int append;
+  unsigned char *data; /* NULL while nothing is mapped */
+  size_t mapped; /* file is that long until close */
+  size_t length;
+  size_t offset;
+} bg_mmap_stream;
+
+static void bg_mmap_stream_close(bg_stream *_stream) {
+  bg_mmap_stream *stream = (bg_mmap_stream *)_stream->object;
+
+  if(stream->data) {
+    munmap(stream->data, stream->mapped);
+  }
+  if(stream->mapped > stream->length) {
+    ftruncate(stream->fd, stream->length);
+  }
+  close(stream->fd);
+
+  bg_stream_at_close(_stream);
+
+  free(stream);
+  free(_stream);
+}
+
+static void bg_mmap_stream_rewind(bg_stream *_stream) {
+  bg_mmap_stream *stream = (bg_mmap_stream *)_stream->object;
+
+  stream->offset = 0;
+}
+
+static void bg_mmap_stream_forward(bg_stream *_stream) {
+  bg_mmap_stream *stream = (bg_mmap_stream *)_stream->object;
+
+  stream->offset = stream->length;
+}
+
+/* doubles file and mapping until length fits */
+static int bg_mmap_stream_grow(bg_mmap_stream *stream, size_t length) {
+  size_t mapped = stream->mapped ? stream->mapped : (size_t)sysconf(_SC_PAGESIZE);
+  void *data;
+
+  while(mapped < length) {
+    mapped *= 2;
+  }
+  if(ftruncate(stream->fd, mapped)) {
+    return -1;
+  }
+
+#ifdef MREMAP_MAYMOVE
+  data = stream->data ? mremap(stream->data, stream->mapped, mapped, MREMAP_MAYMOVE) :
+                        mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, stream->fd, 0);
+#else
+  if(stream->data) {
+    munmap(stream->data, stream->mapped);
+    stream->data = NULL;
+  }
+  data = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, stream->fd, 0);
+#endif
+  if(data == MAP_FAILED) {
+    return -1;
+  }
+
+  stream->data = data;
+  stream->mapped = mapped;
+  return 0;
+}
+
+static size_t bg_mmap_stream_write(bg_stream *_stream, const void *data, size_t size) {
+  bg_mmap_stream *stream = (bg_mmap_stream *)_stream->object;
+
+  if(stream->append) {
+    stream->offset = stream->length;
+  }
+  if(stream->offset + size > stream->mapped && bg_mmap_stream_grow(stream, stream->offset + size)) {
+    return 0;
+  }
+  if(!size) {
+    return 0;
+  }
+
+  memcpy(stream->data + stream->offset, data, size);
+  stream->offset += size;
+  if(stream->offset > stream->length) {
+    stream->length = stream->offset;
+  }
+
+  return size;
+}
+
+static size_t bg_mmap_stream_read(bg_stream *_stream, void *data, size_t size) {
+  bg_mmap_stream *stream = (bg_mmap_stream *)_stream->object;
+
+  if(stream->offset + size > stream->length) {
+    size = stream->length - stream->offset;
+  }
+  if(!size) {
+    return 0;
+  }
+
+  memcpy(data, stream->data + stream->offset, size);
+  stream->offset += size;
+
+  return size;
+}
+
+static size_t bg_mmap_stream_length(bg_stream *_stream) {
+  bg_mmap_stream *stream = (bg_mmap_stream *)_stream->object;
+
+  return stream->length;
+}
+
+static int bg_mmap_stream_map(bg_stream *_stream, const void **data, size_t *length) {
+  bg_mmap_stream *stream = (bg_mmap_stream *)_stream->object;
+
+  *data = stream->data;
+  *length = stream->length;
+  return 0;
+}
+
+static int bg_mmap_stream_reserve(bg_stream *_stream, size_t size) {
+  bg_mmap_stream *stream = (bg_mmap_stream *)_stream->object;
+
+  return size > stream->mapped ? bg_mmap_stream_grow(stream, size) : 0;
+}
+
+static int bg_mmap_stream_flush(bg_stream *_stream) {
+  bg_mmap_stream *stream = (bg_mmap_stream *)_stream->object;
+
+  return stream->data && msync(stream->data, stream->mapped, MS_SYNC) ? -1 : 0;
+}
+
+static struct bg_stream_vtable bg_mmap_stream_vtable = {
+  .close = &bg_mmap_stream_close,
+  .rewind = &bg_mmap_stream_rewind,
+  .forward = &bg_mmap_stream_forward,
+  .write = &bg_mmap_stream_write,
+  .read = &bg_mmap_stream_read,
+  .length = &bg_mmap_stream_length,
+  .map = &bg_mmap_stream_map,
+  .reserve = &bg_mmap_stream_reserve,
+  .flush = &bg_mmap_stream_flush
+};
+
+/* mappings need read access, even to write */
+static int bg_stream_open_mmap(bg_stream *stream, bg_stream_mode mflags, va_list vl) {
+  struct stat status;
+  int flags = bg_fd_stream_flags(mflags);
+
+  if(flags != O_RDONLY) {
+    flags = (flags & ~(O_WRONLY | O_APPEND)) | O_RDWR;
+  }
+
+  stream->vtable = &bg_mmap_stream_vtable;
+  stream->object = malloc(sizeof(bg_mmap_stream));
+  if(!stream->object) {
+    return -1;
+  }
+
+  bg_mmap_stream *object = stream->object;
+  memset(object, 0, sizeof(bg_mmap_stream));
+  object->append = (mflags & BGSM_WRITE) && (mflags & BGSM_APPEND);
+
+  if((object->fd = open(va_arg(vl, const char *), flags | O_CLOEXEC, 0600)) < 0) {
+    free(object);
+    return -1;
+  }
+  if(fstat(object->fd, &status)) {
+    goto fail;
+  }
+
+  object->length = object->mapped = status.st_size;
+  if(object->length) {
+    object->data = mmap(NULL, object->mapped, flags == O_RDONLY ? PROT_READ : PROT_READ | PROT_WRITE,
+                        MAP_SHARED, object->fd, 0);
+    if(object->data == MAP_FAILED) {
+      goto fail;
+    }
+  }
+  return 0;
+
+fail:
+  close(object->fd);
+  free(object);
+  return -1;
+}
+
 void bg_stream_register_at_close(bg_stream *stream, va_list vl) {
   void (* at_close)(void *) = va_arg(vl, void (*)(void *));
   if(at_close) {
@@ -227,8 +747,15 @@ bg_stream *bg_stream_open_(bg_stream_object oflag, bg_stream_mode mflags, ...) {
   va_start(vl, mflags);
   if(oflag & BGSO_MEM) {
     bg_stream_open_mem(stream, vl);
+  } else if(oflag & BGSO_BUFFER) {
+    bg_stream_open_buffer(stream, vl);
   } else if(oflag & BGSO_FILE) {
     bg_stream_open_file(stream, mflags, vl);
+  } else if((oflag & BGSO_FD && bg_stream_open_fd(stream, mflags, vl)) ||
+            (oflag & BGSO_MMAP && bg_stream_open_mmap(stream, mflags, vl))) {
+    va_end(vl);
+    free(stream);
+    return NULL;
   }
   bg_stream_register_at_close(stream, vl);
   va_end(vl);
@@ -257,6 +784,27 @@ size_t bg_stream_write(bg_stream *stream, const void *data, size_t size) {
   return stream->vtable->write(stream, data, size);
 }
 
+size_t bg_stream_writev(bg_stream *stream, const struct iovec *segments, int count) {
+  size_t written = 0;
+  int i;
+
+  if(!(stream->mode & BGSM_WRITE)) {
+    return 0;
+  }
+  if(stream->vtable->writev) {
+    return stream->vtable->writev(stream, segments, count);
+  }
+
+  for(i = 0; i < count; ++i) {
+    size_t done = stream->vtable->write(stream, segments[i].iov_base, segments[i].iov_len);
+    written += done;
+    if(done != segments[i].iov_len) {
+      break;
+    }
+  }
+  return written;
+}
+
 size_t bg_stream_read(bg_stream *stream, void *data, size_t size) {
   if(!(stream->mode & BGSM_READ)) {
     return 0;
@@ -268,3 +816,32 @@ size_t bg_stream_read(bg_stream *stream, void *data, size_t size) {
 size_t bg_stream_length(bg_stream *stream) {
   return stream->vtable->length(stream);
 }
+
+int bg_stream_map(bg_stream *stream, const void **data, size_t *length) {
+  if(!stream->vtable->map) {
+    return -1;
+  }
+  return stream->vtable->map(stream, data, length);
+}
+
+int bg_stream_flush(bg_stream *stream) {
+  if(!(stream->mode & BGSM_WRITE) || !stream->vtable->flush) {
+    return 0;
+  }
+  return stream->vtable->flush(stream);
+}
+
+int bg_stream_reserve(bg_stream *stream, size_t size) {
+  if(!stream->vtable->reserve) {
+    return -1;
+  }
+  return stream->vtable->reserve(stream, size);
+}
+
+void *bg_stream_detach(bg_stream *stream, size_t *length) {
+  if(!stream->vtable->detach) {
+    *length = 0;
+    return NULL;
+  }
+  return stream->vtable->detach(stream, length);
+}
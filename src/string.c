@@ -42,6 +42,20 @@ bg_string *bg_string_from_str(const char *array) {
   return bg_string_from_char_array(array, strlen(array));
 }
 
+size_t bg_string_storage_size(size_t length) {
+  return sizeof(bg_string) + length + 1;
+}
+
+bg_string *bg_string_in_place(void *storage, const char *array, size_t length) {
+  bg_string *str = storage;
+
+  memmove((void*)STR_DATA(str), array, length);
+  str->length = length;
+  STR_APPEND_NUL(str);
+
+  return str;
+}
+
 bg_string *bg_string_copy(const bg_string *copied) {
   return bg_string_from_char_array(bg_string_data(copied), bg_string_length(copied));
 }
@@ -91,6 +105,20 @@ int bg_string_compare(const bg_string *str1, const bg_string *str2) {
   return -1;
 }
 
+/* FNV-1a */
+size_t bg_string_hash(const bg_string *str) {
+  const unsigned char *data = (const unsigned char *)STR_DATA(str);
+  unsigned long long hash = 14695981039346656037ULL;
+
+  size_t i;
+  for(i = 0; i < str->length; ++i) {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return (size_t)hash;
+}
+
 bg_string *bg_string_cat(bg_string **str, const bg_string *catted) {
   return bg_string_cat_char_array(str, STR_DATA(catted), catted->length);
 }
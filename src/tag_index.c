@@ -0,0 +1,188 @@
+#include <string.h>
+#include <blurgather/tag_index.h>
+#include <blurgather/map.h>
+
+struct posting {
+  size_t *ids;
+  size_t count;
+  size_t allocated;
+};
+
+struct bg_tag_index {
+  bg_map *postings;
+};
+
+#define POSTING_INITIAL_IDS 4
+
+static void posting_free(void *_posting) {
+  struct posting *posting = _posting;
+  free(posting->ids);
+  free(posting);
+}
+
+bg_tag_index *bg_tag_index_new(void) {
+  bg_tag_index *index = malloc(sizeof(bg_tag_index));
+  index->postings = bg_map_new();
+  return index;
+}
+
+static int wipe_tag(const bg_string *tag, void *posting, void *out) {
+  bg_string_clean((bg_string *)tag);
+  return 0;
+}
+
+void bg_tag_index_free(bg_tag_index *index) {
+  bg_map_foreach(index->postings, &wipe_tag, NULL);
+  bg_map_free(index->postings);
+  free(index);
+}
+
+size_t bg_tag_index_count(const bg_tag_index *index) {
+  return bg_map_length(index->postings);
+}
+
+static struct posting *find_posting(const bg_tag_index *index, const bg_string *tag) {
+  return bg_map_find_data(index->postings, tag);
+}
+
+/* posting of tag, registering a new one (which takes tag) when needed */
+static struct posting *acquire_posting(bg_tag_index *index, bg_string *tag) {
+  struct posting *posting = find_posting(index, tag);
+  if(posting) {
+    bg_string_clean_free(tag);
+    return posting;
+  }
+
+  posting = malloc(sizeof(struct posting));
+  if(!posting) {
+    bg_string_clean_free(tag);
+    return NULL;
+  }
+  posting->ids = NULL;
+  posting->count = 0;
+  posting->allocated = 0;
+
+  if(bg_map_register_data(index->postings, tag, posting, &posting_free)) {
+    bg_string_clean_free(tag);
+    free(posting);
+    return NULL;
+  }
+
+  return posting;
+}
+
+int bg_tag_index_add(bg_tag_index *index, const char *tag, size_t length, size_t id) {
+  struct posting *posting = acquire_posting(index, bg_string_from_char_array(tag, length));
+  if(!posting) {
+    return -1;
+  }
+
+  if(posting->count) {
+    size_t last = posting->ids[posting->count - 1];
+    if(id == last) { return 0; }
+    if(id < last) { return -2; }
+  }
+
+  if(posting->count == posting->allocated) {
+    size_t allocated = posting->allocated ? posting->allocated * 2 : POSTING_INITIAL_IDS;
+    size_t *ids = realloc(posting->ids, allocated * sizeof(size_t));
+    if(!ids) {
+      return -1;
+    }
+    posting->ids = ids;
+    posting->allocated = allocated;
+  }
+
+  posting->ids[posting->count++] = id;
+  return 0;
+}
+
+size_t bg_tag_index_postings(const bg_tag_index *index, const bg_string *tag) {
+  struct posting *posting = find_posting(index, tag);
+  return posting ? posting->count : 0;
+}
+
+/* first position from start holding an id not less than id:
+   exponential steps, then binary search within the last one */
+static size_t gallop(const struct posting *posting, size_t start, size_t id) {
+  size_t low = start;
+  size_t high = start;
+  size_t step = 1;
+
+  while(high < posting->count && posting->ids[high] < id) {
+    low = high + 1;
+    high = start + step;
+    step *= 2;
+  }
+  if(high > posting->count) {
+    high = posting->count;
+  }
+
+  while(low < high) {
+    size_t middle = low + (high - low) / 2;
+    if(posting->ids[middle] < id) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  return low;
+}
+
+static int compare_postings(const void *lhs, const void *rhs) {
+  size_t left = (*(const struct posting * const *)lhs)->count;
+  size_t right = (*(const struct posting * const *)rhs)->count;
+  return (left > right) - (left < right);
+}
+
+int bg_tag_index_intersect(const bg_tag_index *index, const bg_string * const *tags, size_t count,
+                           int (* callback)(size_t id, void *), void *out) {
+  int err = 0;
+
+  if(count == 0) {
+    return -1;
+  }
+
+  const struct posting **postings = malloc(count * sizeof(struct posting *));
+  size_t *positions = calloc(count, sizeof(size_t));
+  if(!postings || !positions) {
+    free(postings);
+    free(positions);
+    return -1;
+  }
+
+  size_t i, j;
+  for(i = 0; i < count; ++i) {
+    if(!(postings[i] = find_posting(index, tags[i]))) {
+      goto end; /* unknown tag, nothing is tagged with all of them */
+    }
+  }
+
+  if(count > 1) {
+    qsort(postings, count, sizeof(struct posting *), &compare_postings);
+  }
+
+  for(i = 0; i < postings[0]->count; ++i) {
+    size_t id = postings[0]->ids[i];
+
+    for(j = 1; j < count; ++j) {
+      positions[j] = gallop(postings[j], positions[j], id);
+      if(positions[j] == postings[j]->count) {
+        goto end; /* a list is exhausted */
+      }
+      if(postings[j]->ids[positions[j]] != id) {
+        break;
+      }
+    }
+
+    if(j == count && (err = callback(id, out))) {
+      break;
+    }
+  }
+
+end:
+  free(postings);
+  free(positions);
+  return err;
+}
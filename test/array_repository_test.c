@@ -232,3 +232,53 @@ pruf_test_define(array_repository, can_iterate_over_repository_given_3_stored_pa
   pruf_expect_equal_string("somepassname2", bg_string_data(bg_password_name(pwds[1])));
   pruf_expect_equal_string("somepassname3", bg_string_data(bg_password_name(pwds[2])));
 }
+
+pruf_test_define(array_repository, generation_changes_on_add_and_remove_only) {
+  uint64_t before, after_add, after_get, after_remove;
+  bg_password *pwd = bg_password_new();
+  bg_string *name = bg_string_from_str("somepassname");
+  bg_password_update_name(pwd, bg_string_copy(name));
+
+  pruf_expect_zero(bg_repository_generation(repo, &before));
+  bg_repository_add(repo, pwd);
+  bg_repository_generation(repo, &after_add);
+  bg_repository_get(repo, name, &pwd);
+  bg_repository_generation(repo, &after_get);
+  bg_repository_remove(repo, name);
+  bg_repository_generation(repo, &after_remove);
+
+  pruf_expect_not_equal(before, after_add);
+  pruf_expect_equal(after_add, after_get);
+  pruf_expect_not_equal(after_get, after_remove);
+
+  bg_string_free(name);
+}
+
+pruf_test_define(array_repository, add_all_adds_every_password) {
+  bg_password *pwds[3];
+  const char *names[] = {"somepassname3", "somepassname1", "somepassname2"};
+  int i;
+  for(i = 0; i < 3; ++i) {
+    pwds[i] = bg_password_new();
+    bg_password_update_name(pwds[i], bg_string_from_str(names[i]));
+  }
+
+  pruf_expect_zero(bg_repository_add_all(repo, pwds, 3));
+  pruf_expect_equal(3, bg_repository_count(repo));
+}
+
+pruf_test_define(array_repository, add_all_adds_nothing_on_duplicates) {
+  bg_password *stored = bg_password_new();
+  bg_password_update_name(stored, bg_string_from_str("somepassname"));
+  bg_repository_add(repo, stored);
+
+  bg_password *pwds[2] = { bg_password_new(), bg_password_new() };
+  bg_password_update_name(pwds[0], bg_string_from_str("otherpassname"));
+  bg_password_update_name(pwds[1], bg_string_from_str("somepassname"));
+
+  pruf_expect_equal(-1, bg_repository_add_all(repo, pwds, 2));
+  pruf_expect_equal(1, bg_repository_count(repo));
+
+  bg_password_free(pwds[0]);
+  bg_password_free(pwds[1]);
+}
@@ -8,6 +8,7 @@ EXECUTABLE = os.path.join(os.path.dirname(__file__), "..", "build", "bin", "blur
 MASTER_PASSWD_FILE = "/tmp/master_passwd.stdin"
 MASTER_PASSWD = "somemasterpassword"
 TEST_RC_FILE = "/tmp/test.bg.bin"
+TEST_BATCH_RC_FILE = "/tmp/test.bg.batch.bin"
 
 
 def create_master_password_file():
@@ -35,10 +36,12 @@ def call_blur(*args):
 
 def main_test():
     for i in range(50):
+        tags = ["--tag", "even"] if i % 2 == 0 else []
         rstatus, out, err = call_blur("add",
                                      "--name", "somepass" + str(i),
                                      "--description", "some description " + str(i),
-                                     "--value", "somevalue" + str(i))
+                                     "--value", "somevalue" + str(i),
+                                     *tags)
 
         if rstatus != 0:
             return rstatus, out, err
@@ -54,10 +57,55 @@ def main_test():
         if rstatus != 0:
             return rstatus
 
+    rstatus, out, err = call_blur("list", "--tag", "even")
+    if out.decode().split() != ["somepass" + str(i) for i in range(0, 50, 2)]:
+        sys.stderr.write("TAGGED PASSWORDS DO NOT MATCH: " + str(out) + "\n")
+        return 1
+
     rstatus, out, err = call_blur("info")
     if out.decode() != "number of passwords: 50\n":
         return 1
 
+    return batch_test()
+
+
+def call_blur_batch(*lines):
+    arg_list = [EXECUTABLE, "-s", "-n", "-f", TEST_BATCH_RC_FILE, "batch"]
+    stdin = MASTER_PASSWD + "\n" + "".join(line + "\n" for line in lines)
+    process = ps.Popen(arg_list, stdin=ps.PIPE, stdout=ps.PIPE, stderr=ps.PIPE)
+    out, err = process.communicate(stdin.encode())
+    return process.returncode, out, err
+
+
+def batch_test():
+    if os.path.exists(TEST_BATCH_RC_FILE):
+        os.remove(TEST_BATCH_RC_FILE)
+
+    rstatus, out, err = call_blur_batch(*["add --name somepass%d --description \"some description\" --value somevalue%d" % (i, i)
+                                          for i in range(10)])
+    if rstatus != 0:
+        return rstatus
+
+    rstatus, out, err = call_blur_batch("get somepass3",
+                                        "add --name \"batch pass\" --description batch --value \"batch value\"",
+                                        "get \"batch pass\"",
+                                        "remove somepass4 --yes",
+                                        "list")
+    names = ["somepass%d" % i for i in range(10) if i != 4] + ["batch pass"]
+    if rstatus != 0 or out.decode() != "somevalue3\nbatch value\n" + "".join(name + "\n" for name in names):
+        sys.stderr.write("BATCH OUTPUT DOES NOT MATCH: " + str(out) + "\n")
+        return 1
+
+    rstatus, out, err = call_blur_batch("remove somepass5 --yes", "get missing")
+    if rstatus == 0:
+        return 1
+
+    rstatus, out, err = call_blur_batch("list")
+    if out.decode() != "".join(name + "\n" for name in names):
+        sys.stderr.write("FAILED BATCH WAS NOT ROLLED BACK: " + str(out) + "\n")
+        return 1
+
+    os.remove(TEST_BATCH_RC_FILE)
     return 0
 
 
@@ -0,0 +1,200 @@
+#include <unistd.h>
+#include <prufen/prufen.h>
+#include <blurgather/string.h>
+#include <blurgather/context.h>
+#include <blurgather/exchange.h>
+#include <blurgather/repository.h>
+#include <blurgather/persister.h>
+#include <blurgather/mcrypt_cryptor.h>
+#include <blurgather/array_repository.h>
+#include <blurgather/msgpack_persister.h>
+
+
+#define TEST_FILE_PATH "/tmp/bg.shadow.bin.exchange_test"
+
+bg_context *ctx;
+bg_msgpack_persister *persister;
+
+static void setup_context(void) {
+  bgctx_init(&ctx);
+
+  bg_cryptor_t *cryptor = bg_mcrypt_cryptor();
+  bgctx_register_cryptor(ctx, cryptor);
+
+  persister = bg_msgpack_persister_new(bg_string_from_str(TEST_FILE_PATH), cryptor);
+  bgctx_register_persister(ctx, bg_msgpack_persister_persister(persister));
+  bgctx_register_repository(ctx, bg_password_array_repository_new());
+
+  bgctx_config(ctx, BGCTX_ACQUIRE_PERSISTER | BGCTX_ACQUIRE_REPOSITORY);
+  bgctx_seal(ctx);
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+}
+
+pruf_setup(exchange) {
+  setup_context();
+}
+
+pruf_teardown(exchange) {
+  bgctx_finalize(ctx);
+  remove(TEST_FILE_PATH);
+}
+
+static bg_stream *stream_from_str(const char *str) {
+  bg_stream *stream = bg_stream_open(BGSO_MEM, BGSM_READ | BGSM_WRITE);
+  bg_stream_write(stream, str, strlen(str));
+  bg_stream_rewind(stream);
+  return stream;
+}
+
+/* decrypted copy of named password, caller frees */
+static bg_password *find_plain(const char *name) {
+  bg_password *password = NULL;
+  bg_string *str = bg_string_from_str(name);
+
+  if(bgctx_find_password(ctx, str, &password) == 0) {
+    password = bg_password_copy(password);
+    bgctx_decrypt_password(ctx, password);
+  }
+
+  bg_string_free(str);
+  return password;
+}
+
+pruf_test_define(exchange, imports_csv_and_persists_once) {
+  bg_stream *input = stream_from_str("name,value,description,tags,metadata\r\n"
+                                     "mail,\"p,w\"\"d\",my mail,web;personal,user=me\r\n"
+                                     "bank,1234,,finance,\n"
+                                     "\n");
+  size_t imported = 0, count = 0;
+
+  pruf_expect_zero(bgctx_import(ctx, input, BG_EXCHANGE_CSV, 2, &imported));
+  pruf_expect_equal(2, imported);
+  pruf_expect_zero(bg_persister_count(bgctx_persister(ctx), &count));
+  pruf_expect_equal(2, count);
+
+  bg_password *mail = find_plain("mail");
+  pruf_expect_not_null(mail);
+  pruf_expect_equal_string("p,w\"d", bg_string_data(bg_password_value(mail)));
+  pruf_expect_equal_string("my mail", bg_string_data(bg_password_description(mail)));
+
+  bg_string *tag = bg_string_from_str("personal"), *key = bg_string_from_str("user"), *value = NULL;
+  pruf_expect_true(bg_password_has_tag(mail, tag));
+  pruf_expect_zero(bg_password_get_metadata(mail, key, &value));
+  pruf_expect_equal_string("me", bg_string_data(value));
+
+  bg_string_free(tag);
+  bg_string_free(key);
+  bg_string_clean_free(value);
+  bg_password_free(mail);
+  bg_stream_close(input);
+}
+
+pruf_test_define(exchange, malformed_input_imports_nothing) {
+  bg_stream *input = stream_from_str("name,value\nmail,\"unterminated\n");
+
+  pruf_expect_equal(-5, bgctx_import(ctx, input, BG_EXCHANGE_CSV, 0, NULL));
+  pruf_expect_equal(0, bg_repository_count(bgctx_repository(ctx)));
+  pruf_expect_non_zero(access(TEST_FILE_PATH, F_OK));
+
+  bg_stream_close(input);
+}
+
+pruf_test_define(exchange, json_export_imports_back) {
+  bg_stream *input = stream_from_str("[{\"name\": \"mail\", \"value\": \"caf\\u00e9\", \"ignored\": [1, {\"x\": null}],"
+                                     " \"tags\": [\"web\"], \"metadata\": {\"user\": \"me\"}},"
+                                     " {\"name\": \"bank\", \"value\": \"1234\"}]");
+  bg_stream *output = bg_stream_open(BGSO_MEM, BGSM_READ | BGSM_WRITE);
+
+  pruf_expect_zero(bgctx_import(ctx, input, BG_EXCHANGE_JSON, 1, NULL));
+  pruf_expect_zero(bgctx_export(ctx, output, BG_EXCHANGE_JSON));
+
+  bgctx_finalize(ctx);
+  remove(TEST_FILE_PATH);
+  setup_context();
+
+  size_t imported = 0;
+  bg_stream_rewind(output);
+  pruf_expect_zero(bgctx_import(ctx, output, BG_EXCHANGE_JSON, 0, &imported));
+  pruf_expect_equal(2, imported);
+
+  bg_password *mail = find_plain("mail");
+  bg_string *tag = bg_string_from_str("web");
+  pruf_expect_not_null(mail);
+  pruf_expect_equal_string("caf\xc3\xa9", bg_string_data(bg_password_value(mail)));
+  pruf_expect_true(bg_password_has_tag(mail, tag));
+
+  bg_string_free(tag);
+  bg_password_free(mail);
+  bg_stream_close(input);
+  bg_stream_close(output);
+}
+
+pruf_test_define(exchange, csv_export_keeps_separators_within_tags_and_metadata) {
+  bg_stream *input = stream_from_str("[{\"name\": \"mail\", \"tags\": [\"a;b\", \"c\\\\d=\"],"
+                                     " \"metadata\": {\"k=1;x\": \"v;=\\\\\"}}]");
+  bg_stream *output = bg_stream_open(BGSO_MEM, BGSM_READ | BGSM_WRITE);
+
+  pruf_expect_zero(bgctx_import(ctx, input, BG_EXCHANGE_JSON, 1, NULL));
+  pruf_expect_zero(bgctx_export(ctx, output, BG_EXCHANGE_CSV));
+
+  bgctx_finalize(ctx);
+  remove(TEST_FILE_PATH);
+  setup_context();
+
+  bg_stream_rewind(output);
+  pruf_expect_zero(bgctx_import(ctx, output, BG_EXCHANGE_CSV, 0, NULL));
+
+  bg_password *mail = find_plain("mail");
+  bg_string *tag1 = bg_string_from_str("a;b"), *tag2 = bg_string_from_str("c\\d=");
+  bg_string *key = bg_string_from_str("k=1;x"), *value = NULL;
+  pruf_expect_not_null(mail);
+  pruf_expect_true(bg_password_has_tag(mail, tag1));
+  pruf_expect_true(bg_password_has_tag(mail, tag2));
+  pruf_expect_zero(bg_password_get_metadata(mail, key, &value));
+  pruf_expect_equal_string("v;=\\", bg_string_data(value));
+
+  bg_string_free(tag1);
+  bg_string_free(tag2);
+  bg_string_free(key);
+  bg_string_clean_free(value);
+  bg_password_free(mail);
+  bg_stream_close(input);
+  bg_stream_close(output);
+}
+
+pruf_test_define(exchange, export_fails_when_output_cannot_be_flushed) {
+  bg_stream *input = stream_from_str("name,value\nmail,1234\n");
+  bg_stream *output = bg_stream_open(BGSO_FD, BGSM_WRITE, "/dev/full");
+
+  pruf_expect_zero(bgctx_import(ctx, input, BG_EXCHANGE_CSV, 0, NULL));
+  pruf_expect_not_null(output);
+  pruf_expect_equal(-7, bgctx_export(ctx, output, BG_EXCHANGE_CSV));
+
+  bg_stream_close(input);
+  bg_stream_close(output);
+}
+
+pruf_test_define(exchange, import_within_transaction_is_rolled_back) {
+  bg_stream *input = stream_from_str("name\nmail\nbank\n");
+
+  bgctx_begin(ctx);
+  pruf_expect_zero(bgctx_import(ctx, input, BG_EXCHANGE_CSV, 0, NULL));
+  pruf_expect_equal(2, bg_repository_count(bgctx_repository(ctx)));
+  pruf_expect_non_zero(access(TEST_FILE_PATH, F_OK));
+
+  pruf_expect_zero(bgctx_rollback(ctx));
+  pruf_expect_equal(0, bg_repository_count(bgctx_repository(ctx)));
+
+  bg_stream_close(input);
+}
+
+pruf_test_define(exchange, rejects_unknown_format_and_locked_context) {
+  bg_stream *input = stream_from_str("name\nmail\n");
+
+  pruf_expect_equal(-6, bgctx_import(ctx, input, 0, 0, NULL));
+  bgctx_lock(ctx);
+  pruf_expect_equal(-2, bgctx_import(ctx, input, BG_EXCHANGE_CSV, 0, NULL));
+  pruf_expect_equal(-2, bgctx_export(ctx, input, BG_EXCHANGE_CSV));
+
+  bg_stream_close(input);
+}
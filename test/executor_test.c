@@ -0,0 +1,116 @@
+#include <pthread.h>
+#include <prufen/prufen.h>
+#include <blurgather/executor.h>
+
+
+#define NB_THREADS 4
+#define COUNT 10000
+
+bg_executor *executor;
+int visits[COUNT];
+
+pruf_setup(executor) {
+  executor = bg_executor_new(NB_THREADS);
+  memset(visits, 0, sizeof(visits));
+}
+
+pruf_teardown(executor) {
+  bg_executor_free(executor);
+}
+
+static int visit(size_t begin, size_t end, void *data) {
+  size_t i;
+  for(i = begin; i < end; ++i) {
+    __atomic_add_fetch(&visits[i], 1, __ATOMIC_RELAXED);
+  }
+  return 0;
+}
+
+static int visited_once(void) {
+  size_t i;
+  for(i = 0; i < COUNT; ++i) {
+    if(visits[i] != 1) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+pruf_test_define(executor, for_visits_every_index_once) {
+  pruf_expect_equal(NB_THREADS, bg_executor_threads(executor));
+  pruf_expect_zero(bg_executor_for(executor, COUNT, 7, &visit, NULL));
+  pruf_expect_true(visited_once());
+}
+
+pruf_test_define(executor, for_without_executor_runs_on_caller) {
+  pruf_expect_zero(bg_executor_for(NULL, COUNT, 7, &visit, NULL));
+  pruf_expect_true(visited_once());
+}
+
+static int fail_past_half(size_t begin, size_t end, void *data) {
+  visit(begin, end, data);
+  return end > COUNT / 2 ? -3 : 0;
+}
+
+pruf_test_define(executor, for_returns_task_error) {
+  pruf_expect_equal(-3, bg_executor_for(executor, COUNT, 16, &fail_past_half, NULL));
+}
+
+#define MAX_SEEN 64
+
+struct seen_threads {
+  pthread_mutex_t lock;
+  pthread_t threads[MAX_SEEN];
+  size_t count;
+};
+
+static int record_thread(size_t begin, size_t end, void *_seen) {
+  struct seen_threads *seen = _seen;
+  size_t i;
+
+  pthread_mutex_lock(&seen->lock);
+  for(i = 0; i < seen->count && !pthread_equal(seen->threads[i], pthread_self()); ++i) {
+  }
+  if(i == seen->count && seen->count < MAX_SEEN) {
+    seen->threads[seen->count++] = pthread_self();
+  }
+  pthread_mutex_unlock(&seen->lock);
+
+  return 0;
+}
+
+pruf_test_define(executor, threads_are_reused_across_calls) {
+  struct seen_threads seen;
+  int i;
+
+  pthread_mutex_init(&seen.lock, NULL);
+  seen.count = 0;
+
+  for(i = 0; i < 20; ++i) {
+    bg_executor_for(executor, COUNT, 1, &record_thread, &seen);
+  }
+  /* workers and caller */
+  pruf_expect_true(seen.count <= NB_THREADS + 1);
+
+  pthread_mutex_destroy(&seen.lock);
+}
+
+static void visit_slice(void *_slice) {
+  size_t slice = (size_t)_slice;
+  /* tasks may use executor too */
+  bg_executor_for(executor, COUNT / 10, 3, &visit, NULL);
+  visit(slice * (COUNT / 10), (slice + 1) * (COUNT / 10), NULL);
+}
+
+pruf_test_define(executor, wait_returns_once_submitted_tasks_ran) {
+  size_t slice;
+
+  for(slice = 0; slice < 10; ++slice) {
+    pruf_expect_zero(bg_executor_submit(executor, &visit_slice, (void *)slice));
+  }
+  bg_executor_wait(executor);
+
+  /* each nested for visited first slice once more */
+  pruf_expect_equal(11, visits[0]);
+  pruf_expect_equal(1, visits[COUNT - 1]);
+}
@@ -0,0 +1,131 @@
+#include <prufen/prufen.h>
+#include <string.h>
+#include <unistd.h>
+#include "blurgather/stream.h"
+
+const char *filename = "fd_stream.txt";
+
+void at_close(void *arg) {
+  remove((const char*)arg);
+}
+
+static size_t read_back(char *data, size_t length) {
+  bg_stream *stream = bg_stream_open(BGSO_FD, BGSM_READ, filename);
+  size_t read = bg_stream_read(stream, data, length);
+  bg_stream_close(stream);
+  return read;
+}
+
+pruf_test_define(fd_stream, cannot_open_missing_file_for_reading) {
+  remove(filename);
+  pruf_expect_null(bg_stream_open(BGSO_FD, BGSM_READ, filename));
+}
+
+pruf_test_define(fd_stream, write_is_read_back_after_rewind) {
+  bg_stream *stream = bg_stream_open(BGSO_FD, BGSM_WRITE | BGSM_READ, filename, &at_close, filename);
+  char data[] = "hello, it's me", read_data[sizeof(data)];
+
+  pruf_expect_equal(sizeof(data), bg_stream_write(stream, data, sizeof(data)));
+  pruf_expect_equal(sizeof(data), bg_stream_length(stream));
+  bg_stream_rewind(stream);
+  pruf_expect_equal(sizeof(data), bg_stream_read(stream, read_data, sizeof(data)));
+  pruf_expect_equal_memory(data, read_data, sizeof(data));
+  bg_stream_close(stream);
+}
+
+pruf_test_define(fd_stream, exclusive_write_fails_on_existing_file_or_link) {
+  const char *link = "fd_stream.link";
+  bg_stream *stream = bg_stream_open(BGSO_FD, BGSM_WRITE | BGSM_EXCL, filename);
+  pruf_expect_not_null(stream);
+  bg_stream_close(stream);
+  pruf_expect_null(bg_stream_open(BGSO_FD, BGSM_WRITE | BGSM_EXCL, filename));
+
+  remove(link);
+  symlink("fd_stream.missing", link);
+  pruf_expect_null(bg_stream_open(BGSO_FD, BGSM_WRITE | BGSM_EXCL, link));
+  pruf_expect_non_zero(access("fd_stream.missing", F_OK));
+
+  remove(link);
+  remove(filename);
+}
+
+pruf_test_define(fd_stream, writing_truncates_unless_appending) {
+  char read_data[16];
+  bg_stream *stream = bg_stream_open(BGSO_FD, BGSM_WRITE, filename);
+  bg_stream_write(stream, "first", 5);
+  bg_stream_close(stream);
+
+  stream = bg_stream_open(BGSO_FD, BGSM_WRITE, filename);
+  bg_stream_write(stream, "second", 6);
+  bg_stream_close(stream);
+  pruf_expect_equal(6, read_back(read_data, sizeof(read_data)));
+
+  stream = bg_stream_open(BGSO_FD, BGSM_WRITE | BGSM_APPEND, filename, &at_close, filename);
+  bg_stream_write(stream, "third", 5);
+  pruf_expect_equal(11, bg_stream_length(stream));
+  bg_stream_close(stream);
+}
+
+pruf_test_define(fd_stream, writes_after_rewind_overwrite_unless_appending) {
+  bg_stream *stream = bg_stream_open(BGSO_FD, BGSM_WRITE | BGSM_READ, filename, &at_close, filename);
+  char read_data[16];
+
+  bg_stream_write(stream, "hello you", 9);
+  bg_stream_rewind(stream);
+  bg_stream_write(stream, "HELLO", 5);
+  bg_stream_rewind(stream);
+
+  pruf_expect_equal(9, bg_stream_read(stream, read_data, sizeof(read_data)));
+  pruf_expect_equal_memory("HELLO you", read_data, 9);
+  bg_stream_close(stream);
+}
+
+pruf_test_define(fd_stream, reading_then_writing_continues_at_stream_position) {
+  bg_stream *stream = bg_stream_open(BGSO_FD, BGSM_WRITE | BGSM_READ, filename, &at_close, filename);
+  char read_data[16];
+
+  bg_stream_write(stream, "abcdef", 6);
+  bg_stream_rewind(stream);
+  pruf_expect_equal(2, bg_stream_read(stream, read_data, 2));
+  bg_stream_write(stream, "XY", 2);
+  bg_stream_rewind(stream);
+
+  pruf_expect_equal(6, bg_stream_read(stream, read_data, sizeof(read_data)));
+  pruf_expect_equal_memory("abXYef", read_data, 6);
+  bg_stream_close(stream);
+}
+
+pruf_test_define(fd_stream, writev_writes_segments_in_order) {
+  bg_stream *stream = bg_stream_open(BGSO_FD, BGSM_WRITE, filename, &at_close, filename);
+  struct iovec segments[3] = { { "head", 4 }, { "", 0 }, { "tail", 4 } };
+  char read_data[16];
+
+  pruf_expect_equal(8, bg_stream_writev(stream, segments, 3));
+  pruf_expect_equal(8, bg_stream_length(stream));
+  pruf_expect_equal(8, read_back(read_data, sizeof(read_data)));
+  pruf_expect_equal_memory("headtail", read_data, 8);
+  bg_stream_close(stream);
+}
+
+pruf_test_define(fd_stream, large_writes_and_reads_bypass_buffer) {
+  bg_stream *stream = bg_stream_open(BGSO_FD, BGSM_WRITE | BGSM_READ, filename, &at_close, filename);
+  size_t data_length = 1 << 20, i;
+  char *data = malloc(data_length), *read_data = malloc(data_length);
+  struct iovec segments[2] = { { data, 10 }, { data + 10, data_length - 10 } };
+
+  for(i = 0; i < data_length; ++i) {
+    data[i] = (char)(i * 7);
+  }
+
+  pruf_expect_equal(10, bg_stream_write(stream, data, 10));
+  pruf_expect_equal(data_length - 10, bg_stream_writev(stream, segments + 1, 1));
+  pruf_expect_equal(data_length, bg_stream_length(stream));
+  bg_stream_rewind(stream);
+  pruf_expect_equal(3, bg_stream_read(stream, read_data, 3));
+  pruf_expect_equal(data_length - 3, bg_stream_read(stream, read_data + 3, data_length));
+  pruf_expect_equal_memory(data, read_data, data_length);
+
+  free(data);
+  free(read_data);
+  bg_stream_close(stream);
+}
@@ -0,0 +1,79 @@
+#include <string.h>
+#include <blurgather/file_header.h>
+#include <prufen/prufen.h>
+
+bg_file_header header;
+bg_file_header decoded;
+unsigned char buffer[BG_FILE_HEADER_LENGTH];
+
+pruf_setup(file_header) {
+  bg_file_header_init(&header);
+  memset(&decoded, 0, sizeof(bg_file_header));
+  memset(buffer, 0, BG_FILE_HEADER_LENGTH);
+}
+
+
+pruf_test_define(file_header, encoded_header_starts_with_magic) {
+  bg_file_header_encode(&header, buffer);
+
+  pruf_expect_equal_memory(BG_FILE_HEADER_MAGIC, buffer, BG_FILE_HEADER_MAGIC_LENGTH);
+}
+
+pruf_test_define(file_header, decoding_an_encoded_header_gives_back_same_fields) {
+  header.flags = BG_FILE_ENCRYPTED;
+  header.cryptor_id = 1;
+  header.kdf_iterations = 42;
+  header.kdf_salt[3] = 0xAB;
+  header.record_count = 1234567890123ULL;
+  header.payload_length = 256;
+  header.generation = 7;
+  bg_file_header_encode(&header, buffer);
+
+  pruf_expect_zero(bg_file_header_decode(&decoded, buffer, BG_FILE_HEADER_LENGTH));
+
+  pruf_expect_equal(BG_FILE_FORMAT_VERSION, decoded.version);
+  pruf_expect_equal(BG_FILE_HEADER_LENGTH, decoded.header_length);
+  pruf_expect_equal(BG_FILE_ENCRYPTED, decoded.flags);
+  pruf_expect_equal(1, decoded.cryptor_id);
+  pruf_expect_equal(BG_KDF_NONE, decoded.kdf_id);
+  pruf_expect_equal(42, decoded.kdf_iterations);
+  pruf_expect_equal_memory(header.kdf_salt, decoded.kdf_salt, BG_KDF_SALT_LENGTH);
+  pruf_expect_true(decoded.record_count == 1234567890123ULL);
+  pruf_expect_equal(BG_FILE_HEADER_LENGTH, decoded.payload_offset);
+  pruf_expect_equal(256, decoded.payload_length);
+  pruf_expect_equal(7, decoded.generation);
+}
+
+pruf_test_define(file_header, header_is_little_endian) {
+  header.record_count = 0x0102;
+  bg_file_header_encode(&header, buffer);
+
+  pruf_expect_equal(0x02, buffer[40]);
+  pruf_expect_equal(0x01, buffer[41]);
+}
+
+pruf_test_define(file_header, decoding_buffer_without_magic_returns_minus_1) {
+  memcpy(buffer, "\x92\xc4\x03", 3);
+
+  pruf_expect_equal(-1, bg_file_header_decode(&decoded, buffer, BG_FILE_HEADER_LENGTH));
+}
+
+pruf_test_define(file_header, decoding_truncated_header_returns_minus_2) {
+  bg_file_header_encode(&header, buffer);
+
+  pruf_expect_equal(-2, bg_file_header_decode(&decoded, buffer, BG_FILE_HEADER_LENGTH - 1));
+}
+
+pruf_test_define(file_header, decoding_unsupported_version_returns_minus_3) {
+  header.version = BG_FILE_FORMAT_VERSION + 1;
+  bg_file_header_encode(&header, buffer);
+
+  pruf_expect_equal(-3, bg_file_header_decode(&decoded, buffer, BG_FILE_HEADER_LENGTH));
+}
+
+pruf_test_define(file_header, decoding_payload_overlapping_header_returns_minus_5) {
+  header.payload_offset = BG_FILE_HEADER_LENGTH - 8;
+  bg_file_header_encode(&header, buffer);
+
+  pruf_expect_equal(-5, bg_file_header_decode(&decoded, buffer, BG_FILE_HEADER_LENGTH));
+}
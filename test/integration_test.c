@@ -1,9 +1,13 @@
+#include <pthread.h>
+#include <unistd.h>
 #include <prufen/prufen.h>
 #include <blurgather/string.h>
 #include <blurgather/context.h>
 #include <blurgather/mcrypt_cryptor.h>
 #include <blurgather/array_repository.h>
+#include <blurgather/snapshot_repository.h>
 #include <blurgather/msgpack_persister.h>
+#include <blurgather/executor.h>
 
 
 #define TEST_FILE_PATH "/tmp/bg.shadow.bin.integration_test"
@@ -11,7 +15,7 @@
 bg_context *ctx;
 bg_msgpack_persister *persister;
 
-void setup_context(void) {
+static void setup_context_with(bg_repository_t *repository) {
   bgctx_init(&ctx);
 
   bg_cryptor_t *cryptor = bg_mcrypt_cryptor();
@@ -21,12 +25,16 @@ void setup_context(void) {
   persister = bg_msgpack_persister_new(bg_string_from_str(TEST_FILE_PATH), cryptor);
   bgctx_register_persister(ctx, bg_msgpack_persister_persister(persister));
 
-  bgctx_register_repository(ctx, bg_password_array_repository_new());
+  bgctx_register_repository(ctx, repository);
 
   bgctx_config(ctx, BGCTX_ACQUIRE_PERSISTER | BGCTX_ACQUIRE_REPOSITORY);
   bgctx_seal(ctx);
 }
 
+void setup_context(void) {
+  setup_context_with(bg_password_array_repository_new());
+}
+
 pruf_setup(default_blur_setup) {
   setup_context();
 }
@@ -100,3 +108,538 @@ pruf_test_define(default_blur_setup, can_read_saved_passwords) {
     bg_string_free(desc);
   }
 }
+
+int nb_found;
+
+int count_found(const bg_string *name, void *output) {
+  ++nb_found;
+  return 0;
+}
+
+pruf_test_define(default_blur_setup, can_search_names_only_while_unlocked) {
+  bg_string *pattern = bg_string_from_str("pass49");
+  create_password_db();
+
+  nb_found = 0;
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+  pruf_expect_zero(bgctx_search(ctx, pattern, &count_found, NULL));
+  pruf_expect_equal(11, nb_found);
+
+  bgctx_lock(ctx);
+  pruf_expect_non_zero(bgctx_search(ctx, pattern, &count_found, NULL));
+  pruf_expect_equal(11, nb_found);
+
+  bg_string_free(pattern);
+}
+
+pruf_test_define(default_blur_setup, lists_passwords_having_every_tag) {
+  bg_string *tags[2] = { bg_string_from_str("even"), bg_string_from_str("tens") };
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+
+  int i;
+  for(i = 0; i < 100; ++i) {
+    bg_password *pwd = bg_password_new();
+    bg_password_update_name(pwd, bg_string_plus(bg_string_from_str("somepass"), bg_string_from_decimal(i)));
+    bg_password_update_value(pwd, bg_string_from_str("somevalue"));
+    if(i % 2 == 0) { bg_password_add_tag(pwd, tags[0]); }
+    if(i % 10 == 0) { bg_password_add_tag(pwd, tags[1]); }
+    bgctx_encrypt_password(ctx, pwd);
+    bgctx_add_password(ctx, pwd);
+  }
+
+  nb_found = 0;
+  pruf_expect_zero(bgctx_list_tagged(ctx, (const bg_string * const *)tags, 1, &count_found, NULL));
+  pruf_expect_equal(50, nb_found);
+
+  nb_found = 0;
+  pruf_expect_zero(bgctx_list_tagged(ctx, (const bg_string * const *)tags, 2, &count_found, NULL));
+  pruf_expect_equal(10, nb_found);
+
+  bgctx_lock(ctx);
+  pruf_expect_non_zero(bgctx_list_tagged(ctx, (const bg_string * const *)tags, 2, &count_found, NULL));
+
+  bg_string_free(tags[0]);
+  bg_string_free(tags[1]);
+}
+
+static bg_password *new_crypted_password(const char *name, const char *value) {
+  bg_password *pwd = bg_password_new();
+  bg_password_update_name(pwd, bg_string_from_str(name));
+  bg_password_update_value(pwd, bg_string_from_str(value));
+  bgctx_encrypt_password(ctx, pwd);
+  return pwd;
+}
+
+static int collect_plain_value(bg_password *password, void *_values) {
+  bg_string **values = _values;
+  bg_string_cat(values, bg_password_value(password));
+  return bg_password_crypted(password);
+}
+
+pruf_test_define(default_blur_setup, iterates_over_decrypted_copies) {
+  bg_string *values = bg_string_new();
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+  bgctx_add_password(ctx, new_crypted_password("pass1", "value1"));
+  bgctx_add_password(ctx, new_crypted_password("pass2", "value2"));
+
+  pruf_expect_zero(bgctx_each_decrypted_password(ctx, &collect_plain_value, &values));
+  pruf_expect_equal_string("value1value2", bg_string_data(values));
+  bg_string_clean_free(values);
+
+  bgctx_lock(ctx);
+  pruf_expect_equal(-2, bgctx_each_decrypted_password(ctx, &collect_plain_value, &values));
+}
+
+pruf_test_define(default_blur_setup, transaction_persists_only_on_commit) {
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+
+  pruf_expect_zero(bgctx_begin(ctx));
+  pruf_expect_true(bgctx_in_transaction(ctx));
+  pruf_expect_zero(bgctx_add_password(ctx, new_crypted_password("pass1", "value1")));
+  pruf_expect_zero(bgctx_persist(ctx));
+  pruf_expect_zero(bgctx_add_password(ctx, new_crypted_password("pass2", "value2")));
+  pruf_expect_non_zero(access(TEST_FILE_PATH, F_OK));
+
+  pruf_expect_zero(bgctx_commit(ctx));
+  pruf_expect_false(bgctx_in_transaction(ctx));
+
+  size_t count = 0;
+  pruf_expect_zero(bg_persister_count(bgctx_persister(ctx), &count));
+  pruf_expect_equal(2, count);
+}
+
+pruf_test_define(default_blur_setup, rollback_restores_repository_from_undo_log) {
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+  bg_password *kept = new_crypted_password("kept", "keptvalue");
+  bg_string *kept_name = bg_string_copy(bg_password_name(kept));
+  bgctx_add_password(ctx, kept);
+  bgctx_add_password(ctx, new_crypted_password("other", "othervalue"));
+
+  pruf_expect_zero(bgctx_begin(ctx));
+  pruf_expect_zero(bgctx_remove_password(ctx, kept_name));
+  pruf_expect_zero(bgctx_add_password(ctx, new_crypted_password("added1", "value1")));
+  pruf_expect_zero(bgctx_add_password(ctx, new_crypted_password("added2", "value2")));
+  pruf_expect_equal(3, bg_repository_count(bgctx_repository(ctx)));
+
+  pruf_expect_zero(bgctx_rollback(ctx));
+
+  bg_password *found = NULL;
+  pruf_expect_equal(2, bg_repository_count(bgctx_repository(ctx)));
+  pruf_expect_zero(bg_repository_get(bgctx_repository(ctx), kept_name, &found));
+  pruf_expect_not_null(found);
+  pruf_expect_non_zero(access(TEST_FILE_PATH, F_OK));
+
+  bg_string_free(kept_name);
+}
+
+pruf_test_define(default_blur_setup, rollback_restores_updated_password) {
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+  bg_password *pwd = new_crypted_password("pass", "oldvalue");
+  bg_string *name = bg_string_copy(bg_password_name(pwd));
+  bgctx_add_password(ctx, pwd);
+
+  bg_password *updated = new_crypted_password("pass", "newvalue");
+  bg_string *updated_name = bg_string_copy(bg_password_name(updated));
+  pruf_expect_zero(bgctx_begin(ctx));
+  pruf_expect_zero(bgctx_update_password(ctx, name, updated));
+  pruf_expect_zero(bgctx_rollback(ctx));
+
+  bg_password *found = NULL;
+  pruf_expect_equal(1, bg_repository_count(bgctx_repository(ctx)));
+  pruf_expect_zero(bg_repository_get(bgctx_repository(ctx), name, &found));
+  bgctx_decrypt_password(ctx, found);
+  pruf_expect_equal_string("oldvalue", bg_string_data(bg_password_value(found)));
+  pruf_expect_non_zero(bg_repository_get(bgctx_repository(ctx), updated_name, &found));
+
+  bg_string_free(name);
+  bg_string_free(updated_name);
+}
+
+pruf_test_define(default_blur_setup, transactions_do_not_nest) {
+  pruf_expect_equal(-3, bgctx_commit(ctx));
+  pruf_expect_equal(-3, bgctx_rollback(ctx));
+
+  pruf_expect_zero(bgctx_begin(ctx));
+  pruf_expect_equal(-3, bgctx_begin(ctx));
+  pruf_expect_equal(-3, bgctx_load(ctx));
+  pruf_expect_zero(bgctx_rollback(ctx));
+}
+
+pruf_test_define(default_blur_setup, persisting_unchanged_context_does_not_rewrite_file) {
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+  pruf_expect_true(bgctx_dirty(ctx));
+
+  bgctx_add_password(ctx, new_crypted_password("pass1", "value1"));
+  pruf_expect_zero(bgctx_persist(ctx));
+  pruf_expect_false(bgctx_dirty(ctx));
+
+  remove(TEST_FILE_PATH);
+  pruf_expect_zero(bgctx_persist(ctx));
+  pruf_expect_non_zero(access(TEST_FILE_PATH, F_OK));
+
+  bgctx_add_password(ctx, new_crypted_password("pass2", "value2"));
+  pruf_expect_true(bgctx_dirty(ctx));
+  pruf_expect_zero(bgctx_persist(ctx));
+  pruf_expect_zero(access(TEST_FILE_PATH, F_OK));
+}
+
+pruf_test_define(default_blur_setup, loaded_context_is_not_dirty_until_changed) {
+  create_password_db();
+  bgctx_finalize(ctx);
+  setup_context();
+
+  pruf_expect_zero(bgctx_load(ctx));
+  pruf_expect_false(bgctx_dirty(ctx));
+
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+  bgctx_add_password(ctx, new_crypted_password("pass", "value"));
+  pruf_expect_true(bgctx_dirty(ctx));
+}
+
+pruf_test_define(default_blur_setup, finds_several_passwords_in_one_pass) {
+  const char *strs[] = {"somepass3", "somepass499", "missing", "somepass3"};
+  bg_string *names[4];
+  bg_password *found[4];
+  bg_password *single = NULL;
+  int i;
+
+  create_password_db();
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+  for(i = 0; i < 4; ++i) {
+    names[i] = bg_string_from_str(strs[i]);
+  }
+
+  pruf_expect_equal(1, bgctx_find_passwords(ctx, (const bg_string * const *)names, 4, found));
+  pruf_expect_not_null(found[0]);
+  pruf_expect_not_null(found[1]);
+  pruf_expect_null(found[2]);
+  pruf_expect_same_address(found[0], found[3]);
+
+  pruf_expect_zero(bgctx_find_passwords(ctx, (const bg_string * const *)names, 2, found));
+  pruf_expect_zero(bgctx_find_password(ctx, names[1], &single));
+  pruf_expect_same_address(found[1], single);
+
+  for(i = 0; i < 4; ++i) {
+    bg_string_free(names[i]);
+  }
+}
+
+pruf_test_define(default_blur_setup, copies_outlive_removal_of_found_passwords) {
+  const char *strs[] = {"somepass3", "missing", "somepass3"};
+  bg_string *names[3];
+  bg_password *copies[3];
+  bg_password *found = NULL;
+  int i;
+
+  create_password_db();
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+  for(i = 0; i < 3; ++i) {
+    names[i] = bg_string_from_str(strs[i]);
+  }
+
+  pruf_expect_equal(1, bgctx_copy_passwords(ctx, (const bg_string * const *)names, 3, copies));
+  pruf_expect_null(copies[1]);
+  pruf_expect_zero(bgctx_find_password(ctx, names[0], &found));
+  pruf_expect_not_same_address(found, copies[0]);
+  pruf_expect_not_same_address(copies[0], copies[2]);
+
+  bg_string *stored_name = bg_string_copy(bg_password_name(found));
+  pruf_expect_zero(bgctx_remove_password(ctx, stored_name));
+  bg_string_free(stored_name);
+  pruf_expect_zero(bgctx_decrypt_password(ctx, copies[0]));
+  pruf_expect_equal_string("somevalue3", bg_string_data(bg_password_value(copies[0])));
+
+  bg_password_free(copies[0]);
+  bg_password_free(copies[2]);
+  for(i = 0; i < 3; ++i) {
+    bg_string_free(names[i]);
+  }
+}
+
+#define NB_READERS 4
+
+static void *find_passwords_while_writing(void *_failures) {
+  int i;
+  for(i = 0; i < 50; ++i) {
+    bg_string *name = bg_string_plus(bg_string_from_str("somepass"), bg_string_from_decimal(i * 7 % NB_PASS));
+    bg_password *found = NULL, *copy = NULL;
+
+    if(bgctx_find_password(ctx, name, &found)) {
+      __atomic_add_fetch((int *)_failures, 1, __ATOMIC_RELAXED);
+    } else {
+      copy = bg_password_copy(found);
+      bgctx_decrypt_password(ctx, copy);
+      bg_password_free(copy);
+    }
+    bg_string_free(name);
+  }
+  return NULL;
+}
+
+pruf_test_define(default_blur_setup, readers_run_alongside_a_writer) {
+  pthread_t readers[NB_READERS];
+  int failures = 0, i;
+
+  create_password_db();
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+
+  for(i = 0; i < NB_READERS; ++i) {
+    pthread_create(&readers[i], NULL, &find_passwords_while_writing, &failures);
+  }
+  for(i = 0; i < 20; ++i) {
+    bg_string *name = bg_string_plus(bg_string_from_str("written"), bg_string_from_decimal(i));
+    bgctx_add_password(ctx, new_crypted_password(bg_string_data(name), "value"));
+    bg_string_free(name);
+  }
+  for(i = 0; i < NB_READERS; ++i) {
+    pthread_join(readers[i], NULL);
+  }
+
+  pruf_expect_zero(failures);
+  pruf_expect_equal(NB_PASS + 20, bg_repository_count(bgctx_repository(ctx)));
+}
+
+static void *add_passwords_while_persisting(void *unused) {
+  int i;
+  for(i = 0; i < 20; ++i) {
+    bg_string *name = bg_string_plus(bg_string_from_str("written"), bg_string_from_decimal(i));
+    bgctx_add_password(ctx, new_crypted_password(bg_string_data(name), "value"));
+    bg_string_free(name);
+  }
+  return NULL;
+}
+
+pruf_test_define(default_blur_setup, persists_snapshot_while_writer_adds) {
+  pthread_t writer;
+  size_t count = 0;
+
+  bgctx_finalize(ctx);
+  setup_context_with(bg_snapshot_repository_new());
+  create_password_db();
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+
+  bg_password *first = new_crypted_password("first", "value");
+  bgctx_add_password(ctx, first);
+  pthread_create(&writer, NULL, &add_passwords_while_persisting, NULL);
+  pruf_expect_zero(bgctx_persist(ctx));
+  pthread_join(writer, NULL);
+
+  pruf_expect_zero(bgctx_persist(ctx));
+  pruf_expect_false(bgctx_dirty(ctx));
+  pruf_expect_zero(bg_persister_count(bgctx_persister(ctx), &count));
+  pruf_expect_equal(NB_PASS + 21, count);
+}
+
+/* iteration waiting on a writer, which would never finish under reader lock */
+struct writer_during_foreach {
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  pthread_t thread;
+  int finished;
+  int visited;
+};
+
+static void *add_one_password(void *_state) {
+  struct writer_during_foreach *state = _state;
+
+  bgctx_add_password(ctx, new_crypted_password("written", "value"));
+
+  pthread_mutex_lock(&state->lock);
+  state->finished = 1;
+  pthread_cond_broadcast(&state->done);
+  pthread_mutex_unlock(&state->lock);
+  return NULL;
+}
+
+static int wait_for_writer(bg_password *password, void *_state) {
+  struct writer_during_foreach *state = _state;
+  struct timespec deadline;
+
+  if(state->visited++) {
+    return 0;
+  }
+  pthread_create(&state->thread, NULL, &add_one_password, state);
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += 5;
+  pthread_mutex_lock(&state->lock);
+  while(!state->finished && pthread_cond_timedwait(&state->done, &state->lock, &deadline) == 0) {
+  }
+  pthread_mutex_unlock(&state->lock);
+  return 0;
+}
+
+pruf_test_define(default_blur_setup, iteration_over_snapshot_does_not_block_writers) {
+  struct writer_during_foreach state = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+  bgctx_finalize(ctx);
+  setup_context_with(bg_snapshot_repository_new());
+  create_password_db();
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+
+  pruf_expect_zero(bgctx_each_password(ctx, &wait_for_writer, &state));
+  pthread_join(state.thread, NULL);
+
+  pruf_expect_true(state.finished);
+  pruf_expect_equal(NB_PASS, state.visited);
+  pruf_expect_equal(NB_PASS + 1, bg_repository_count(bgctx_repository(ctx)));
+}
+
+/* persister whose writes wait for gate to open */
+struct gate {
+  pthread_mutex_t lock;
+  pthread_cond_t opened;
+  int open;
+  int writes;
+};
+struct gate gate = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 };
+
+static void gated_destroy(bg_persister_t *self) {
+}
+
+static int gated_load(bg_persister_t *self, bg_repository_t *repo) {
+  return 0;
+}
+
+static int gated_persist(bg_persister_t *self, bg_repository_t *repo) {
+  pthread_mutex_lock(&gate.lock);
+  while(!gate.open) {
+    pthread_cond_wait(&gate.opened, &gate.lock);
+  }
+  ++gate.writes;
+  pthread_mutex_unlock(&gate.lock);
+  return 0;
+}
+
+static struct bg_persister_vtable gated_vtable = {
+  .destroy = &gated_destroy,
+  .load = &gated_load,
+  .persist = &gated_persist,
+};
+
+bg_persister_t gated_persister = { &gated_vtable, NULL };
+
+struct persisted {
+  int count;
+  int failures;
+};
+
+static void count_persisted(bg_context *ctx, int err, void *_persisted) {
+  struct persisted *persisted = _persisted;
+  __atomic_add_fetch(&persisted->count, 1, __ATOMIC_RELAXED);
+  if(err) {
+    __atomic_add_fetch(&persisted->failures, 1, __ATOMIC_RELAXED);
+  }
+}
+
+pruf_test_define(default_blur_setup, background_persists_coalesce) {
+  struct persisted persisted = { 0, 0 };
+  int i;
+
+  bgctx_finalize(ctx);
+  bgctx_init(&ctx);
+  bgctx_register_cryptor(ctx, bg_mcrypt_cryptor());
+  bgctx_register_persister(ctx, &gated_persister);
+  bgctx_register_repository(ctx, bg_snapshot_repository_new());
+  bgctx_config(ctx, BGCTX_ACQUIRE_REPOSITORY);
+  bgctx_seal(ctx);
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+
+  /* first write holds back until all are requested */
+  for(i = 0; i < 10; ++i) {
+    bg_string *name = bg_string_plus(bg_string_from_str("written"), bg_string_from_decimal(i));
+    pruf_expect_zero(bgctx_add_password(ctx, new_crypted_password(bg_string_data(name), "value")));
+    pruf_expect_zero(bgctx_persist_async(ctx, &count_persisted, &persisted));
+    bg_string_free(name);
+  }
+
+  pthread_mutex_lock(&gate.lock);
+  gate.open = 1;
+  pthread_cond_broadcast(&gate.opened);
+  pthread_mutex_unlock(&gate.lock);
+  bgctx_persist_wait(ctx);
+
+  pruf_expect_equal(10, persisted.count);
+  pruf_expect_zero(persisted.failures);
+  pruf_expect_true(gate.writes >= 1 && gate.writes <= 2);
+  pruf_expect_false(bgctx_dirty(ctx));
+}
+
+struct persisted decoding_persisted;
+
+/* as persisters decoding records over executor, a persist being requested meanwhile */
+static int decode_requesting_persist(size_t begin, size_t end, void *unused) {
+  if(begin == 0) {
+    bgctx_persist_async(ctx, &count_persisted, &decoding_persisted);
+  }
+  usleep(1000);
+  return 0;
+}
+
+static int decoding_load(bg_persister_t *self, bg_repository_t *repo) {
+  return bg_executor_for(bgctx_executor(ctx), 32, 1, &decode_requesting_persist, NULL);
+}
+
+static int instant_persist(bg_persister_t *self, bg_repository_t *repo) {
+  return 0;
+}
+
+static struct bg_persister_vtable decoding_vtable = {
+  .destroy = &gated_destroy,
+  .load = &decoding_load,
+  .persist = &instant_persist,
+};
+
+bg_persister_t decoding_persister = { &decoding_vtable, NULL };
+
+pruf_test_define(default_blur_setup, persist_requested_while_load_decodes_runs_after_it) {
+  decoding_persisted.count = decoding_persisted.failures = 0;
+
+  bgctx_finalize(ctx);
+  bgctx_init(&ctx);
+  bgctx_register_cryptor(ctx, bg_mcrypt_cryptor());
+  bgctx_register_persister(ctx, &decoding_persister);
+  bgctx_register_repository(ctx, bg_password_array_repository_new());
+  bgctx_register_executor(ctx, bg_executor_new(1));
+  bgctx_config(ctx, BGCTX_ACQUIRE_REPOSITORY | BGCTX_ACQUIRE_EXECUTOR);
+  bgctx_seal(ctx);
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+
+  pruf_expect_zero(bgctx_load(ctx));
+  bgctx_persist_wait(ctx);
+
+  pruf_expect_equal(1, decoding_persisted.count);
+  pruf_expect_zero(decoding_persisted.failures);
+}
+
+pruf_test_define(default_blur_setup, writers_on_same_file_keep_each_other_changes) {
+  bg_context *first = ctx, *second;
+  size_t count = 0;
+
+  bgctx_unlock(ctx, bg_secret_key_new("secret", 6));
+  bgctx_add_password(ctx, new_crypted_password("pass1", "value1"));
+  pruf_expect_zero(bgctx_persist(ctx));
+
+  /* as another process would */
+  setup_context();
+  second = ctx;
+  pruf_expect_zero(bgctx_load(second));
+  bgctx_unlock(second, bg_secret_key_new("secret", 6));
+  bgctx_add_password(second, new_crypted_password("pass2", "value2"));
+
+  ctx = first;
+  bgctx_add_password(first, new_crypted_password("pass3", "value3"));
+
+  pruf_expect_zero(bgctx_persist(second));
+  pruf_expect_zero(bgctx_persist(first));
+  pruf_expect_equal(3, bg_repository_count(bgctx_repository(first)));
+  pruf_expect_zero(bg_persister_count(bgctx_persister(first), &count));
+  pruf_expect_equal(3, count);
+
+  pruf_expect_equal(1, bgctx_refresh(second));
+  pruf_expect_equal(3, bg_repository_count(bgctx_repository(second)));
+  pruf_expect_false(bgctx_dirty(second));
+  pruf_expect_zero(bgctx_refresh(second));
+
+  bgctx_finalize(second);
+}
@@ -0,0 +1,243 @@
+#include <pthread.h>
+#include <prufen/prufen.h>
+#include <blurgather/lazy_repository.h>
+
+
+bg_repository_t *repo;
+
+/* records are plain names */
+int materialize_called;
+int source_destroy_called;
+
+static void test_source_destroy(bg_record_source *self) {
+  ++source_destroy_called;
+}
+
+static int test_source_materialize(bg_record_source *self, const unsigned char *record, size_t length, bg_password **password) {
+  __atomic_add_fetch(&materialize_called, 1, __ATOMIC_RELAXED);
+  *password = bg_password_new();
+  bg_password_fill_raw_name(*password, record, length);
+  return 0;
+}
+
+static struct bg_record_source_vtable test_source_vtable = {
+  .destroy = &test_source_destroy,
+  .materialize = &test_source_materialize,
+};
+
+bg_record_source *source;
+
+static void add_records(size_t count) {
+  static const char *names[] = {"name1", "name2", "name3", "name4"};
+  size_t i;
+  for(i = 0; i < count; ++i) {
+    bg_repository_add_record(repo, source, (const unsigned char *)names[i], 5);
+  }
+}
+
+static int count_password(bg_password *password, void *count) {
+  ++*(size_t*)count;
+  return 0;
+}
+
+pruf_setup(lazy_repository) {
+  repo = bg_lazy_repository_new();
+
+  source = malloc(sizeof(bg_record_source));
+  source->vtable = &test_source_vtable;
+  source->object = source;
+  source->references = 1;
+
+  materialize_called = 0;
+  source_destroy_called = 0;
+}
+
+pruf_teardown(lazy_repository) {
+  if(source) {
+    bg_record_source_release(source);
+  }
+  bg_repository_destroy(repo);
+  free((void*)repo->object);
+}
+
+
+pruf_test_define(lazy_repository, accepts_records) {
+  pruf_expect_true(bg_repository_accepts_records(repo));
+}
+
+pruf_test_define(lazy_repository, adding_records_does_not_materialize_them) {
+  add_records(3);
+
+  pruf_expect_equal(3, bg_repository_count(repo));
+  pruf_expect_equal(0, materialize_called);
+  pruf_expect_equal(0, bg_lazy_repository_materialized(repo));
+}
+
+pruf_test_define(lazy_repository, get_keeps_only_found_record_materialized) {
+  bg_password *password = NULL;
+  bg_string *name = bg_string_from_str("name2");
+  add_records(3);
+
+  pruf_expect_zero(bg_repository_get(repo, name, &password));
+  pruf_expect_equal_string("name2", bg_string_data(bg_password_name(password)));
+  pruf_expect_equal(1, bg_lazy_repository_materialized(repo));
+
+  bg_string_free(name);
+}
+
+pruf_test_define(lazy_repository, foreach_materializes_each_record_once) {
+  size_t count = 0;
+  add_records(3);
+
+  bg_repository_foreach(repo, &count_password, &count);
+  bg_repository_foreach(repo, &count_password, &count);
+
+  pruf_expect_equal(6, count);
+  pruf_expect_equal(3, materialize_called);
+}
+
+pruf_test_define(lazy_repository, limit_drops_least_recently_used_records) {
+  size_t count = 0;
+  add_records(4);
+  bg_lazy_repository_limit(repo, 2);
+
+  bg_repository_foreach(repo, &count_password, &count);
+
+  pruf_expect_equal(4, count);
+  pruf_expect_equal(2, bg_lazy_repository_materialized(repo));
+}
+
+static void *get_while_other_reader_evicts(void *_mismatches) {
+  bg_string *names[] = { bg_string_from_str("name1"), bg_string_from_str("name2"),
+                         bg_string_from_str("name3"), bg_string_from_str("name4") };
+  size_t i;
+
+  for(i = 0; i < 1000; ++i) {
+    bg_password *held = NULL, *other = NULL;
+    bg_repository_get(repo, names[i % 4], &held);
+    bg_repository_get(repo, names[(i + 1) % 4], &other);
+    if(bg_string_compare(bg_password_name(held), names[i % 4])) {
+      __atomic_add_fetch((int *)_mismatches, 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  for(i = 0; i < 4; ++i) {
+    bg_string_free(names[i]);
+  }
+  return NULL;
+}
+
+pruf_test_define(lazy_repository, limit_keeps_passwords_other_readers_hold) {
+  pthread_t readers[2];
+  int mismatches = 0;
+  size_t i;
+  add_records(4);
+  bg_lazy_repository_limit(repo, 1);
+
+  for(i = 0; i < 2; ++i) {
+    pthread_create(&readers[i], NULL, &get_while_other_reader_evicts, &mismatches);
+  }
+  for(i = 0; i < 2; ++i) {
+    pthread_join(readers[i], NULL);
+  }
+
+  pruf_expect_equal(0, mismatches);
+  pruf_expect_true(bg_lazy_repository_materialized(repo) <= 2);
+}
+
+pruf_test_define(lazy_repository, can_add_and_remove_passwords_among_records) {
+  bg_password *pwd = bg_password_new();
+  bg_string *name = bg_string_from_str("somepassname");
+  bg_password_update_name(pwd, bg_string_from_str("somepassname"));
+  add_records(2);
+
+  pruf_expect_zero(bg_repository_add(repo, pwd));
+  pruf_expect_equal(3, bg_repository_count(repo));
+
+  pruf_expect_zero(bg_repository_remove(repo, name));
+  pruf_expect_equal(2, bg_repository_count(repo));
+
+  bg_string_free(name);
+}
+
+pruf_test_define(lazy_repository, cannot_add_a_password_named_as_a_record) {
+  bg_password *pwd = bg_password_new();
+  bg_password_update_name(pwd, bg_string_from_str("name1"));
+  add_records(2);
+
+  pruf_expect_non_zero(bg_repository_add(repo, pwd));
+  pruf_expect_equal(2, bg_repository_count(repo));
+
+  bg_password_free(pwd);
+}
+
+pruf_test_define(lazy_repository, releases_source_once_records_are_gone) {
+  bg_string *name = bg_string_from_str("name1");
+  add_records(1);
+  bg_record_source_release(source);
+  source = NULL;
+
+  bg_repository_remove(repo, name);
+
+  pruf_expect_equal(1, source_destroy_called);
+
+  bg_string_free(name);
+}
+
+pruf_test_define(lazy_repository, materializing_records_keeps_generation) {
+  uint64_t loaded, accessed;
+  size_t count = 0;
+  add_records(2);
+
+  pruf_expect_zero(bg_repository_generation(repo, &loaded));
+  bg_repository_foreach(repo, &count_password, &count);
+  bg_repository_generation(repo, &accessed);
+
+  pruf_expect_equal(loaded, accessed);
+}
+
+pruf_test_define(lazy_repository, add_all_appends_after_records) {
+  bg_password *pwds[2] = { bg_password_new(), bg_password_new() };
+  bg_password_update_name(pwds[0], bg_string_from_str("name5"));
+  bg_password_update_name(pwds[1], bg_string_from_str("name6"));
+  add_records(4);
+
+  pruf_expect_zero(bg_repository_add_all(repo, pwds, 2));
+  pruf_expect_equal(6, bg_repository_count(repo));
+  pruf_expect_zero(bg_lazy_repository_materialized(repo));
+}
+
+pruf_test_define(lazy_repository, add_all_adds_nothing_named_as_a_record) {
+  bg_password *pwds[2] = { bg_password_new(), bg_password_new() };
+  bg_password_update_name(pwds[0], bg_string_from_str("name5"));
+  bg_password_update_name(pwds[1], bg_string_from_str("name2"));
+  add_records(3);
+
+  pruf_expect_equal(-1, bg_repository_add_all(repo, pwds, 2));
+  pruf_expect_equal(3, bg_repository_count(repo));
+
+  bg_password_free(pwds[0]);
+  bg_password_free(pwds[1]);
+}
+
+static void *count_passwords(void *count) {
+  bg_repository_foreach(repo, &count_password, count);
+  return NULL;
+}
+
+pruf_test_define(lazy_repository, concurrent_readers_materialize_records_once) {
+  pthread_t readers[4];
+  size_t counts[4] = {0, 0, 0, 0};
+  int i;
+  add_records(4);
+
+  for(i = 0; i < 4; ++i) {
+    pthread_create(&readers[i], NULL, &count_passwords, &counts[i]);
+  }
+  for(i = 0; i < 4; ++i) {
+    pthread_join(readers[i], NULL);
+    pruf_expect_equal(4, counts[i]);
+  }
+
+  pruf_expect_equal(4, bg_lazy_repository_materialized(repo));
+}
@@ -115,3 +115,46 @@ pruf_test_define(map, free_callback_is_called_when_free_map) {
   pruf_expect_equal(2, times_free_called);
   map = bg_map_new();
 }
+
+#define MANY_PAIRS 1000
+size_t times_iterated = 0;
+int check_insertion_order(const bg_string *key, void *value, void* output) {
+  bg_string *expected = bg_string_plus(bg_string_from_str("somekey"), bg_string_from_decimal(times_iterated));
+  int err = bg_string_compare(expected, key);
+  bg_string_free(expected);
+
+  if(err || value != ((int *)output) + times_iterated) {
+    return -1;
+  }
+
+  times_iterated++;
+  return 0;
+}
+
+pruf_test_define(map, can_register_and_iterate_many_pairs_in_insertion_order) {
+  int values[MANY_PAIRS];
+  size_t i;
+  for(i = 0; i < MANY_PAIRS; ++i) {
+    bg_map_register_data(map, bg_string_plus(bg_string_from_str("somekey"), bg_string_from_decimal(i)), &values[i], NULL);
+  }
+
+  pruf_expect_equal(MANY_PAIRS, bg_map_length(map));
+  pruf_expect_same_address(&values[0], bg_map_get_data(map, bg_string_from_str("somekey0")));
+  pruf_expect_same_address(&values[MANY_PAIRS - 1], bg_map_get_data(map, bg_string_from_str("somekey999")));
+  pruf_expect_zero(bg_map_foreach(map, &check_insertion_order, values));
+  pruf_expect_equal(MANY_PAIRS, times_iterated);
+}
+
+pruf_test_define(map, reregistering_a_pair_keeps_its_position) {
+  int i, j, k;
+  bg_map_register_data(map, bg_string_from_str("somekey1"), &i, NULL);
+  bg_map_register_data(map, bg_string_from_str("somekey2"), &j, NULL);
+  bg_map_register_data(map, bg_string_from_str("somekey1"), &k, NULL);
+
+  times_called = 0;
+  bg_map_foreach(map, &on_pair, NULL);
+
+  pruf_expect_equal(2, bg_map_length(map));
+  pruf_expect_equal_string("somekey1", bg_string_data(keys[0]));
+  pruf_expect_same_address(&k, values[0]);
+}
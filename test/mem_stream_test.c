@@ -1,4 +1,5 @@
 #include <string.h>
+#include <stdlib.h>
 
 #include "blurgather/stream.h"
 
@@ -267,3 +268,84 @@ pruf_test_define(mem_stream, allocation_is_dynamic_when_write_4194304b_buffer) {
   free(read_data);
   bg_stream_close(stream);
 }
+
+pruf_test_define(mem_stream, writev_writes_each_segment) {
+  bg_stream *stream = bg_stream_open(BGSO_MEM, BGSM_WRITE | BGSM_READ);
+  struct iovec segments[2] = { { "head", 4 }, { "tail", 4 } };
+  char read_data[8];
+
+  pruf_expect_equal(8, bg_stream_writev(stream, segments, 2));
+  bg_stream_rewind(stream);
+  pruf_expect_equal(8, bg_stream_read(stream, read_data, 8));
+  pruf_expect_equal_memory("headtail", read_data, 8);
+  bg_stream_close(stream);
+}
+
+pruf_test_define(mem_stream, reserved_memory_is_not_moved_by_writes) {
+  bg_stream *stream = bg_stream_open(BGSO_MEM, BGSM_WRITE | BGSM_READ);
+  char data[4096];
+  const void *before, *after;
+  size_t length, i;
+  memset(data, 'x', sizeof(data));
+
+  pruf_expect_equal(0, bg_stream_reserve(stream, 64 * sizeof(data)));
+  bg_stream_map(stream, &before, &length);
+  for(i = 0; i < 64; ++i) {
+    bg_stream_write(stream, data, sizeof(data));
+  }
+  bg_stream_map(stream, &after, &length);
+
+  pruf_expect_same_address(before, after);
+  pruf_expect_equal(64 * sizeof(data), length);
+  bg_stream_close(stream);
+}
+
+pruf_test_define(mem_stream, buffer_stream_reads_caller_buffer_in_place) {
+  char buffer[] = "hello, it's me", read_data[sizeof(buffer)];
+  const void *mapped;
+  size_t length;
+  bg_stream *stream = bg_stream_open(BGSO_BUFFER, BGSM_READ, buffer, sizeof(buffer));
+
+  pruf_expect_equal(sizeof(buffer), bg_stream_length(stream));
+  bg_stream_map(stream, &mapped, &length);
+  pruf_expect_same_address(buffer, mapped);
+  pruf_expect_equal(sizeof(buffer), bg_stream_read(stream, read_data, sizeof(read_data)));
+  pruf_expect_equal_memory(buffer, read_data, sizeof(buffer));
+  pruf_expect_null(bg_stream_detach(stream, &length));
+  bg_stream_close(stream);
+}
+
+pruf_test_define(mem_stream, buffer_stream_writes_in_place_until_it_outgrows_buffer) {
+  char buffer[] = "hello";
+  const void *mapped;
+  size_t length;
+  bg_stream *stream = bg_stream_open(BGSO_BUFFER, BGSM_READ | BGSM_WRITE, buffer, sizeof(buffer) - 1);
+
+  bg_stream_write(stream, "J", 1);
+  pruf_expect_equal_string("Jello", buffer);
+
+  bg_stream_forward(stream);
+  bg_stream_write(stream, " world", 6);
+  pruf_expect_equal_string("Jello", buffer);
+  bg_stream_map(stream, &mapped, &length);
+  pruf_expect_not_same_address(buffer, mapped);
+  pruf_expect_equal(11, length);
+  pruf_expect_equal_memory("Jello world", mapped, length);
+  bg_stream_close(stream);
+}
+
+pruf_test_define(mem_stream, detach_hands_content_over_and_empties_stream) {
+  bg_stream *stream = bg_stream_open(BGSO_MEM, BGSM_WRITE | BGSM_READ);
+  char data[] = "hello, it's me";
+  size_t length;
+
+  bg_stream_write(stream, data, sizeof(data));
+  char *detached = bg_stream_detach(stream, &length);
+
+  pruf_expect_equal(sizeof(data), length);
+  pruf_expect_equal_memory(data, detached, length);
+  pruf_expect_equal(0, bg_stream_length(stream));
+  pruf_expect_equal(3, bg_stream_write(stream, "new", 3));
+  bg_stream_close(stream);
+  free(detached);
+}
@@ -0,0 +1,100 @@
+#include <prufen/prufen.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "blurgather/stream.h"
+
+const char *filename = "mmap_stream.txt";
+
+void at_close(void *arg) {
+  remove((const char*)arg);
+}
+
+static size_t file_length(void) {
+  struct stat status;
+  return stat(filename, &status) ? 0 : status.st_size;
+}
+
+pruf_test_define(mmap_stream, cannot_open_missing_file_for_reading) {
+  remove(filename);
+  pruf_expect_null(bg_stream_open(BGSO_MMAP, BGSM_READ, filename));
+}
+
+pruf_test_define(mmap_stream, write_is_read_back_after_rewind) {
+  bg_stream *stream = bg_stream_open(BGSO_MMAP, BGSM_WRITE | BGSM_READ, filename, &at_close, filename);
+  char data[] = "hello, it's me", read_data[sizeof(data)];
+
+  pruf_expect_equal(sizeof(data), bg_stream_write(stream, data, sizeof(data)));
+  pruf_expect_equal(sizeof(data), bg_stream_length(stream));
+  bg_stream_rewind(stream);
+  pruf_expect_equal(sizeof(data), bg_stream_read(stream, read_data, sizeof(data)));
+  pruf_expect_equal_memory(data, read_data, sizeof(data));
+  pruf_expect_equal(0, bg_stream_read(stream, read_data, 1));
+  bg_stream_close(stream);
+}
+
+pruf_test_define(mmap_stream, growing_keeps_content_and_file_is_cut_to_length_on_close) {
+  size_t i, length = 3 * 1024 * 1024 + 17;
+  unsigned char *data = malloc(length);
+  for(i = 0; i < length; ++i) {
+    data[i] = (unsigned char)(i * 7);
+  }
+
+  bg_stream *stream = bg_stream_open(BGSO_MMAP, BGSM_WRITE, filename);
+  for(i = 0; i < length; i += 1000) {
+    bg_stream_write(stream, data + i, i + 1000 < length ? 1000 : length - i);
+  }
+  pruf_expect_equal(length, bg_stream_length(stream));
+  bg_stream_close(stream);
+  pruf_expect_equal(length, file_length());
+
+  const void *mapped = NULL;
+  size_t mapped_length = 0;
+  stream = bg_stream_open(BGSO_MMAP, BGSM_READ, filename, &at_close, filename);
+  pruf_expect_equal(0, bg_stream_map(stream, &mapped, &mapped_length));
+  pruf_expect_equal(length, mapped_length);
+  pruf_expect_equal_memory(data, mapped, length);
+  bg_stream_close(stream);
+
+  free(data);
+}
+
+pruf_test_define(mmap_stream, appending_keeps_previous_content) {
+  const void *mapped;
+  size_t length;
+  bg_stream *stream = bg_stream_open(BGSO_MMAP, BGSM_WRITE, filename);
+  bg_stream_write(stream, "first", 5);
+  bg_stream_close(stream);
+
+  stream = bg_stream_open(BGSO_MMAP, BGSM_WRITE | BGSM_APPEND, filename);
+  bg_stream_rewind(stream);
+  bg_stream_write(stream, "second", 6);
+  bg_stream_close(stream);
+
+  stream = bg_stream_open(BGSO_MMAP, BGSM_READ, filename, &at_close, filename);
+  bg_stream_map(stream, &mapped, &length);
+  pruf_expect_equal(11, length);
+  pruf_expect_equal_memory("firstsecond", mapped, 11);
+  bg_stream_close(stream);
+}
+
+pruf_test_define(mmap_stream, empty_file_maps_to_nothing) {
+  const void *mapped = "";
+  size_t length = 1;
+  char read_data[1];
+  bg_stream *stream = bg_stream_open(BGSO_MMAP, BGSM_WRITE | BGSM_READ, filename, &at_close, filename);
+
+  pruf_expect_equal(0, bg_stream_map(stream, &mapped, &length));
+  pruf_expect_equal(0, length);
+  pruf_expect_equal(0, bg_stream_read(stream, read_data, 1));
+  bg_stream_close(stream);
+}
+
+pruf_test_define(mmap_stream, file_streams_cannot_be_mapped) {
+  const void *mapped;
+  size_t length;
+  bg_stream *stream = bg_stream_open(BGSO_FILE, BGSM_WRITE, filename, &at_close, filename);
+
+  pruf_expect_equal(-1, bg_stream_map(stream, &mapped, &length));
+  bg_stream_close(stream);
+}
@@ -1,6 +1,12 @@
 #include <prufen/prufen.h>
 #include "mocks.h"
 #include <blurgather/msgpack_persister.h>
+#include <blurgather/lazy_repository.h>
+#include <blurgather/array_repository.h>
+#include <blurgather/executor.h>
+#include <blurgather/mcrypt_cryptor.h>
+#include <msgpack.h>
+#include <sys/stat.h>
 
 
 #define TEST_FILE_PATH "/tmp/bg.shadow.bin.test"
@@ -170,3 +176,509 @@ pruf_test_define(persister, deserializing_three_passwords_calls_repository_add_w
   pruf_expect_equal_string("somedesc3", bg_string_data(bg_password_description(pwds[2])));
   pruf_expect_equal_string("somevalue3", bg_string_data(bg_password_value(pwds[2])));
 }
+
+static void pack_raw_field(msgpack_packer *pk, const char *key, const char *value, int as_bin) {
+  msgpack_pack_str(pk, strlen(key));
+  msgpack_pack_str_body(pk, key, strlen(key));
+  if(as_bin) {
+    msgpack_pack_bin(pk, strlen(value));
+    msgpack_pack_bin_body(pk, value, strlen(value));
+  } else {
+    msgpack_pack_str(pk, strlen(value));
+    msgpack_pack_str_body(pk, value, strlen(value));
+  }
+}
+
+static void write_raw_file(msgpack_sbuffer *buffer) {
+  FILE *file = fopen(TEST_FILE_PATH, "wb");
+  fwrite(buffer->data, 1, buffer->size, file);
+  fclose(file);
+  msgpack_sbuffer_destroy(buffer);
+}
+
+pruf_test_define(persister, deserializing_accepts_fields_in_any_order_and_skips_unknown_ones) {
+  msgpack_sbuffer buffer;
+  msgpack_packer pk;
+  msgpack_sbuffer_init(&buffer);
+  msgpack_packer_init(&pk, &buffer, msgpack_sbuffer_write);
+  msgpack_pack_array(&pk, 1);
+  msgpack_pack_map(&pk, 4);
+  pack_raw_field(&pk, "value", "somevalue1", 1);
+  pack_raw_field(&pk, "somefuturefield", "somefuturevalue", 1);
+  pack_raw_field(&pk, "description", "somedesc1", 1);
+  pack_raw_field(&pk, "name", "somename1", 1);
+  write_raw_file(&buffer);
+  *((void**)&(mock_repository_vtable.add)) = &test_repo_add;
+
+  pruf_expect_zero(bg_persister_load(persister, &mock_repository));
+
+  pruf_expect_equal(1, times_add_called);
+  pruf_expect_equal_string("somename1", bg_string_data(bg_password_name(pwds[0])));
+  pruf_expect_equal_string("somedesc1", bg_string_data(bg_password_description(pwds[0])));
+  pruf_expect_equal_string("somevalue1", bg_string_data(bg_password_value(pwds[0])));
+}
+
+pruf_test_define(persister, deserializing_fails_when_field_has_wrong_type) {
+  msgpack_sbuffer buffer;
+  msgpack_packer pk;
+  msgpack_sbuffer_init(&buffer);
+  msgpack_packer_init(&pk, &buffer, msgpack_sbuffer_write);
+  msgpack_pack_array(&pk, 1);
+  msgpack_pack_map(&pk, 3);
+  pack_raw_field(&pk, "name", "somename1", 0);
+  pack_raw_field(&pk, "description", "somedesc1", 1);
+  pack_raw_field(&pk, "value", "somevalue1", 1);
+  write_raw_file(&buffer);
+
+  pruf_expect_non_zero(bg_persister_load(persister, &mock_repository));
+  pruf_expect_equal(0, mock_repository_add_called);
+}
+
+pruf_test_define(persister, deserializing_fails_when_field_is_missing) {
+  msgpack_sbuffer buffer;
+  msgpack_packer pk;
+  msgpack_sbuffer_init(&buffer);
+  msgpack_packer_init(&pk, &buffer, msgpack_sbuffer_write);
+  msgpack_pack_array(&pk, 1);
+  msgpack_pack_map(&pk, 2);
+  pack_raw_field(&pk, "name", "somename1", 1);
+  pack_raw_field(&pk, "value", "somevalue1", 1);
+  write_raw_file(&buffer);
+
+  pruf_expect_non_zero(bg_persister_load(persister, &mock_repository));
+  pruf_expect_equal(0, mock_repository_add_called);
+}
+
+pruf_test_define(persister, tags_and_metadata_are_persisted_with_other_fields) {
+  bg_string *tag = bg_string_from_str("work");
+  bg_string *key = bg_string_from_str("env");
+  bg_string *value = bg_string_from_str("prod");
+  bg_password_add_tag(pwd1, tag);
+  bg_password_set_metadata(pwd1, key, value);
+  *((void**)&(mock_repository_vtable.foreach)) = &test_repo_foreach_1;
+  *((void**)&(mock_repository_vtable.add)) = &test_repo_add;
+  mock_repository_count_return_value = 1;
+  bg_persister_persist(persister, &mock_repository);
+
+  pruf_expect_zero(bg_persister_load(persister, &mock_repository));
+
+  pruf_expect_equal(1, times_add_called);
+  pruf_expect_equal_string("work", bg_string_data(bg_password_tags(pwds[0])));
+  pruf_expect_equal(8, bg_string_length(bg_password_metadata(pwds[0])));
+  pruf_expect_zero(memcmp("env\0prod", bg_string_data(bg_password_metadata(pwds[0])), 8));
+
+  bg_string_free(tag);
+  bg_string_free(key);
+  bg_string_free(value);
+}
+
+pruf_test_define(persister, deserializing_record_without_metadata_leaves_it_empty) {
+  msgpack_sbuffer buffer;
+  msgpack_packer pk;
+  msgpack_sbuffer_init(&buffer);
+  msgpack_packer_init(&pk, &buffer, msgpack_sbuffer_write);
+  msgpack_pack_array(&pk, 1);
+  msgpack_pack_map(&pk, 4);
+  pack_raw_field(&pk, "name", "somename1", 1);
+  pack_raw_field(&pk, "tags", "sometags1", 1);
+  pack_raw_field(&pk, "description", "somedesc1", 1);
+  pack_raw_field(&pk, "value", "somevalue1", 1);
+  write_raw_file(&buffer);
+  *((void**)&(mock_repository_vtable.add)) = &test_repo_add;
+
+  pruf_expect_zero(bg_persister_load(persister, &mock_repository));
+
+  pruf_expect_equal(1, times_add_called);
+  pruf_expect_equal_string("somename1", bg_string_data(bg_password_name(pwds[0])));
+  pruf_expect_equal_string("sometags1", bg_string_data(bg_password_tags(pwds[0])));
+  pruf_expect_zero(bg_string_length(bg_password_metadata(pwds[0])));
+}
+
+pruf_test_define(persister, deserializing_fails_when_file_is_not_a_password_array) {
+  FILE *file = fopen(TEST_FILE_PATH, "wb");
+  fwrite("\xc1garbage", 1, 8, file);
+  fclose(file);
+
+  pruf_expect_non_zero(bg_persister_load(persister, &mock_repository));
+}
+
+pruf_test_define(persister, persisted_file_header_holds_record_count) {
+  bg_file_header header;
+  *((void**)&(mock_repository_vtable.foreach)) = &test_repo_foreach_3;
+  mock_repository_count_return_value = 3;
+  bg_persister_persist(persister, &mock_repository);
+
+  pruf_expect_zero(bg_msgpack_persister_header(persister, &header));
+  pruf_expect_equal(BG_FILE_FORMAT_VERSION, header.version);
+  pruf_expect_equal(3, header.record_count);
+}
+
+pruf_test_define(persister, count_reads_header_without_loading_passwords) {
+  size_t count = 0;
+  *((void**)&(mock_repository_vtable.foreach)) = &test_repo_foreach_3;
+  mock_repository_count_return_value = 3;
+  bg_persister_persist(persister, &mock_repository);
+
+  pruf_expect_zero(bg_persister_count(persister, &count));
+  pruf_expect_equal(3, count);
+  pruf_expect_equal(0, mock_repository_add_called);
+}
+
+pruf_test_define(persister, can_still_load_legacy_headerless_file) {
+  msgpack_sbuffer buffer;
+  msgpack_packer pk;
+  msgpack_sbuffer_init(&buffer);
+  msgpack_packer_init(&pk, &buffer, msgpack_sbuffer_write);
+  msgpack_pack_array(&pk, 1);
+  msgpack_pack_map(&pk, 3);
+  pack_raw_field(&pk, "name", "somename1", 1);
+  pack_raw_field(&pk, "description", "somedesc1", 1);
+  pack_raw_field(&pk, "value", "somevalue1", 1);
+  write_raw_file(&buffer);
+
+  pruf_expect_zero(bg_persister_load(persister, &mock_repository));
+  pruf_expect_equal(1, mock_repository_add_called);
+}
+
+static void persist_three_crypted_passwords(bg_secret_key_t *key) {
+  bg_msgpack_persister_register_key(persister, key);
+  bg_password_crypt(pwd1, &mock_cryptor, key);
+  bg_password_crypt(pwd2, &mock_cryptor, key);
+  bg_password_crypt(pwd3, &mock_cryptor, key);
+
+  *((void**)&(mock_repository_vtable.foreach)) = &test_repo_foreach_3;
+  mock_repository_count_return_value = 3;
+  bg_persister_persist(persister, &mock_repository);
+}
+
+pruf_test_define(persister, can_fetch_one_password_without_loading_others) {
+  bg_secret_key_t *key = bg_secret_key_new("secret", 6);
+  bg_string *name = bg_string_from_str("somename2");
+  bg_password *fetched = NULL;
+  persist_three_crypted_passwords(key);
+
+  pruf_expect_zero(bg_persister_fetch(persister, name, &fetched));
+  pruf_expect_equal(0, mock_repository_add_called);
+
+  bg_password_decrypt(fetched, &mock_cryptor, key);
+  pruf_expect_equal_string("somename2", bg_string_data(bg_password_name(fetched)));
+  pruf_expect_equal_string("somevalue2", bg_string_data(bg_password_value(fetched)));
+
+  bg_password_free(fetched);
+  bg_string_free(name);
+  bg_secret_key_free(key);
+}
+
+pruf_test_define(persister, fetching_unknown_name_returns_1) {
+  bg_secret_key_t *key = bg_secret_key_new("secret", 6);
+  bg_string *name = bg_string_from_str("somename4");
+  bg_password *fetched = NULL;
+  persist_three_crypted_passwords(key);
+
+  pruf_expect_equal(1, bg_persister_fetch(persister, name, &fetched));
+  pruf_expect_null(fetched);
+
+  bg_string_free(name);
+  bg_secret_key_free(key);
+}
+
+pruf_test_define(persister, fetching_under_another_secret_key_finds_nothing) {
+  bg_secret_key_t *key = bg_secret_key_new("secret", 6);
+  bg_secret_key_t *other = bg_secret_key_new("secreT", 6);
+  bg_string *name = bg_string_from_str("somename2");
+  bg_password *fetched = NULL;
+  persist_three_crypted_passwords(key);
+  bg_msgpack_persister_register_key(persister, other);
+
+  pruf_expect_equal(1, bg_persister_fetch(persister, name, &fetched));
+  pruf_expect_null(fetched);
+
+  bg_string_free(name);
+  bg_secret_key_free(other);
+  bg_secret_key_free(key);
+}
+
+pruf_test_define(persister, fetching_from_file_without_directory_returns_minus_9) {
+  bg_string *name = bg_string_from_str("somename1");
+  bg_password *fetched = NULL;
+  msgpack_sbuffer buffer;
+  msgpack_packer pk;
+  msgpack_sbuffer_init(&buffer);
+  msgpack_packer_init(&pk, &buffer, msgpack_sbuffer_write);
+  msgpack_pack_array(&pk, 0);
+  write_raw_file(&buffer);
+
+  pruf_expect_equal(-9, bg_persister_fetch(persister, name, &fetched));
+
+  bg_string_free(name);
+}
+
+pruf_test_define(persister, loading_records_keeps_persisted_order) {
+  bg_secret_key_t *key = bg_secret_key_new("secret", 6);
+  *((void**)&(mock_repository_vtable.add)) = &test_repo_add;
+  persist_three_crypted_passwords(key);
+
+  pruf_expect_zero(bg_persister_load(persister, &mock_repository));
+  pruf_expect_equal(3, times_add_called);
+
+  bg_password_decrypt(pwds[0], &mock_cryptor, key);
+  bg_password_decrypt(pwds[2], &mock_cryptor, key);
+  pruf_expect_equal_string("somename1", bg_string_data(bg_password_name(pwds[0])));
+  pruf_expect_equal_string("somename3", bg_string_data(bg_password_name(pwds[2])));
+
+  bg_password_free(pwds[0]);
+  bg_password_free(pwds[1]);
+  bg_password_free(pwds[2]);
+  bg_secret_key_free(key);
+}
+
+pruf_test_define(persister, loading_into_lazy_repository_keeps_records_encrypted_until_accessed) {
+  bg_secret_key_t *key = bg_secret_key_new("secret", 6);
+  bg_repository_t *lazy = bg_lazy_repository_new();
+  bg_password *password = NULL;
+  persist_three_crypted_passwords(key);
+
+  pruf_expect_zero(bg_persister_load(persister, lazy));
+  pruf_expect_equal(3, bg_repository_count(lazy));
+  pruf_expect_equal(0, bg_lazy_repository_materialized(lazy));
+
+  pruf_expect_zero(bg_repository_get(lazy, bg_password_name(pwd3), &password));
+  pruf_expect_equal(1, bg_lazy_repository_materialized(lazy));
+  pruf_expect_equal_memory(bg_string_data(bg_password_value(pwd3)),
+                           bg_string_data(bg_password_value(password)),
+                           bg_string_length(bg_password_value(pwd3)));
+
+  bg_repository_destroy(lazy);
+  free((void*)lazy->object);
+  bg_secret_key_free(key);
+}
+
+static int count_password(bg_password *password, void *count) {
+  ++*(size_t *)count;
+  return 0;
+}
+
+pruf_test_define(persister, decoding_all_at_load_leaves_nothing_to_decrypt_later) {
+  bg_secret_key_t *key = bg_secret_key_new("secret", 6);
+  bg_repository_t *lazy = bg_lazy_repository_new();
+  size_t count = 0;
+  persist_three_crypted_passwords(key);
+
+  bg_msgpack_persister_decode_all(persister, 1);
+  pruf_expect_zero(bg_persister_load(persister, lazy));
+
+  /* records left as they are would need key to be read */
+  bg_msgpack_persister_unregister_key(persister);
+  pruf_expect_zero(bg_repository_foreach(lazy, &count_password, &count));
+  pruf_expect_equal(3, count);
+
+  bg_repository_destroy(lazy);
+  free((void*)lazy->object);
+  bg_secret_key_free(key);
+}
+
+static int collect_name(bg_password *password, void *_names) {
+  bg_string ***names = _names;
+  *(*names)++ = bg_password_name(password);
+  return 0;
+}
+
+pruf_test_define(persister, loading_decodes_records_over_executor_in_persisted_order) {
+  bg_secret_key_t *key = bg_secret_key_new("secret", 6);
+  bg_repository_t *persisted = bg_password_array_repository_new(), *loaded = bg_password_array_repository_new();
+  bg_executor *executor = bg_executor_new(4);
+  bg_cryptor_t *cryptor = bg_mcrypt_cryptor();
+  bg_persister_t *parallel = bg_msgpack_persister_persister(bg_msgpack_persister_new(bg_string_from_str(TEST_FILE_PATH), cryptor));
+  bg_string *persisted_names[300], *loaded_names[300], **next = persisted_names;
+  int i, same = 1;
+
+  for(i = 0; i < 300; ++i) {
+    bg_password *password = bg_password_new();
+    bg_password_update_name(password, bg_string_from_decimal(i));
+    bg_password_update_value(password, bg_string_from_str("value"));
+    bg_password_crypt(password, cryptor, key);
+    bg_repository_add(persisted, password);
+  }
+  bg_msgpack_persister_register_key(parallel, key);
+  bg_persister_persist(parallel, persisted);
+  bg_repository_foreach(persisted, &collect_name, &next);
+
+  bg_msgpack_persister_register_executor(parallel, executor);
+  pruf_expect_zero(bg_persister_load(parallel, loaded));
+  pruf_expect_equal(300, bg_repository_count(loaded));
+
+  next = loaded_names;
+  bg_repository_foreach(loaded, &collect_name, &next);
+  for(i = 0; i < 300; ++i) {
+    same = same && bg_string_compare(persisted_names[i], loaded_names[i]) == 0;
+  }
+  pruf_expect_true(same);
+
+  bg_persister_destroy(parallel);
+  free((void*)parallel->object);
+  bg_executor_free(executor);
+  bg_repository_destroy(persisted);
+  free((void*)persisted->object);
+  bg_repository_destroy(loaded);
+  free((void*)loaded->object);
+  bg_secret_key_free(key);
+}
+
+#define LARGE_COUNT 3000
+
+/* payload spans several write chunks and read batches */
+static void round_trip_with(int engine) {
+  bg_repository_t *persisted = bg_password_array_repository_new(), *loaded = bg_password_array_repository_new();
+  bg_password *password = NULL;
+  char value[1024];
+  int i;
+
+  memset(value, 'v', sizeof(value) - 1);
+  value[sizeof(value) - 1] = 0;
+  for(i = 0; i < LARGE_COUNT; ++i) {
+    password = bg_password_new();
+    bg_password_update_name(password, bg_string_from_decimal(i));
+    bg_password_update_value(password, bg_string_from_str(value));
+    bg_repository_add(persisted, password);
+  }
+
+  bg_msgpack_persister_select_io(persister, engine);
+  pruf_expect_zero(bg_persister_persist(persister, persisted));
+  pruf_expect_zero(bg_persister_load(persister, loaded));
+  pruf_expect_equal(LARGE_COUNT, bg_repository_count(loaded));
+
+  bg_string *name = bg_string_from_decimal(LARGE_COUNT - 1);
+  pruf_expect_zero(bg_repository_get(loaded, name, &password));
+  pruf_expect_equal_string(value, bg_string_data(bg_password_value(password)));
+  bg_string_free(name);
+
+  bg_repository_destroy(persisted);
+  free((void*)persisted->object);
+  bg_repository_destroy(loaded);
+  free((void*)loaded->object);
+}
+
+pruf_test_define(persister, large_files_round_trip_through_stdio) {
+  round_trip_with(BG_MSGPACK_IO_STDIO);
+}
+
+pruf_test_define(persister, large_files_round_trip_through_io_uring_when_available) {
+  round_trip_with(BG_MSGPACK_IO_URING);
+}
+
+pruf_test_define(persister, selecting_unknown_io_engine_falls_back_to_stdio) {
+  pruf_expect_equal(BG_MSGPACK_IO_STDIO, bg_msgpack_persister_select_io(persister, 42));
+}
+
+static unsigned int file_mode(const char *path) {
+  struct stat status;
+  return stat(path, &status) ? 0 : status.st_mode & 07777;
+}
+
+pruf_test_define(persister, persisting_keeps_mode_of_replaced_file) {
+  *((void**)&(mock_repository_vtable.foreach)) = &test_repo_foreach_1;
+  mock_repository_count_return_value = 1;
+
+  pruf_expect_zero(bg_persister_persist(persister, &mock_repository));
+  pruf_expect_equal(0600, file_mode(TEST_FILE_PATH));
+
+  chmod(TEST_FILE_PATH, 0640);
+  pruf_expect_zero(bg_persister_persist(persister, &mock_repository));
+  pruf_expect_equal(0640, file_mode(TEST_FILE_PATH));
+}
+
+pruf_test_define(persister, persisting_replaces_leftover_temporary_file) {
+  *((void**)&(mock_repository_vtable.foreach)) = &test_repo_foreach_1;
+  mock_repository_count_return_value = 1;
+
+  FILE *leftover = fopen(TEST_FILE_PATH ".tmp", "wb");
+  fputs("interrupted", leftover);
+  fclose(leftover);
+
+  pruf_expect_zero(bg_persister_persist(persister, &mock_repository));
+  pruf_expect_equal(0600, file_mode(TEST_FILE_PATH));
+  pruf_expect_non_zero(access(TEST_FILE_PATH ".tmp", F_OK));
+}
+
+pruf_test_define(persister, persisting_fails_when_lock_cannot_be_taken) {
+  bg_persister_t *homeless = bg_msgpack_persister_persister(
+    bg_msgpack_persister_new(bg_string_from_str(TEST_FILE_PATH ".missing/vault"), &mock_cryptor));
+  *((void**)&(mock_repository_vtable.foreach)) = &test_repo_foreach_1;
+  mock_repository_count_return_value = 1;
+
+  pruf_expect_equal(-12, bg_persister_persist(homeless, &mock_repository));
+  pruf_expect_non_zero(access(TEST_FILE_PATH ".missing/vault.tmp", F_OK));
+
+  bg_persister_destroy(homeless);
+  free((void*)homeless->object);
+}
+
+pruf_test_define(persister, persisting_creates_no_lock_file) {
+  *((void**)&(mock_repository_vtable.foreach)) = &test_repo_foreach_1;
+  mock_repository_count_return_value = 1;
+
+  pruf_expect_zero(bg_persister_persist(persister, &mock_repository));
+  pruf_expect_zero(bg_persister_persist(persister, &mock_repository));
+  pruf_expect_zero(bg_persister_load(persister, &mock_repository));
+  pruf_expect_non_zero(access(TEST_FILE_PATH ".lock", F_OK));
+}
+
+static bg_password *new_password(const char *name, const char *value) {
+  bg_password *password = bg_password_new();
+  bg_password_update_name(password, bg_string_from_str(name));
+  bg_password_update_value(password, bg_string_from_str(value));
+  return password;
+}
+
+static void replace_password(bg_repository_t *repo, const char *name, const char *value) {
+  bg_string *key = bg_string_from_str(name);
+  bg_repository_remove(repo, key);
+  bg_string_free(key);
+  bg_repository_add(repo, new_password(name, value));
+}
+
+static int has_value(bg_repository_t *repo, const char *name, const char *value) {
+  bg_string *key = bg_string_from_str(name);
+  bg_password *password = NULL;
+  int found = bg_repository_get(repo, key, &password) == 0 && password &&
+              strcmp(bg_string_data(bg_password_value(password)), value) == 0;
+  bg_string_free(key);
+  return found;
+}
+
+pruf_test_define(persister, refresh_applies_others_changes_keeping_local_ones) {
+  bg_repository_t *mine = bg_password_array_repository_new(), *theirs = bg_password_array_repository_new();
+  bg_persister_t *other = bg_msgpack_persister_persister(bg_msgpack_persister_new(bg_string_from_str(TEST_FILE_PATH), &mock_cryptor));
+  bg_string *removed = bg_string_from_str("name3");
+
+  bg_repository_add(mine, new_password("name1", "value1"));
+  bg_repository_add(mine, new_password("name2", "value2"));
+  bg_repository_add(mine, new_password("name3", "value3"));
+  pruf_expect_zero(bg_persister_persist(persister, mine));
+  pruf_expect_zero(bg_persister_refresh(persister, mine));
+
+  pruf_expect_zero(bg_persister_load(other, theirs));
+  replace_password(theirs, "name1", "theirs1");
+  replace_password(theirs, "name2", "theirs2");
+  bg_repository_remove(theirs, removed);
+  bg_repository_add(theirs, new_password("name4", "value4"));
+  pruf_expect_zero(bg_persister_persist(other, theirs));
+
+  replace_password(mine, "name1", "mine1");
+  pruf_expect_equal(-11, bg_persister_persist(persister, mine));
+  pruf_expect_equal(1, bg_persister_refresh(persister, mine));
+
+  pruf_expect_equal(3, bg_repository_count(mine));
+  pruf_expect_true(has_value(mine, "name1", "mine1"));
+  pruf_expect_true(has_value(mine, "name2", "theirs2"));
+  pruf_expect_true(has_value(mine, "name4", "value4"));
+  pruf_expect_zero(bg_persister_persist(persister, mine));
+
+  bg_string_free(removed);
+  bg_persister_destroy(other);
+  free((void*)other->object);
+  bg_repository_destroy(mine);
+  free((void*)mine->object);
+  bg_repository_destroy(theirs);
+  free((void*)theirs->object);
+}
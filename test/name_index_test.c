@@ -0,0 +1,154 @@
+#include <prufen/prufen.h>
+#include <blurgather/name_index.h>
+
+
+bg_name_index *index_;
+const char *found[8];
+size_t nb_found;
+
+static int store_name(const bg_string *name, void *out) {
+  found[nb_found++] = bg_string_data(name);
+  return 0;
+}
+
+static int stop_at_first(const bg_string *name, void *out) {
+  ++nb_found;
+  return 1;
+}
+
+static void add_name(const char *name) {
+  bg_string *str = bg_string_from_str(name);
+  bg_name_index_add(index_, str);
+  bg_string_free(str);
+}
+
+static int search(const char *pattern, int flags) {
+  bg_string *str = bg_string_from_str(pattern);
+  int err = bg_name_index_search(index_, str, flags, &store_name, NULL);
+  bg_string_free(str);
+  return err;
+}
+
+pruf_setup(name_index) {
+  index_ = bg_name_index_new();
+  nb_found = 0;
+
+  add_name("github");
+  add_name("gitlab");
+  add_name("bank");
+  add_name("hub");
+  bg_name_index_build(index_);
+}
+
+pruf_teardown(name_index) {
+  bg_name_index_free(index_);
+}
+
+
+pruf_test_define(name_index, counts_added_names) {
+  pruf_expect_equal(4, bg_name_index_count(index_));
+}
+
+pruf_test_define(name_index, finds_names_containing_pattern_in_insertion_order) {
+  pruf_expect_zero(search("ub", 0));
+
+  pruf_expect_equal(2, nb_found);
+  pruf_expect_equal_string("github", found[0]);
+  pruf_expect_equal_string("hub", found[1]);
+}
+
+pruf_test_define(name_index, reports_name_once_when_pattern_occurs_twice) {
+  add_name("abab");
+  bg_name_index_build(index_);
+
+  pruf_expect_zero(search("ab", 0));
+
+  pruf_expect_equal(2, nb_found);
+  pruf_expect_equal_string("gitlab", found[0]);
+  pruf_expect_equal_string("abab", found[1]);
+}
+
+pruf_test_define(name_index, prefix_search_only_matches_name_starts) {
+  pruf_expect_zero(search("hub", BG_SEARCH_PREFIX));
+
+  pruf_expect_equal(1, nb_found);
+  pruf_expect_equal_string("hub", found[0]);
+}
+
+pruf_test_define(name_index, finds_nothing_for_unknown_pattern) {
+  pruf_expect_zero(search("zzz", 0));
+  pruf_expect_zero(search("gitz", 0));
+
+  pruf_expect_equal(0, nb_found);
+}
+
+pruf_test_define(name_index, empty_pattern_matches_every_name) {
+  pruf_expect_zero(search("", 0));
+
+  pruf_expect_equal(4, nb_found);
+  pruf_expect_equal_string("github", found[0]);
+  pruf_expect_equal_string("hub", found[3]);
+}
+
+pruf_test_define(name_index, stops_when_callback_returns_non_zero) {
+  bg_string *str = bg_string_from_str("g");
+
+  pruf_expect_equal(1, bg_name_index_search(index_, str, 0, &stop_at_first, NULL));
+  pruf_expect_equal(1, nb_found);
+
+  bg_string_free(str);
+}
+
+pruf_test_define(name_index, cannot_search_before_build) {
+  add_name("another");
+
+  pruf_expect_non_zero(search("an", 0));
+}
+
+size_t distances[8];
+
+static int store_candidate(const bg_string *name, size_t distance, void *out) {
+  distances[nb_found] = distance;
+  found[nb_found++] = bg_string_data(name);
+  return 0;
+}
+
+static int fuzzy(const char *pattern, size_t k, size_t max_distance) {
+  bg_string *str = bg_string_from_str(pattern);
+  int err = bg_name_index_fuzzy(index_, str, k, max_distance, &store_candidate, NULL);
+  bg_string_free(str);
+  return err;
+}
+
+pruf_test_define(name_index, fuzzy_ranks_closest_names_first) {
+  pruf_expect_zero(fuzzy("gitlub", 2, 3));
+
+  pruf_expect_equal(2, nb_found);
+  pruf_expect_equal_string("github", found[0]);
+  pruf_expect_equal(1, distances[0]);
+  pruf_expect_equal_string("gitlab", found[1]);
+  pruf_expect_equal(1, distances[1]);
+}
+
+pruf_test_define(name_index, fuzzy_keeps_at_most_k_names_within_max_distance) {
+  pruf_expect_zero(fuzzy("bnak", 8, 2));
+
+  pruf_expect_equal(1, nb_found);
+  pruf_expect_equal_string("bank", found[0]);
+  pruf_expect_equal(2, distances[0]);
+}
+
+pruf_test_define(name_index, fuzzy_ignores_case) {
+  pruf_expect_zero(fuzzy("GitHub", 1, 0));
+
+  pruf_expect_equal(1, nb_found);
+  pruf_expect_equal_string("github", found[0]);
+}
+
+pruf_test_define(name_index, fuzzy_handles_patterns_longer_than_a_word) {
+  add_name("a_really_long_name_for_a_password_entry_that_keeps_going_and_going");
+  pruf_expect_zero(fuzzy("a_really_long_name_for_a_password_entry_that_keeps_going_and_goin", 1, 1));
+
+  pruf_expect_equal(1, nb_found);
+  pruf_expect_equal(1, distances[0]);
+}
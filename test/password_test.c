@@ -176,3 +176,148 @@ pruf_test_define(password, password_is_flagged_crypted_when_fill_raw) {
 
   pruf_expect_true(bg_password_crypted(pwd));
 }
+
+pruf_test_define(password, copy_has_same_fields_as_original) {
+  bg_password *pwd = bg_password_new();
+  bg_password_update_name(pwd, bg_string_from_str("somename"));
+  bg_password_update_description(pwd, bg_string_from_str("somedesc"));
+  bg_password_update_value(pwd, bg_string_from_str("somevalue"));
+
+  bg_password *copy = bg_password_copy(pwd);
+
+  pruf_expect_equal_string("somename", bg_string_data(bg_password_name(copy)));
+  pruf_expect_equal_string("somedesc", bg_string_data(bg_password_description(copy)));
+  pruf_expect_equal_string("somevalue", bg_string_data(bg_password_value(copy)));
+  pruf_expect_not_same_address(bg_password_name(pwd), bg_password_name(copy));
+}
+
+#define LONG_FIELD                                                      \
+  "somelongdescriptionthatdoesnotfitinsidethepasswordrecordstorage"    \
+  "somelongdescriptionthatdoesnotfitinsidethepasswordrecordstorage"
+
+pruf_test_define(password, copy_has_same_fields_as_original_when_fields_are_long) {
+  bg_password *pwd = bg_password_new();
+  bg_password_update_name(pwd, bg_string_from_str("somename"));
+  bg_password_update_description(pwd, bg_string_from_str(LONG_FIELD));
+
+  bg_password *copy = bg_password_copy(pwd);
+
+  pruf_expect_equal_string("somename", bg_string_data(bg_password_name(copy)));
+  pruf_expect_equal_string(LONG_FIELD, bg_string_data(bg_password_description(copy)));
+}
+
+pruf_test_define(password, fields_are_restored_when_decrypted_after_crypt) {
+  bg_password *pwd = bg_password_new();
+  bg_password_update_name(pwd, bg_string_from_str("somename"));
+  bg_password_update_description(pwd, bg_string_from_str(LONG_FIELD));
+  bg_password_update_value(pwd, bg_string_from_str("somevalue"));
+
+  bg_password_crypt(pwd, &mock_cryptor, mock_secret_key);
+  bg_password *copy = bg_password_copy(pwd);
+  bg_password_decrypt(copy, &mock_cryptor, mock_secret_key);
+
+  pruf_expect_equal_string("somename", bg_string_data(bg_password_name(copy)));
+  pruf_expect_equal_string(LONG_FIELD, bg_string_data(bg_password_description(copy)));
+  pruf_expect_equal_string("somevalue", bg_string_data(bg_password_value(copy)));
+}
+
+pruf_test_define(password, name_and_description_are_set_correctly_when_fill_raw) {
+  bg_password *pwd = bg_password_new();
+  char crypted_name[] = "somecryptedname";
+  char crypted_description[] = "somecrypteddescription";
+
+  pruf_expect_zero(bg_password_fill_raw_name(pwd, crypted_name, strlen(crypted_name)));
+  pruf_expect_zero(bg_password_fill_raw_description(pwd, crypted_description, strlen(crypted_description)));
+
+  pruf_expect_equal_string(crypted_name, bg_string_data(bg_password_name(pwd)));
+  pruf_expect_equal_string(crypted_description, bg_string_data(bg_password_description(pwd)));
+  pruf_expect_true(bg_password_crypted(pwd));
+}
+
+static int count_tag(const char *tag, size_t length, void *count) {
+  ++*(int *)count;
+  return 0;
+}
+
+pruf_test_define(password, added_tags_are_listed_once) {
+  bg_password *pwd = bg_password_new();
+  bg_string *work = bg_string_from_str("work");
+  bg_string *team = bg_string_from_str("team");
+  int count = 0;
+
+  pruf_expect_zero(bg_password_add_tag(pwd, work));
+  pruf_expect_zero(bg_password_add_tag(pwd, team));
+  pruf_expect_zero(bg_password_add_tag(pwd, work));
+
+  pruf_expect_zero(bg_password_foreach_tag(pwd, &count_tag, &count));
+  pruf_expect_equal(2, count);
+  pruf_expect_true(bg_password_has_tag(pwd, team));
+}
+
+pruf_test_define(password, empty_tag_is_refused) {
+  bg_password *pwd = bg_password_new();
+  bg_string *empty = bg_string_new();
+
+  pruf_expect_equal(-2, bg_password_add_tag(pwd, empty));
+  pruf_expect_zero(bg_string_length(bg_password_tags(pwd)));
+}
+
+pruf_test_define(password, tags_cannot_be_added_to_crypted_password) {
+  bg_password *pwd = bg_password_new();
+  bg_string *work = bg_string_from_str("work");
+  bg_password_crypt(pwd, &mock_cryptor, mock_secret_key);
+
+  pruf_expect_equal(-1, bg_password_add_tag(pwd, work));
+}
+
+pruf_test_define(password, metadata_value_is_replaced_when_key_is_set_again) {
+  bg_password *pwd = bg_password_new();
+  bg_string *env = bg_string_from_str("env");
+  bg_string *team = bg_string_from_str("team");
+  bg_string *value = NULL;
+
+  pruf_expect_zero(bg_password_set_metadata(pwd, env, bg_string_from_str("staging")));
+  pruf_expect_zero(bg_password_set_metadata(pwd, team, bg_string_from_str("infra")));
+  pruf_expect_zero(bg_password_set_metadata(pwd, env, bg_string_from_str("prod")));
+
+  pruf_expect_zero(bg_password_get_metadata(pwd, env, &value));
+  pruf_expect_equal_string("prod", bg_string_data(value));
+  pruf_expect_equal(19, bg_string_length(bg_password_metadata(pwd)));
+}
+
+pruf_test_define(password, getting_unset_metadata_returns_1) {
+  bg_password *pwd = bg_password_new();
+  bg_string *env = bg_string_from_str("env");
+  bg_string *value = NULL;
+
+  pruf_expect_equal(1, bg_password_get_metadata(pwd, env, &value));
+  pruf_expect_null(value);
+}
+
+pruf_test_define(password, tags_and_metadata_are_restored_when_decrypted_after_crypt) {
+  bg_password *pwd = bg_password_new();
+  bg_string *work = bg_string_from_str("work");
+  bg_string *env = bg_string_from_str("env");
+  bg_string *value = NULL;
+  bg_password_add_tag(pwd, work);
+  bg_password_set_metadata(pwd, env, bg_string_from_str("prod"));
+
+  pruf_expect_zero(bg_password_crypt(pwd, &mock_cryptor, mock_secret_key));
+  pruf_expect_zero(bg_password_decrypt(pwd, &mock_cryptor, mock_secret_key));
+
+  pruf_expect_true(bg_password_has_tag(pwd, work));
+  pruf_expect_zero(bg_password_get_metadata(pwd, env, &value));
+  pruf_expect_equal_string("prod", bg_string_data(value));
+}
+
+pruf_test_define(password, missing_optional_fields_do_not_fail_decryption) {
+  bg_password *pwd = bg_password_new();
+  bg_password_crypt(pwd, &mock_cryptor, mock_secret_key);
+  bg_password *raw = bg_password_new();
+  bg_password_fill_raw_name(raw, bg_string_data(bg_password_name(pwd)), bg_string_length(bg_password_name(pwd)));
+  bg_password_fill_raw_description(raw, bg_string_data(bg_password_description(pwd)), bg_string_length(bg_password_description(pwd)));
+  bg_password_fill_raw(raw, bg_string_data(bg_password_value(pwd)), bg_string_length(bg_password_value(pwd)));
+
+  pruf_expect_zero(bg_password_decrypt(raw, &mock_cryptor, mock_secret_key));
+  pruf_expect_zero(bg_string_length(bg_password_tags(raw)));
+}
@@ -0,0 +1,165 @@
+#include <pthread.h>
+#include <prufen/prufen.h>
+#include <blurgather/snapshot_repository.h>
+
+
+bg_repository_t *repo;
+
+pruf_setup(snapshot_repository) {
+  repo = bg_snapshot_repository_new();
+}
+
+pruf_teardown(snapshot_repository) {
+  bg_repository_free(repo);
+}
+
+static bg_password *new_password(const char *name) {
+  bg_password *password = bg_password_new();
+  bg_password_update_name(password, bg_string_from_str(name));
+  return password;
+}
+
+static int has(bg_repository_t *repository, const char *name) {
+  bg_string *str = bg_string_from_str(name);
+  bg_password *found = NULL;
+  int err = bg_repository_get(repository, str, &found);
+  bg_string_free(str);
+  return !err && found;
+}
+
+static int remove_named(bg_repository_t *repository, const char *name) {
+  bg_string *str = bg_string_from_str(name);
+  int err = bg_repository_remove(repository, str);
+  bg_string_free(str);
+  return err;
+}
+
+static int count_password(bg_password *password, void *count) {
+  ++*(size_t*)count;
+  return 0;
+}
+
+pruf_test_define(snapshot_repository, adds_gets_and_removes) {
+  uint64_t before = 0, after = 0;
+
+  pruf_expect_zero(bg_repository_add(repo, new_password("mail")));
+  pruf_expect_zero(bg_repository_add(repo, new_password("bank")));
+  pruf_expect_true(has(repo, "mail"));
+  pruf_expect_equal(2, bg_repository_count(repo));
+
+  pruf_expect_zero(bg_repository_generation(repo, &before));
+  pruf_expect_zero(remove_named(repo, "mail"));
+  pruf_expect_zero(bg_repository_generation(repo, &after));
+  pruf_expect_true(before != after);
+
+  pruf_expect_false(has(repo, "mail"));
+  pruf_expect_equal(-1, remove_named(repo, "mail"));
+  pruf_expect_equal(1, bg_repository_count(repo));
+}
+
+pruf_test_define(snapshot_repository, rejects_duplicate_and_empty_names) {
+  bg_password *duplicate = new_password("mail"), *empty = bg_password_new();
+
+  pruf_expect_zero(bg_repository_add(repo, new_password("mail")));
+  pruf_expect_equal(-1, bg_repository_add(repo, duplicate));
+  pruf_expect_equal(-2, bg_repository_add(repo, empty));
+  pruf_expect_equal(1, bg_repository_count(repo));
+
+  bg_password_free(duplicate);
+  bg_password_free(empty);
+}
+
+pruf_test_define(snapshot_repository, add_all_adds_nothing_on_duplicate) {
+  bg_password *passwords[] = {new_password("mail"), new_password("bank"), new_password("mail")};
+
+  pruf_expect_equal(-1, bg_repository_add_all(repo, passwords, 3));
+  pruf_expect_zero(bg_repository_count(repo));
+
+  bg_password_free(passwords[2]);
+  pruf_expect_zero(bg_repository_add_all(repo, passwords, 2));
+  pruf_expect_equal(2, bg_repository_count(repo));
+}
+
+pruf_test_define(snapshot_repository, snapshot_keeps_content_through_changes) {
+  size_t count = 0;
+  uint64_t generation = 0, snapshot_generation = 0;
+
+  bg_repository_add(repo, new_password("mail"));
+  bg_repository_add(repo, new_password("bank"));
+  bg_repository_generation(repo, &generation);
+
+  bg_repository_t *snapshot = bg_repository_snapshot(repo);
+  pruf_expect_not_null(snapshot);
+
+  pruf_expect_zero(remove_named(repo, "mail"));
+  pruf_expect_zero(bg_repository_add(repo, new_password("work")));
+  pruf_expect_false(has(repo, "mail"));
+
+  pruf_expect_true(has(snapshot, "mail"));
+  pruf_expect_false(has(snapshot, "work"));
+  pruf_expect_zero(bg_repository_foreach(snapshot, &count_password, &count));
+  pruf_expect_equal(2, count);
+  pruf_expect_zero(bg_repository_generation(snapshot, &snapshot_generation));
+  pruf_expect_equal(generation, snapshot_generation);
+
+  bg_password *rejected = new_password("other");
+  pruf_expect_equal(-1, bg_repository_add(snapshot, rejected));
+  pruf_expect_equal(-1, remove_named(snapshot, "bank"));
+  bg_password_free(rejected);
+
+  bg_repository_free(snapshot);
+  pruf_expect_true(has(repo, "work"));
+}
+
+pruf_test_define(snapshot_repository, snapshot_outlives_repository) {
+  bg_repository_add(repo, new_password("mail"));
+  bg_repository_t *snapshot = bg_repository_snapshot(repo);
+
+  bg_repository_free(repo);
+  repo = bg_snapshot_repository_new();
+
+  pruf_expect_true(has(snapshot, "mail"));
+  bg_repository_free(snapshot);
+}
+
+#define NB_READERS 4
+
+static void *iterate_while_writing(void *_failures) {
+  int i;
+  for(i = 0; i < 200; ++i) {
+    size_t count = 0;
+    bg_repository_t *snapshot = bg_repository_snapshot(repo);
+
+    bg_repository_foreach(snapshot, &count_password, &count);
+    if(count != bg_repository_count(snapshot) || !has(snapshot, "first")) {
+      __atomic_add_fetch((int *)_failures, 1, __ATOMIC_RELAXED);
+    }
+    bg_repository_free(snapshot);
+  }
+  return NULL;
+}
+
+pruf_test_define(snapshot_repository, readers_iterate_while_writer_publishes) {
+  pthread_t readers[NB_READERS];
+  int failures = 0, i;
+
+  bg_repository_add(repo, new_password("first"));
+  for(i = 0; i < NB_READERS; ++i) {
+    pthread_create(&readers[i], NULL, &iterate_while_writing, &failures);
+  }
+  for(i = 0; i < 100; ++i) {
+    bg_string *name = bg_string_from_decimal(i);
+    bg_password *password = bg_password_new();
+    bg_password_update_name(password, name);
+    bg_repository_add(repo, password);
+    if(i % 2) {
+      bg_repository_remove(repo, bg_password_name(password));
+    }
+  }
+  for(i = 0; i < NB_READERS; ++i) {
+    pthread_join(readers[i], NULL);
+  }
+
+  pruf_expect_zero(failures);
+  pruf_expect_equal(51, bg_repository_count(repo));
+}
@@ -0,0 +1,120 @@
+#include <prufen/prufen.h>
+#include <blurgather/tag_index.h>
+
+
+bg_tag_index *index_;
+size_t found[64];
+size_t nb_found;
+
+static int store_id(size_t id, void *out) {
+  found[nb_found++] = id;
+  return 0;
+}
+
+static int stop_at_first(size_t id, void *out) {
+  ++nb_found;
+  return 1;
+}
+
+static void add_tag(const char *tag, size_t id) {
+  bg_tag_index_add(index_, tag, strlen(tag), id);
+}
+
+static int intersect(const char *tag1, const char *tag2) {
+  bg_string *tags[2] = { bg_string_from_str(tag1), tag2 ? bg_string_from_str(tag2) : NULL };
+  int err = bg_tag_index_intersect(index_, (const bg_string * const *)tags, tag2 ? 2 : 1, &store_id, NULL);
+  bg_string_free(tags[0]);
+  if(tags[1]) { bg_string_free(tags[1]); }
+  return err;
+}
+
+pruf_setup(tag_index) {
+  index_ = bg_tag_index_new();
+  nb_found = 0;
+
+  add_tag("work", 0);
+  add_tag("prod", 0);
+  add_tag("work", 1);
+  add_tag("home", 2);
+  add_tag("prod", 3);
+  add_tag("work", 3);
+}
+
+pruf_teardown(tag_index) {
+  bg_tag_index_free(index_);
+}
+
+
+pruf_test_define(tag_index, counts_distinct_tags_and_their_postings) {
+  bg_string *work = bg_string_from_str("work");
+
+  pruf_expect_equal(3, bg_tag_index_count(index_));
+  pruf_expect_equal(3, bg_tag_index_postings(index_, work));
+
+  bg_string_free(work);
+}
+
+pruf_test_define(tag_index, single_tag_lists_its_postings_in_order) {
+  pruf_expect_zero(intersect("work", NULL));
+
+  pruf_expect_equal(3, nb_found);
+  pruf_expect_equal(0, found[0]);
+  pruf_expect_equal(1, found[1]);
+  pruf_expect_equal(3, found[2]);
+}
+
+pruf_test_define(tag_index, intersects_posting_lists) {
+  pruf_expect_zero(intersect("work", "prod"));
+
+  pruf_expect_equal(2, nb_found);
+  pruf_expect_equal(0, found[0]);
+  pruf_expect_equal(3, found[1]);
+}
+
+pruf_test_define(tag_index, unknown_tag_intersects_to_nothing) {
+  pruf_expect_zero(intersect("work", "nope"));
+
+  pruf_expect_equal(0, nb_found);
+}
+
+pruf_test_define(tag_index, repeated_id_is_ignored_and_smaller_one_refused) {
+  bg_string *work = bg_string_from_str("work");
+
+  pruf_expect_zero(bg_tag_index_add(index_, "work", 4, 3));
+  pruf_expect_equal(-2, bg_tag_index_add(index_, "work", 4, 2));
+  pruf_expect_equal(3, bg_tag_index_postings(index_, work));
+
+  bg_string_free(work);
+}
+
+pruf_test_define(tag_index, gallops_through_long_posting_lists) {
+  size_t i;
+  for(i = 4; i < 1000; ++i) {
+    add_tag("many", i);
+  }
+  add_tag("few", 10);
+  add_tag("few", 500);
+  add_tag("few", 999);
+  add_tag("few", 1200);
+
+  pruf_expect_zero(intersect("many", "few"));
+
+  pruf_expect_equal(3, nb_found);
+  pruf_expect_equal(10, found[0]);
+  pruf_expect_equal(500, found[1]);
+  pruf_expect_equal(999, found[2]);
+}
+
+pruf_test_define(tag_index, stops_when_callback_returns_non_zero) {
+  bg_string *work = bg_string_from_str("work");
+  const bg_string *tags[1] = { work };
+
+  pruf_expect_equal(1, bg_tag_index_intersect(index_, tags, 1, &stop_at_first, NULL));
+  pruf_expect_equal(1, nb_found);
+
+  bg_string_free(work);
+}
+
+pruf_test_define(tag_index, intersecting_no_tag_returns_minus_1) {
+  pruf_expect_equal(-1, bg_tag_index_intersect(index_, NULL, 0, &store_id, NULL));
+}